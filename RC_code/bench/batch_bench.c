@@ -0,0 +1,137 @@
+// Batch transfer benchmark (files per second).
+// Cria uma diretoria com muitos ficheiros pequenos e envia-a através do cabo
+// emulado de duas maneiras: um lote numa só sessão (tx com a diretoria) e uma
+// sessão por ficheiro (llopen, pacotes de controlo e llclose em cada um, como
+// correr o bin/main uma vez por ficheiro, mas sem o arranque do processo).
+// Verifica os ficheiros recebidos e mostra ficheiros/s e bytes/s de cada modo.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/batch_bench bench/batch_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/batch_bench [-n ficheiros] [-s tamanho_máximo] [-b baud] [-p atraso_us]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "application_layer.h"
+#include "pty_cable.h"
+
+static PtyCableConfig cableConfig = {.baudRate = 115200};
+
+// Uma sessão completa (tx de source, rx para target). Returns 0 if both sides succeeded.
+static int runSession(const char *txPort, const char *rxPort, const char *source, const char *target) {
+    int rxStatus, txStatus;
+    pid_t receiver = startRole(rxPort, "rx", target);
+    pid_t transmitter = startRole(txPort, "tx", source);
+    waitpid(transmitter, &txStatus, 0);
+    waitpid(receiver, &rxStatus, 0);
+    return WIFEXITED(txStatus) && WEXITSTATUS(txStatus) == 0 && WIFEXITED(rxStatus) && WEXITSTATUS(rxStatus) == 0
+         ? 0 : -1;
+}
+
+// Returns 1 if both files have the same contents.
+static int sameContents(const char *a, const char *b) {
+    FILE *x = fopen(a, "rb"), *y = fopen(b, "rb");
+    int same = x != NULL && y != NULL;
+    while (same) {
+        int cx = fgetc(x), cy = fgetc(y);
+        if (cx != cy) same = 0;
+        if (cx == EOF || cy == EOF) break;
+    }
+    if (x) fclose(x);
+    if (y) fclose(y);
+    return same;
+}
+
+static int countMatching(const char *source, const char *target, int files) {
+    int matching = 0;
+    for (int i = 0; i < files; i++) {
+        char a[128], b[128];
+        snprintf(a, sizeof(a), "%s/f%05d", source, i);
+        snprintf(b, sizeof(b), "%s/f%05d", target, i);
+        matching += sameContents(a, b);
+    }
+    return matching;
+}
+
+int main(int argc, char *argv[]) {
+    int files = 200;
+    int maxSize = 512;
+    int option;
+    while ((option = getopt(argc, argv, "n:s:b:p:")) != -1) {
+        switch (option) {
+            case 'n': files = atoi(optarg); break;
+            case 's': maxSize = atoi(optarg); break;
+            case 'b': cableConfig.baudRate = atoi(optarg); break;
+            case 'p': cableConfig.propDelay = atoi(optarg) / 1.0e6; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n files] [-s max_size] [-b baud] [-p prop_us]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    char dir[] = "/tmp/batch_benchXXXXXX";
+    if (mkdtemp(dir) == NULL) return 1;
+    char source[64], batchTarget[64], singleTarget[64];
+    snprintf(source, sizeof(source), "%s/src", dir);
+    snprintf(batchTarget, sizeof(batchTarget), "%s/batch", dir);
+    snprintf(singleTarget, sizeof(singleTarget), "%s/single", dir);
+    mkdir(source, 0755);
+    mkdir(singleTarget, 0755);
+    srand(1234);
+    long long totalBytes = 0;
+    for (int i = 0; i < files; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/f%05d", source, i);
+        FILE *file = fopen(path, "wb");
+        if (file == NULL) return 1;
+        int size = rand() % (maxSize + 1);
+        for (int b = 0; b < size; b++) fputc(rand() & 0xFF, file);
+        fclose(file);
+        totalBytes += size;
+    }
+
+    char txPort[64], rxPort[64];
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    double start = nowSeconds();
+    int batchOk = runSession(txPort, rxPort, source, batchTarget) == 0;
+    double batchSeconds = nowSeconds() - start;
+    int batchMatching = countMatching(source, batchTarget, files);
+
+    int sessionsOk = 0;
+    start = nowSeconds();
+    for (int i = 0; i < files; i++) {
+        char a[128], b[128];
+        snprintf(a, sizeof(a), "%s/f%05d", source, i);
+        snprintf(b, sizeof(b), "%s/f%05d", singleTarget, i);
+        sessionsOk += runSession(txPort, rxPort, a, b) == 0;
+    }
+    double singleSeconds = nowSeconds() - start;
+    int singleMatching = countMatching(source, singleTarget, files);
+
+    fprintf(stderr, "%d ficheiros de 0 a %d bytes (%lld bytes), %d baud, atraso %.1f ms\n", files, maxSize,
+            totalBytes, cableConfig.baudRate, cableConfig.propDelay * 1000.0);
+    fprintf(stderr, "%-22s %8.2f s %9.1f ficheiros/s %9.0f B/s  %d/%d iguais\n", "lote (1 sessão)",
+            batchSeconds, files / batchSeconds, totalBytes / batchSeconds, batchMatching, files);
+    fprintf(stderr, "%-22s %8.2f s %9.1f ficheiros/s %9.0f B/s  %d/%d iguais\n", "sessão por ficheiro",
+            singleSeconds, files / singleSeconds, totalBytes / singleSeconds, singleMatching, files);
+    fprintf(stderr, "Ganho: %.1fx\n", singleSeconds / batchSeconds);
+
+    int ok = batchOk && batchMatching == files && sessionsOk == files && singleMatching == files;
+    if (ok) {
+        char command[128];
+        snprintf(command, sizeof(command), "rm -rf %s", dir);
+        if (system(command) != 0) return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// Baud rate upshift benchmark.
+// Transfere um bloco de dados com llwrite/llread através do cabo emulado, que
+// segue as mudanças de taxa de cada lado, e mostra a taxa a que a ligação chegou
+// depois do llopen, o tempo do llopen e o débito útil. Com -c a linha só é limpa
+// até essa taxa: acima dela os bytes são corrompidos com a probabilidade de -e,
+// e a subida deve parar (ou recuar) aí.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/baud_bench bench/baud_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/baud_bench [-s bytes] [-b baud_inicial] [-m baud_máximo] [-p atraso_us] [-c baud_limpo] [-e erro_por_byte]
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "link_layer.h"
+#include "link_layer_ext.h"
+#include "pty_cable.h"
+
+static PtyCableConfig cableConfig = {.baudRate = 9600, .followBaud = 1, .noisyByteErrors = 0.01};
+
+// Byte i do bloco transferido
+static unsigned char patternByte(long i) {
+    return (unsigned char)(i * 7 % 251);
+}
+
+// Receptor: lê até ao DISC e confirma o conteúdo
+static int runReceiver(const char *port, long size) {
+    if (llopen(linkParameters(port, LlRx, cableConfig.baudRate, 3)) < 0) return 1;
+    unsigned char *packet = malloc(llMaxPayload());
+    if (packet == NULL) return 1;
+    long received = 0;
+    int errors = 0;
+    int length;
+    while ((length = llread(packet)) >= 0) {
+        for (int i = 0; i < length; i++) {
+            if (packet[i] != patternByte(received + i)) errors++;
+        }
+        received += length;
+    }
+    if (length != -2) return 1;     // Só o DISC acaba a sessão sem erro
+    llclose(FALSE);
+    return received == size && errors == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    long size = 200000;
+    int maxBaud = 921600;
+    int option;
+    while ((option = getopt(argc, argv, "s:b:m:p:c:e:")) != -1) {
+        switch (option) {
+            case 's': size = atol(optarg); break;
+            case 'b': cableConfig.baudRate = atoi(optarg); break;
+            case 'm': maxBaud = atoi(optarg); break;
+            case 'p': cableConfig.propDelay = atoi(optarg) / 1.0e6; break;
+            case 'c': cableConfig.cleanBaud = atoi(optarg); break;
+            case 'e': cableConfig.noisyByteErrors = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s bytes] [-b baud] [-m max_baud] [-p prop_us] [-c clean_baud] [-e byte_error]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Os dois lados aceitam subir até maxBaud
+    char value[16];
+    snprintf(value, sizeof(value), "%d", maxBaud);
+    setenv("RCOM_MAX_BAUD", value, 1);
+
+    char txPort[64], rxPort[64];
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    pid_t receiver = fork();
+    if (receiver == 0) {
+        _exit(runReceiver(rxPort, size));
+    }
+    usleep(100000);
+
+    double start = nowSeconds();
+    if (llopen(linkParameters(txPort, LlTx, cableConfig.baudRate, 3)) < 0) {
+        fprintf(stderr, "llopen falhou (%s)\n", llErrorString(llLastError()));
+        kill(receiver, SIGTERM);
+        return 1;
+    }
+    double opened = nowSeconds();
+    LlLinkHealth health;
+    llLinkHealth(&health);
+    int upshiftedBaud = health.baudRate;
+
+    int chunk = llMaxPayload();
+    unsigned char *packet = malloc(chunk);
+    if (packet == NULL) return 1;
+    int failed = 0;
+    for (long sent = 0; sent < size && !failed; sent += chunk) {
+        int length = size - sent < chunk ? (int)(size - sent) : chunk;
+        for (int i = 0; i < length; i++) packet[i] = patternByte(sent + i);
+        failed = llwrite(packet, length) < 0;
+    }
+    double written = nowSeconds();
+    llLinkHealth(&health);
+    if (llclose(FALSE) < 0) failed = 1;
+
+    int status = 0;
+    waitpid(receiver, &status, 0);
+    PtyCableStats stats;
+    ptyCableGetStats(&stats);
+
+    fprintf(stderr, "%ld bytes, taxa inicial %d, máxima %d, linha limpa até %d (erro por byte acima %.4f)\n",
+            size, cableConfig.baudRate, maxBaud, cableConfig.cleanBaud, cableConfig.noisyByteErrors);
+    fprintf(stderr, "llopen %.1f ms, taxa depois do llopen %d, no fim %d baud\n",
+            (opened - start) * 1000.0, upshiftedBaud, health.baudRate);
+    fprintf(stderr, "Transferência %.3f s, débito útil %.0f bytes/s (%.1f%% da taxa inicial)\n",
+            written - opened, size / (written - opened),
+            100.0 * size * 10.0 / (written - opened) / cableConfig.baudRate);
+    fprintf(stderr, "Cabo: %ld bytes, %ld corrompidos pelo ruído, %ld em taxas diferentes\n",
+            stats.bytes, stats.corrupted, stats.mismatched);
+    int ok = !failed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    fprintf(stderr, "%s\n", ok ? "Dados recebidos corretamente" : "FALHOU");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+// Clock for the benchmarks.
+// Só o relógio, para os benchmarks que não precisam do cabo emulado.
+
+#ifndef _BENCH_CLOCK_H_
+#define _BENCH_CLOCK_H_
+
+#include <time.h>
+
+// Relógio monotónico em segundos.
+static inline double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+#endif // _BENCH_CLOCK_H_
@@ -0,0 +1,113 @@
+// Chunk benchmark (MB/s dos cortes e do armazém).
+// Gera um ficheiro e uma versão nova com alterações espalhadas (bytes trocados,
+// inseridos e apagados), corta os dois com o chunker como o transmissor do
+// dedup e guarda os pedaços do primeiro num armazém temporário, como o
+// receptor. Mostra o débito dos cortes e do armazém e quanto da versão nova
+// já estava no armazém (o que iria em referências).
+// Não usa o cabo: mede só o cálculo e o disco.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/chunk_bench bench/chunk_bench.c src/*.c -pthread
+// Usar:
+//   ./bin/chunk_bench [-s MB] [-e alterações] [-d diretoria_temporária]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "chunk_store.h"
+#include "chunker.h"
+#include "bench_clock.h"
+
+int main(int argc, char *argv[]) {
+    long long megabytes = 64;
+    int edits = 100;
+    const char *dir = "/tmp";
+    int option;
+    while ((option = getopt(argc, argv, "s:e:d:")) != -1) {
+        switch (option) {
+            case 's': megabytes = atoll(optarg); break;
+            case 'e': edits = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MB] [-e edits] [-d tmpdir]\n", argv[0]);
+                return 1;
+        }
+    }
+    long long size = megabytes * 1024 * 1024;
+
+    // A versão nova: a original com uma alteração a cada size / edits bytes
+    unsigned char *old = malloc(size);
+    unsigned char *new = malloc(size + edits * 64LL);
+    if (old == NULL || new == NULL) return 1;
+    srand(1234);
+    for (long long i = 0; i < size; i++) old[i] = rand() & 0xFF;
+    long long newSize = 0;
+    long long step = edits > 0 ? size / edits : size;
+    for (long long pos = 0; pos < size; pos += step) {
+        long long piece = pos + step < size ? step : size - pos;
+        memcpy(new + newSize, old + pos, piece);
+        newSize += piece;
+        int kind = rand() % 3;
+        if (kind == 0) {
+            new[newSize - piece / 2] ^= 0xFF;                   // Byte trocado
+        } else if (kind == 1) {
+            for (int i = 0; i < 37; i++) new[newSize++] = rand() & 0xFF;    // Inseridos
+        } else if (piece > 64) {
+            newSize -= 29;                                      // Apagados
+        }
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/chunk_bench.%d", dir, getpid());
+    unlink(path);
+    ChunkStore store;
+    if (chunkStoreOpen(&store, path) < 0) {
+        fprintf(stderr, "Erro ao criar o armazém %s\n", path);
+        return 1;
+    }
+
+    // Receptor: cortes do ficheiro original e pedaços no armazém
+    double start = nowSeconds();
+    long chunks = 0;
+    for (long long pos = 0; pos < size; chunks++) {
+        int remaining = size - pos < CHUNKER_MAX_SIZE ? size - pos : CHUNKER_MAX_SIZE;
+        pos += chunkerCut(old + pos, remaining);
+    }
+    double cutSeconds = nowSeconds() - start;
+
+    start = nowSeconds();
+    for (long long pos = 0; pos < size;) {
+        int remaining = size - pos < CHUNKER_MAX_SIZE ? size - pos : CHUNKER_MAX_SIZE;
+        int length = chunkerCut(old + pos, remaining);
+        if (chunkStoreAdd(&store, chunkStoreHash(old + pos, length), old + pos, length) < 0) return 1;
+        pos += length;
+    }
+    double storeSeconds = nowSeconds() - start;
+
+    // Transmissor: cortes da versão nova e procura no armazém
+    start = nowSeconds();
+    long long found = 0;
+    long newChunks = 0;
+    for (long long pos = 0; pos < newSize; newChunks++) {
+        int remaining = newSize - pos < CHUNKER_MAX_SIZE ? newSize - pos : CHUNKER_MAX_SIZE;
+        int length = chunkerCut(new + pos, remaining);
+        if (chunkStoreHas(&store, chunkStoreHash(new + pos, length), length)) found += length;
+        pos += length;
+    }
+    double lookupSeconds = nowSeconds() - start;
+
+    fprintf(stderr, "%lld MB, %d alterações, %ld pedaços (%lld bytes em média)\n", megabytes, edits, chunks,
+            size / chunks);
+    fprintf(stderr, "Cortes:                   %8.1f MB/s\n", megabytes / cutSeconds);
+    fprintf(stderr, "Cortes, hash e armazém:   %8.1f MB/s\n", megabytes / storeSeconds);
+    fprintf(stderr, "Cortes, hash e procura:   %8.1f MB/s\n", newSize / (1024.0 * 1024.0) / lookupSeconds);
+    fprintf(stderr, "No armazém: %lld de %lld bytes (%.2f%%) em %ld pedaços da versão nova\n", found, newSize,
+            100.0 * found / newSize, newChunks);
+    chunkStoreClose(&store);
+    unlink(path);
+    free(old);
+    free(new);
+    return 0;
+}
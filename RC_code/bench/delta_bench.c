@@ -0,0 +1,110 @@
+// Delta benchmark (MB/s das duas passagens).
+// Gera uma cópia antiga e uma versão nova com alterações espalhadas (bytes
+// trocados, inseridos e apagados), calcula as assinaturas dos blocos da cópia
+// como o receptor e procura-as em todas as posições da versão nova, rolando a
+// soma fraca, como o transmissor. Mostra o débito de cada passagem e quanto
+// do ficheiro novo ficou em referências.
+// Não usa o cabo: mede só o cálculo.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/delta_bench bench/delta_bench.c src/*.c -pthread
+// Usar:
+//   ./bin/delta_bench [-s MB] [-e alterações] [-b tamanho_do_bloco]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "delta.h"
+#include "bench_clock.h"
+
+int main(int argc, char *argv[]) {
+    long long megabytes = 64;
+    int edits = 100;
+    int blockSize = 0;
+    int option;
+    while ((option = getopt(argc, argv, "s:e:b:")) != -1) {
+        switch (option) {
+            case 's': megabytes = atoll(optarg); break;
+            case 'e': edits = atoi(optarg); break;
+            case 'b': blockSize = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MB] [-e edits] [-b block]\n", argv[0]);
+                return 1;
+        }
+    }
+    long long size = megabytes * 1024 * 1024;
+    if (blockSize <= 0) blockSize = deltaBlockSizeFor(size);
+
+    // A versão nova: a cópia com uma alteração a cada size / edits bytes
+    unsigned char *old = malloc(size);
+    unsigned char *new = malloc(size + edits * 64LL);
+    if (old == NULL || new == NULL) return 1;
+    srand(1234);
+    for (long long i = 0; i < size; i++) old[i] = rand() & 0xFF;
+    long long newSize = 0;
+    long long step = edits > 0 ? size / edits : size;
+    for (long long pos = 0; pos < size; pos += step) {
+        long long piece = pos + step < size ? step : size - pos;
+        memcpy(new + newSize, old + pos, piece);
+        newSize += piece;
+        int kind = rand() % 3;
+        if (kind == 0) {
+            new[newSize - piece / 2] ^= 0xFF;                   // Byte trocado
+        } else if (kind == 1) {
+            for (int i = 0; i < 37; i++) new[newSize++] = rand() & 0xFF;    // Inseridos
+        } else if (piece > 64) {
+            newSize -= 29;                                      // Apagados
+        }
+    }
+
+    // Passagem do receptor: uma assinatura por bloco
+    double start = nowSeconds();
+    DeltaIndex index;
+    if (deltaIndexInit(&index, size, blockSize) < 0) return 1;
+    for (int block = 0; block < index.blocks; block++) {
+        DeltaSignature signature;
+        deltaSignature(old + (long long)block * blockSize, blockSize, &signature);
+        deltaIndexSet(&index, block, &signature);
+    }
+    if (deltaIndexBuild(&index) < 0) return 1;
+    double signSeconds = nowSeconds() - start;
+
+    // Passagem do transmissor: a janela rola byte a byte até encontrar um bloco
+    start = nowSeconds();
+    long long matched = 0;
+    long long pos = 0;
+    int rolling = 0, hint = -1;
+    unsigned int weak = 0;
+    while (pos + blockSize <= newSize) {
+        if (!rolling) {
+            weak = deltaWeak(new + pos, blockSize);
+            rolling = 1;
+        }
+        int block = deltaIndexFind(&index, weak, new + pos, hint);
+        if (block >= 0) {
+            matched += blockSize;
+            pos += blockSize;
+            hint = block + 1;
+            rolling = 0;
+            continue;
+        }
+        hint = -1;
+        if (pos + blockSize < newSize) weak = deltaRoll(weak, new[pos], new[pos + blockSize], blockSize);
+        else rolling = 0;
+        pos++;
+    }
+    double scanSeconds = nowSeconds() - start;
+
+    fprintf(stderr, "%lld MB, %d alterações, blocos de %d bytes (%d blocos)\n", megabytes, edits, blockSize,
+            index.blocks);
+    fprintf(stderr, "Assinaturas (receptor): %8.1f MB/s\n", megabytes / signSeconds);
+    fprintf(stderr, "Procura (transmissor):  %8.1f MB/s\n", newSize / (1024.0 * 1024.0) / scanSeconds);
+    fprintf(stderr, "Em referências: %lld de %lld bytes (%.2f%%), %lld falsos positivos da soma fraca\n", matched,
+            newSize, 100.0 * matched / newSize, index.stats.falseMatches);
+    deltaIndexFree(&index);
+    free(old);
+    free(new);
+    return 0;
+}
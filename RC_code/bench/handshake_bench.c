@@ -0,0 +1,111 @@
+// Connect+close latency benchmark.
+// Mede o tempo de llopen + llclose (sem dados) em muitas sessões seguidas,
+// através de um cabo emulado entre dois pseudo-terminais (taxa, atraso de
+// propagação e perda de blocos configuráveis).
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/handshake_bench bench/handshake_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/handshake_bench [-n sessões] [-b baud] [-p atraso_us] [-l perda] [-d atraso_rx_ms]
+//   -d: o receptor só chama llopen esse tempo depois de o transmissor começar
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "link_layer.h"
+#include "link_layer_ext.h"
+#include "pty_cable.h"
+
+#define MAX_SESSIONS 10000
+
+static PtyCableConfig cableConfig = {.baudRate = 115200};
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Receptor: aceita as sessões uma a uma
+static int runReceiver(const char *port, int sessions, int rxDelayMs) {
+    for (int i = 0; i < sessions; i++) {
+        if (rxDelayMs > 0) usleep(rxDelayMs * 1000);
+        if (llopen(linkParameters(port, LlRx, cableConfig.baudRate, 3)) < 0) return 1;
+        if (llclose(FALSE) < 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int sessions = 200;
+    int rxDelayMs = 0;
+    int option;
+    while ((option = getopt(argc, argv, "n:b:p:l:d:")) != -1) {
+        switch (option) {
+            case 'n': sessions = atoi(optarg); break;
+            case 'b': cableConfig.baudRate = atoi(optarg); break;
+            case 'p': cableConfig.propDelay = atoi(optarg) / 1.0e6; break;
+            case 'l': cableConfig.lossRate = atof(optarg); break;
+            case 'd': rxDelayMs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n sessions] [-b baud] [-p prop_us] [-l loss] [-d rx_delay_ms]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (sessions < 1 || sessions > MAX_SESSIONS) sessions = MAX_SESSIONS;
+
+    char txPort[64], rxPort[64];
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    pid_t receiver = fork();
+    if (receiver == 0) {
+        _exit(runReceiver(rxPort, sessions, rxDelayMs));
+    }
+
+    static double connectMs[MAX_SESSIONS], closeMs[MAX_SESSIONS], totalMs[MAX_SESSIONS];
+    int done = 0;
+    for (int i = 0; i < sessions; i++) {
+        double start = nowSeconds();
+        if (llopen(linkParameters(txPort, LlTx, cableConfig.baudRate, 3)) < 0) {
+            fprintf(stderr, "Sessão %d: llopen falhou (%s)\n", i, llErrorString(llLastError()));
+            break;
+        }
+        double opened = nowSeconds();
+        if (llclose(FALSE) < 0) {
+            fprintf(stderr, "Sessão %d: llclose falhou (%s)\n", i, llErrorString(llLastError()));
+            break;
+        }
+        double closed = nowSeconds();
+        // Com -d o receptor só começa depois: conta a latência a partir daí
+        connectMs[done] = (opened - start) * 1000.0 - rxDelayMs;
+        closeMs[done] = (closed - opened) * 1000.0;
+        totalMs[done] = connectMs[done] + closeMs[done];
+        done++;
+    }
+
+    int status = 0;
+    if (done < sessions) kill(receiver, SIGTERM);
+    waitpid(receiver, &status, 0);
+
+    fprintf(stderr, "%d/%d sessões, %d baud, atraso %.1f ms, perda %.3f, receptor atrasado %d ms\n",
+            done, sessions, cableConfig.baudRate, cableConfig.propDelay * 1000.0, cableConfig.lossRate, rxDelayMs);
+    if (done == 0) return 1;
+
+    const char *names[3] = {"llopen", "llclose", "total"};
+    double *series[3] = {connectMs, closeMs, totalMs};
+    for (int s = 0; s < 3; s++) {
+        double sum = 0;
+        for (int i = 0; i < done; i++) sum += series[s][i];
+        qsort(series[s], done, sizeof(double), compareDoubles);
+        fprintf(stderr, "%-8s média %8.2f ms  mediana %8.2f ms  p99 %8.2f ms  máx %8.2f ms\n", names[s],
+                sum / done, series[s][done / 2], series[s][(int)(done * 0.99)], series[s][done - 1]);
+    }
+    return done == sessions && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// Content hash benchmark (MB/s por tamanho de pacote).
+// Passa o mesmo buffer pelo hash do conteúdo em pedaços do tamanho dos pacotes
+// de dados, como as etapas de leitura e de escrita, e pelo FNV-1a byte a byte
+// do diário, para comparar o custo por MB com o débito da ligação.
+// Não usa o cabo: mede só o hash.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/hash_bench bench/hash_bench.c src/*.c -pthread
+// Usar:
+//   ./bin/hash_bench [-s MB] [-r repetições]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "content_hash.h"
+#include "bench_clock.h"
+
+// O mesmo FNV-1a de 64 bits do checkpoint_journal.c
+static unsigned long long fnv1a(const unsigned char *data, size_t size) {
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int main(int argc, char *argv[]) {
+    long long megabytes = 64;
+    int repeats = 3;
+    int option;
+    while ((option = getopt(argc, argv, "s:r:")) != -1) {
+        switch (option) {
+            case 's': megabytes = atoll(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MB] [-r repeats]\n", argv[0]);
+                return 1;
+        }
+    }
+    size_t size = megabytes * 1024 * 1024;
+    unsigned char *buffer = malloc(size);
+    if (buffer == NULL || repeats < 1) return 1;
+    srand(1234);
+    for (size_t i = 0; i < size; i++) buffer[i] = rand() & 0xFF;
+
+    // Todos os pedaços têm de dar o mesmo hash que o buffer inteiro
+    ContentHash whole;
+    contentHashInit(&whole);
+    contentHashUpdate(&whole, buffer, size);
+    unsigned long long expected = contentHashDigest(&whole);
+
+    fprintf(stderr, "%lld MB, melhor de %d\n", megabytes, repeats);
+    int chunks[] = {256, 1000, 4096, 65535};
+    int failed = 0;
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        double best = 0;
+        unsigned long long digest = 0;
+        for (int r = 0; r < repeats; r++) {
+            double start = nowSeconds();
+            ContentHash hash;
+            contentHashInit(&hash);
+            for (size_t pos = 0; pos < size; pos += chunks[c]) {
+                contentHashUpdate(&hash, buffer + pos, size - pos < (size_t)chunks[c] ? size - pos : chunks[c]);
+            }
+            digest = contentHashDigest(&hash);
+            double seconds = nowSeconds() - start;
+            if (best == 0 || seconds < best) best = seconds;
+        }
+        failed |= digest != expected;
+        fprintf(stderr, "hash  pacotes de %5d bytes: %8.1f MB/s  %016llx%s\n", chunks[c], megabytes / best, digest,
+                digest == expected ? "" : "  DIFERENTE");
+    }
+
+    double best = 0;
+    unsigned long long fnv = 0;
+    for (int r = 0; r < repeats; r++) {
+        double start = nowSeconds();
+        fnv = fnv1a(buffer, size);
+        double seconds = nowSeconds() - start;
+        if (best == 0 || seconds < best) best = seconds;
+    }
+    fprintf(stderr, "FNV-1a (diário)               : %8.1f MB/s  %016llx\n", megabytes / best, fnv);
+    free(buffer);
+    return failed ? 1 : 0;
+}
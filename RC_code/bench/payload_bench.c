@@ -0,0 +1,145 @@
+// Payload size sweep benchmark.
+// Para cada tamanho de pacote negociado (RCOM_MAX_PAYLOAD nos dois lados)
+// transfere o mesmo bloco com llwrite/llread através do cabo emulado e mostra o
+// débito útil e a eficiência em relação à taxa da linha. Com -e todos os bytes
+// podem ser corrompidos: mostra a partir de que tamanho as retransmissões das
+// tramas grandes custam mais do que o cabeçalho das pequenas. O openSerialPort
+// só aceita até 115200: acima disso a ligação abre a 115200 e sobe a taxa
+// (RCOM_MAX_BAUD) antes dos dados.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/payload_bench bench/payload_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/payload_bench [-s bytes] [-b baud] [-p atraso_us] [-e erro_por_byte] [tamanho...]
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "link_layer.h"
+#include "link_layer_ext.h"
+#include "pty_cable.h"
+
+#define MAX_SIZES 32
+
+#define OPEN_BAUD_MAX 115200
+
+static PtyCableConfig cableConfig = {.baudRate = OPEN_BAUD_MAX, .followBaud = 1};
+static int lineBaud = 921600;
+static const int defaultSizes[] = {64, 256, 1000, 4096, 16384, 65536};
+
+// Byte i do bloco transferido
+static unsigned char patternByte(long i) {
+    return (unsigned char)(i * 7 % 251);
+}
+
+// Receptor: lê até ao DISC e confirma o conteúdo
+static int runReceiver(const char *port, long size) {
+    if (llopen(linkParameters(port, LlRx, OPEN_BAUD_MAX, 5)) < 0) return 1;
+    unsigned char *packet = malloc(llMaxPayload());
+    if (packet == NULL) return 1;
+    long received = 0;
+    int errors = 0;
+    int length;
+    while ((length = llread(packet)) >= 0) {
+        for (int i = 0; i < length; i++) {
+            if (packet[i] != patternByte(received + i)) errors++;
+        }
+        received += length;
+    }
+    if (length != -2) return 1;     // Só o DISC acaba a sessão sem erro
+    llclose(FALSE);
+    return received == size && errors == 0 ? 0 : 1;
+}
+
+// Uma sessão com pacotes de payload bytes. Returns the goodput in bytes/s, or -1.
+static double runSession(const char *txPort, const char *rxPort, long size, int payload) {
+    char value[16];
+    snprintf(value, sizeof(value), "%d", payload);
+    setenv("RCOM_MAX_PAYLOAD", value, 1);
+
+    pid_t receiver = fork();
+    if (receiver == 0) {
+        _exit(runReceiver(rxPort, size));
+    }
+
+    if (llopen(linkParameters(txPort, LlTx, OPEN_BAUD_MAX, 5)) < 0) {
+        kill(receiver, SIGTERM);
+        waitpid(receiver, NULL, 0);
+        return -1;
+    }
+    LlLinkHealth health;
+    llLinkHealth(&health);
+    int chunk = llMaxPayload();
+    unsigned char *packet = malloc(chunk);
+    int failed = packet == NULL || health.baudRate != lineBaud;
+    double start = nowSeconds();
+    for (long sent = 0; sent < size && !failed; sent += chunk) {
+        int length = size - sent < chunk ? (int)(size - sent) : chunk;
+        for (int i = 0; i < length; i++) packet[i] = patternByte(sent + i);
+        failed = llwrite(packet, length) < 0;
+    }
+    double elapsed = nowSeconds() - start;
+    free(packet);
+    if (llclose(FALSE) < 0) failed = 1;
+
+    int status = 0;
+    if (failed) kill(receiver, SIGTERM);
+    waitpid(receiver, &status, 0);
+    if (failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return size / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    long size = 1000000;
+    int option;
+    while ((option = getopt(argc, argv, "s:b:p:e:")) != -1) {
+        switch (option) {
+            case 's': size = atol(optarg); break;
+            case 'b': lineBaud = atoi(optarg); break;
+            case 'p': cableConfig.propDelay = atoi(optarg) / 1.0e6; break;
+            case 'e':
+                cableConfig.noisyByteErrors = atof(optarg);
+                cableConfig.cleanBaud = 1;      // Ruído a qualquer taxa
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s bytes] [-b baud] [-p prop_us] [-e byte_error] [payload...]\n", argv[0]);
+                return 1;
+        }
+    }
+    int sizes[MAX_SIZES];
+    int count = 0;
+    for (int i = optind; i < argc && count < MAX_SIZES; i++) sizes[count++] = atoi(argv[i]);
+    if (count == 0) {
+        for (size_t i = 0; i < sizeof(defaultSizes) / sizeof(defaultSizes[0]); i++) sizes[count++] = defaultSizes[i];
+    }
+
+    char value[16];
+    snprintf(value, sizeof(value), "%d", lineBaud);
+    setenv("RCOM_MAX_BAUD", value, 1);
+
+    char txPort[50], rxPort[50];     // Tamanho de LinkLayer.serialPort
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    fprintf(stderr, "%ld bytes por sessão, %d baud, atraso %.1f ms, erro por byte %.5f\n",
+            size, lineBaud, cableConfig.propDelay * 1000.0, cableConfig.noisyByteErrors);
+    fprintf(stderr, "%8s %12s %10s\n", "pacote", "bytes/s", "eficiência");
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        double goodput = runSession(txPort, rxPort, size, sizes[i]);
+        if (goodput < 0) {
+            fprintf(stderr, "%8d %12s\n", sizes[i], "falhou");
+            failures++;
+            continue;
+        }
+        fprintf(stderr, "%8d %12.0f %9.1f%%\n", sizes[i], goodput, 100.0 * goodput * 10.0 / lineBaud);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+// Emulated cable for the benchmarks (ver pty_cable.h).
+
+#define _GNU_SOURCE
+#include "pty_cable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "application_layer.h"
+
+#define CABLE_QUEUE 4096
+#define CABLE_CHUNK 64
+
+// Bloco de bytes a caminho do outro lado do cabo
+typedef struct {
+    double deliverAt;
+    int length;
+    unsigned char data[CABLE_CHUNK];
+} CableChunk;
+
+typedef struct {
+    int from, to;               // Masters dos dois pseudo-terminais
+    CableChunk queue[CABLE_QUEUE];
+    int head, tail;
+    double busyUntil;           // Fim da transmissão do último bloco (s)
+} CableDirection;
+
+static PtyCableConfig cable;
+static CableDirection directions[2];
+static PtyCableStats counters;
+
+static const speed_t speedFlags[] = {B1200, B1800, B2400, B4800, B9600, B19200, B38400, B57600, B115200,
+                                     B230400, B460800, B921600, B1000000, B1500000, B2000000, B3000000, B4000000};
+static const int speedRates[] = {1200, 1800, 2400, 4800, 9600, 19200, 38400, 57600, 115200,
+                                 230400, 460800, 921600, 1000000, 1500000, 2000000, 3000000, 4000000};
+
+// Taxa que o slave do pseudo-terminal master tem configurada (o master vê o termios do slave)
+static int portBaudRate(int master) {
+    struct termios tio;
+    if (!cable.followBaud || tcgetattr(master, &tio) < 0) return cable.baudRate;
+    speed_t speed = cfgetospeed(&tio);
+    for (size_t i = 0; i < sizeof(speedRates) / sizeof(speedRates[0]); i++) {
+        if (speedFlags[i] == speed) return speedRates[i];
+    }
+    return cable.baudRate;
+}
+
+// Cria um pseudo-terminal e devolve o master; o nome do slave fica em name
+static int openCableEnd(char *name, size_t size) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return -1;
+    snprintf(name, size, "%s", ptsname(master));
+    return master;
+}
+
+// Copia os bytes entre os dois masters com o atraso, a taxa e os erros do cabo
+static void *cableThread(void *arg) {
+    unsigned int seed = 12345;
+    for (;;) {
+        double now = nowSeconds();
+        int waitMs = 50;
+        struct pollfd pfds[2];
+        for (int d = 0; d < 2; d++) {
+            CableDirection *dir = &directions[d];
+            while (dir->head != dir->tail && dir->queue[dir->head].deliverAt <= now) {
+                CableChunk *chunk = &dir->queue[dir->head];
+                if (write(dir->to, chunk->data, chunk->length) < 0 && errno != EAGAIN) break;
+                dir->head = (dir->head + 1) % CABLE_QUEUE;
+            }
+            if (dir->head != dir->tail) {
+                int ms = (int)((dir->queue[dir->head].deliverAt - now) * 1000.0) + 1;
+                if (ms < waitMs) waitMs = ms;
+            }
+            pfds[d].fd = dir->from;
+            pfds[d].events = POLLIN;
+        }
+        if (poll(pfds, 2, waitMs) <= 0) continue;
+
+        now = nowSeconds();
+        for (int d = 0; d < 2; d++) {
+            if (!(pfds[d].revents & POLLIN)) continue;
+            CableDirection *dir = &directions[d];
+            unsigned char buffer[CABLE_CHUNK];
+            int length = read(dir->from, buffer, sizeof(buffer));
+            if (length <= 0) continue;
+            if (cable.lossRate > 0 && (double)rand_r(&seed) / RAND_MAX < cable.lossRate) continue;
+            if ((dir->tail + 1) % CABLE_QUEUE == dir->head) continue;   // Cabo cheio: perde-se
+
+            // Taxas diferentes nas duas pontas: o receptor só vê lixo
+            int baudRate = portBaudRate(dir->from);
+            int mismatch = baudRate != portBaudRate(dir->to);
+            int noisy = cable.cleanBaud > 0 && baudRate > cable.cleanBaud;
+            for (int i = 0; i < length; i++) {
+                if (mismatch) {
+                    buffer[i] ^= 0x55 ^ (rand_r(&seed) & 0xAA);
+                    counters.mismatched++;
+                } else if (noisy && (double)rand_r(&seed) / RAND_MAX < cable.noisyByteErrors) {
+                    buffer[i] ^= 1 << (rand_r(&seed) % 8);
+                    counters.corrupted++;
+                }
+            }
+            counters.bytes += length;
+
+            double start = dir->busyUntil > now ? dir->busyUntil : now;
+            dir->busyUntil = start + length * 10.0 / baudRate;
+            CableChunk *chunk = &dir->queue[dir->tail];
+            chunk->deliverAt = dir->busyUntil + cable.propDelay;
+            chunk->length = length;
+            memcpy(chunk->data, buffer, length);
+            dir->tail = (dir->tail + 1) % CABLE_QUEUE;
+        }
+    }
+    return NULL;
+}
+
+int ptyCableStart(const PtyCableConfig *config, char *txPort, char *rxPort, size_t size) {
+    cable = *config;
+    directions[0].from = directions[1].to = openCableEnd(txPort, size);
+    directions[1].from = directions[0].to = openCableEnd(rxPort, size);
+    if (directions[0].from < 0 || directions[1].from < 0) {
+        perror("posix_openpt");
+        return -1;
+    }
+    // Mantém os slaves abertos para o master não receber EIO entre sessões. Ficam
+    // em modo raw à taxa do cabo: é isso que o closeSerialPort repõe, e com o eco
+    // por omissão as duas pontas fechadas devolviam os bytes uma à outra.
+    const char *ports[2] = {txPort, rxPort};
+    for (int i = 0; i < 2; i++) {
+        int slave = open(ports[i], O_RDWR | O_NOCTTY);
+        struct termios tio;
+        if (slave < 0 || tcgetattr(slave, &tio) < 0) {
+            perror("open");
+            return -1;
+        }
+        cfmakeraw(&tio);
+        for (size_t r = 0; r < sizeof(speedRates) / sizeof(speedRates[0]); r++) {
+            if (speedRates[r] == cable.baudRate) cfsetspeed(&tio, speedFlags[r]);
+        }
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, cableThread, NULL) != 0) return -1;
+    pthread_detach(thread);
+    return 0;
+}
+
+void ptyCableGetStats(PtyCableStats *stats) {
+    *stats = counters;
+}
+
+LinkLayer linkParameters(const char *port, LinkLayerRole role, int baudRate, int nRetransmissions) {
+    LinkLayer parameters = {.role = role, .baudRate = baudRate, .nRetransmissions = nRetransmissions, .timeout = 4};
+    snprintf(parameters.serialPort, sizeof(parameters.serialPort), "%s", port);
+    return parameters;
+}
+
+pid_t startRole(const char *port, const char *mode, const char *filename) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        applicationLayer(port, mode, PTY_CABLE_OPEN_BAUD, 3, 4, filename);
+        _exit(0);
+    }
+    return pid;
+}
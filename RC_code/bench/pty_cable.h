@@ -0,0 +1,51 @@
+// Emulated cable for the benchmarks.
+// Dois pseudo-terminais ligados por uma thread que copia os bytes com a taxa,
+// o atraso de propagação e os erros configurados. Com followBaud cada sentido usa
+// a taxa que o lado que envia pôs na sua porta (termios), e se os dois lados
+// estiverem em taxas diferentes os bytes chegam corrompidos, como numa UART.
+
+#ifndef _PTY_CABLE_H_
+#define _PTY_CABLE_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "bench_clock.h"
+#include "link_layer.h"
+
+// O openSerialPort só aceita até 115200: a taxa real é a do cabo
+#define PTY_CABLE_OPEN_BAUD 115200
+
+typedef struct
+{
+    int baudRate;           // Taxa do cabo (sem followBaud)
+    int followBaud;         // Segue as mudanças de taxa de cada lado
+    double propDelay;       // Atraso de propagação (s)
+    double lossRate;        // Probabilidade de perder um bloco de bytes
+    int cleanBaud;          // Acima desta taxa (0 = sem limite) a linha tem ruído...
+    double noisyByteErrors; // ...e cada byte é corrompido com esta probabilidade
+} PtyCableConfig;
+
+typedef struct
+{
+    long bytes;             // Bytes entregues
+    long corrupted;         // Bytes corrompidos pelo ruído
+    long mismatched;        // Bytes enviados numa taxa diferente da do outro lado
+} PtyCableStats;
+
+// Cria os dois pseudo-terminais, mantém os slaves abertos (o master não recebe
+// EIO entre sessões) e arranca a thread do cabo. Os nomes das portas ficam em
+// txPort e rxPort (size bytes cada).
+// Returns 0 on success, -1 on error.
+int ptyCableStart(const PtyCableConfig *config, char *txPort, char *rxPort, size_t size);
+
+// Contadores do cabo desde o arranque.
+void ptyCableGetStats(PtyCableStats *stats);
+
+// Parâmetros do llopen para uma das portas do cabo (timeout 4 s).
+LinkLayer linkParameters(const char *port, LinkLayerRole role, int baudRate, int nRetransmissions);
+
+// Corre applicationLayer(port, mode, ...) num processo filho, a PTY_CABLE_OPEN_BAUD
+// com 3 tentativas e timeout de 4 s. Returns the child's pid.
+pid_t startRole(const char *port, const char *mode, const char *filename);
+
+#endif // _PTY_CABLE_H_
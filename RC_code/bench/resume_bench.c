@@ -0,0 +1,128 @@
+// Crash/resume test for interrupted transfers.
+// Transfere um ficheiro aleatório com a camada de aplicação através do cabo
+// emulado e mata o receptor com SIGKILL a meio (sem hipótese de gravar nada no
+// fim). Lê o diário que ficou no disco, volta a transferir o mesmo ficheiro e
+// verifica que o resultado é igual ao original e que só foi enviado o que faltava.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/resume_bench bench/resume_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/resume_bench [-s bytes] [-b baud] [-k matar_ms] [-r repetições]
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "application_layer.h"
+#include "checkpoint_journal.h"
+#include "pty_cable.h"
+
+static PtyCableConfig cableConfig = {.baudRate = 921600};
+
+static int exitedOk(int status) {
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Returns 1 if both files have the same contents.
+static int sameContents(const char *a, const char *b) {
+    FILE *x = fopen(a, "rb"), *y = fopen(b, "rb");
+    int same = x != NULL && y != NULL;
+    while (same) {
+        int cx = fgetc(x), cy = fgetc(y);
+        if (cx != cy) same = 0;
+        if (cx == EOF || cy == EOF) break;
+    }
+    if (x) fclose(x);
+    if (y) fclose(y);
+    return same;
+}
+
+int main(int argc, char *argv[]) {
+    long size = 512 * 1024;
+    int killMs = 2000;
+    int rounds = 1;
+    int option;
+    while ((option = getopt(argc, argv, "s:b:k:r:")) != -1) {
+        switch (option) {
+            case 's': size = atol(optarg); break;
+            case 'b': cableConfig.baudRate = atoi(optarg); break;
+            case 'k': killMs = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s bytes] [-b baud] [-k kill_ms] [-r rounds]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    char dir[] = "/tmp/resume_benchXXXXXX";
+    if (mkdtemp(dir) == NULL) return 1;
+    char input[64], output[64], journalPath[80];
+    snprintf(input, sizeof(input), "%s/in.bin", dir);
+    snprintf(output, sizeof(output), "%s/out.bin", dir);
+    snprintf(journalPath, sizeof(journalPath), "%s%s", output, JOURNAL_SUFFIX);
+    FILE *file = fopen(input, "wb");
+    if (file == NULL) return 1;
+    srand(1234);
+    for (long i = 0; i < size; i++) fputc(rand() & 0xFF, file);
+    fclose(file);
+
+    char txPort[64], rxPort[64];
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    // Transferências interrompidas: o receptor morre sem aviso, o transmissor
+    // é parado logo a seguir (senão esperava pelos timeouts)
+    int failures = 0;
+    for (int round = 0; round < rounds; round++) {
+        pid_t receiver = startRole(rxPort, "rx", output);
+        usleep(100000);
+        pid_t transmitter = startRole(txPort, "tx", input);
+        usleep(killMs * 1000);
+        kill(receiver, SIGKILL);
+        kill(transmitter, SIGKILL);
+        waitpid(receiver, NULL, 0);
+        waitpid(transmitter, NULL, 0);
+
+        CheckpointJournal journal;
+        if (journalLoad(journalPath, &journal) < 0) {
+            fprintf(stderr, "Ronda %d: sem diário depois do SIGKILL\n", round + 1);
+            failures++;
+            continue;
+        }
+        fprintf(stderr, "Ronda %d: morto ao fim de %d ms, diário com %d intervalos, retoma em %lld/%ld bytes\n",
+                round + 1, killMs, journal.rangeCount, journalResumeOffset(&journal), size);
+    }
+
+    // Retoma até ao fim
+    CheckpointJournal journal;
+    long long resumeOffset = journalLoad(journalPath, &journal) == 0 ? journalResumeOffset(&journal) : 0;
+    double start = nowSeconds();
+    pid_t receiver = startRole(rxPort, "rx", output);
+    usleep(100000);
+    pid_t transmitter = startRole(txPort, "tx", input);
+    int rxStatus = 0, txStatus = 0;
+    waitpid(transmitter, &txStatus, 0);
+    waitpid(receiver, &rxStatus, 0);
+    double elapsed = nowSeconds() - start - 0.1;
+
+    int same = sameContents(input, output);
+    int journalLeft = access(journalPath, F_OK) == 0;
+    fprintf(stderr, "Retoma: %lld bytes já no disco, %lld enviados em %.2f s (%d baud)\n",
+            resumeOffset, size - resumeOffset, elapsed, cableConfig.baudRate);
+    fprintf(stderr, "Resultado: tx %s, rx %s, ficheiro %s, diário %s\n", exitedOk(txStatus) ? "ok" : "falhou",
+            exitedOk(rxStatus) ? "ok" : "falhou", same ? "igual" : "DIFERENTE", journalLeft ? "ficou" : "apagado");
+
+    if (same) {
+        unlink(input);
+        unlink(output);
+        rmdir(dir);
+    }
+    return failures == 0 && same && !journalLeft && exitedOk(txStatus) && exitedOk(rxStatus) ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// File source benchmark (CPU per MB, page faults and page cache).
+// Lê um ficheiro grande com o FileSource do transmissor das duas maneiras,
+// fread para um buffer e fatias do mmap, e passa por todos os bytes (como o
+// stuffing). Cada modo corre a frio (páginas largadas da cache com
+// POSIX_FADV_DONTNEED) e a quente. Mostra o tempo de CPU por MB, o débito, as
+// faltas de página e quanto do ficheiro ficou na page cache (mincore).
+// Não usa o cabo: mede só a origem dos dados.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/source_bench bench/source_bench.c src/*.c -pthread
+// Usar:
+//   ./bin/source_bench [-s MB] [-c tamanho_do_pacote] [-f ficheiro]
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "file_source.h"
+#include "bench_clock.h"
+
+// Percentagem das páginas do ficheiro que estão na page cache
+static double residentPercent(const char *path, long long size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    long page = sysconf(_SC_PAGESIZE);
+    long pages = (size + page - 1) / page;
+    unsigned char *vector = malloc(pages);
+    long resident = 0;
+    if (vector != NULL && mincore(map, size, vector) == 0) {
+        for (long i = 0; i < pages; i++) resident += vector[i] & 1;
+    }
+    free(vector);
+    munmap(map, size);
+    return 100.0 * resident / pages;
+}
+
+static void dropCache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// Lê o ficheiro todo em pacotes de chunk bytes. Returns 0 on success, -1 on error.
+static int runMode(const char *path, long long size, int mmapMode, int cold, int chunk) {
+    setenv("RCOM_MMAP", mmapMode ? "1" : "0", 1);
+    if (cold) dropCache(path);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+
+    unsigned char *buffer = malloc(chunk);
+    FileSource source;
+    if (buffer == NULL || fileSourceOpen(&source, file) < 0) {
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+    double start = nowSeconds();
+    unsigned long long sum = 0;
+    for (;;) {
+        const unsigned char *data = buffer;
+        int bytes = fileSourceMapped(&source) ? fileSourceSlice(&source, chunk, &data)
+                                              : fileSourceRead(&source, buffer, chunk);
+        if (bytes <= 0) break;
+        for (int i = 0; i < bytes; i++) sum += data[i];
+    }
+    double elapsed = nowSeconds() - start;
+    FileSourceStats stats;
+    fileSourceGetStats(&source, &stats);
+    fileSourceClose(&source);
+    fclose(file);
+    free(buffer);
+
+    double megabytes = stats.bytes / (1024.0 * 1024.0);
+    fprintf(stderr, "%-6s %-6s %8.2f ms CPU/MB %9.1f MB/s  faltas %8ld menores %6ld maiores  cache %5.1f%%  (soma %llx)\n",
+            stats.mapped ? "mmap" : "fread", cold ? "frio" : "quente", stats.cpuMs / megabytes, megabytes / elapsed,
+            stats.minorFaults, stats.majorFaults, residentPercent(path, size), sum);
+    return stats.bytes == size ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    long long megabytes = 256;
+    int chunk = 1000;
+    const char *path = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "s:c:f:")) != -1) {
+        switch (option) {
+            case 's': megabytes = atoll(optarg); break;
+            case 'c': chunk = atoi(optarg); break;
+            case 'f': path = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s MB] [-c chunk] [-f file]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Sem -f cria um ficheiro temporário com o tamanho pedido
+    char temp[] = "/tmp/source_benchXXXXXX";
+    if (path == NULL) {
+        int fd = mkstemp(temp);
+        if (fd < 0) return 1;
+        unsigned char block[65536];
+        srand(1234);
+        for (long long written = 0; written < megabytes * 1024 * 1024; written += sizeof(block)) {
+            for (size_t i = 0; i < sizeof(block); i++) block[i] = rand() & 0xFF;
+            if (write(fd, block, sizeof(block)) != sizeof(block)) return 1;
+        }
+        close(fd);
+        path = temp;
+    }
+    FILE *file = fopen(path, "rb");
+    if (file == NULL || fseeko(file, 0, SEEK_END) < 0) return 1;
+    long long size = ftello(file);
+    fclose(file);
+
+    fprintf(stderr, "%s: %lld bytes, pacotes de %d bytes\n", path, size, chunk);
+    int failed = 0;
+    for (int cold = 1; cold >= 0; cold--) {
+        failed |= runMode(path, size, 0, cold, chunk);
+        failed |= runMode(path, size, 1, cold, chunk);
+    }
+    if (path == temp) unlink(temp);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// Auto-tuner benchmark (goodput per session).
+// Envia o mesmo ficheiro várias vezes através do cabo emulado, primeiro com o
+// auto-tuner (RCOM_AUTOTUNE=1, perfil numa diretoria temporária, por isso cada
+// sessão começa onde a anterior ficou) e depois com os valores fixos do llopen.
+// Mostra o débito útil de cada sessão e o perfil que ficou no fim.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -Ibench -o bin/tuner_bench bench/tuner_bench.c bench/pty_cable.c src/*.c -pthread
+// Usar:
+//   ./bin/tuner_bench [-s bytes] [-n sessões] [-b baud] [-p atraso_us] [-e erros_por_byte] [-l perdas]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "application_layer.h"
+#include "pty_cable.h"
+
+#define MAX_SESSIONS 32
+
+static PtyCableConfig cableConfig = {.baudRate = 115200};
+
+// Returns 1 if both files have the same contents.
+static int sameContents(const char *a, const char *b) {
+    FILE *x = fopen(a, "rb"), *y = fopen(b, "rb");
+    int same = x != NULL && y != NULL;
+    while (same) {
+        int cx = fgetc(x), cy = fgetc(y);
+        if (cx != cy) same = 0;
+        if (cx == EOF || cy == EOF) break;
+    }
+    if (x) fclose(x);
+    if (y) fclose(y);
+    return same;
+}
+
+// Uma sessão completa. Returns the elapsed seconds, or -1 if the file did not arrive intact.
+static double runSession(const char *txPort, const char *rxPort, const char *input, const char *output) {
+    unlink(output);
+    double start = nowSeconds();
+    pid_t receiver = startRole(rxPort, "rx", output);
+    pid_t transmitter = startRole(txPort, "tx", input);
+    int rxStatus, txStatus;
+    waitpid(transmitter, &txStatus, 0);
+    waitpid(receiver, &rxStatus, 0);
+    double elapsed = nowSeconds() - start;
+    int ok = WIFEXITED(txStatus) && WEXITSTATUS(txStatus) == 0 && WIFEXITED(rxStatus) &&
+             WEXITSTATUS(rxStatus) == 0 && sameContents(input, output);
+    return ok ? elapsed : -1;
+}
+
+static double runSeries(const char *label, int sessions, long size, const char *txPort, const char *rxPort,
+                        const char *input, const char *output) {
+    double total = 0;
+    int failed = 0;
+    for (int i = 0; i < sessions; i++) {
+        double seconds = runSession(txPort, rxPort, input, output);
+        if (seconds < 0) {
+            fprintf(stderr, "%-10s sessão %2d: FALHOU\n", label, i + 1);
+            failed++;
+            continue;
+        }
+        total += seconds;
+        fprintf(stderr, "%-10s sessão %2d: %7.2f s %9.0f B/s\n", label, i + 1, seconds, size / seconds);
+    }
+    return failed ? -1 : total;
+}
+
+int main(int argc, char *argv[]) {
+    long size = 256 * 1024;
+    int sessions = 6;
+    int option;
+    while ((option = getopt(argc, argv, "s:n:b:p:e:l:")) != -1) {
+        switch (option) {
+            case 's': size = atol(optarg); break;
+            case 'n': sessions = atoi(optarg); break;
+            case 'b': cableConfig.baudRate = atoi(optarg); break;
+            case 'p': cableConfig.propDelay = atoi(optarg) / 1.0e6; break;
+            case 'e': cableConfig.cleanBaud = 1; cableConfig.noisyByteErrors = atof(optarg); break;
+            case 'l': cableConfig.lossRate = atof(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-s bytes] [-n sessions] [-b baud] [-p prop_us] [-e byte_errors] "
+                        "[-l loss]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (sessions < 1 || sessions > MAX_SESSIONS) sessions = sessions < 1 ? 1 : MAX_SESSIONS;
+
+    char dir[] = "/tmp/tuner_benchXXXXXX";
+    if (mkdtemp(dir) == NULL) return 1;
+    char input[64], output[64];
+    snprintf(input, sizeof(input), "%s/in.bin", dir);
+    snprintf(output, sizeof(output), "%s/out.bin", dir);
+    FILE *file = fopen(input, "wb");
+    if (file == NULL) return 1;
+    srand(1234);
+    for (long i = 0; i < size; i++) fputc(rand() & 0xFF, file);
+    fclose(file);
+
+    char txPort[64], rxPort[64];
+    if (ptyCableStart(&cableConfig, txPort, rxPort, sizeof(txPort)) < 0) return 1;
+
+    // A camada de ligação escreve mensagens de depuração no stdout: os
+    // resultados vão para o stderr
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+    fprintf(stderr, "%ld bytes, %d baud, atraso %.1f ms, erros %.2g/byte, perdas %.2g\n", size,
+            cableConfig.baudRate, cableConfig.propDelay * 1000.0, cableConfig.noisyByteErrors,
+            cableConfig.lossRate);
+
+    // Os filhos herdam o ambiente: só a primeira série tem o auto-tuner
+    setenv("RCOM_AUTOTUNE", "1", 1);
+    setenv("RCOM_PROFILE_DIR", dir, 1);
+    double tuned = runSeries("auto-tuner", sessions, size, txPort, rxPort, input, output);
+    unsetenv("RCOM_AUTOTUNE");
+    double fixed = runSeries("fixo", sessions, size, txPort, rxPort, input, output);
+
+    if (tuned > 0 && fixed > 0) {
+        fprintf(stderr, "Média: auto-tuner %.0f B/s, fixo %.0f B/s (%.2fx)\n", sessions * size / tuned,
+                sessions * size / fixed, fixed / tuned);
+    }
+
+    // O perfil tem o nome da porta do transmissor
+    char command[256];
+    snprintf(command, sizeof(command), "cat %s/*.profile >&2", dir);
+    fprintf(stderr, "Perfil:\n");
+    if (system(command) != 0) fprintf(stderr, "(sem perfil)\n");
+
+    int ok = tuned > 0 && fixed > 0;
+    if (ok) {
+        snprintf(command, sizeof(command), "rm -rf %s", dir);
+        if (system(command) != 0) return 1;
+    }
+    return ok ? 0 : 1;
+}
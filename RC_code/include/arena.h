@@ -0,0 +1,47 @@
+// Arena header.
+// Alocador por sessão (bump allocator): pede ao malloc blocos grandes de vez
+// em quando e reparte-os por ordem, sem libertar nada até ao fim. Para muitas
+// alocações pequenas que vivem todas o mesmo tempo (p.ex. os nomes de um lote).
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16              // Alinhamento de cada alocação
+#define ARENA_BLOCK_SIZE 65536      // Tamanho de um bloco por omissão
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Contadores da arena
+typedef struct
+{
+    long mallocs;           // Blocos pedidos ao malloc
+    long allocations;       // Chamadas a arenaAlloc
+    long long bytes;        // Bytes entregues (com o alinhamento)
+} ArenaStats;
+
+typedef struct
+{
+    ArenaBlock *blocks;     // Bloco atual (os anteriores ligados a ele)
+    size_t blockSize;
+    ArenaStats stats;
+} Arena;
+
+// Prepara uma arena vazia; o primeiro bloco só é pedido na primeira alocação.
+// blockSize = 0 usa ARENA_BLOCK_SIZE.
+void arenaInit(Arena *arena, size_t blockSize);
+
+// Reserva size bytes alinhados a ARENA_ALIGN. Pedidos maiores do que um bloco
+// têm um bloco só para eles.
+// Returns NULL if malloc fails.
+void *arenaAlloc(Arena *arena, size_t size);
+
+// Copia text para a arena.
+// Returns the copy, or NULL if malloc fails.
+char *arenaStrdup(Arena *arena, const char *text);
+
+// Liberta todos os blocos; a arena fica vazia e pode voltar a ser usada.
+void arenaFree(Arena *arena);
+
+#endif // _ARENA_H_
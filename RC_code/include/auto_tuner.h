@@ -0,0 +1,86 @@
+// Auto-tuner header.
+// Afinação do transmissor durante a transferência (RCOM_AUTOTUNE=1): em épocas
+// curtas mede o débito útil (bytes confirmados por segundo) e sobe a encosta
+// (hill climbing) mudando um parâmetro de cada vez: blocos por pacote, teto da
+// janela e timeout de retransmissão. Uma mudança só fica se a época seguinte
+// for melhor do que a medição de referência; entre tentativas a referência é
+// medida de novo, para acompanhar uma linha que muda. O número de tentativas
+// sobe com as perdas. O enquadramento não muda a meio da sessão: o perfil
+// guarda o débito de cada um e a sessão seguinte usa o melhor (e de vez em
+// quando experimenta o outro).
+//
+// O perfil de cada porta série fica em RCOM_PROFILE_DIR (por omissão ~/.rcom,
+// ou /tmp sem HOME), num ficheiro de texto com uma chave=valor por linha.
+
+#ifndef _AUTO_TUNER_H_
+#define _AUTO_TUNER_H_
+
+#include "link_layer_ext.h"
+
+#define TUNER_MAX_BLOCKS 8          // Pacote máximo dividido em blocos (passos do tamanho do pacote)
+#define TUNER_MAX_WINDOW 32         // Maior teto da janela (o MAX_WINDOW da ligação)
+#define TUNER_PATH_SIZE 512
+
+typedef struct
+{
+    int blocks;                 // Blocos por pacote de dados
+    int windowLimit;            // Teto da janela (tramas)
+    int retransmitMs;           // Timeout de retransmissão (ms)
+    int retries;                // Transmissões por trama
+} TunerSettings;
+
+typedef enum
+{
+    TUNER_BASELINE,             // A medir a referência com os valores atuais
+    TUNER_TRIAL,                // A medir uma mudança
+} TunerPhase;
+
+typedef struct
+{
+    char profilePath[TUNER_PATH_SIZE];
+    TunerSettings current;      // Valores aceites
+    TunerSettings trial;        // Valores a experimentar
+    TunerPhase phase;
+    int maxBlocks;              // 1 se o receptor não aceita pacotes de vários blocos
+    int maxWindow;              // 1 sem janela deslizante
+    int minRetransmitMs, maxRetransmitMs;
+    int baseRetries;
+    int dimension;              // Parâmetro que está a ser mudado
+    int direction;              // +1 ou -1
+    double referenceGoodput;    // Bytes/s da última referência
+    double bestGoodput;         // Melhor época da sessão
+    // Época atual
+    unsigned long long epochStartMs;
+    LlCounters epochStart;
+    // Perfil: débito médio de cada enquadramento e sessões já feitas
+    double framingGoodput[2];   // [0] stop-and-wait, [1] janela
+    int framingWindow;          // Enquadramento desta sessão
+    int sessions;
+    long changes;               // Mudanças aceites (estatísticas)
+    long trials;
+} AutoTuner;
+
+// Returns 1 if RCOM_AUTOTUNE asks for the auto-tuner.
+int autoTunerEnabled();
+
+// Antes do llopen: lê o perfil de serialPort e escolhe o enquadramento da
+// sessão (RCOM_FRAMING, se não estiver definido).
+void autoTunerPrepare(AutoTuner *tuner, const char *serialPort);
+
+// Depois do llopen: limites da sessão e valores iniciais (do perfil, se houver).
+// timeoutMs e retries são os do llopen.
+void autoTunerStart(AutoTuner *tuner, int maxBlocks, int windowMode, int timeoutMs, int retries);
+
+// Chamada depois de cada trama enviada: fecha a época quando chega ao fim e
+// escolhe os valores seguintes.
+// Returns 1 if the settings changed (read them with autoTunerSettings), 0 otherwise.
+int autoTunerStep(AutoTuner *tuner);
+
+// Valores a usar agora (a referência ou a tentativa).
+const TunerSettings *autoTunerSettings(const AutoTuner *tuner);
+
+// No fim da transferência: guarda o perfil com os valores aceites e o débito
+// médio da sessão (bytes/s) no enquadramento usado.
+void autoTunerFinish(AutoTuner *tuner, double sessionGoodput);
+
+#endif // _AUTO_TUNER_H_
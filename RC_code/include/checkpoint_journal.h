@@ -0,0 +1,66 @@
+// Checkpoint journal header.
+// Diário do receptor para retomar uma transferência interrompida: a identidade
+// do ficheiro (nome, tamanho e hash do conteúdo) e os intervalos contíguos que
+// já estão escritos (e sincronizados) no disco. É gravado num ficheiro
+// temporário e trocado com rename, por isso um crash deixa sempre o diário
+// anterior ou o novo, nunca um meio-termo.
+
+#ifndef _CHECKPOINT_JOURNAL_H_
+#define _CHECKPOINT_JOURNAL_H_
+
+#include <stdio.h>
+#include "range_bitmap.h"
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_MAX_RANGES 64
+#define JOURNAL_NAME_MAX 255
+
+typedef struct
+{
+    long long fileSize;
+    unsigned long long hash;    // FNV-1a de 64 bits do conteúdo
+    char name[JOURNAL_NAME_MAX + 1];  // Nome enviado pelo transmissor
+} FileIdentity;
+
+typedef struct
+{
+    long long start;
+    long long end;              // Exclusivo
+} JournalRange;
+
+typedef struct
+{
+    FileIdentity identity;
+    int blockSize;              // Blocos da sessão que gravou o diário
+    int rangeCount;
+    JournalRange ranges[JOURNAL_MAX_RANGES];
+} CheckpointJournal;
+
+// Calcula a identidade de file (lido do início; volta ao início no fim). Se
+// step não for NULL é chamada entre blocos lidos, p.ex. para a ligação tratar
+// a porta enquanto lê um ficheiro grande; se devolver -1 o cálculo para.
+// Returns 0 on success, -1 on a read error or if step failed.
+int fileIdentityCompute(FILE *file, const char *name, FileIdentity *identity, int (*step)(void));
+
+// Returns 1 if both identities describe the same file.
+int fileIdentityEquals(const FileIdentity *a, const FileIdentity *b);
+
+// Lê o diário de path.
+// Returns 0 on success, -1 if it does not exist or is damaged.
+int journalLoad(const char *path, CheckpointJournal *journal);
+
+// Grava o diário em path (temporário, fsync, rename e fsync da diretoria).
+// Returns 0 on success, -1 on error.
+int journalSave(const char *path, const CheckpointJournal *journal);
+
+// Apaga o diário (no fim de uma transferência completa).
+void journalRemove(const char *path);
+
+// Copia os blocos marcados em map para os intervalos do diário. Se houver mais
+// de JOURNAL_MAX_RANGES intervalos ficam só os primeiros (o resto volta a ser enviado).
+void journalFromBitmap(CheckpointJournal *journal, const RangeBitmap *map);
+
+// Bytes contíguos já escritos desde o início do ficheiro.
+long long journalResumeOffset(const CheckpointJournal *journal);
+
+#endif // _CHECKPOINT_JOURNAL_H_
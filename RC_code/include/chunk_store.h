@@ -0,0 +1,58 @@
+// Chunk store header.
+// Armazém persistente de pedaços no receptor: um único ficheiro onde os
+// pedaços são acrescentados (cabeçalho com o hash e o tamanho, depois os
+// dados) e um índice em memória, reconstruído ao abrir, que dá a posição de um
+// pedaço pelo hash e o tamanho. Um registo cortado no fim (a escrita foi
+// interrompida) é removido ao abrir. Os dados lidos são verificados com o hash.
+
+#ifndef _CHUNK_STORE_H_
+#define _CHUNK_STORE_H_
+
+#define CHUNK_STORE_MAGIC "RCOMCHK1"
+#define CHUNK_STORE_HEADER 12           // Hash (8 bytes) e tamanho (4) antes dos dados
+#define CHUNK_STORE_MAX_LENGTH (1 << 24)
+
+typedef struct
+{
+    unsigned long long hash;
+    int length;                 // 0 = entrada vazia
+    long long offset;           // Posição dos dados no ficheiro do armazém
+} ChunkEntry;
+
+typedef struct
+{
+    int fd;
+    long long size;             // Fim do ficheiro (onde vai o próximo pedaço)
+    ChunkEntry *table;          // Endereçamento aberto, nunca mais de meio cheia
+    int tableBits;
+    int count;                  // Pedaços no armazém
+    long long bytes;            // Dados dos pedaços
+    int added;                  // Pedaços acrescentados desde que foi aberto...
+    long long addedBytes;       // ...e os seus bytes
+} ChunkStore;
+
+// Hash de um pedaço (o mesmo do conteúdo dos ficheiros).
+unsigned long long chunkStoreHash(const unsigned char *data, int length);
+
+// Abre (ou cria) o armazém em path e lê o índice.
+// Returns 0 on success, -1 on error or if path is not a chunk store.
+int chunkStoreOpen(ChunkStore *store, const char *path);
+
+// Returns 1 if the store has the chunk with this hash and length.
+int chunkStoreHas(const ChunkStore *store, unsigned long long hash, int length);
+
+// Lê os length bytes do pedaço para buf e confirma o hash.
+// Returns 0 on success, -1 if it is missing, unreadable or corrupted.
+int chunkStoreRead(const ChunkStore *store, unsigned long long hash, int length, unsigned char *buf);
+
+// Acrescenta um pedaço (os que já lá estão são ignorados).
+// Returns 1 if it was added, 0 if it was already there, -1 on error.
+int chunkStoreAdd(ChunkStore *store, unsigned long long hash, const unsigned char *data, int length);
+
+// Passa os pedaços acrescentados para o disco.
+// Returns 0 on success, -1 on error.
+int chunkStoreSync(ChunkStore *store);
+
+void chunkStoreClose(ChunkStore *store);
+
+#endif // _CHUNK_STORE_H_
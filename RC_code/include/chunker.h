@@ -0,0 +1,21 @@
+// Chunker header.
+// Cortes definidos pelo conteúdo (FastCDC): um hash "gear" rola sobre os bytes
+// e um pedaço acaba onde os bits da máscara do hash estão todos a zero. Como o
+// corte depende só dos bytes à volta, uma inserção ou remoção num ficheiro só
+// muda os pedaços onde aconteceu; os outros ficam iguais e com o mesmo hash.
+// Até CHUNKER_AVG_SIZE a máscara é mais exigente e depois menos (normalized
+// chunking), para os tamanhos ficarem perto da média.
+
+#ifndef _CHUNKER_H_
+#define _CHUNKER_H_
+
+#define CHUNKER_MIN_SIZE 2048       // Antes disto não há corte
+#define CHUNKER_AVG_SIZE 8192
+#define CHUNKER_MAX_SIZE 65536      // Corte forçado
+
+// Procura o fim do pedaço que começa em data (size bytes disponíveis). Com
+// menos de CHUNKER_MAX_SIZE bytes só é o fim do ficheiro: o resto é o pedaço.
+// Returns the chunk length (at most size and CHUNKER_MAX_SIZE).
+int chunkerCut(const unsigned char *data, int size);
+
+#endif // _CHUNKER_H_
@@ -0,0 +1,34 @@
+// Content hash header.
+// Hash incremental de 64 bits do conteúdo transferido (o algoritmo do XXH64):
+// quatro acumuladores independentes que consomem 32 bytes por volta, por isso
+// o processador os calcula em paralelo e o custo por byte é muito menor do que
+// o do FNV-1a do diário. O transmissor calcula-o à medida que lê o ficheiro e
+// o receptor à medida que escreve os dados, sem voltar a ler nada; o resultado
+// vai no pacote de fim.
+
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+
+#include <stddef.h>
+
+#define CONTENT_HASH_STRIPE 32      // Bytes por volta dos quatro acumuladores
+
+typedef struct
+{
+    unsigned long long lanes[4];
+    unsigned long long totalBytes;
+    unsigned char stripe[CONTENT_HASH_STRIPE];  // Resto que ainda não encheu uma volta
+    int buffered;
+} ContentHash;
+
+// Começa um hash vazio.
+void contentHashInit(ContentHash *hash);
+
+// Acrescenta size bytes de data. Pode ser chamada com pedaços de qualquer
+// tamanho: o resultado é o mesmo que com os dados todos de uma vez.
+void contentHashUpdate(ContentHash *hash, const void *data, size_t size);
+
+// Returns the digest of everything added so far (the state is not changed).
+unsigned long long contentHashDigest(const ContentHash *hash);
+
+#endif // _CONTENT_HASH_H_
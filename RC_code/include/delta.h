@@ -0,0 +1,77 @@
+// Delta header.
+// Transferência de diferenças ao estilo do rsync: o receptor divide a cópia
+// que já tem em blocos de tamanho fixo e envia a assinatura de cada um (uma
+// soma fraca que se pode rolar byte a byte e um hash forte de 64 bits); o
+// transmissor procura esses blocos em todas as posições do ficheiro novo e só
+// envia os dados que não encontrou, mais referências para os blocos que
+// encontrou. O hash forte só é calculado quando a soma fraca coincide.
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#define DELTA_MIN_BLOCK 512         // Limites do tamanho dos blocos (raiz quadrada do tamanho do ficheiro)
+#define DELTA_MAX_BLOCK 16384
+#define DELTA_MAX_BLOCKS (1 << 24)  // O índice do bloco viaja em 3 bytes
+
+typedef struct
+{
+    unsigned int weak;          // Soma de Adler: a nos 16 bits de baixo, b nos de cima
+    unsigned long long strong;  // Hash do conteúdo do bloco
+} DeltaSignature;
+
+// Contadores da procura
+typedef struct
+{
+    long long weakHits;         // Posições em que a soma fraca estava na tabela
+    long long falseMatches;     // ...e o hash forte não coincidiu
+    long long matches;          // Blocos encontrados
+} DeltaStats;
+
+typedef struct
+{
+    int blockSize;
+    int blocks;                 // Blocos inteiros da cópia do receptor
+    int known;                  // Blocos com assinatura recebida
+    DeltaSignature *signatures;
+    unsigned char *present;     // 1 se a assinatura do bloco chegou
+    int *buckets;               // Primeiro bloco de cada entrada da tabela (-1 = vazia)
+    int *next;                  // Bloco seguinte com a mesma entrada
+    int tableBits;
+    DeltaStats stats;
+} DeltaIndex;
+
+// Tamanho dos blocos para um ficheiro de fileSize bytes: a raiz quadrada,
+// em múltiplos de 64, entre DELTA_MIN_BLOCK e DELTA_MAX_BLOCK.
+int deltaBlockSizeFor(long long fileSize);
+
+// Soma fraca de size bytes.
+unsigned int deltaWeak(const unsigned char *data, int size);
+
+// Soma fraca da janela de blockSize bytes deslocada um byte: sai out, entra in.
+unsigned int deltaRoll(unsigned int weak, unsigned char out, unsigned char in, int blockSize);
+
+// Assinatura completa de um bloco (no receptor).
+void deltaSignature(const unsigned char *data, int size, DeltaSignature *signature);
+
+// Prepara um índice vazio para os blocos inteiros de uma cópia de basisSize bytes.
+// Returns 0 on success, -1 if malloc fails.
+int deltaIndexInit(DeltaIndex *index, long long basisSize, int blockSize);
+
+// Guarda a assinatura do bloco block (as repetidas são ignoradas).
+void deltaIndexSet(DeltaIndex *index, int block, const DeltaSignature *signature);
+
+// Returns 1 if the signature of block has arrived.
+int deltaIndexHas(const DeltaIndex *index, int block);
+
+// Monta a tabela de procura com as assinaturas recebidas.
+// Returns 0 on success, -1 if malloc fails.
+int deltaIndexBuild(DeltaIndex *index);
+
+// Procura um bloco igual aos blockSize bytes de data, cuja soma fraca é weak.
+// hint é o bloco que continuaria a última referência (é o primeiro a ser visto).
+// Returns the block index, or -1 if there is none.
+int deltaIndexFind(DeltaIndex *index, unsigned int weak, const unsigned char *data, int hint);
+
+void deltaIndexFree(DeltaIndex *index);
+
+#endif // _DELTA_H_
@@ -0,0 +1,47 @@
+// File batch header.
+// Lista dos ficheiros de uma diretoria (com as subdiretorias) para os enviar
+// todos numa só sessão, e os caminhos do lado do receptor: cada ficheiro leva o
+// caminho relativo à diretoria, que o receptor recria dentro da sua.
+
+#ifndef _FILE_BATCH_H_
+#define _FILE_BATCH_H_
+
+#include <stddef.h>
+#include "arena.h"
+
+#define BATCH_NAME_MAX 255      // O caminho relativo vai num campo TLV de 8 bits
+
+typedef struct
+{
+    char *path;                 // Caminho local
+    char *name;                 // Caminho relativo à diretoria
+    long long size;
+} BatchEntry;
+
+typedef struct
+{
+    BatchEntry *entries;        // Por ordem do caminho relativo
+    int count;
+    int capacity;
+    long long totalBytes;
+    Arena names;                // Caminhos das entradas (libertados todos juntos)
+} FileBatch;
+
+// Returns 1 if path is a directory.
+int fileBatchIsDirectory(const char *path);
+
+// Junta a batch os ficheiros regulares de dir e das subdiretorias (as ligações
+// simbólicas são ignoradas).
+// Returns 0 on success, -1 on error (or a relative path longer than BATCH_NAME_MAX).
+int fileBatchScan(const char *dir, FileBatch *batch);
+
+// Liberta a lista.
+void fileBatchFree(FileBatch *batch);
+
+// Caminho onde o receptor escreve o ficheiro name dentro de dir (em path, com
+// size bytes), criando as diretorias que faltam. Recusa caminhos absolutos e
+// com "..", que escreveriam fora de dir.
+// Returns 0 on success, -1 on error.
+int fileBatchOutputPath(const char *dir, const char *name, char *path, size_t size);
+
+#endif // _FILE_BATCH_H_
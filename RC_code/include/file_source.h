@@ -0,0 +1,79 @@
+// File source header.
+// Origem dos dados do transmissor. Um ficheiro regular é mapeado em memória
+// (mmap com MADV_SEQUENTIAL) e cada pacote leva uma fatia do mapa, que o
+// stuffing lê diretamente das páginas: sem fread nem cópias intermédias. À
+// frente da posição atual vai um pedido de readahead (MADV_WILLNEED) de
+// FILE_SOURCE_READAHEAD bytes. Ficheiros regulares com RCOM_MMAP=0 usam a
+// leitura normal (fread) para um buffer; pipes, stdin e dispositivos usam
+// read, que entrega o que já chegou sem esperar por um pacote cheio.
+// Num ficheiro esparso os buracos são encontrados com SEEK_DATA/SEEK_HOLE e
+// saltados sem serem lidos (fileSourceHole e fileSourceSkip).
+
+#ifndef _FILE_SOURCE_H_
+#define _FILE_SOURCE_H_
+
+#include <stdio.h>
+
+#define FILE_SOURCE_READAHEAD (8 * 1024 * 1024)
+
+// Contadores desde o fileSourceOpen. O tempo de CPU e as faltas de página são
+// do processo todo (getrusage), incluindo a ligação.
+typedef struct
+{
+    int mapped;             // 1 com mmap, 0 com fread
+    long long bytes;        // Bytes entregues
+    double cpuMs;           // Tempo de CPU (utilizador + sistema)
+    long minorFaults;       // Páginas já em cache
+    long majorFaults;       // Páginas lidas do disco
+    long long holeBytes;    // Bytes saltados em buracos do ficheiro (fileSourceSkip)
+} FileSourceStats;
+
+typedef struct
+{
+    FILE *file;
+    int stream;                 // Não é um ficheiro regular (tamanho desconhecido)
+    const unsigned char *map;   // NULL sem mmap
+    long long size;
+    long long position;         // Com mmap (sem mmap é a do FILE)
+    long long fileSize;         // Tamanho de um ficheiro regular
+    long long dataEnd;          // Fim dos dados já encontrados com SEEK_HOLE
+    long long adviseEnd;        // Até onde já foi pedido o readahead
+    FileSourceStats stats;
+    double startCpuMs;
+    long startMinor, startMajor;
+} FileSource;
+
+// Prepara a leitura de file a partir da posição atual. Tenta o mmap se file
+// for um ficheiro regular não vazio; senão fica com fread (ou read, num stream).
+// Returns 0 on success, -1 on error.
+int fileSourceOpen(FileSource *source, FILE *file);
+
+// Returns 1 if the file is memory mapped (use fileSourceSlice), 0 otherwise (use fileSourceRead).
+int fileSourceMapped(const FileSource *source);
+
+// Ficheiro mapeado: a próxima fatia de até size bytes fica em *slice e a
+// posição avança. A fatia é válida até ao fileSourceClose.
+// Returns the slice size, or 0 at the end of the file.
+int fileSourceSlice(FileSource *source, int size, const unsigned char **slice);
+
+// Sem mmap: lê até size bytes para buf (num stream, pelo menos 1 byte ou o fim).
+// Returns the number of bytes read, 0 at the end of the file, or -1 on error.
+int fileSourceRead(FileSource *source, unsigned char *buf, int size);
+
+// Ficheiro regular: tamanho do buraco (zeros sem blocos no disco) que começa
+// na posição atual, segundo SEEK_DATA/SEEK_HOLE. Só faz as chamadas ao sistema
+// quando a posição passa o fim dos dados da chamada anterior.
+// Returns the hole size in bytes, 0 if there is data here (or no hole support).
+long long fileSourceHole(FileSource *source);
+
+// Avança size bytes sem os ler (contados em holeBytes, não em bytes).
+// Returns 0 on success, -1 on error.
+int fileSourceSkip(FileSource *source, long long size);
+
+// Copia os contadores atuais para stats.
+void fileSourceGetStats(FileSource *source, FileSourceStats *stats);
+
+// Desfaz o mapa (o ficheiro continua aberto).
+void fileSourceClose(FileSource *source);
+
+#endif // _FILE_SOURCE_H_
@@ -0,0 +1,63 @@
+// Frame pool header.
+// Pool de tramas pré-alocadas, usado pela camada de ligação e pela camada de
+// aplicação para evitar malloc/free depois do llopen.
+
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+
+#include <stdatomic.h>
+
+// Alinhamento de cada trama (uma linha de cache)
+#define FRAME_POOL_ALIGN 64
+
+// Número de tramas do pool por omissão: a janela de envio (até 32 tramas)
+// mais as que estão nas filas e etapas do pipeline
+#define FRAME_POOL_SLOTS 64
+
+// Uma trama do pool. Os metadados ocupam uma linha de cache própria para que
+// threads diferentes não partilhem linhas ao mexer em tramas diferentes.
+typedef struct
+{
+    _Alignas(FRAME_POOL_ALIGN) unsigned char *data; // Buffer alinhado da trama
+    int capacity;                                   // Tamanho do buffer em bytes
+    int length;                                     // Bytes válidos no buffer
+    atomic_int refCount;                            // Referências ativas (0 = livre)
+    int index;                                      // Posição no pool
+    int next;                                       // Próxima trama livre (-1 = nenhuma)
+} FrameSlot;
+
+// Contadores do pool
+typedef struct
+{
+    long allocations;   // Chamadas a malloc feitas pelo pool (só no framePoolInit)
+    long acquires;      // Tramas obtidas com framePoolAcquire
+    long releases;      // Tramas devolvidas ao pool
+    long exhausted;     // Pedidos falhados por falta de tramas livres
+    int inUse;          // Tramas atualmente em uso
+    int peakInUse;      // Máximo de tramas em uso em simultâneo
+} FramePoolStats;
+
+// Reserva toda a memória do pool: nSlots tramas de slotSize bytes cada.
+// Returns 0 on success, -1 on error.
+int framePoolInit(int nSlots, int slotSize);
+
+// Liberta a memória do pool.
+void framePoolDestroy();
+
+// Obtém uma trama livre com refCount = 1, em O(1).
+// Returns NULL if the pool is exhausted.
+FrameSlot *framePoolAcquire();
+
+// Acrescenta uma referência (p.ex. trama à espera de ACK).
+void framePoolRetain(FrameSlot *slot);
+
+// Retira uma referência; a trama volta ao pool quando chega a 0.
+void framePoolRelease(FrameSlot *slot);
+
+// Número de tramas livres.
+int framePoolAvailable();
+
+// Copia os contadores atuais do pool para stats.
+void framePoolGetStats(FramePoolStats *stats);
+
+#endif // _FRAME_POOL_H_
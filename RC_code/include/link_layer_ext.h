@@ -0,0 +1,149 @@
+// Link layer extensions header.
+// Funções da camada de ligação para além da interface base de link_layer.h.
+
+#ifndef _LINK_LAYER_EXT_H_
+#define _LINK_LAYER_EXT_H_
+
+#include "frame_pool.h"
+#include "link_negotiation.h"
+
+// Maior pacote que se pode negociar (RCOM_MAX_PAYLOAD nos dois lados): com o
+// cabeçalho de 4 bytes, os dados de um pacote cabem no campo de tamanho de 16 bits
+#define LL_MAX_JUMBO_PAYLOAD 65536
+
+// Maior resposta da aplicação do receptor (llReply): cabe no bloco de uma trama de supervisão
+#define LL_REPLY_MAX_SIZE (NEGOTIATION_MAX_SIZE - 1)
+
+// Motivo da última falha da camada de ligação
+typedef enum
+{
+    LL_ERROR_NONE,
+    LL_ERROR_TIMEOUT,       // Esgotaram-se as retransmissões
+    LL_ERROR_LINK_DEAD,     // O outro lado deixou de responder às sondagens (keepalive)
+    LL_ERROR_IO,            // Erro na porta série
+} LlError;
+
+// Estado da ligação segundo o keepalive
+typedef enum
+{
+    LL_LINK_DOWN,           // Antes do llopen ou depois do llclose
+    LL_LINK_UP,             // Chegaram bytes há pouco tempo
+    LL_LINK_PROBING,        // Sem bytes há mais de RCOM_KEEPALIVE_MS: à espera de resposta a uma sondagem
+    LL_LINK_DEAD,           // Sem resposta às sondagens durante RCOM_DEAD_LINK_MS
+} LlLinkState;
+
+typedef struct
+{
+    LlLinkState state;
+    long msSinceRx;         // Tempo desde o último byte recebido
+    int keepaliveMs;        // Silêncio antes da primeira sondagem (0 = keepalive desligado)
+    int deadLinkMs;         // Silêncio depois da sondagem até declarar a ligação morta
+    long probesSent;        // Sondagens enviadas
+    long probesAnswered;    // Sondagens com resposta
+    int baudRate;           // Taxa atual (pode ter subido depois do llopen, RCOM_MAX_BAUD)
+    double rttUs;           // Tx: última amostra de RTT de uma trama de dados (0 sem amostras)
+} LlLinkHealth;
+
+// Motivo do último -1 devolvido por llopen, llwrite, llwriteFrame, llFlush, llread ou llclose.
+LlError llLastError();
+
+// Descrição de um LlError.
+const char *llErrorString(LlError error);
+
+// Copia o estado atual da ligação para health. Pode ser usada entre chamadas
+// para decidir mudar de ligação sem esperar pelos timeouts.
+void llLinkHealth(LlLinkHealth *health);
+
+// Copia para caps os parâmetros da sessão acordados no llopen: a interseção das
+// capacidades dos dois lados, ou os das tramas de 5 bytes se o outro lado não negociou.
+// Returns 1 if the parameters were negotiated (SETX/UAX), 0 for a peer without negotiation.
+int llSessionParameters(LinkCapabilities *caps);
+
+// Maior pacote aceite por llwrite e llEncodeFrame na sessão atual. Depois do
+// llopen os buffers passados a llread têm de ter pelo menos este tamanho.
+int llMaxPayload();
+
+// Receptor: envia ao transmissor uma resposta curta (size <= LL_REPLY_MAX_SIZE
+// bytes) numa trama de supervisão, p.ex. o offset para retomar uma transferência.
+// Não é confirmada: o transmissor volta a pedir se não a receber.
+// Returns 0 on success, -1 on error.
+int llReply(const unsigned char *buf, int size);
+
+// Transmissor: espera até timeoutMs por uma resposta enviada com llReply e
+// copia-a para buf (LL_REPLY_MAX_SIZE bytes). As outras tramas são ignoradas.
+// Returns the reply size, 0 on timeout, or -1 if the link failed.
+int llReadReply(unsigned char *buf, int timeoutMs);
+
+// Maior trama (com stuffing de todos os bytes) de um pacote de payloadSize
+// bytes com o enquadramento e o FCS da sessão atual.
+int llFrameBound(int payloadSize);
+
+// Parâmetros do transmissor que podem mudar durante a sessão (0 = os do llopen)
+typedef struct
+{
+    int windowLimit;        // Teto da janela (tramas); abaixo do que o RTT pede
+    int retransmitMs;       // Timeout de retransmissão das tramas de dados (ms)
+    int retries;            // Transmissões por trama
+} LlTuning;
+
+// Contadores para medir o débito útil e as retransmissões
+typedef struct
+{
+    long long ackedBytes;   // Bytes de pacotes confirmados
+    long framesSent;        // Tramas de dados enviadas (com retransmissões)
+    long framesAcked;       // Tramas de dados confirmadas
+    int framesOutstanding;  // Tramas na janela por confirmar
+    long framesReceived;    // Rx: tramas de dados aceites
+    long framesRejected;    // Rx: tramas com erro (o transmissor reenvia-as)
+    long long receivedBytes;    // Rx: bytes de pacotes aceites
+} LlCounters;
+
+// Muda os parâmetros do transmissor a partir da próxima trama. Os campos a 0
+// voltam aos valores do llopen (retries a 0 mantém o atual).
+void llSetTuning(const LlTuning *tuning);
+
+// Copia os valores em uso (a janela efetiva, não o teto).
+void llGetTuning(LlTuning *tuning);
+
+// Copia os contadores da ligação desde o llopen.
+void llCounters(LlCounters *counters);
+
+// Monta em frame uma trama de dados completa (cabeçalho, stuffing, FCS e FLAG)
+// com o pacote buf de bufSize bytes. Pode ser chamada fora da thread da ligação.
+// Returns the frame size in bytes, or -1 on error.
+int llEncodeFrame(const unsigned char *buf, int bufSize, FrameSlot *frame);
+
+// Como llEncodeFrame, com o pacote em duas partes: head (headSize bytes, p.ex.
+// o cabeçalho) seguido de buf. Nenhuma das partes é copiada para outro buffer
+// antes do stuffing, por isso buf pode ser uma fatia de um ficheiro mapeado.
+// Returns the frame size in bytes, or -1 on error.
+int llEncodeFrameParts(const unsigned char *head, int headSize, const unsigned char *buf, int bufSize,
+                       FrameSlot *frame);
+
+// Envia uma trama montada por llEncodeFrame. Com janela deslizante volta assim
+// que a trama entra na janela (bloqueia só com a janela cheia) e guarda uma
+// referência até ao ACK; sem janela espera pelo ACK como o llwrite.
+// payloadSize é o tamanho do pacote original (estatísticas).
+// Return number of chars written, or "-1" on error (this or an earlier frame failed).
+int llwriteFrame(FrameSlot *frame, int payloadSize);
+
+// Espera até todas as tramas enviadas estarem confirmadas.
+// Returns 0 on success, -1 if the link failed.
+int llFlush();
+
+// Transmissor: trata sem bloquear o que já chegou à porta (RR, REJ, sondagens
+// do keepalive) e os temporizadores que expiraram (retransmissões, keepalive).
+// Deve ser chamada quando o transmissor passa algum tempo sem enviar tramas,
+// p.ex. enquanto lê um ficheiro grande, senão o receptor dá a ligação como morta.
+// Returns 0 on success, -1 if the link failed.
+int llService();
+
+// Com keep a 1 o llclose deixa a porta série aberta (de volta à taxa do
+// llopen) e o llopen seguinte usa-a sem a abrir e configurar de novo: várias
+// sessões seguidas no mesmo processo (receptor em modo daemon). Um SET de um
+// novo transmissor que chegue durante o llclose fica para o llopen seguinte.
+// As estatísticas da ligação voltam a zero em cada llopen. Com keep a 0 a
+// porta que ficou aberta entre sessões é fechada.
+void llKeepPortOpen(int keep);
+
+#endif // _LINK_LAYER_EXT_H_
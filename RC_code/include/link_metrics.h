@@ -0,0 +1,95 @@
+// Link metrics header.
+// Métricas de um processo num segmento de memória partilhada (RCOM_METRICS),
+// para serem lidas por outro processo enquanto a ligação corre (a ferramenta
+// tools/rcom_metrics mostra-as no formato de texto do Prometheus). O segmento
+// chama-se METRICS_PREFIX seguido do pid, ou o nome dado em RCOM_METRICS, e é
+// removido quando o processo acaba.
+//
+// Consistência por seqlock: quem escreve põe a sequência ímpar, copia os
+// valores e volta a pô-la par; quem lê repete a cópia enquanto a sequência
+// for ímpar ou tiver mudado a meio. Quem escreve nunca espera por quem lê.
+// A publicação é feita pela thread da ligação no máximo a cada
+// RCOM_METRICS_MS (por omissão METRICS_DEFAULT_MS), não a cada trama.
+
+#ifndef _LINK_METRICS_H_
+#define _LINK_METRICS_H_
+
+#include <stdatomic.h>
+
+#define METRICS_MAGIC 0x52434D31        // "RCM1"
+#define METRICS_PREFIX "rcom."          // Em /dev/shm
+#define METRICS_NAME_SIZE 64
+#define METRICS_DEFAULT_MS 250
+#define METRICS_READ_TRIES 1000
+
+// Valores publicados (contadores desde o início do processo, o resto é o estado atual)
+typedef struct
+{
+    int pid;
+    int transmitter;                    // 1 tx, 0 rx
+    char port[METRICS_NAME_SIZE];
+    double updated;                     // Hora da publicação (segundos desde 1970)
+    // Contadores
+    long long framesSent;               // Tramas de dados enviadas (com retransmissões)
+    long long framesAcked;
+    long long framesReceived;
+    long long framesRejected;
+    long long retransmissions;          // Tx: enviadas - confirmadas - por confirmar
+    long long bytesAcked;               // Tx: bytes de pacotes confirmados
+    long long bytesReceived;            // Rx: bytes de pacotes aceites
+    long long files;                    // Ficheiros terminados
+    long long probesSent;               // Sondagens do keepalive
+    // Estado atual
+    long long fileBytes;                // Progresso do ficheiro atual...
+    long long fileTotal;                // ...e o seu tamanho (-1 desconhecido)
+    double rttUs;                       // Última amostra de RTT
+    int window;                         // Janela em uso (tramas)
+    int outstanding;                    // Tramas por confirmar
+    int queueFirst;                     // Ocupação das filas do pipeline
+    int queueSecond;
+    int baudRate;
+    int linkState;                      // LlLinkState
+} MetricsValues;
+
+// Segmento partilhado
+typedef struct
+{
+    unsigned int magic;
+    unsigned int size;                  // sizeof(MetricsSegment) de quem o criou
+    atomic_uint sequence;               // Ímpar durante uma escrita
+    MetricsValues values;
+} MetricsSegment;
+
+typedef struct
+{
+    MetricsSegment *segment;            // NULL se desligado
+    char name[METRICS_NAME_SIZE + 16];
+    int owner;                          // Criou o segmento (remove-o ao fechar)
+    long intervalMs;
+    unsigned long long lastMs;
+} Metrics;
+
+// Cria o segmento do processo se RCOM_METRICS estiver definida ("1" para o
+// nome por omissão). Sem ela metrics->segment fica a NULL. Um segmento com o
+// mesmo nome de um processo que ainda corre não é tocado (errno = EEXIST).
+// Returns 0 on success or if disabled, -1 on error.
+int metricsCreate(Metrics *metrics);
+
+// Returns 1 if the publishing interval has passed (reads only the coarse clock).
+int metricsDue(Metrics *metrics);
+
+// Copia values para o segmento (escrita do seqlock).
+void metricsPublish(Metrics *metrics, const MetricsValues *values);
+
+// Abre só para leitura o segmento name (sem a "/").
+// Returns 0 on success, -1 on error or if it is not a metrics segment.
+int metricsAttach(Metrics *metrics, const char *name);
+
+// Copia os valores atuais de forma consistente.
+// Returns 0 on success, -1 if the writer kept changing them.
+int metricsRead(const Metrics *metrics, MetricsValues *values);
+
+// Desfaz o mapa; quem criou o segmento também o remove.
+void metricsClose(Metrics *metrics);
+
+#endif // _LINK_METRICS_H_
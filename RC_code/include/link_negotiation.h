@@ -0,0 +1,82 @@
+// Link negotiation header.
+// Capacidades trocadas no SET/UA estendido (SETX/UAX) e cálculo dos parâmetros
+// da sessão como a interseção das capacidades dos dois lados.
+
+#ifndef _LINK_NEGOTIATION_H_
+#define _LINK_NEGOTIATION_H_
+
+#define NEGOTIATION_VERSION 9
+
+// A partir desta versão a camada de aplicação dos dois lados aceita pacotes de
+// dados com o offset no ficheiro
+#define NEGOTIATION_VERSION_OFFSETS 2
+
+// A partir desta versão o receptor responde ao pedido de retoma do pacote de
+// início (llReply) com o offset a partir do qual o transmissor continua
+#define NEGOTIATION_VERSION_RESUME 3
+
+// A partir desta versão o receptor aceita vários ficheiros numa sessão (lotes)
+#define NEGOTIATION_VERSION_BATCH 4
+
+// A partir desta versão um pacote com offset pode levar vários blocos seguidos
+// (o transmissor muda o tamanho dos pacotes durante a transferência)
+#define NEGOTIATION_VERSION_MULTIBLOCK 5
+
+// A partir desta versão o receptor aceita ficheiros de tamanho desconhecido
+// (pipes, stdin): o tamanho final vem no pacote de fim
+#define NEGOTIATION_VERSION_STREAM 6
+
+// A partir desta versão o receptor envia as assinaturas dos blocos da cópia
+// que já tem de um ficheiro, e o transmissor só envia as diferenças (delta)
+#define NEGOTIATION_VERSION_DELTA 7
+
+// A partir desta versão o receptor aceita pacotes de buracos (zonas a zeros
+// que não são enviadas)
+#define NEGOTIATION_VERSION_HOLES 8
+
+// A partir desta versão o receptor tem um armazém de pedaços e responde às
+// ofertas do transmissor (dedup)
+#define NEGOTIATION_VERSION_DEDUP 9
+
+// Tamanho máximo do bloco de capacidades (antes do stuffing)
+#define NEGOTIATION_MAX_SIZE 16
+
+// Algoritmos de verificação das tramas de dados (máscara de bits)
+#define FCS_XOR 0x01        // BCC2 de 1 byte (XOR), o das tramas de 5 bytes
+#define FCS_CRC16 0x02      // CRC-16/CCITT de 2 bytes
+
+// Modos de enquadramento (máscara de bits)
+#define FRAMING_LEGACY 0x01 // Stop-and-wait com RR0/RR1 (tramas originais)
+#define FRAMING_WINDOW 0x02 // Janela deslizante com Ns/Nr e RR agregados
+
+// Compressão do pacote (máscara de bits); por agora só há "sem compressão"
+#define COMPRESSION_NONE 0x01
+
+typedef struct
+{
+    int version;
+    int maxPayload;         // Maior pacote aceite (bytes)
+    int maxWindow;          // Maior janela aceite (tramas)
+    int fcsMask;
+    int framingMask;
+    int compressionMask;
+    int timeout;            // Timeout de retransmissão (s)
+    int retries;            // Número de transmissões por trama
+    int maxBaud;            // Maior taxa para subir depois do llopen (0 nos blocos sem este campo)
+} LinkCapabilities;
+
+// Escreve as capacidades em buf (NEGOTIATION_MAX_SIZE bytes, com um byte de verificação).
+// Returns the number of bytes written.
+int capabilitiesEncode(const LinkCapabilities *caps, unsigned char *buf);
+
+// Lê as capacidades de buf.
+// Returns 0 on success, -1 if the block is too short or the check byte is wrong.
+int capabilitiesDecode(const unsigned char *buf, int size, LinkCapabilities *caps);
+
+// Parâmetros da sessão: o menor payload, janela e taxa máxima, o melhor FCS,
+// enquadramento e compressão comuns, e o maior timeout e número de tentativas. Cada máscara do
+// resultado tem um só bit.
+// Returns 0 on success, -1 if there is no common FCS or framing mode.
+int capabilitiesIntersect(const LinkCapabilities *local, const LinkCapabilities *peer, LinkCapabilities *result);
+
+#endif // _LINK_NEGOTIATION_H_
@@ -0,0 +1,54 @@
+// Link window sizing header.
+// Calcula a janela de envio a partir do produto largura de banda x atraso,
+// com o RTT medido no handshake SET/UA e depois em cada trama confirmada.
+
+#ifndef _LINK_WINDOW_H_
+#define _LINK_WINDOW_H_
+
+// Amostras por época do filtro de mínimo do atraso de propagação
+#define WINDOW_RTT_EPOCH 32
+
+typedef struct
+{
+    int baudRate;
+    int maxWindow;
+    int window;             // Janela atual (tramas)
+    double frameBytes;      // Tamanho médio das tramas de dados na linha (bytes)
+    double twoPropUs;       // Estimativa de 2 x atraso de propagação (us)
+    double epochMinUs;      // Mínimo da época atual (us)
+    double ackStride;       // Média de tramas confirmadas por cada RR (ACK agregado)
+    int epochSamples;
+    long samples;           // Amostras de RTT usadas
+} WindowSizer;
+
+// Inicializa com a taxa da porta, o limite da janela e um tamanho de trama provisório.
+void windowSizerInit(WindowSizer *sizer, int baudRate, int maxWindow, double frameBytesGuess);
+
+// Usa o RTT do SET/UA (duas tramas de supervisão de supBytes bytes) como primeira estimativa.
+// Returns the new window size.
+int windowSizerHandshake(WindowSizer *sizer, double rttUs, int supBytes);
+
+// Regista uma amostra de RTT (início da trama na linha até ao RR) de uma trama
+// de frameBytes bytes confirmada por uma trama de supervisão de ackBytes bytes.
+// Returns the new window size.
+int windowSizerSample(WindowSizer *sizer, double rttUs, int frameBytes, int ackBytes);
+
+// Regista quantas tramas um RR cumulativo confirmou. Com ACKs agregados o RR
+// da primeira trama só chega depois de mais algumas, e a janela cresce nessa medida.
+// Returns the new window size.
+int windowSizerAckStride(WindowSizer *sizer, int framesAcked);
+
+// Atualiza a taxa da linha (p.ex. depois de uma mudança de baud rate).
+// Returns the new window size.
+int windowSizerSetBaudRate(WindowSizer *sizer, int baudRate);
+
+// Tempo de transmissão de bytes bytes na linha (8N1, 10 bits por byte), em us.
+double windowSizerByteTimeUs(const WindowSizer *sizer, double bytes);
+
+// Parâmetro a = Tprop / Tframe para a trama média atual.
+double windowSizerA(const WindowSizer *sizer);
+
+// Eficiência máxima teórica com uma janela de window tramas: min(1, W / (1 + 2a)).
+double windowSizerEfficiencyBound(const WindowSizer *sizer, int window);
+
+#endif // _LINK_WINDOW_H_
@@ -0,0 +1,56 @@
+// Progress header.
+// Progresso da transferência durante o envio ou a recepção (RCOM_PROGRESS):
+// bytes feitos e o total do pacote de início, débito útil no último intervalo
+// e desde o início, taxa de retransmissões e tempo que falta. Vai para o
+// stderr, no máximo uma linha a cada RCOM_PROGRESS_MS (por omissão 1000 ms),
+// em texto ou em JSON (uma linha por objeto, RCOM_PROGRESS=json). Com
+// RCOM_PROGRESS=0 fica desligado.
+//
+// progressStep é chamada pela thread da ligação a cada trama: lê o relógio
+// CLOCK_MONOTONIC_COARSE (no vDSO, sem chamada ao sistema) e só faz mais
+// alguma coisa quando o intervalo passou.
+
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+#include "link_layer_ext.h"
+
+#define PROGRESS_DEFAULT_MS 1000
+#define PROGRESS_NAME_SIZE 256
+
+typedef enum
+{
+    PROGRESS_OFF,
+    PROGRESS_TEXT,
+    PROGRESS_JSON,
+} ProgressFormat;
+
+typedef struct
+{
+    ProgressFormat format;
+    long intervalMs;
+    int transmitter;            // 1 no tx (retransmissões pelas tramas por confirmar), 0 no rx (pelas rejeitadas)
+    char name[PROGRESS_NAME_SIZE];
+    long long total;            // Tamanho do ficheiro, -1 num stream
+    long long startDone;        // Bytes já no receptor no início (retoma)
+    unsigned long long startMs;
+    // Último intervalo
+    unsigned long long lastMs;
+    long long lastDone;
+    LlCounters lastCounters;
+    long lines;                 // Linhas já mostradas
+} Progress;
+
+// Prepara o progresso de um ficheiro de total bytes (-1 se não se sabe), dos
+// quais startDone já estão feitos. Lê RCOM_PROGRESS e RCOM_PROGRESS_MS.
+void progressInit(Progress *progress, int transmitter, const char *name, long long total, long long startDone);
+
+// Mostra uma linha se o intervalo passou desde a última; done é o fim dos
+// dados já passados à ligação (tx) ou escritos (rx).
+void progressStep(Progress *progress, long long done);
+
+// Última linha (a 100% se a transferência acabou): em JSON sempre, em texto
+// só se já tinha sido mostrada alguma.
+void progressFinish(Progress *progress, long long done);
+
+#endif // _PROGRESS_H_
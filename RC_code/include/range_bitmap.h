@@ -0,0 +1,52 @@
+// Received-range bitmap header.
+// Mapa de bits dos blocos de um ficheiro já recebidos. Cada bloco tem o tamanho
+// dos dados de um pacote (o último pode ser mais curto), por isso os pacotes
+// podem chegar por qualquer ordem ou repetidos.
+
+#ifndef _RANGE_BITMAP_H_
+#define _RANGE_BITMAP_H_
+
+typedef struct
+{
+    unsigned long long *words;  // Um bit por bloco (1 = recebido)
+    long long fileSize;         // Tamanho do ficheiro (bytes)
+    long long blocks;           // Número de blocos
+    long long receivedBlocks;   // Blocos marcados
+    long long receivedBytes;    // Bytes nos blocos marcados
+    int blockSize;              // Tamanho de cada bloco (bytes)
+} RangeBitmap;
+
+// Reserva o mapa de um ficheiro de fileSize bytes em blocos de blockSize bytes.
+// Returns 0 on success, -1 on error.
+int rangeBitmapInit(RangeBitmap *map, long long fileSize, int blockSize);
+
+// Liberta a memória do mapa.
+void rangeBitmapFree(RangeBitmap *map);
+
+// Marca os blocos de [offset, offset + length) como recebidos (um pacote pode
+// levar vários blocos seguidos).
+// Returns 1 if any block is new, 0 if all were already received, -1 if offset
+// and length do not describe whole blocks of the file.
+int rangeBitmapMark(RangeBitmap *map, long long offset, int length);
+
+// Diz se o bloco que começa em offset já foi recebido.
+int rangeBitmapHas(const RangeBitmap *map, long long offset);
+
+// Returns 1 when every block has been received.
+int rangeBitmapComplete(const RangeBitmap *map);
+
+// Offset do primeiro bloco em falta a partir de offset.
+// Returns fileSize if there is none.
+long long rangeBitmapNextMissing(const RangeBitmap *map, long long offset);
+
+// Offset do primeiro bloco já recebido a partir de offset.
+// Returns fileSize if there is none.
+long long rangeBitmapNextReceived(const RangeBitmap *map, long long offset);
+
+// Marca os blocos inteiros de [0, end) como recebidos (p.ex. os de uma
+// transferência retomada). Com outro tamanho de bloco, o bloco cortado por end
+// fica por receber.
+// Returns the end of the marked prefix (a block boundary, or fileSize).
+long long rangeBitmapMarkPrefix(RangeBitmap *map, long long end);
+
+#endif // _RANGE_BITMAP_H_
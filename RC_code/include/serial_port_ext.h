@@ -0,0 +1,21 @@
+// Serial port extensions header.
+// Mudança da taxa da porta série depois de aberta (serial_port.c só a define
+// no openSerialPort).
+
+#ifndef _SERIAL_PORT_EXT_H_
+#define _SERIAL_PORT_EXT_H_
+
+// Posição de baudRate na tabela de taxas suportadas, por ordem crescente.
+// Returns the index, or -1 if the rate is not supported.
+int serialPortBaudIndex(int baudRate);
+
+// Taxa na posição index da tabela.
+// Returns the baud rate, or 0 if index is out of range.
+int serialPortBaudAt(int index);
+
+// Espera que os bytes pendentes saiam da porta e muda a taxa de envio e de
+// receção para baudRate.
+// Returns 0 on success, -1 on error.
+int serialPortSetBaudRate(int baudRate);
+
+#endif // _SERIAL_PORT_EXT_H_
@@ -0,0 +1,66 @@
+// Single-producer/single-consumer queue header.
+// Fila circular sem locks entre duas threads (um produtor, um consumidor).
+
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+#include <stdatomic.h>
+
+#define SPSC_CACHE_LINE 64
+
+// Capacidade máxima de uma fila (potência de 2)
+#define SPSC_MAX_CAPACITY 64
+
+// Elemento transportado pela fila
+typedef struct
+{
+    void *ptr;  // Normalmente um FrameSlot
+    int len;    // Bytes úteis
+    int tag;    // Significado definido por quem usa a fila
+    long long offset;   // Posição no ficheiro dos dados (pacotes de dados)
+} SpscItem;
+
+// Contadores de uma fila, atualizados só pela thread a que dizem respeito
+typedef struct
+{
+    long pushes;
+    long pops;
+    long occupancySum;      // Soma da ocupação vista em cada push (média = occupancySum / pushes)
+    double producerStallMs; // Tempo que o produtor esperou com a fila cheia
+    double consumerStallMs; // Tempo que o consumidor esperou com a fila vazia
+} SpscStats;
+
+typedef struct
+{
+    _Alignas(SPSC_CACHE_LINE) atomic_uint head;  // Próxima posição a ler (consumidor)
+    _Alignas(SPSC_CACHE_LINE) atomic_uint tail;  // Próxima posição a escrever (produtor)
+    _Alignas(SPSC_CACHE_LINE) unsigned int mask;
+    SpscItem items[SPSC_MAX_CAPACITY];
+    SpscStats stats;
+} SpscQueue;
+
+// Inicializa a fila com capacity elementos (potência de 2, <= SPSC_MAX_CAPACITY).
+// Returns 0 on success, -1 on error.
+int spscInit(SpscQueue *queue, unsigned int capacity);
+
+// Tenta inserir sem bloquear. Returns 1 if inserted, 0 if the queue is full.
+int spscTryPush(SpscQueue *queue, SpscItem item);
+
+// Tenta retirar sem bloquear. Returns 1 if an item was removed, 0 if empty.
+int spscTryPop(SpscQueue *queue, SpscItem *item);
+
+// Insere, esperando enquanto a fila estiver cheia (conta o tempo de espera).
+void spscPush(SpscQueue *queue, SpscItem item);
+
+// Retira, esperando enquanto a fila estiver vazia (conta o tempo de espera).
+void spscPop(SpscQueue *queue, SpscItem *item);
+
+// Como spscPop, mas desiste ao fim de timeoutMs (p.ex. para a thread da ligação
+// tratar a porta enquanto o produtor está parado).
+// Returns 1 if an item was removed, 0 on timeout.
+int spscPopTimed(SpscQueue *queue, SpscItem *item, int timeoutMs);
+
+// Número de elementos na fila (aproximado se chamado por uma terceira thread).
+unsigned int spscSize(SpscQueue *queue);
+
+#endif // _SPSC_QUEUE_H_
@@ -0,0 +1,77 @@
+// Timer wheel header.
+// Roda de temporizadores hierárquica com resolução de 1 ms. Iniciar, parar e
+// expirar temporizadores custa O(1); a camada de ligação usa-a em vez do alarm().
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#define TW_LEVELS 4                     // 4 níveis de 64 posições: até ~4.6 horas
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+
+// Tipos de temporizador usados pela camada de ligação
+typedef enum
+{
+    TIMER_RETRANSMIT,   // Retransmissão de uma trama à espera de ACK
+    TIMER_HANDSHAKE,    // SET/UA e DISC/UA
+    TIMER_RECEIVE,      // Espera por uma trama de dados no receptor
+    TIMER_ACK,          // RR adiado no receptor (confirmações agregadas)
+    TIMER_KEEPALIVE,    // Sondagem da ligação quando não chegam bytes
+    TIMER_BAUD,         // Verificação e recuo da taxa depois de uma mudança de baud rate
+} TimerKind;
+
+typedef struct Timer Timer;
+typedef void (*TimerCallback)(Timer *timer, void *arg);
+
+// Temporizador; a memória pertence a quem o usa (normalmente dentro de outra estrutura)
+struct Timer
+{
+    unsigned long long expires; // Instante de expiração em ms
+    TimerCallback callback;
+    void *arg;
+    TimerKind kind;
+    int id;                     // Identificador livre (p.ex. número de sequência da trama)
+    Timer *prev;
+    Timer *next;
+    int level;                  // -1 quando inativo
+    int slot;
+};
+
+typedef struct
+{
+    unsigned long long now;                         // Último tick processado (ms)
+    Timer *slots[TW_LEVELS][TW_SLOTS];
+    unsigned long long occupied[TW_LEVELS];        // Bit i = posição i não vazia
+    int active;                                     // Temporizadores ativos
+} TimerWheel;
+
+// Tempo monotónico em milissegundos.
+unsigned long long timerNowMs();
+
+// Tempo monotónico em microssegundos (medição de RTT).
+unsigned long long timerNowUs();
+
+// Inicializa a roda no instante nowMs.
+void timerWheelInit(TimerWheel *wheel, unsigned long long nowMs);
+
+// Prepara um temporizador (inativo) com a função a chamar quando expirar.
+void timerInit(Timer *timer, TimerKind kind, int id, TimerCallback callback, void *arg);
+
+// (Re)inicia o temporizador para expirar daqui a delayMs milissegundos.
+void timerStart(TimerWheel *wheel, Timer *timer, unsigned long long delayMs);
+
+// Para o temporizador, se estiver ativo.
+void timerStop(TimerWheel *wheel, Timer *timer);
+
+// Indica se o temporizador está ativo.
+int timerActive(const Timer *timer);
+
+// Avança a roda até nowMs, chamando os temporizadores expirados.
+// Returns the number of timers that expired.
+int timerWheelAdvance(TimerWheel *wheel, unsigned long long nowMs);
+
+// Milissegundos até à próxima expiração possível (limite inferior), a contar de nowMs.
+// Returns -1 if there are no active timers.
+int timerWheelNextTimeout(TimerWheel *wheel, unsigned long long nowMs);
+
+#endif // _TIMER_WHEEL_H_
@@ -0,0 +1,86 @@
+// Write-behind sink header.
+// Escrita diferida do receptor: os dados dos pacotes são copiados para
+// buffers grandes (WRITE_SINK_BUFFER_SIZE) e uma thread própria escreve-os
+// no ficheiro com pwrite, enquanto a etapa de escrita continua a encher o
+// buffer seguinte. Dados contíguos juntam-se no mesmo buffer e os buffers
+// acabam em offsets alinhados a WRITE_SINK_ALIGN, por isso uma transferência
+// sequencial é escrita em blocos alinhados de 1 MiB. Só há fsync no fim
+// (writeSinkSync); um disco lento só atrasa a ligação quando os
+// WRITE_SINK_BUFFERS buffers estão todos à espera de ser escritos.
+
+#ifndef _WRITE_SINK_H_
+#define _WRITE_SINK_H_
+
+#include <pthread.h>
+
+#define WRITE_SINK_BUFFERS 4
+#define WRITE_SINK_BUFFER_SIZE (1024 * 1024)
+#define WRITE_SINK_ALIGN 4096
+
+// Contadores do sink
+typedef struct
+{
+    long writes;            // Chamadas a pwrite
+    long long bytes;        // Bytes escritos
+    double writeMs;         // Tempo dentro do pwrite (thread do sink)
+    double stallMs;         // Espera da etapa de escrita por um buffer livre
+    double syncMs;          // Tempo do fsync final
+    int preallocated;       // O fallocate reservou o espaço do ficheiro
+    long long holeBytes;    // Bytes recriados como buracos (writeSinkHole)
+    int holesPunched;       // O sistema de ficheiros aceitou FALLOC_FL_PUNCH_HOLE
+} WriteSinkStats;
+
+typedef struct
+{
+    unsigned char *data;
+    long long offset;       // Posição no ficheiro do primeiro byte
+    int length;
+    int limit;              // Bytes até ao fim alinhado do buffer
+} WriteSinkBuffer;
+
+typedef struct
+{
+    int fd;
+    WriteSinkBuffer buffers[WRITE_SINK_BUFFERS];
+    int fillIndex;          // Buffer a ser enchido (só a etapa de escrita mexe nele)
+    int flushIndex;         // Próximo buffer a escrever pela thread
+    int pending;            // Buffers cheios à espera (ou a ser escritos)
+    int stop;
+    int failed;             // Um pwrite falhou
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    WriteSinkStats stats;
+} WriteSink;
+
+// Reserva os buffers e arranca a thread que escreve em fd.
+// Returns 0 on success, -1 on error.
+int writeSinkOpen(WriteSink *sink, int fd);
+
+// Reserva no disco size bytes para o ficheiro (fallocate sem mudar o tamanho),
+// para as escritas não esperarem pela alocação de blocos nem fragmentarem.
+// Returns 0 on success, -1 if the file system does not support it.
+int writeSinkPreallocate(WriteSink *sink, long long size);
+
+// Copia size bytes de data para a posição offset do ficheiro (escritos mais tarde).
+// Returns 0 on success, -1 if an earlier write failed.
+int writeSinkWrite(WriteSink *sink, const unsigned char *data, int size, long long offset);
+
+// Deixa [offset, offset + size) do ficheiro a zeros sem escrever os zeros:
+// liberta os blocos com FALLOC_FL_PUNCH_HOLE e estende o ficheiro se o buraco
+// passar do fim. Sem suporte no sistema de ficheiros escreve os zeros.
+// Returns 0 on success, -1 on error.
+int writeSinkHole(WriteSink *sink, long long offset, long long size);
+
+// Espera até todos os dados copiados estarem escritos no ficheiro (sem fsync).
+// Returns 0 on success, -1 if a write failed.
+int writeSinkFlush(WriteSink *sink);
+
+// writeSinkFlush seguido de fsync.
+// Returns 0 on success, -1 on error.
+int writeSinkSync(WriteSink *sink);
+
+// Escreve o que falta, para a thread e liberta os buffers (não fecha fd).
+void writeSinkClose(WriteSink *sink);
+
+#endif // _WRITE_SINK_H_
@@ -1,22 +1,282 @@
 #include <stdio.h>     
 #include <stdlib.h>    
 #include <string.h>    
+#include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "application_layer.h"
 #include "link_layer.h"
 #include "serial_port.h"
+#include "frame_pool.h"
+#include "link_layer_ext.h"
+#include "spsc_queue.h"
+#include "range_bitmap.h"
+#include "checkpoint_journal.h"
+#include "file_batch.h"
+#include "auto_tuner.h"
+#include "file_source.h"
+#include "write_sink.h"
+#include "content_hash.h"
+#include "delta.h"
+#include "chunker.h"
+#include "chunk_store.h"
+#include "progress.h"
+#include "link_metrics.h"
+
+#define DATA_MAX_CHUNK 0xFFFF   // Maior bloco do ficheiro num pacote de dados (campo de tamanho de 16 bits)
+#define LEGACY_CHUNK_SIZE 256   // Bloco dos pacotes para um par sem negociação (o receptor original não aceita mais)
+#define PIPELINE_DEPTH 4        // Capacidade de cada fila do pipeline
+#define LINK_SERVICE_MS 10      // Tx: espera pela fila entre duas passagens pela porta (llService)
+
+// Pacotes de dados: o original (C = 0x01) leva um número de sequência de 8 bits
+// e os dados vão para o fim do ficheiro; o com offset (C = 0x05) leva a posição
+// de 64 bits e o receptor escreve-o aí com pwrite, por qualquer ordem. Só é
+// usado se os dois lados negociaram NEGOTIATION_VERSION_OFFSETS no llopen.
+#define PACKET_DATA_OFFSET 0x05
+#define DATA_HEADER_SIZE 4          // C, N, L2, L1
+#define DATA_OFFSET_HEADER_SIZE 11  // C, offset (8 bytes), L2, L1
+#define DATA_HEADROOM DATA_OFFSET_HEADER_SIZE   // Reservado antes dos dados lidos para o cabeçalho
+
+// Campos (T) do pacote de controlo
+#define CONTROL_FILE_SIZE 0
+#define CONTROL_FILE_NAME 1
+#define CONTROL_BLOCK_SIZE 2        // Dados por pacote com offset (blocos do mapa do receptor)
+#define CONTROL_FILE_HASH 3         // Hash do conteúdo (identidade do ficheiro para a retoma)
+#define CONTROL_RESUME 4            // Pedido de retoma: o receptor responde com o offset (llReply)
+#define CONTROL_BATCH 5             // Posição do ficheiro no lote (o nome é o caminho relativo)
+#define CONTROL_CONTENT_HASH 6      // Fim: primeiro byte enviado na sessão e hash dos dados (8 + 8 bytes)
+#define CONTROL_DELTA 7             // Pedido de delta: tamanho dos blocos das assinaturas (4 bytes)
+#define CONTROL_DEDUP 8             // Pedido de dedup (sem valor): o receptor responde com os pedaços do armazém
+
+// Streams (NEGOTIATION_VERSION_STREAM): de um pipe ou do stdin ("-") o tamanho
+// não se sabe no início. O pacote de início leva CONTROL_FILE_SIZE a -1, sem
+// blocos nem retoma, e o pacote de fim leva o tamanho final, que o receptor
+// compara com o que escreveu. A memória usada é a mesma de um ficheiro (o pool
+// e as filas do pipeline), qualquer que seja o tamanho do stream.
+#define STREAM_SIZE_UNKNOWN -1
+
+// Verificação do conteúdo: o transmissor calcula o hash dos dados na etapa de
+// leitura e o receptor na de escrita, pela ordem dos offsets, e o pacote de
+// fim leva o do transmissor (CONTROL_CONTENT_HASH). Numa retoma os dois
+// começam no offset acordado. Um receptor sem este campo ignora-o.
+#define CONTENT_HASH_FIELD_SIZE 16
+
+// Delta (NEGOTIATION_VERSION_DELTA, RCOM_DELTA=1 no transmissor): o pacote de
+// início leva CONTROL_DELTA e o receptor responde (llReply) com o tamanho da
+// cópia que já tem do ficheiro. O transmissor pede as assinaturas dos blocos
+// dessa cópia em pacotes C = 0x08 (primeiro bloco, 4 bytes, e quantos, 2
+// bytes) e o receptor responde com uma resposta por bloco: o índice (3 bytes),
+// a soma fraca (4) e o hash forte (8). Depois o ficheiro vai em pacotes com
+// offset, só com os dados que não estão na cópia, e em referências para os
+// blocos que estão: C = 0x07, o offset no ficheiro novo (8 bytes), o primeiro
+// bloco da cópia (4) e quantos blocos seguidos (2). O receptor escreve num
+// ficheiro temporário e só o troca com a cópia antiga se chegar completo.
+#define PACKET_DELTA_COPY 0x07
+#define PACKET_DELTA_REQUEST 0x08
+#define DELTA_COPY_SIZE 15
+#define DELTA_REQUEST_SIZE 7
+#define DELTA_SIGNATURE_SIZE 15     // Cabe numa resposta (LL_REPLY_MAX_SIZE)
+#define DELTA_REQUEST_BLOCKS 64     // Assinaturas por pedido
+#define DELTA_REPLY_MS 1000
+#define DELTA_MAX_RUN 0xFFFF        // Blocos numa referência
+#define DELTA_SCAN_BUFFER (4 * 65536)   // Janela de procura do transmissor: um pacote de dados e um bloco cabem sempre
+#define DELTA_SUFFIX ".delta"
+
+// Buracos (NEGOTIATION_VERSION_HOLES; RCOM_SPARSE=0 desliga): os buracos de
+// um ficheiro esparso (SEEK_DATA/SEEK_HOLE) e os pacotes só com zeros não são
+// enviados. Em vez deles vai C = 0x09 com o offset (8 bytes) e o tamanho (8
+// bytes) da zona a zeros, que o receptor recria com FALLOC_FL_PUNCH_HOLE.
+// Buracos seguidos juntam-se num só pacote. Cobrem sempre blocos inteiros,
+// como os pacotes de dados, para o mapa de blocos do receptor.
+#define PACKET_HOLE 0x09
+#define HOLE_PACKET_SIZE 17
+#define HOLE_MAX_LENGTH (1LL << 30)
+
+// Dedup (NEGOTIATION_VERSION_DEDUP, RCOM_DEDUP=1 no transmissor): o receptor
+// guarda os pedaços dos ficheiros que recebe num armazém (RCOM_CHUNK_STORE,
+// por omissão CHUNK_STORE_DEFAULT na diretoria atual) que fica de uma sessão
+// para a outra. O transmissor corta o ficheiro com cortes definidos pelo
+// conteúdo (chunker.h), envia o pacote de início com CONTROL_DEDUP (a resposta
+// é o número de pedaços no armazém, -1 sem armazém) e oferece os hashes em
+// pacotes C = 0x0A: o primeiro pedaço (4 bytes), o seu offset (8), quantos (1)
+// e, por pedaço, o hash (8) e o tamanho (4). A resposta (llReply) leva o
+// primeiro pedaço e um bit por pedaço que o receptor já tem. Esses vão em
+// referências C = 0x0B: o offset (8 bytes), quantos (1) e os pedaços (hash e
+// tamanho); os outros em pacotes de dados. Com o ficheiro completo e o hash do
+// conteúdo verificado, o receptor acrescenta ao armazém os pedaços que faltavam.
+#define PACKET_DEDUP_OFFER 0x0A
+#define PACKET_DEDUP_COPY 0x0B
+#define DEDUP_OFFER_HEADER 14
+#define DEDUP_COPY_HEADER 10
+#define DEDUP_ENTRY_SIZE 12
+#define DEDUP_BATCH 64              // Pedaços por oferta (um bit de cada na resposta) e por referência
+#define DEDUP_REPLY_SIZE 12
+#define DEDUP_REPLY_MS 1000
+#define DEDUP_READ_BUFFER (1 << 20) // Leitura dos cortes: muitos pedaços por leitura
+#define CHUNK_STORE_DEFAULT ".rcom_chunks"
+
+// Lotes (NEGOTIATION_VERSION_BATCH): com uma diretoria o transmissor envia
+// todos os ficheiros numa só sessão, cada um entre um pacote de início (com
+// CONTROL_BATCH) e um de fim, e o receptor recria-os dentro da diretoria que
+// lhe foi dada. Os ficheiros que cabem inteiros num pacote vão juntos em
+// pacotes agrupados: C = 0x06 e, por ficheiro, o tamanho do nome (1 byte), o
+// nome, o tamanho dos dados (2 bytes) e os dados. O lote acaba com C = 0x04.
+#define PACKET_BATCH_END 0x04
+#define PACKET_PACKED 0x06
+#define PACKED_ENTRY_HEADER 3       // Tamanho do nome e tamanho dos dados
+
+// Retoma (NEGOTIATION_VERSION_RESUME): o receptor guarda num diário os blocos
+// já escritos no disco, com um checkpoint a cada JOURNAL_CHECKPOINT_MS ou
+// JOURNAL_CHECKPOINT_BYTES. Ao pedido do pacote de início responde com o fim do
+// prefixo contíguo se a identidade do ficheiro for a mesma, e o transmissor
+// continua daí.
+#define JOURNAL_CHECKPOINT_MS 1000
+#define JOURNAL_CHECKPOINT_BYTES (4 * 1024 * 1024)
+#define JOURNAL_PATH_SIZE 4096
+#define RESUME_REQUEST_TRIES 3
+#define RESUME_REPLY_MS 1000
+
+// Marcas dos elementos que circulam nas filas do pipeline. PIPE_SLICE é uma
+// fatia do ficheiro mapeado (ptr aponta para o mapa, não para uma trama do pool).
+// PIPE_PACKET é um pacote já completo na trama do pool (referência do delta ou buraco).
+enum { PIPE_DATA, PIPE_EOF, PIPE_ERROR, PIPE_SLICE, PIPE_PACKET };
+
+// Pedaço do dedup (cortes do chunker.h)
+typedef struct {
+    long long offset;
+    unsigned long long hash;
+    int length;
+    int stored;             // Tx: o receptor já o tem no armazém
+} DedupChunk;
+
+// Estado partilhado pelas três etapas de um pipeline (tx ou rx)
+typedef struct {
+    FILE *file;
+    SpscQueue first;        // Etapa 1 -> etapa 2
+    SpscQueue second;       // Etapa 2 -> etapa 3
+    atomic_int abort;       // Pedido de paragem depois de um erro
+    double poolStallMs[2];  // Espera por tramas livres nas etapas 1 e 2
+    long long appendOffset; // Rx: onde vão os dados dos pacotes sem offset
+    RangeBitmap received;   // Rx: blocos recebidos (só com pacotes com offset)
+    int tracking;           // Rx: o pacote de controlo inicial anunciou os blocos
+    long long startOffset;  // Tx: primeiro byte a enviar (retoma)
+    FileSource source;      // Tx: leitura do ficheiro (mmap ou fread)
+    WriteSink sink;         // Rx: escrita diferida do ficheiro
+    atomic_int packetBlocks;    // Tx: blocos de dataBlockSize() bytes por pacote (auto-tuner)
+    long packetsBuilt;      // Tx: pacotes de dados montados na etapa de codificação...
+    double buildNs;         // ...e o tempo gasto no cabeçalho e no stuffing
+    FramePoolStats poolStart;   // Tx: contadores do pool no início do ficheiro
+    // Rx: diário para retomar (só se o transmissor enviou a identidade do ficheiro)
+    int journaling;
+    int hasJournal;         // Havia um diário de uma transferência anterior
+    long long resumeOffset; // Resposta ao pedido de retoma
+    CheckpointJournal journal;
+    char journalPath[JOURNAL_PATH_SIZE];
+    RangeBitmap written;    // Blocos já escritos (etapa de escrita)
+    long long uncheckpointed;   // Bytes escritos desde o último checkpoint
+    struct timespec lastCheckpoint;
+    int streaming;          // Rx: tamanho desconhecido no pacote de início
+    long long writtenEnd;   // Rx: fim dos dados mais adiantados (etapa de escrita)
+    ContentHash hash;       // Dados lidos (tx) ou escritos (rx) nesta sessão
+    long long hashStart;    // Primeiro byte no hash
+    long long hashEnd;      // Rx: fim dos dados já no hash
+    int hashGap;            // Rx: chegaram dados depois de um buraco (o hash não se pode verificar)
+    double hashNs;          // Tempo gasto no hash
+    // Delta
+    int delta;              // Tx: há assinaturas da cópia do receptor; rx: o transmissor pediu o delta
+    DeltaIndex index;       // Tx: assinaturas dos blocos da cópia do receptor
+    FILE *basis;            // Rx: cópia anterior do ficheiro (só leitura)
+    long long basisSize;    // Rx
+    int deltaBlockSize;     // Rx: tamanho dos blocos das assinaturas
+    long long literalBytes; // Bytes em pacotes de dados
+    long long copiedBytes;  // Bytes em referências (para a cópia anterior ou para o armazém)
+    long references;
+    // Buracos
+    int sparse;             // Tx: enviar as zonas a zeros como buracos
+    long long zeroBytes;    // Tx: bytes em pacotes só com zeros (os dos buracos do ficheiro estão na origem)
+    long holePackets;
+    // Dedup
+    int dedup;              // Tx: o receptor disse que pedaços tem; rx: o transmissor pediu o dedup
+    DedupChunk *chunks;     // Tx: pedaços do ficheiro; rx: pedaços oferecidos que não estavam no armazém
+    int chunkCount;
+    int chunkCapacity;
+    long long offeredEnd;   // Rx: fim dos pedaços já oferecidos (as ofertas repetidas não contam)
+    // Progresso: fim dos dados passados ao pipeline (tx) ou escritos (rx), lido pela ligação
+    atomic_llong progressEnd;
+} Pipeline;
+
+static int negotiatedPeer = FALSE;  // O outro lado negociou os parâmetros no llopen
+static int offsetPackets = FALSE;   // Tx: o receptor aceita pacotes com offset
+static int resumePeer = FALSE;      // O outro lado aceita pedidos de retoma
+static int batchPeer = FALSE;       // O outro lado aceita lotes de ficheiros
+static int streamPeer = FALSE;      // O receptor aceita ficheiros de tamanho desconhecido
+static int deltaPeer = FALSE;       // O receptor envia as assinaturas da cópia que já tem
+static int deltaMode = FALSE;       // Tx: enviar só as diferenças (RCOM_DELTA)
+static int holesPeer = FALSE;       // O receptor aceita pacotes de buracos
+static int sparseMode = TRUE;       // Tx: enviar as zonas a zeros como buracos (RCOM_SPARSE)
+static int dedupPeer = FALSE;       // O receptor tem um armazém de pedaços
+static int dedupMode = FALSE;       // Tx: oferecer os pedaços antes de os enviar (RCOM_DEDUP)
+static ChunkStore chunkStore;       // Rx: aberto no primeiro pedido de dedup
+static int chunkStoreState = 0;     // 0 ainda não aberto, 1 aberto, -1 falhou
+static int batchMode = FALSE;       // Vários ficheiros na sessão: sem estatísticas por ficheiro
+static int multiBlockPeer = FALSE;  // O receptor aceita pacotes com vários blocos
+static int daemonMode = FALSE;      // Rx: sessões seguidas para uma diretoria (RCOM_DAEMON)
+static long daemonSessions = 0;     // Sessão atual do daemon
+static int tuning = FALSE;          // Tx: auto-tuner ativo (RCOM_AUTOTUNE)
+static AutoTuner tuner;
+static Metrics metrics;             // Segmento de métricas (RCOM_METRICS)
+static MetricsValues metricsValues; // O que não vem da ligação: porta, ficheiros e progresso
+static MetricsValues metricsBase;   // Contadores das sessões anteriores (daemon)
 
 // Declaración de funciones auxiliares utilizadas en la capa de aplicación
 static int startTransmission(const char *filename);
+static int transmitFile(const char *path, const char *name, int batchIndex);
+static int transmitBatch(const char *dir);
 static int startReception(const char *filename);
+static int receiveFile(const char *filename, FrameSlot *first, int firstSize);
+static int receiveBatch(const char *dir, FrameSlot *packet, int packetSize);
+static const unsigned char *controlField(const unsigned char *packet, int size, unsigned char type, int *length);
 static FILE* openFile(const char *filename, const char *mode);
 static long calculateFileSize(FILE *file);
-static unsigned char* createControlPacket(unsigned char type, const char *filename, long fileSize);
+static long long controlFileSize(const unsigned char *packet, int size);
+static int buildControlPacket(unsigned char *packet, int capacity, unsigned char type, const char *filename,
+                              long fileSize, int blockSize);
+static FrameSlot* createControlPacket(unsigned char type, const char *filename, long fileSize, int blockSize);
+static int addControlField(FrameSlot *slot, unsigned char type, const unsigned char *value, int length);
+static int addResumeRequest(FrameSlot *slot, unsigned long long hash);
+static int addContentHash(FrameSlot *slot, Pipeline *pipe);
+static long long requestResume(FrameSlot *controlPacket, long fileSize);
+static int requestSignatures(Pipeline *pipe, FrameSlot *controlPacket, int blockSize);
+static int answerSignatures(Pipeline *pipe, const unsigned char *packet, int size);
+static int offerChunks(Pipeline *pipe, FrameSlot *controlPacket, FILE *file);
+static int answerOffer(Pipeline *pipe, const unsigned char *packet, int size);
+static int growChunks(Pipeline *pipe);
+static int dedupEntriesPerPacket(int header);
 static int sendControlPacket(unsigned char *packet, int packetSize);
-static unsigned char* createDataPacket(unsigned char sequence, const unsigned char *data, int dataSize);
+static int writeDataHeader(unsigned char *data, unsigned char sequence, long long offset, int dataSize);
+static int dataChunkSize();
+static int dataBlockSize();
+static void applyTuning(Pipeline *pipe);
 static unsigned char getNextSequence(unsigned char sequence);
+static int pipelineInit(Pipeline *pipe, FILE *file);
+static void startStage(pthread_t *thread, void *(*stage)(void *), Pipeline *pipe);
+static FrameSlot *acquireSlot(Pipeline *pipe, int stage);
+static void printPipelineStats(Pipeline *pipe, const char *stage1, const char *stage2, const char *stage3);
+static void printPacketStats(Pipeline *pipe);
+static void printSinkStats(Pipeline *pipe);
+static void updateHash(Pipeline *pipe, const unsigned char *data, int size);
+static void publishMetrics(Pipeline *pipe);
+static void addSessionMetrics();
+static void closeMetrics();
+static void startSession(const LinkLayer *config);
+static void startMetrics(const LinkLayer *config);
+static void runDaemon(LinkLayer config, const char *spoolDir);
+static int spoolPath(const char *dir, const unsigned char *packet, int size, char *path, int pathSize);
 
 ////////////////////////////////////////////////
 // APPLICATION LAYER - Gestor principal da camada de aplicação
@@ -38,24 +298,39 @@ void applicationLayer(const char *serialPort, const char *mode, int baudRate, in
     };
     strcpy(config.serialPort, serialPort);
 
+    // O perfil da porta pode escolher o enquadramento: tem de ser antes do llopen
+    tuning = config.role == LlTx && autoTunerEnabled();
+    if (tuning) autoTunerPrepare(&tuner, serialPort);
+
+    // Receptor em modo daemon: sessões seguidas, sem voltar a abrir a porta
+    const char *option = getenv("RCOM_DAEMON");
+    if (config.role == LlRx && option != NULL && atoi(option) != 0) {
+        runDaemon(config, filename);
+        return;
+    }
+
     // Abre a conexão serial usando llopen
     if (llopen(config) < 0) {
-        perror("Erro ao abrir conexão\n");
+        fprintf(stderr, "Erro ao abrir conexão: %s\n", llErrorString(llLastError()));
         exit(-1);
     }
+    startSession(&config);
+    startMetrics(&config);
 
     // Marca o tempo de início para medir a duração da transmissão
     clock_t start = clock();
+    struct timespec wallStart, wallEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
 
     // Escolha entre transmissão e recepção, conforme o papel da conexão
     if (config.role == LlTx) {
         if (startTransmission(filename) < 0) {
-            perror("Erro durante a transmissão\n");
+            fprintf(stderr, "Erro durante a transmissão: %s\n", llErrorString(llLastError()));
             exit(-1);
         }
     } else if (config.role == LlRx) {
         if (startReception(filename) < 0) {
-            perror("Erro durante a recepção\n");
+            fprintf(stderr, "Erro durante a recepção: %s\n", llErrorString(llLastError()));
             exit(-1);
         }
     }
@@ -64,82 +339,1667 @@ void applicationLayer(const char *serialPort, const char *mode, int baudRate, in
     clock_t end = clock();
     printf("Tempo de transmissão: %.2f segundos\n", (double)(end - start) / CLOCKS_PER_SEC);
 
+    // O débito da sessão fica no perfil, para a escolha do enquadramento
+    if (tuning) {
+        LlCounters counters;
+        llCounters(&counters);
+        clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+        double seconds = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1.0e9;
+        autoTunerFinish(&tuner, seconds > 0 ? counters.ackedBytes / seconds : 0);
+    }
+
+    if (chunkStoreState > 0) chunkStoreClose(&chunkStore);
+
     // Fecha a conexão serial
     llclose(1);
+    publishMetrics(NULL);
+}
+
+// Lê os parâmetros acordados no llopen e as opções da sessão
+static void startSession(const LinkLayer *config) {
+    LinkCapabilities session;
+    negotiatedPeer = llSessionParameters(&session);
+    offsetPackets = negotiatedPeer && session.version >= NEGOTIATION_VERSION_OFFSETS;
+    resumePeer = negotiatedPeer && session.version >= NEGOTIATION_VERSION_RESUME;
+    batchPeer = negotiatedPeer && session.version >= NEGOTIATION_VERSION_BATCH;
+    streamPeer = negotiatedPeer && session.version >= NEGOTIATION_VERSION_STREAM;
+    multiBlockPeer = offsetPackets && session.version >= NEGOTIATION_VERSION_MULTIBLOCK;
+    deltaPeer = offsetPackets && session.version >= NEGOTIATION_VERSION_DELTA;
+    const char *option = getenv("RCOM_DELTA");
+    deltaMode = config->role == LlTx && option != NULL && atoi(option) != 0;
+    holesPeer = offsetPackets && session.version >= NEGOTIATION_VERSION_HOLES;
+    option = getenv("RCOM_SPARSE");
+    sparseMode = option == NULL || atoi(option) != 0;
+    dedupPeer = offsetPackets && session.version >= NEGOTIATION_VERSION_DEDUP;
+    option = getenv("RCOM_DEDUP");
+    dedupMode = config->role == LlTx && option != NULL && atoi(option) != 0;
+    batchMode = FALSE;
+    if (tuning) {
+        autoTunerStart(&tuner, multiBlockPeer ? TUNER_MAX_BLOCKS : 1, session.framingMask == FRAMING_WINDOW,
+                       session.timeout * 1000, session.retries);
+    }
+}
+
+// Métricas para outros processos: só a thread da ligação as publica
+static void startMetrics(const LinkLayer *config) {
+    if (metricsCreate(&metrics) < 0) {
+        if (errno == EEXIST) {
+            printf("Aviso: o segmento de métricas %s é de outro processo, métricas desligadas\n", metrics.name + 1);
+        } else {
+            printf("Aviso: não foi possível criar o segmento de métricas (RCOM_METRICS)\n");
+        }
+    } else if (metrics.segment != NULL) {
+        metricsValues.pid = getpid();
+        metricsValues.transmitter = config->role == LlTx;
+        snprintf(metricsValues.port, sizeof(metricsValues.port), "%s", config->serialPort);
+        metricsValues.fileTotal = -1;
+        atexit(closeMetrics);
+        publishMetrics(NULL);
+    }
+}
+
+// Receptor em modo daemon (RCOM_DAEMON=1): a porta fica aberta e configurada
+// entre sessões e cada sessão (llopen ... llclose) escreve os ficheiros em
+// spoolDir, com o nome do pacote de início (um lote recria lá as suas
+// diretorias). Uma sessão que falha não termina o daemon; só um erro da porta.
+static void runDaemon(LinkLayer config, const char *spoolDir) {
+    if (mkdir(spoolDir, 0755) < 0 && !fileBatchIsDirectory(spoolDir)) {
+        fprintf(stderr, "Erro: não foi possível criar a diretoria %s\n", spoolDir);
+        exit(-1);
+    }
+    daemonMode = TRUE;
+    llKeepPortOpen(TRUE);
+    startMetrics(&config);
+    for (daemonSessions = 1;; daemonSessions++) {
+        // Os contadores da ligação recomeçam em cada llopen: os das métricas não
+        addSessionMetrics();
+        printf("Daemon: à espera da sessão %ld em %s\n", daemonSessions, config.serialPort);
+        fflush(stdout);
+        if (llopen(config) < 0) {
+            fprintf(stderr, "Erro ao abrir conexão: %s\n", llErrorString(llLastError()));
+            if (llLastError() == LL_ERROR_IO) break;
+            continue;
+        }
+        startSession(&config);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int result = startReception(spoolDir);
+        if (result < 0) {
+            fprintf(stderr, "Erro durante a recepção (sessão %ld): %s\n", daemonSessions,
+                    llErrorString(llLastError()));
+        }
+        llclose(1);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Daemon: sessão %ld %s em %.2f s\n", daemonSessions, result < 0 ? "falhou" : "terminada",
+               (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9);
+        fflush(stdout);             // O log de um daemon costuma ir para um ficheiro
+        publishMetrics(NULL);
+    }
+    llKeepPortOpen(FALSE);
+    if (chunkStoreState > 0) chunkStoreClose(&chunkStore);
+    exit(-1);
+}
+
+// Zona a zeros ainda por enviar (juntam-se as seguidas)
+typedef struct {
+    long long offset;
+    long long length;
+} PendingHole;
+
+static const unsigned char zeroBlock[65536];
+
+// Returns 1 if all size bytes of data are zero.
+static int isZero(const unsigned char *data, int size) {
+    // O memcmp da libc compara com instruções vetoriais mesmo sem otimização
+    return size > 0 && data[0] == 0 && memcmp(data, data + 1, size - 1) == 0;
+}
+
+// Acrescenta size zeros ao hash do conteúdo
+static void hashZeros(Pipeline *pipe, long long size) {
+    while (size > 0) {
+        int chunk = size < (long long)sizeof(zeroBlock) ? size : (int)sizeof(zeroBlock);
+        updateHash(pipe, zeroBlock, chunk);
+        size -= chunk;
+    }
+}
+
+// Envia o buraco pendente (se houver) num pacote C = 0x09
+static int sendHole(Pipeline *pipe, PendingHole *hole) {
+    if (hole->length == 0) return 0;
+    FrameSlot *slot = acquireSlot(pipe, 0);
+    if (slot == NULL) return -1;
+    unsigned char *packet = slot->data;
+    packet[0] = PACKET_HOLE;
+    for (int i = 0; i < 8; i++) {
+        packet[1 + i] = (hole->offset >> (8 * (7 - i))) & 0xFF;
+        packet[9 + i] = (hole->length >> (8 * (7 - i))) & 0xFF;
+    }
+    slot->length = HOLE_PACKET_SIZE;
+    spscPush(&pipe->first, (SpscItem){slot, HOLE_PACKET_SIZE, PIPE_PACKET, hole->offset});
+    pipe->holePackets++;
+    hole->length = 0;
+    return 0;
+}
+
+// Junta [offset, offset + length) ao buraco pendente, enviando-o quando não
+// é contíguo ou chega ao máximo (em blocos inteiros)
+static int addHole(Pipeline *pipe, PendingHole *hole, long long offset, long long length) {
+    long long limit = HOLE_MAX_LENGTH - HOLE_MAX_LENGTH % dataBlockSize();
+    hashZeros(pipe, length);
+    while (length > 0) {
+        if (hole->length > 0 && (hole->offset + hole->length != offset || hole->length == limit) &&
+            sendHole(pipe, hole) < 0) {
+            return -1;
+        }
+        if (hole->length == 0) hole->offset = offset;
+        long long chunk = limit - hole->length < length ? limit - hole->length : length;
+        hole->length += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Etapa de leitura (tx): com o ficheiro mapeado passa fatias do mapa; senão lê
+// o ficheiro para tramas do pool, depois do espaço reservado para o cabeçalho.
+// As zonas a zeros (buracos do ficheiro ou pacotes só com zeros) viram buracos.
+static void *readerStage(void *arg) {
+    Pipeline *pipe = arg;
+    int tag = PIPE_EOF;
+    long long offset = pipe->startOffset;
+    PendingHole hole = {0, 0};
+
+    while (!atomic_load(&pipe->abort)) {
+        atomic_store_explicit(&pipe->progressEnd, offset, memory_order_relaxed);
+
+        // O auto-tuner pode mudar o tamanho dos pacotes a meio: sempre em blocos inteiros
+        int chunkSize = dataBlockSize() * atomic_load(&pipe->packetBlocks);
+
+        // Buracos do ficheiro: saltados sem os ler (cortados em blocos inteiros,
+        // salvo o que vai até ao fim)
+        if (pipe->sparse) {
+            long long skip = fileSourceHole(&pipe->source);
+            if (offset + skip < pipe->source.fileSize) skip -= skip % dataBlockSize();
+            if (skip > 0) {
+                if (fileSourceSkip(&pipe->source, skip) < 0 || addHole(pipe, &hole, offset, skip) < 0) {
+                    tag = PIPE_ERROR;
+                    break;
+                }
+                offset += skip;
+                continue;
+            }
+        }
+
+        if (fileSourceMapped(&pipe->source)) {
+            const unsigned char *slice;
+            int sliceSize = fileSourceSlice(&pipe->source, chunkSize, &slice);
+            if (sliceSize == 0) break;
+            if (pipe->sparse && isZero(slice, sliceSize)) {
+                if (addHole(pipe, &hole, offset, sliceSize) < 0) {
+                    tag = PIPE_ERROR;
+                    break;
+                }
+                pipe->zeroBytes += sliceSize;
+                offset += sliceSize;
+                continue;
+            }
+            if (sendHole(pipe, &hole) < 0) {
+                tag = PIPE_ERROR;
+                break;
+            }
+            updateHash(pipe, slice, sliceSize);
+            spscPush(&pipe->first, (SpscItem){(void *)slice, sliceSize, PIPE_SLICE, offset});
+            offset += sliceSize;
+            continue;
+        }
+
+        FrameSlot *slot = acquireSlot(pipe, 0);
+        if (slot == NULL) break;
+        int bytesRead = fileSourceRead(&pipe->source, slot->data + DATA_HEADROOM, chunkSize);
+        if (bytesRead <= 0) {
+            framePoolRelease(slot);
+            if (bytesRead < 0) tag = PIPE_ERROR;
+            break;
+        }
+        if (pipe->sparse && isZero(slot->data + DATA_HEADROOM, bytesRead)) {
+            framePoolRelease(slot);
+            if (addHole(pipe, &hole, offset, bytesRead) < 0) {
+                tag = PIPE_ERROR;
+                break;
+            }
+            pipe->zeroBytes += bytesRead;
+            offset += bytesRead;
+            continue;
+        }
+        if (sendHole(pipe, &hole) < 0) {
+            framePoolRelease(slot);
+            tag = PIPE_ERROR;
+            break;
+        }
+        slot->length = bytesRead;
+        updateHash(pipe, slot->data + DATA_HEADROOM, bytesRead);
+        spscPush(&pipe->first, (SpscItem){slot, bytesRead, PIPE_DATA, offset});
+        offset += bytesRead;
+    }
+    if (tag == PIPE_EOF && !atomic_load(&pipe->abort) && sendHole(pipe, &hole) < 0) tag = PIPE_ERROR;
+    atomic_store_explicit(&pipe->progressEnd, offset, memory_order_relaxed);
+    spscPush(&pipe->first, (SpscItem){NULL, 0, tag});
+    return NULL;
+}
+
+// Etapa de codificação (tx): cria o pacote de dados e monta a trama com stuffing
+static void *encoderStage(void *arg) {
+    Pipeline *pipe = arg;
+    unsigned char sequence = 0;
+    int failed = 0;
+    SpscItem item;
+
+    for (;;) {
+        spscPop(&pipe->first, &item);
+        if (item.tag != PIPE_DATA && item.tag != PIPE_SLICE && item.tag != PIPE_PACKET) break;
+
+        // Depois de um erro na ligação só esvazia a fila
+        FrameSlot *chunk = item.tag != PIPE_SLICE ? item.ptr : NULL;
+        if (atomic_load(&pipe->abort)) {
+            framePoolRelease(chunk);
+            continue;
+        }
+
+        // O cabeçalho vai para o espaço antes dos dados lidos, ou para um buffer
+        // local com uma fatia do mapa; o stuffing lê as duas partes de onde
+        // estão e escreve-as na trama que a ligação envia
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        unsigned char sliceHeader[DATA_HEADROOM];
+        unsigned char *data = chunk != NULL ? chunk->data + DATA_HEADROOM : item.ptr;
+        unsigned char *headerEnd = chunk != NULL ? data : sliceHeader + DATA_HEADROOM;
+        int header;
+        if (item.tag == PIPE_PACKET) {  // Referência do delta ou buraco: o pacote já está completo
+            data = headerEnd = chunk->data;
+            header = 0;
+        } else {
+            header = writeDataHeader(headerEnd, sequence, item.offset, item.len);
+        }
+        FrameSlot *frame = header >= 0 ? acquireSlot(pipe, 1) : NULL;
+        if (frame == NULL || llEncodeFrameParts(headerEnd - header, header, data, item.len, frame) < 0) {
+            framePoolRelease(chunk);
+            framePoolRelease(frame);
+            atomic_store(&pipe->abort, 1);
+            failed = 1;
+            continue;
+        }
+        framePoolRelease(chunk);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pipe->buildNs += (end.tv_sec - start.tv_sec) * 1.0e9 + (end.tv_nsec - start.tv_nsec);
+        pipe->packetsBuilt++;
+        spscPush(&pipe->second, (SpscItem){frame, header + item.len, PIPE_DATA});
+        sequence = getNextSequence(sequence);  // Atualiza a sequência
+    }
+    spscPush(&pipe->second, (SpscItem){NULL, 0, failed ? PIPE_ERROR : item.tag});
+    return NULL;
+}
+
+// Referência do delta a ser juntada: blocos seguidos da cópia para offsets seguidos
+typedef struct {
+    long long offset;
+    int block;
+    int count;
+} DeltaRun;
+
+// Lê o ficheiro para a janela do delta (do mapa ou com fread)
+static int readDeltaSource(Pipeline *pipe, unsigned char *buf, int size) {
+    if (!fileSourceMapped(&pipe->source)) return fileSourceRead(&pipe->source, buf, size);
+    const unsigned char *slice;
+    int sliceSize = fileSourceSlice(&pipe->source, size, &slice);
+    memcpy(buf, slice, sliceSize);
+    return sliceSize;
+}
+
+// Envia size bytes do ficheiro novo (que não estão na cópia) em pacotes de dados
+static int sendLiterals(Pipeline *pipe, const unsigned char *data, int size, long long offset, int chunkSize) {
+    while (size > 0) {
+        FrameSlot *slot = acquireSlot(pipe, 0);
+        if (slot == NULL) return -1;
+        int chunk = size < chunkSize ? size : chunkSize;
+        memcpy(slot->data + DATA_HEADROOM, data, chunk);
+        slot->length = chunk;
+        updateHash(pipe, data, chunk);
+        spscPush(&pipe->first, (SpscItem){slot, chunk, PIPE_DATA, offset});
+        pipe->literalBytes += chunk;
+        data += chunk;
+        size -= chunk;
+        offset += chunk;
+    }
+    return 0;
+}
+
+// Envia a referência pendente (se houver) num pacote C = 0x07
+static int sendRun(Pipeline *pipe, DeltaRun *run) {
+    if (run->count == 0) return 0;
+    FrameSlot *slot = acquireSlot(pipe, 0);
+    if (slot == NULL) return -1;
+    unsigned char *packet = slot->data;
+    packet[0] = PACKET_DELTA_COPY;
+    for (int i = 0; i < 8; i++) packet[1 + i] = (run->offset >> (8 * (7 - i))) & 0xFF;
+    for (int i = 0; i < 4; i++) packet[9 + i] = (run->block >> (8 * (3 - i))) & 0xFF;
+    packet[13] = (run->count >> 8) & 0xFF;
+    packet[14] = run->count & 0xFF;
+    slot->length = DELTA_COPY_SIZE;
+    spscPush(&pipe->first, (SpscItem){slot, DELTA_COPY_SIZE, PIPE_PACKET, run->offset});
+    pipe->copiedBytes += (long long)run->count * pipe->index.blockSize;
+    pipe->references++;
+    run->count = 0;
+    return 0;
+}
+
+// Etapa de leitura do delta (tx): passa uma janela do tamanho de um bloco por
+// todas as posições do ficheiro, rolando a soma fraca byte a byte. Um bloco
+// encontrado na cópia do receptor vira uma referência; os bytes entre blocos
+// encontrados vão em pacotes de dados. Tudo sai pela ordem do ficheiro, para
+// o hash do conteúdo dos dois lados seguir os mesmos bytes.
+static void *deltaReaderStage(void *arg) {
+    Pipeline *pipe = arg;
+    DeltaIndex *index = &pipe->index;
+    int blockSize = index->blockSize;
+    int tag = PIPE_EOF;
+    unsigned char *buffer = malloc(DELTA_SCAN_BUFFER);
+    long long base = 0;         // Offset no ficheiro de buffer[0]
+    int filled = 0;             // Bytes lidos para o buffer
+    int literal = 0;            // Primeiro byte ainda não enviado
+    int pos = 0;                // Início da janela
+    int chunkSize = 0;
+    int rolling = FALSE, eof = FALSE;
+    unsigned int weak = 0;
+    DeltaRun run = {0, 0, 0};
+    if (buffer == NULL) tag = PIPE_ERROR;
+
+    while (buffer != NULL && !atomic_load(&pipe->abort)) {
+        // Sem uma janela inteira: o que falta enviar passa para o início e lê-se mais
+        if (!eof && filled - pos < blockSize) {
+            memmove(buffer, buffer + literal, filled - literal);
+            base += literal;
+            pos -= literal;
+            filled -= literal;
+            literal = 0;
+            int bytesRead = readDeltaSource(pipe, buffer + filled, DELTA_SCAN_BUFFER - filled);
+            if (bytesRead < 0) {
+                tag = PIPE_ERROR;
+                break;
+            }
+            if (bytesRead == 0) eof = TRUE;
+            filled += bytesRead;
+            chunkSize = dataBlockSize() * atomic_load(&pipe->packetBlocks);
+            atomic_store_explicit(&pipe->progressEnd, base, memory_order_relaxed);
+            continue;
+        }
+        if (filled - pos < blockSize) break;   // Só resta a cauda, mais curta do que um bloco
+
+        if (!rolling) {
+            weak = deltaWeak(buffer + pos, blockSize);
+            rolling = TRUE;
+        }
+        int block = deltaIndexFind(index, weak, buffer + pos, run.count > 0 ? run.block + run.count : -1);
+        if (block >= 0) {
+            // Primeiro os dados antes do bloco; blocos seguidos juntam-se na mesma referência
+            int failed = 0;
+            if (pos > literal) {
+                failed = sendRun(pipe, &run) < 0 ||
+                         sendLiterals(pipe, buffer + literal, pos - literal, base + literal, chunkSize) < 0;
+            }
+            if (run.count > 0 && (block != run.block + run.count || run.count == DELTA_MAX_RUN)) {
+                failed |= sendRun(pipe, &run) < 0;
+            }
+            if (failed) {
+                tag = PIPE_ERROR;
+                break;
+            }
+            if (run.count == 0) {
+                run.offset = base + pos;
+                run.block = block;
+            }
+            run.count++;
+            updateHash(pipe, buffer + pos, blockSize);
+            pos += blockSize;
+            literal = pos;
+            rolling = FALSE;
+            continue;
+        }
+
+        // O byte fica para os dados; com um pacote cheio envia-o já
+        if (pos - literal >= chunkSize) {
+            if (sendRun(pipe, &run) < 0 || sendLiterals(pipe, buffer + literal, pos - literal, base + literal,
+                                                        chunkSize) < 0) {
+                tag = PIPE_ERROR;
+                break;
+            }
+            literal = pos;
+        }
+        if (pos + blockSize < filled) {
+            weak = deltaRoll(weak, buffer[pos], buffer[pos + blockSize], blockSize);
+        } else {
+            rolling = FALSE;
+        }
+        pos++;
+    }
+
+    // A referência pendente e a cauda
+    if (tag == PIPE_EOF && !atomic_load(&pipe->abort) &&
+        (sendRun(pipe, &run) < 0 ||
+         sendLiterals(pipe, buffer + literal, filled - literal, base + literal, chunkSize) < 0)) {
+        tag = PIPE_ERROR;
+    }
+    atomic_store_explicit(&pipe->progressEnd, base + filled, memory_order_relaxed);
+    free(buffer);
+    spscPush(&pipe->first, (SpscItem){NULL, 0, tag});
+    return NULL;
+}
+
+// Referências pendentes para pedaços do armazém, montadas num pacote C = 0x0B
+typedef struct {
+    FrameSlot *slot;
+    long long offset;
+    int count;
+} DedupRun;
+
+// Envia as referências pendentes (se houver)
+static void sendCopies(Pipeline *pipe, DedupRun *run) {
+    if (run->count == 0) return;
+    FrameSlot *slot = run->slot;
+    slot->data[DEDUP_COPY_HEADER - 1] = run->count;
+    slot->length = DEDUP_COPY_HEADER + run->count * DEDUP_ENTRY_SIZE;
+    spscPush(&pipe->first, (SpscItem){slot, slot->length, PIPE_PACKET, run->offset});
+    pipe->references++;
+    run->slot = NULL;
+    run->count = 0;
 }
 
-// Inicia a transmissão de um arquivo
+// Junta uma referência para o pedaço chunk às pendentes (que vão quando enchem um pacote)
+static int addCopy(Pipeline *pipe, DedupRun *run, const DedupChunk *chunk, int perPacket) {
+    if (run->count == perPacket) sendCopies(pipe, run);
+    if (run->count == 0) {
+        if ((run->slot = acquireSlot(pipe, 0)) == NULL) return -1;
+        run->offset = chunk->offset;
+        run->slot->data[0] = PACKET_DEDUP_COPY;
+        for (int i = 0; i < 8; i++) run->slot->data[1 + i] = (chunk->offset >> (8 * (7 - i))) & 0xFF;
+    }
+    unsigned char *entry = run->slot->data + DEDUP_COPY_HEADER + run->count * DEDUP_ENTRY_SIZE;
+    for (int i = 0; i < 8; i++) entry[i] = (chunk->hash >> (8 * (7 - i))) & 0xFF;
+    for (int i = 0; i < 4; i++) entry[8 + i] = (chunk->length >> (8 * (3 - i))) & 0xFF;
+    run->count++;
+    pipe->copiedBytes += chunk->length;
+    return 0;
+}
+
+// Etapa de leitura do dedup (tx): lê o ficheiro pedaço a pedaço, pela ordem;
+// os que o receptor tem viram referências, os outros vão em pacotes de dados
+static void *dedupReaderStage(void *arg) {
+    Pipeline *pipe = arg;
+    int tag = PIPE_EOF;
+    int perPacket = dedupEntriesPerPacket(DEDUP_COPY_HEADER);
+    unsigned char *buffer = malloc(CHUNKER_MAX_SIZE);
+    DedupRun run = {NULL, 0, 0};
+    if (buffer == NULL) tag = PIPE_ERROR;
+
+    for (int i = 0; buffer != NULL && i < pipe->chunkCount && !atomic_load(&pipe->abort); i++) {
+        DedupChunk *chunk = &pipe->chunks[i];
+        int filled = 0, bytesRead = 0;
+        while (filled < chunk->length &&
+               (bytesRead = readDeltaSource(pipe, buffer + filled, chunk->length - filled)) > 0) {
+            filled += bytesRead;
+        }
+        if (filled < chunk->length) {   // O ficheiro mudou depois dos cortes
+            tag = PIPE_ERROR;
+            break;
+        }
+        int failed;
+        if (chunk->stored) {
+            updateHash(pipe, buffer, chunk->length);    // Os dados do sendLiterals já vão para o hash
+            failed = addCopy(pipe, &run, chunk, perPacket) < 0;
+        } else {
+            sendCopies(pipe, &run);
+            failed = sendLiterals(pipe, buffer, chunk->length, chunk->offset,
+                                  dataBlockSize() * atomic_load(&pipe->packetBlocks)) < 0;
+        }
+        if (failed) {
+            tag = PIPE_ERROR;
+            break;
+        }
+        atomic_store_explicit(&pipe->progressEnd, chunk->offset + chunk->length, memory_order_relaxed);
+    }
+    if (tag == PIPE_EOF && !atomic_load(&pipe->abort)) sendCopies(pipe, &run);
+    framePoolRelease(run.slot);
+    free(buffer);
+    spscPush(&pipe->first, (SpscItem){NULL, 0, tag});
+    return NULL;
+}
+
+// Inicia a transmissão de um arquivo, ou de todos os de uma diretoria
 static int startTransmission(const char *filename) {
+    if (fileBatchIsDirectory(filename)) return transmitBatch(filename);
+    return transmitFile(filename, filename, -1);
+}
+
+// Transmite o ficheiro path com o nome name (batchIndex >= 0 num lote).
+// O ficheiro passa por três etapas ligadas por filas SPSC: leitura (thread),
+// codificação (thread) e ligação (esta thread, que espera pelos ACKs).
+static int transmitFile(const char *path, const char *name, int batchIndex) {
     // Abre o arquivo em modo de leitura
-    FILE *file = openFile(filename, "rb");
+    FILE *file = openFile(path, "rb");
     if (!file) return -1;
 
     // Calcula o tamanho do arquivo para incluir no pacote de controle
     long fileSize = calculateFileSize(file);
+    if (fileSize == STREAM_SIZE_UNKNOWN && !streamPeer) {
+        fprintf(stderr, "Erro: o receptor não aceita ficheiros de tamanho desconhecido\n");
+        if (file != stdin) fclose(file);
+        return -1;
+    }
 
-    // Envia o pacote de controle inicial com informações do arquivo
-    unsigned char *controlPacket = createControlPacket(0x02, filename, fileSize);
-    if (sendControlPacket(controlPacket, strlen((char *)controlPacket) + 1) < 0) {
-        free(controlPacket);
+    Pipeline pipe;
+    pthread_t reader, encoder;
+    if (pipelineInit(&pipe, file) < 0) {
+        if (file != stdin) fclose(file);
         return -1;
     }
-    free(controlPacket);
 
-    // Variáveis para gerenciar sequência e buffer de dados
-    unsigned char sequence = 0;
-    unsigned char buffer[256];
-    int bytesRead;
-
-    // Lê e envia os dados do arquivo em pacotes de tamanho fixo até o final do arquivo
-    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        // Cria o pacote de dados com o número de sequência atual
-        unsigned char *dataPacket = createDataPacket(sequence, buffer, bytesRead);
-        // Envia o pacote e verifica erros
-        if (llwrite(dataPacket, bytesRead + 4) < 0) {
-            free(dataPacket);
-            return -1;
+    // Pacote de controle inicial com informações do arquivo. Com offsets o
+    // receptor fica a saber o tamanho dos blocos para o mapa de recebidos
+    // (sem mapa no delta e no dedup: as referências não seguem os blocos)
+    int result = 0;
+    int delta = deltaMode && deltaPeer && fileSize != STREAM_SIZE_UNKNOWN;
+    int dedup = dedupMode && dedupPeer && !delta && fileSize != STREAM_SIZE_UNKNOWN;
+    int blockSize = offsetPackets && fileSize != STREAM_SIZE_UNKNOWN && !delta && !dedup ? dataBlockSize() : 0;
+    FrameSlot *controlPacket = createControlPacket(0x02, name, fileSize, blockSize);
+    if (controlPacket == NULL) result = -1;
+    if (result == 0 && batchIndex >= 0) {
+        unsigned char index[4] = {batchIndex >> 24, batchIndex >> 16, batchIndex >> 8, batchIndex};
+        result = addControlField(controlPacket, CONTROL_BATCH, index, sizeof(index));
+    }
+
+    // O delta precisa das assinaturas antes de a leitura começar
+    if (result == 0 && delta) {
+        int deltaBlock = deltaBlockSizeFor(fileSize);
+        unsigned char value[4] = {deltaBlock >> 24, deltaBlock >> 16, deltaBlock >> 8, deltaBlock};
+        if (addControlField(controlPacket, CONTROL_DELTA, value, sizeof(value)) < 0 ||
+            requestSignatures(&pipe, controlPacket, deltaBlock) < 0) {
+            result = -1;
         }
-        sequence = getNextSequence(sequence);  // Atualiza a sequência
-        free(dataPacket);
     }
 
-    // Envia o pacote de controle final indicando o término da transmissão
-    controlPacket = createControlPacket(0x03, filename, fileSize);
-    if (sendControlPacket(controlPacket, strlen((char *)controlPacket) + 1) < 0) {
-        free(controlPacket);
+    // O dedup corta o ficheiro e oferece os pedaços antes de a leitura começar
+    if (result == 0 && dedup &&
+        (addControlField(controlPacket, CONTROL_DEDUP, NULL, 0) < 0 || offerChunks(&pipe, controlPacket, file) < 0)) {
+        result = -1;
+    }
+
+    // Com retoma o offset tem de ser conhecido antes de a leitura começar. A
+    // identidade lê o ficheiro todo: entretanto a ligação continua a responder
+    // às sondagens do receptor, que está à espera do pacote de início
+    int resume = resumePeer && fileSize != STREAM_SIZE_UNKNOWN && !delta && !dedup;
+    if (result == 0 && resume) {
+        FileIdentity identity;
+        if (fileIdentityCompute(file, name, &identity, llService) < 0 || addResumeRequest(controlPacket, identity.hash) < 0 ||
+            (pipe.startOffset = requestResume(controlPacket, fileSize)) < 0 ||
+            fseeko(file, pipe.startOffset, SEEK_SET) < 0) {
+            result = -1;
+        } else if (pipe.startOffset > 0) {
+            printf("Retoma: %lld de %ld bytes já estão no receptor\n", pipe.startOffset, fileSize);
+        }
+    }
+    if (result < 0) atomic_store(&pipe.abort, 1);
+    if (tuning) applyTuning(&pipe);
+    pipe.hashStart = pipe.startOffset;
+    pipe.sparse = sparseMode && holesPeer;
+
+    // Sem retoma as etapas de leitura e codificação arrancam antes do pacote de
+    // controle, para que os primeiros pacotes fiquem prontos durante o envio deste
+    if (result == 0) fileSourceOpen(&pipe.source, file);
+    startStage(&reader, pipe.delta ? deltaReaderStage : pipe.dedup ? dedupReaderStage : readerStage, &pipe);
+    startStage(&encoder, encoderStage, &pipe);
+    if (result == 0 && !resume && !delta && !dedup && sendControlPacket(controlPacket->data, controlPacket->length) < 0) {
+        atomic_store(&pipe.abort, 1);
+        result = -1;
+    }
+    framePoolRelease(controlPacket);
+
+    // Etapa de ligação: envia as tramas já montadas até ao fim do ficheiro
+    Progress progress;
+    progressInit(&progress, TRUE, name, fileSize, pipe.startOffset);
+    metricsValues.fileTotal = fileSize;
+    SpscItem item;
+    for (;;) {
+        // Com o produtor parado (p.ex. um pipe) a ligação continua a responder
+        // às sondagens e a tratar os RR enquanto espera pela próxima trama
+        while (!spscPopTimed(&pipe.second, &item, LINK_SERVICE_MS)) {
+            if (result == 0 && llService() < 0) {
+                atomic_store(&pipe.abort, 1);
+                result = -1;
+            }
+            if (metricsDue(&metrics)) publishMetrics(&pipe);
+        }
+        if (item.tag != PIPE_DATA) break;
+        if (result == 0 && llwriteFrame(item.ptr, item.len) < 0) {
+            atomic_store(&pipe.abort, 1);
+            result = -1;
+        }
+        framePoolRelease(item.ptr);
+        if (tuning && autoTunerStep(&tuner)) applyTuning(&pipe);
+        progressStep(&progress, atomic_load_explicit(&pipe.progressEnd, memory_order_relaxed));
+        if (metricsDue(&metrics)) publishMetrics(&pipe);
+    }
+    if (item.tag == PIPE_ERROR) result = -1;
+
+    pthread_join(reader, NULL);
+    pthread_join(encoder, NULL);
+    progressFinish(&progress, atomic_load(&pipe.progressEnd));
+    if (!batchMode) {
+        printPipelineStats(&pipe, "leitura", "codificação", "ligação");
+        printPacketStats(&pipe);
+    }
+    if (pipe.delta && (!batchMode || result < 0)) {
+        printf("Delta: %lld bytes em pacotes de dados, %lld em %ld referências (%d/%d assinaturas de blocos de "
+               "%d bytes, %lld falsos positivos da soma fraca)\n", pipe.literalBytes, pipe.copiedBytes,
+               pipe.references, pipe.index.known, pipe.index.blocks, pipe.index.blockSize,
+               pipe.index.stats.falseMatches);
+    }
+    if (pipe.dedup && (!batchMode || result < 0)) {
+        printf("Dedup: %lld bytes em pacotes de dados, %lld do armazém do receptor em %ld pacotes de referências\n",
+               pipe.literalBytes, pipe.copiedBytes, pipe.references);
+    }
+    if (pipe.holePackets > 0 && !batchMode) {
+        printf("Buracos: %lld bytes não enviados (%lld em buracos do ficheiro, %lld em pacotes a zeros) em %ld "
+               "pacotes\n", pipe.source.stats.holeBytes + pipe.zeroBytes, pipe.source.stats.holeBytes,
+               pipe.zeroBytes, pipe.holePackets);
+    }
+    deltaIndexFree(&pipe.index);
+    free(pipe.chunks);
+    fileSourceClose(&pipe.source);
+    if (file != stdin) fclose(file);
+    if (result < 0) return -1;
+
+    // Envia o pacote de controle final indicando o término da transmissão (com
+    // o tamanho final de um stream)
+    if (fileSize == STREAM_SIZE_UNKNOWN) {
+        fileSize = pipe.source.stats.bytes;
+        printf("Stream: %ld bytes enviados\n", fileSize);
+    }
+    controlPacket = createControlPacket(0x03, name, fileSize, 0);
+    if (controlPacket == NULL) return -1;
+    if (addContentHash(controlPacket, &pipe) < 0 ||
+        sendControlPacket(controlPacket->data, controlPacket->length) < 0) {
+        framePoolRelease(controlPacket);
         return -1;
     }
-    free(controlPacket);
+    framePoolRelease(controlPacket);
+    metricsValues.files++;
+    publishMetrics(NULL);
+    return 0;
+}
 
-    // Fecha o arquivo após a transmissão completa
+// Envia um pacote agrupado (os ficheiros pequenos já lá estão) sem esperar pelo
+// ACK. Se correr bem, os pendingFiles ficheiros que leva passam para packedFiles.
+static int sendPacked(FrameSlot *packed, int *pendingFiles, int *packedFiles) {
+    FrameSlot *frame = framePoolAcquire();
+    int result = frame != NULL && llEncodeFrame(packed->data, packed->length, frame) > 0 &&
+                 llwriteFrame(frame, packed->length) >= 0 ? 0 : -1;
+    framePoolRelease(frame);
+    framePoolRelease(packed);
+    if (result == 0) *packedFiles += *pendingFiles;
+    *pendingFiles = 0;
+    return result;
+}
+
+// Acrescenta o ficheiro entry ao pacote agrupado
+static int packFile(FrameSlot *packed, const BatchEntry *entry) {
+    FILE *file = openFile(entry->path, "rb");
+    if (file == NULL) return -1;
+    unsigned char *packet = packed->data;
+    int nameSize = strlen(entry->name);
+    packet[packed->length++] = nameSize;
+    memcpy(&packet[packed->length], entry->name, nameSize);
+    packed->length += nameSize;
+    int sizeAt = packed->length;
+    packed->length += 2;
+    // O ficheiro pode ter mudado depois da listagem: vale o que se leu
+    int bytesRead = fread(&packet[packed->length], 1, entry->size, file);
     fclose(file);
+    packet[sizeAt] = (bytesRead >> 8) & 0xFF;
+    packet[sizeAt + 1] = bytesRead & 0xFF;
+    packed->length += bytesRead;
+    return 0;
+}
+
+// Transmite todos os ficheiros de dir numa só sessão: os que cabem num pacote
+// vão em pacotes agrupados, os outros um a um com os seus pacotes de controlo
+static int transmitBatch(const char *dir) {
+    if (!batchPeer) {
+        fprintf(stderr, "Erro: o receptor não aceita lotes de ficheiros\n");
+        return -1;
+    }
+    FileBatch batch;
+    if (fileBatchScan(dir, &batch) < 0) return -1;
+    batchMode = TRUE;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = 0;
+    int sentFiles = 0, packedFiles = 0, packedPackets = 0;
+    int pendingFiles = 0;   // Ficheiros no pacote agrupado em curso, ainda por enviar
+    FrameSlot *packed = NULL;
+    for (int i = 0; i < batch.count && result == 0; i++) {
+        BatchEntry *entry = &batch.entries[i];
+        int entrySize = PACKED_ENTRY_HEADER + strlen(entry->name) + entry->size;
+        if (1 + entrySize > llMaxPayload()) {
+            if (packed != NULL) result = sendPacked(packed, &pendingFiles, &packedFiles);
+            packed = NULL;
+            if (result == 0) result = transmitFile(entry->path, entry->name, i);
+            if (result == 0) sentFiles++;
+            continue;
+        }
+        if (packed != NULL && packed->length + entrySize > llMaxPayload()) {
+            result = sendPacked(packed, &pendingFiles, &packedFiles);
+            packed = NULL;
+        }
+        if (result == 0 && packed == NULL) {
+            if ((packed = framePoolAcquire()) == NULL) result = -1;
+            else {
+                packed->data[0] = PACKET_PACKED;
+                packed->length = 1;
+                packedPackets++;
+            }
+        }
+        if (result == 0) result = packFile(packed, entry);
+        if (result == 0) pendingFiles++;
+    }
+    if (packed != NULL) {
+        if (result == 0) result = sendPacked(packed, &pendingFiles, &packedFiles);
+        else framePoolRelease(packed);
+    }
+    sentFiles += packedFiles;
+
+    // Fim do lote: o número de ficheiros e o total de bytes
+    FrameSlot *controlPacket = result == 0 ? createControlPacket(PACKET_BATCH_END, "", batch.totalBytes, 0) : NULL;
+    if (controlPacket != NULL) {
+        unsigned char count[4] = {batch.count >> 24, batch.count >> 16, batch.count >> 8, batch.count};
+        if (addControlField(controlPacket, CONTROL_BATCH, count, sizeof(count)) < 0 ||
+            sendControlPacket(controlPacket->data, controlPacket->length) < 0) {
+            result = -1;
+        }
+        framePoolRelease(controlPacket);
+    } else {
+        result = -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9;
+    // Depois de um erro só contam os ficheiros que chegaram a ser enviados
+    printf("Lote: %d de %d ficheiros enviados (%d em %d pacotes agrupados), %lld bytes no lote, %.2f s (%.1f ficheiros/s)\n",
+           sentFiles, batch.count, packedFiles, packedPackets, batch.totalBytes, seconds,
+           seconds > 0 ? sentFiles / seconds : 0.0);
+    fileBatchFree(&batch);
+    return result;
+}
+
+// Abre o armazém de pedaços (RCOM_CHUNK_STORE ou CHUNK_STORE_DEFAULT) no
+// primeiro pedido de dedup; fica aberto até ao fim da sessão.
+// Returns 1 if the store is open.
+static int openChunkStore() {
+    if (chunkStoreState == 0) {
+        const char *path = getenv("RCOM_CHUNK_STORE");
+        if (path == NULL) path = CHUNK_STORE_DEFAULT;
+        chunkStoreState = chunkStoreOpen(&chunkStore, path) == 0 ? 1 : -1;
+        if (chunkStoreState > 0) {
+            printf("Armazém de pedaços %s: %d pedaços, %lld bytes\n", path, chunkStore.count, chunkStore.bytes);
+        } else {
+            printf("Aviso: não foi possível abrir o armazém de pedaços %s\n", path);
+        }
+    }
+    return chunkStoreState > 0;
+}
+
+// Lê o pacote de controlo inicial (na thread da ligação, antes de chegarem
+// dados): com o tamanho dos blocos dos pacotes com offset prepara o mapa dos
+// blocos recebidos e, com a identidade do ficheiro, o diário. A um pedido de
+// retoma responde com o offset, também aos pedidos repetidos.
+static int readStartPacket(Pipeline *pipe, const unsigned char *packet, int size) {
+    long long fileSize = controlFileSize(packet, size);
+    int blockSize = 0;
+    int deltaBlock = 0;
+    int dedup = FALSE;
+    int resume = FALSE;
+    FileIdentity identity;
+    memset(&identity, 0, sizeof(identity));
+    int identified = FALSE;
+    if (fileSize == STREAM_SIZE_UNKNOWN && !pipe->streaming) {
+        pipe->streaming = TRUE;
+        printf("Stream: tamanho desconhecido até ao pacote de fim\n");
+    }
+    for (int i = 1; i + 2 <= size && i + 2 + packet[i + 1] <= size; i += 2 + packet[i + 1]) {
+        const unsigned char *value = &packet[i + 2];
+        int length = packet[i + 1];
+        if (packet[i] == CONTROL_FILE_NAME) {
+            memcpy(identity.name, value, length);
+        } else if (packet[i] == CONTROL_BLOCK_SIZE) {
+            for (int b = 0; b < length; b++) blockSize = (blockSize << 8) | value[b];
+        } else if (packet[i] == CONTROL_FILE_HASH && length == 8) {
+            for (int b = 0; b < length; b++) identity.hash = (identity.hash << 8) | value[b];
+            identified = TRUE;
+        } else if (packet[i] == CONTROL_RESUME) {
+            resume = TRUE;
+        } else if (packet[i] == CONTROL_DELTA && length == 4) {
+            for (int b = 0; b < length; b++) deltaBlock = (deltaBlock << 8) | value[b];
+        } else if (packet[i] == CONTROL_DEDUP) {
+            dedup = TRUE;
+        }
+    }
+
+    if (fileSize >= 0 && blockSize > 0 && !pipe->tracking) {
+        pipe->tracking = rangeBitmapInit(&pipe->received, fileSize, blockSize) == 0;
+        identity.fileSize = fileSize;
+        if (pipe->tracking && identified && rangeBitmapInit(&pipe->written, fileSize, blockSize) == 0) {
+            // O prefixo do diário só serve para o mesmo ficheiro; com outro tamanho
+            // de bloco perde-se o bloco cortado
+            long long prefix = 0;
+            if (pipe->hasJournal && fileIdentityEquals(&identity, &pipe->journal.identity)) {
+                prefix = journalResumeOffset(&pipe->journal);
+            } else if (pipe->hasJournal && ftruncate(fileno(pipe->file), 0) < 0) {
+                return -1;
+            }
+            pipe->resumeOffset = rangeBitmapMarkPrefix(&pipe->received, prefix);
+            rangeBitmapMarkPrefix(&pipe->written, pipe->resumeOffset);
+            pipe->journal.identity = identity;
+            pipe->journaling = TRUE;
+            pipe->hasJournal = FALSE;
+            clock_gettime(CLOCK_MONOTONIC, &pipe->lastCheckpoint);
+            if (pipe->resumeOffset > 0) {
+                printf("Retoma: %lld de %lld bytes já recebidos\n", pipe->resumeOffset, fileSize);
+            }
+        }
+    }
+    // Um diário de outra transferência: o ficheiro recomeça do zero
+    if (pipe->hasJournal) {
+        pipe->hasJournal = FALSE;
+        journalRemove(pipe->journalPath);
+        if (ftruncate(fileno(pipe->file), 0) < 0) return -1;
+    }
+
+    // Espaço do ficheiro reservado de uma vez (a falta de suporte não é um erro)
+    if (fileSize > 0 && !pipe->sink.stats.preallocated) writeSinkPreallocate(&pipe->sink, fileSize);
+
+    // O hash dos dados começa onde o transmissor vai começar a enviar
+    pipe->hashStart = pipe->hashEnd = pipe->resumeOffset;
+
+    if (resume) {
+        unsigned char reply[8];
+        for (int i = 0; i < 8; i++) reply[i] = (pipe->resumeOffset >> (8 * (7 - i))) & 0xFF;
+        if (llReply(reply, sizeof(reply)) < 0) return -1;
+    }
+
+    // Ao pedido de delta responde com o tamanho da cópia anterior (0 sem cópia)
+    if (deltaBlock > 0 && deltaBlock <= DELTA_MAX_BLOCK) {
+        pipe->deltaBlockSize = deltaBlock;
+        long long basisSize = pipe->basis != NULL ? pipe->basisSize : 0;
+        unsigned char reply[8];
+        for (int i = 0; i < 8; i++) reply[i] = (basisSize >> (8 * (7 - i))) & 0xFF;
+        if (llReply(reply, sizeof(reply)) < 0) return -1;
+    }
+
+    // Ao pedido de dedup responde com o número de pedaços do armazém (-1 sem armazém)
+    if (dedup) {
+        long long stored = openChunkStore() ? chunkStore.count : -1;
+        unsigned char reply[8];
+        for (int i = 0; i < 8; i++) reply[i] = (stored >> (8 * (7 - i))) & 0xFF;
+        if (llReply(reply, sizeof(reply)) < 0) return -1;
+    }
+    return 0;
+}
+
+// Etapa de descodificação (rx): valida os pacotes e separa os dados
+static void *decoderStage(void *arg) {
+    Pipeline *pipe = arg;
+    SpscItem item;
+
+    for (;;) {
+        spscPop(&pipe->first, &item);
+        if (item.tag != PIPE_DATA) break;
+
+        FrameSlot *packet = item.ptr;
+        unsigned char *buffer = packet->data;
+        if (atomic_load(&pipe->abort)) {
+            framePoolRelease(packet);
+        } else if (buffer[0] == 0x01 && item.len >= DATA_HEADER_SIZE) {  // Pacote de dados
+            int dataSize = (buffer[2] << 8) | buffer[3];
+            if (dataSize != item.len - DATA_HEADER_SIZE) {
+                printf("Aviso: pacote de dados com tamanho %d, esperado %d\n", item.len - DATA_HEADER_SIZE, dataSize);
+            }
+            long long offset = pipe->appendOffset;
+            pipe->appendOffset += item.len - DATA_HEADER_SIZE;
+            spscPush(&pipe->second, (SpscItem){packet, item.len - DATA_HEADER_SIZE, PIPE_DATA, offset});
+        } else if (buffer[0] == PACKET_DATA_OFFSET && item.len >= DATA_OFFSET_HEADER_SIZE) {
+            long long offset = 0;
+            for (int b = 1; b <= 8; b++) offset = (offset << 8) | buffer[b];
+            int dataSize = (buffer[9] << 8) | buffer[10];
+            // Os duplicados (reenvios) já estão no ficheiro; com o mapa, um bloco que
+            // não encaixa nos anunciados é descartado
+            int mark = dataSize == item.len - DATA_OFFSET_HEADER_SIZE
+                     ? (pipe->tracking ? rangeBitmapMark(&pipe->received, offset, dataSize) : 1) : -1;
+            if (mark < 0) {
+                printf("Aviso: pacote com offset %lld e %d bytes fora dos blocos anunciados\n", offset, dataSize);
+            }
+            if (mark > 0) {
+                spscPush(&pipe->second, (SpscItem){packet, dataSize, PIPE_DATA, offset});
+            } else {
+                framePoolRelease(packet);
+            }
+        } else if (buffer[0] == PACKET_HOLE && item.len == HOLE_PACKET_SIZE) {
+            // Zona a zeros: marca os blocos como um pacote de dados
+            long long offset = 0, length = 0;
+            for (int b = 1; b <= 8; b++) {
+                offset = (offset << 8) | buffer[b];
+                length = (length << 8) | buffer[8 + b];
+            }
+            int mark = length > 0 && length <= HOLE_MAX_LENGTH
+                     ? (pipe->tracking ? rangeBitmapMark(&pipe->received, offset, length) : 1) : -1;
+            if (mark < 0) {
+                printf("Aviso: buraco com offset %lld e %lld bytes fora dos blocos anunciados\n", offset, length);
+            }
+            if (mark > 0) {
+                spscPush(&pipe->second, (SpscItem){packet, length, PIPE_DATA, offset});
+            } else {
+                framePoolRelease(packet);
+            }
+        } else if (buffer[0] == PACKET_DEDUP_COPY && item.len >= DEDUP_COPY_HEADER && chunkStoreState > 0 &&
+                   item.len == DEDUP_COPY_HEADER + buffer[DEDUP_COPY_HEADER - 1] * DEDUP_ENTRY_SIZE) {
+            // Referências para pedaços do armazém: a etapa de escrita copia-os
+            long long offset = 0, length = 0;
+            for (int b = 1; b <= 8; b++) offset = (offset << 8) | buffer[b];
+            for (int pos = DEDUP_COPY_HEADER + 8; pos < item.len; pos += DEDUP_ENTRY_SIZE) {
+                length += (buffer[pos] << 24) | (buffer[pos + 1] << 16) | (buffer[pos + 2] << 8) | buffer[pos + 3];
+            }
+            spscPush(&pipe->second, (SpscItem){packet, length, PIPE_DATA, offset});
+        } else if (buffer[0] == PACKET_DELTA_COPY && item.len == DELTA_COPY_SIZE && pipe->basis != NULL) {
+            // Referência para blocos da cópia anterior: a etapa de escrita copia-os
+            long long offset = 0;
+            for (int b = 1; b <= 8; b++) offset = (offset << 8) | buffer[b];
+            int count = (buffer[13] << 8) | buffer[14];
+            spscPush(&pipe->second, (SpscItem){packet, count * pipe->deltaBlockSize, PIPE_DATA, offset});
+        } else {
+            framePoolRelease(packet);
+        }
+    }
+    spscPush(&pipe->second, (SpscItem){NULL, 0, item.tag});
+    return NULL;
+}
+
+// Grava no diário os blocos escritos: primeiro escreve e sincroniza os dados,
+// para o diário nunca apontar para blocos que ainda não estão no disco
+static int checkpoint(Pipeline *pipe) {
+    clock_gettime(CLOCK_MONOTONIC, &pipe->lastCheckpoint);
+    pipe->uncheckpointed = 0;
+    if (writeSinkFlush(&pipe->sink) < 0 || fdatasync(fileno(pipe->file)) < 0) return -1;
+    journalFromBitmap(&pipe->journal, &pipe->written);
+    return journalSave(pipe->journalPath, &pipe->journal);
+}
+
+// Passa size bytes para o sink no offset e acrescenta-os ao hash do conteúdo.
+// Returns 0 on success, -1 on error.
+static int storeData(Pipeline *pipe, const unsigned char *data, int size, long long offset) {
+    int result = writeSinkWrite(&pipe->sink, data, size, offset);
+    long long end = offset + size;
+    if (end > pipe->writtenEnd) pipe->writtenEnd = end;
+
+    // O hash segue os offsets: um reenvio já lá está, um buraco impede a verificação
+    if (offset > pipe->hashEnd) {
+        pipe->hashGap = TRUE;
+    } else if (!pipe->hashGap && end > pipe->hashEnd) {
+        updateHash(pipe, data + (pipe->hashEnd - offset), end - pipe->hashEnd);
+        pipe->hashEnd = end;
+    }
+    return result;
+}
+
+// Recria size bytes a zeros no offset (um buraco) e acrescenta-os ao hash.
+// Returns 0 on success, -1 on error.
+static int storeHole(Pipeline *pipe, long long offset, int size) {
+    int result = writeSinkHole(&pipe->sink, offset, size);
+    long long end = offset + size;
+    if (end > pipe->writtenEnd) pipe->writtenEnd = end;
+    if (offset > pipe->hashEnd) {
+        pipe->hashGap = TRUE;
+    } else if (!pipe->hashGap && end > pipe->hashEnd) {
+        hashZeros(pipe, end - pipe->hashEnd);
+        pipe->hashEnd = end;
+    }
+    return result;
+}
+
+// Copia para offset os size bytes da cópia anterior de uma referência do delta.
+// Returns 0 on success, -1 on error.
+static int copyBasisBlocks(Pipeline *pipe, const unsigned char *packet, int size, long long offset) {
+    long long block = ((long long)packet[9] << 24) | (packet[10] << 16) | (packet[11] << 8) | packet[12];
+    long long source = block * pipe->deltaBlockSize;
+    if (source + size > pipe->basisSize) return -1;
+    unsigned char buffer[65536];
+    for (int done = 0; done < size;) {
+        int chunk = size - done < (int)sizeof(buffer) ? size - done : (int)sizeof(buffer);
+        if (pread(fileno(pipe->basis), buffer, chunk, source + done) != chunk ||
+            storeData(pipe, buffer, chunk, offset + done) < 0) {
+            return -1;
+        }
+        done += chunk;
+    }
+    pipe->copiedBytes += size;
+    pipe->references++;
     return 0;
 }
 
-// Inicia a recepção de um arquivo
+// Copia para offset os pedaços do armazém de um pacote de referências do dedup.
+// Returns 0 on success, -1 if a chunk is missing or corrupted, or on error.
+static int copyStoredChunks(Pipeline *pipe, const unsigned char *packet, long long offset) {
+    unsigned char buffer[CHUNKER_MAX_SIZE];
+    int count = packet[DEDUP_COPY_HEADER - 1];
+    for (int i = 0; i < count; i++) {
+        const unsigned char *entry = packet + DEDUP_COPY_HEADER + i * DEDUP_ENTRY_SIZE;
+        unsigned long long hash = 0;
+        int length = 0;
+        for (int b = 0; b < 8; b++) hash = (hash << 8) | entry[b];
+        for (int b = 8; b < 12; b++) length = (length << 8) | entry[b];
+        if (length <= 0 || length > CHUNKER_MAX_SIZE || chunkStoreRead(&chunkStore, hash, length, buffer) < 0 ||
+            storeData(pipe, buffer, length, offset) < 0) {
+            printf("Erro: pedaço %016llx (%d bytes) em falta ou corrompido no armazém\n", hash, length);
+            return -1;
+        }
+        offset += length;
+        pipe->copiedBytes += length;
+    }
+    pipe->references++;
+    return 0;
+}
+
+// Acrescenta ao armazém os pedaços oferecidos que ainda não estavam lá, lidos
+// do ficheiro recebido (só depois de completo e verificado).
+// Returns the number of chunks added.
+static int storeNewChunks(Pipeline *pipe) {
+    unsigned char *buffer = malloc(CHUNKER_MAX_SIZE);
+    int added = 0;
+    for (int i = 0; buffer != NULL && i < pipe->chunkCount; i++) {
+        DedupChunk *chunk = &pipe->chunks[i];
+        if (pread(fileno(pipe->file), buffer, chunk->length, chunk->offset) != chunk->length ||
+            chunkStoreHash(buffer, chunk->length) != chunk->hash) {
+            continue;
+        }
+        int result = chunkStoreAdd(&chunkStore, chunk->hash, buffer, chunk->length);
+        if (result < 0) {
+            printf("Aviso: não foi possível escrever no armazém de pedaços\n");
+            break;
+        }
+        added += result;
+    }
+    if (added > 0 && chunkStoreSync(&chunkStore) < 0) {
+        printf("Aviso: não foi possível escrever no armazém de pedaços\n");
+    }
+    free(buffer);
+    return added;
+}
+
+// Etapa de escrita (rx): passa os dados para o sink, que os escreve no ficheiro
+static void *writerStage(void *arg) {
+    Pipeline *pipe = arg;
+    SpscItem item;
+
+    for (;;) {
+        spscPop(&pipe->second, &item);
+        if (item.tag != PIPE_DATA) break;
+
+        // Cada pacote vai para a sua posição: a ordem de chegada não importa
+        FrameSlot *packet = item.ptr;
+        int result;
+        if (packet->data[0] == PACKET_DELTA_COPY) {
+            result = copyBasisBlocks(pipe, packet->data, item.len, item.offset);
+        } else if (packet->data[0] == PACKET_DEDUP_COPY) {
+            result = copyStoredChunks(pipe, packet->data, item.offset);
+        } else if (packet->data[0] == PACKET_HOLE) {
+            result = storeHole(pipe, item.offset, item.len);
+        } else {
+            int header = packet->data[0] == PACKET_DATA_OFFSET ? DATA_OFFSET_HEADER_SIZE : DATA_HEADER_SIZE;
+            result = storeData(pipe, packet->data + header, item.len, item.offset);
+            pipe->literalBytes += item.len;
+        }
+        if (result < 0) atomic_store(&pipe->abort, 1);
+        framePoolRelease(packet);
+        atomic_store_explicit(&pipe->progressEnd, pipe->writtenEnd, memory_order_relaxed);
+
+        if (pipe->journaling && rangeBitmapMark(&pipe->written, item.offset, item.len) > 0) {
+            pipe->uncheckpointed += item.len;
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long elapsedMs = (now.tv_sec - pipe->lastCheckpoint.tv_sec) * 1000 +
+                             (now.tv_nsec - pipe->lastCheckpoint.tv_nsec) / 1000000;
+            if ((pipe->uncheckpointed >= JOURNAL_CHECKPOINT_BYTES || elapsedMs >= JOURNAL_CHECKPOINT_MS) &&
+                checkpoint(pipe) < 0) {
+                printf("Aviso: não foi possível gravar o diário %s\n", pipe->journalPath);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Inicia a recepção de um arquivo, ou de um lote para a diretoria filename:
+// decide pelo primeiro pacote
 static int startReception(const char *filename) {
-    // Abre o arquivo em modo de escrita
-    FILE *file = openFile(filename, "wb");
-    if (!file) return -1;
+    FrameSlot *packet = framePoolAcquire();
+    if (packet == NULL) return -1;
+    int packetSize = llread(packet->data);
+    if (packetSize <= 0) {
+        framePoolRelease(packet);
+        return -1;
+    }
+    int length;
+    if (packet->data[0] == PACKET_PACKED || packet->data[0] == PACKET_BATCH_END ||
+        (packet->data[0] == 0x02 && controlField(packet->data, packetSize, CONTROL_BATCH, &length) != NULL)) {
+        return receiveBatch(filename, packet, packetSize);
+    }
+    if (daemonMode) {
+        char path[JOURNAL_PATH_SIZE];
+        if (spoolPath(filename, packet->data, packetSize, path, sizeof(path)) < 0) {
+            framePoolRelease(packet);
+            return -1;
+        }
+        return receiveFile(path, packet, packetSize);
+    }
+    return receiveFile(filename, packet, packetSize);
+}
 
-    unsigned char buffer[512];
-    int packetSize;
+// Daemon: caminho em dir para o ficheiro do pacote de início packet. Fica só
+// o último componente do nome; sem um nome que sirva (p.ex. o "-" do stdin)
+// usa o pid e o número da sessão, que recomeça em cada arranque do daemon, e
+// se ainda assim o nome existir acrescenta um sufixo até encontrar um livre.
+// Returns 0 on success, -1 on error.
+static int spoolPath(const char *dir, const unsigned char *packet, int size, char *path, int pathSize) {
+    char name[BATCH_NAME_MAX + 1] = "";
+    int length;
+    const unsigned char *value = packet[0] == 0x02 ? controlField(packet, size, CONTROL_FILE_NAME, &length) : NULL;
+    if (value != NULL) {
+        memcpy(name, value, length);
+        name[length] = '\0';
+    }
+    const char *base = strrchr(name, '/') != NULL ? strrchr(name, '/') + 1 : name;
+    char fallback[64];
+    int generated = base[0] == '\0' || strcmp(base, "-") == 0 || strcmp(base, ".") == 0 || strcmp(base, "..") == 0;
+    for (int suffix = 0;; suffix++) {
+        if (generated) {
+            int n = snprintf(fallback, sizeof(fallback), "sessao-%ld-%ld", (long)getpid(), daemonSessions);
+            if (suffix > 0) snprintf(fallback + n, sizeof(fallback) - n, "-%d", suffix);
+            base = fallback;
+        }
+        if (fileBatchOutputPath(dir, base, path, pathSize) < 0) {
+            fprintf(stderr, "Erro: caminho inválido na diretoria %s: %s\n", dir, base);
+            return -1;
+        }
+        if (!generated || access(path, F_OK) < 0) return 0;
+    }
+}
+
+// Recebe um ficheiro para filename, começando pelo pacote first (já lido).
+// Espelho da transmissão: ligação (esta thread), descodificação e escrita.
+static int receiveFile(const char *filename, FrameSlot *first, int firstSize) {
+    // Com um pedido de delta a cópia que já existe é a base e o ficheiro novo
+    // vai para um temporário, que só no fim a substitui
+    int length;
+    int delta = first->data[0] == 0x02 && controlField(first->data, firstSize, CONTROL_DELTA, &length) != NULL;
+    FILE *basis = delta ? fopen(filename, "rb") : NULL;
+    int dedup = first->data[0] == 0x02 && controlField(first->data, firstSize, CONTROL_DEDUP, &length) != NULL;
+    char deltaPath[JOURNAL_PATH_SIZE];
+    snprintf(deltaPath, sizeof(deltaPath), "%s%s", filename, DELTA_SUFFIX);
+
+    // Com o diário de uma transferência interrompida o ficheiro é mantido até
+    // se saber (no pacote de início) se é a mesma; sem diário é recriado
+    CheckpointJournal journal;
+    char journalPath[JOURNAL_PATH_SIZE];
+    snprintf(journalPath, sizeof(journalPath), "%s%s", filename, JOURNAL_SUFFIX);
+    int hasJournal = !delta && journalLoad(journalPath, &journal) == 0;
+    FILE *file = hasJournal ? fopen(filename, "r+b") : NULL;
+    if (file == NULL) {
+        hasJournal = FALSE;
+        // No dedup os pedaços novos são lidos do ficheiro no fim, para o armazém
+        file = openFile(basis != NULL ? deltaPath : filename, dedup ? "w+b" : "wb");
+    }
+    if (!file) {
+        if (basis != NULL) fclose(basis);
+        framePoolRelease(first);
+        return -1;
+    }
+
+    Pipeline pipe;
+    pthread_t decoder, writer;
+    if (pipelineInit(&pipe, file) < 0 || writeSinkOpen(&pipe.sink, fileno(file)) < 0) {
+        fclose(file);
+        if (basis != NULL) fclose(basis);
+        framePoolRelease(first);
+        return -1;
+    }
+    pipe.delta = delta;
+    pipe.dedup = dedup;
+    pipe.basis = basis;
+    if (basis != NULL && fseeko(basis, 0, SEEK_END) == 0) pipe.basisSize = ftello(basis);
+    pipe.hasJournal = hasJournal;
+    if (hasJournal) pipe.journal = journal;
+    memcpy(pipe.journalPath, journalPath, sizeof(journalPath));
+    startStage(&decoder, decoderStage, &pipe);
+    startStage(&writer, writerStage, &pipe);
 
     // Recebe pacotes até o final do arquivo (pacote de controle final)
-    while ((packetSize = llread(buffer)) > 0) {
-        if (buffer[0] == 0x01) {  // Verifica se é um pacote de dados
-            fwrite(buffer + 4, sizeof(unsigned char), packetSize - 4, file);
-        } else if (buffer[0] == 0x03) {  // Pacote de controle final
+    int packetSize;
+    int tag = PIPE_ERROR;
+    long long finalSize = -1;
+    long long sentHashStart = -1;
+    unsigned long long sentHash = 0;
+    Progress progress;
+    int progressing = FALSE;   // Só depois do pacote de início (o tamanho e a retoma)
+    while (!atomic_load(&pipe.abort)) {
+        FrameSlot *packet = first;
+        if (packet != NULL) {
+            packetSize = firstSize;
+            first = NULL;
+        } else {
+            if ((packet = acquireSlot(&pipe, 0)) == NULL) break;
+            if ((packetSize = llread(packet->data)) <= 0) {
+                framePoolRelease(packet);
+                break;
+            }
+        }
+        if (packet->data[0] == 0x03) {  // Pacote de controle final
+            finalSize = controlFileSize(packet->data, packetSize);
+            int length;
+            const unsigned char *value = controlField(packet->data, packetSize, CONTROL_CONTENT_HASH, &length);
+            if (value != NULL && length == CONTENT_HASH_FIELD_SIZE) {
+                sentHashStart = 0;
+                for (int b = 0; b < 8; b++) sentHashStart = (sentHashStart << 8) | value[b];
+                for (int b = 8; b < 16; b++) sentHash = (sentHash << 8) | value[b];
+            }
+            framePoolRelease(packet);
+            tag = PIPE_EOF;
             break;
         }
+        if (packet->data[0] == 0x02) {  // Pacote de controle inicial (ou um pedido de retoma repetido)
+            int result = readStartPacket(&pipe, packet->data, packetSize);
+            if (result == 0 && !progressing) {
+                progressInit(&progress, FALSE, filename, controlFileSize(packet->data, packetSize),
+                             pipe.resumeOffset);
+                progressing = TRUE;
+                metricsValues.fileTotal = progress.total;
+            }
+            framePoolRelease(packet);
+            if (result < 0) break;
+            continue;
+        }
+        if (packet->data[0] == PACKET_DELTA_REQUEST) {  // Pedido de assinaturas da cópia anterior
+            int result = answerSignatures(&pipe, packet->data, packetSize);
+            framePoolRelease(packet);
+            if (result < 0) break;
+            continue;
+        }
+        if (packet->data[0] == PACKET_DEDUP_OFFER) {    // Oferta de pedaços
+            int result = answerOffer(&pipe, packet->data, packetSize);
+            framePoolRelease(packet);
+            if (result < 0) break;
+            continue;
+        }
+        spscPush(&pipe.first, (SpscItem){packet, packetSize, PIPE_DATA});
+        if (progressing) progressStep(&progress, atomic_load_explicit(&pipe.progressEnd, memory_order_relaxed));
+        if (metricsDue(&metrics)) publishMetrics(&pipe);
     }
+    framePoolRelease(first);
+    spscPush(&pipe.first, (SpscItem){NULL, 0, tag});
 
+    pthread_join(decoder, NULL);
+    pthread_join(writer, NULL);
+    if (progressing) progressFinish(&progress, pipe.writtenEnd);
+
+    // Os dados só vão para o disco no fim (e nos checkpoints do diário)
+    if (writeSinkSync(&pipe.sink) < 0) {
+        printf("Erro ao escrever %s\n", filename);
+        atomic_store(&pipe.abort, 1);
+    }
+    if (!batchMode) {
+        printPipelineStats(&pipe, "ligação", "descodificação", "escrita");
+        printSinkStats(&pipe);
+    }
+
+    // Com pacotes com offset o fim só vale se todos os blocos chegaram
+    int complete = TRUE;
+    if (pipe.tracking) {
+        complete = rangeBitmapComplete(&pipe.received);
+        if (!batchMode || !complete) {
+            printf("Blocos recebidos em %s: %lld/%lld (%lld bytes)\n", filename, pipe.received.receivedBlocks,
+                   pipe.received.blocks, pipe.received.receivedBytes);
+        }
+        if (!complete) {
+            printf("Erro: falta o bloco em %lld\n", rangeBitmapNextMissing(&pipe.received, 0));
+        }
+        rangeBitmapFree(&pipe.received);
+    }
+
+    // Num stream (e no delta e no dedup, sem mapa de blocos) as tramas chegam
+    // por ordem: basta comparar o fim com o tamanho final
+    if ((pipe.streaming || pipe.delta || pipe.dedup) && tag == PIPE_EOF) {
+        complete = pipe.writtenEnd == finalSize;
+        if (pipe.streaming) {
+            printf("Stream: %lld bytes recebidos, %lld anunciados no fim\n", pipe.writtenEnd, finalSize);
+        }
+    }
+    if (pipe.basis != NULL && (!batchMode || !complete)) {
+        printf("Delta: %lld bytes em pacotes de dados, %lld copiados da cópia anterior em %ld referências\n",
+               pipe.literalBytes, pipe.copiedBytes, pipe.references);
+    }
+
+    // O hash do transmissor (se o enviou) tem de ser igual ao dos dados escritos
+    if (sentHashStart >= 0 && tag == PIPE_EOF && complete) {
+        unsigned long long digest = contentHashDigest(&pipe.hash);
+        if (pipe.hashGap || sentHashStart != pipe.hashStart) {
+            printf("Aviso: hash do conteúdo de %s não verificado (dados fora de ordem)\n", filename);
+        } else if (digest != sentHash) {
+            printf("Erro: hash do conteúdo de %s é %016llx, o transmissor enviou %016llx\n", filename, digest,
+                   sentHash);
+            complete = FALSE;
+        } else if (!batchMode) {
+            printf("Hash do conteúdo: %016llx verificado (%llu bytes desde %lld, %.2f ms)\n", digest,
+                   pipe.hash.totalBytes, pipe.hashStart, pipe.hashNs / 1.0e6);
+        }
+    }
+
+    // Os pedaços novos só entram no armazém com o ficheiro completo e verificado
+    if (pipe.dedup) {
+        int added = 0;
+        if (complete && tag == PIPE_EOF && !atomic_load(&pipe.abort) && chunkStoreState > 0 &&
+            writeSinkFlush(&pipe.sink) == 0) {
+            added = storeNewChunks(&pipe);
+        }
+        if (!batchMode || !complete) {
+            printf("Dedup: %lld bytes em pacotes de dados, %lld do armazém em %ld pacotes de referências, %d "
+                   "pedaços novos no armazém (%d no total)\n", pipe.literalBytes, pipe.copiedBytes, pipe.references,
+                   added, chunkStore.count);
+        }
+        free(pipe.chunks);
+    }
+
+    // Completo, o diário deixa de ser preciso; senão fica o último estado para retomar
+    if (pipe.journaling) {
+        if (complete && tag == PIPE_EOF && !atomic_load(&pipe.abort)) {
+            journalRemove(pipe.journalPath);
+        } else if (checkpoint(&pipe) == 0) {
+            printf("Diário %s: retoma a partir de %lld bytes\n", pipe.journalPath,
+                   journalResumeOffset(&pipe.journal));
+        }
+        rangeBitmapFree(&pipe.written);
+    }
+
+    writeSinkClose(&pipe.sink);
     fclose(file);  // Fecha o arquivo após a recepção completa
-    return packetSize < 0 ? -1 : 0;
+    int received = tag == PIPE_EOF && complete && !atomic_load(&pipe.abort);
+
+    // Só um ficheiro completo substitui a cópia anterior; senão esta fica como estava
+    if (basis != NULL) {
+        fclose(basis);
+        if (received && rename(deltaPath, filename) < 0) {
+            printf("Erro ao substituir %s\n", filename);
+            received = FALSE;
+        }
+        if (!received) unlink(deltaPath);
+    }
+    if (received) metricsValues.files++;
+    publishMetrics(NULL);
+    return received ? 0 : -1;
+}
+
+// Escreve os ficheiros de um pacote agrupado dentro de dir.
+// Returns the number of files, or -1 on error.
+static int writePackedFiles(const char *dir, const unsigned char *packet, int size) {
+    int files = 0;
+    int pos = 1;
+    while (pos < size) {
+        int nameSize = packet[pos];
+        if (pos + PACKED_ENTRY_HEADER + nameSize > size) return -1;
+        char name[BATCH_NAME_MAX + 1];
+        memcpy(name, &packet[pos + 1], nameSize);
+        name[nameSize] = '\0';
+        pos += 1 + nameSize;
+        int dataSize = (packet[pos] << 8) | packet[pos + 1];
+        pos += 2;
+        if (pos + dataSize > size) return -1;
+
+        char path[JOURNAL_PATH_SIZE];
+        FILE *file = NULL;
+        if (fileBatchOutputPath(dir, name, path, sizeof(path)) < 0 || (file = openFile(path, "wb")) == NULL) {
+            fprintf(stderr, "Erro: não foi possível criar %s/%s\n", dir, name);
+            return -1;
+        }
+        int written = fwrite(&packet[pos], 1, dataSize, file);
+        if (fclose(file) != 0 || written != dataSize) return -1;
+        pos += dataSize;
+        files++;
+    }
+    return files;
+}
+
+// Recebe um lote para a diretoria dir até ao pacote de fim do lote, começando
+// pelo pacote packet (já lido)
+static int receiveBatch(const char *dir, FrameSlot *packet, int packetSize) {
+    batchMode = TRUE;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int files = 0, packedFiles = 0, expected = -1;
+    int result = 0;
+    for (;;) {
+        unsigned char type = packet->data[0];
+        int length;
+        const unsigned char *value;
+        if (type == 0x02) {
+            // Um ficheiro: o caminho relativo é o nome do pacote de início
+            char name[BATCH_NAME_MAX + 1] = "";
+            char path[JOURNAL_PATH_SIZE];
+            if ((value = controlField(packet->data, packetSize, CONTROL_FILE_NAME, &length)) != NULL) {
+                memcpy(name, value, length);
+                name[length] = '\0';
+            }
+            if (fileBatchOutputPath(dir, name, path, sizeof(path)) < 0) {
+                fprintf(stderr, "Erro: caminho inválido no lote: %s\n", name);
+                framePoolRelease(packet);
+                result = -1;
+                break;
+            }
+            result = receiveFile(path, packet, packetSize);
+            if (result < 0) break;
+            files++;
+        } else if (type == PACKET_PACKED) {
+            int count = writePackedFiles(dir, packet->data, packetSize);
+            framePoolRelease(packet);
+            if (count < 0) {
+                result = -1;
+                break;
+            }
+            files += count;
+            packedFiles += count;
+        } else {
+            if (type == PACKET_BATCH_END &&
+                (value = controlField(packet->data, packetSize, CONTROL_BATCH, &length)) != NULL && length == 4) {
+                expected = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
+            }
+            framePoolRelease(packet);
+            if (type == PACKET_BATCH_END) break;
+        }
+
+        if ((packet = framePoolAcquire()) == NULL) {
+            result = -1;
+            break;
+        }
+        if ((packetSize = llread(packet->data)) <= 0) {
+            framePoolRelease(packet);
+            result = -1;
+            break;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1.0e9;
+    printf("Lote em %s: %d ficheiros (%d agrupados) em %.2f s (%.1f ficheiros/s)\n", dir, files, packedFiles,
+           seconds, seconds > 0 ? files / seconds : 0.0);
+    if (result == 0 && expected != files) {
+        printf("Erro: o lote tinha %d ficheiros, recebidos %d\n", expected, files);
+        result = -1;
+    }
+    return result;
+}
+
+////////////////////////////////////////////////
+// PIPELINE - Etapas em threads ligadas por filas SPSC
+////////////////////////////////////////////////
+
+static int pipelineInit(Pipeline *pipe, FILE *file) {
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->file = file;
+    atomic_init(&pipe->abort, 0);
+    atomic_init(&pipe->packetBlocks, 1);
+    atomic_init(&pipe->progressEnd, 0);
+    framePoolGetStats(&pipe->poolStart);
+    contentHashInit(&pipe->hash);
+    if (spscInit(&pipe->first, PIPELINE_DEPTH) < 0 || spscInit(&pipe->second, PIPELINE_DEPTH) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Cria a thread de uma etapa
+static void startStage(pthread_t *thread, void *(*stage)(void *), Pipeline *pipe) {
+    if (pthread_create(thread, NULL, stage, pipe) != 0) {
+        perror("Erro ao criar thread do pipeline\n");
+        exit(-1);
+    }
+}
+
+// Obtém uma trama do pool, esperando se estiver esgotado (conta a espera na etapa)
+static FrameSlot *acquireSlot(Pipeline *pipe, int stage) {
+    FrameSlot *slot = framePoolAcquire();
+    if (slot != NULL) return slot;
+
+    struct timespec start, now, pause = {0, 50000};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((slot = framePoolAcquire()) == NULL && !atomic_load(&pipe->abort)) {
+        nanosleep(&pause, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pipe->poolStallMs[stage] += (now.tv_sec - start.tv_sec) * 1000.0 + (now.tv_nsec - start.tv_nsec) / 1.0e6;
+    return slot;
+}
+
+// Acrescenta dados ao hash do conteúdo (etapa de leitura no tx, de escrita no rx)
+static void updateHash(Pipeline *pipe, const unsigned char *data, int size) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    contentHashUpdate(&pipe->hash, data, size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pipe->hashNs += (end.tv_sec - start.tv_sec) * 1.0e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+// Publica as métricas: contadores e estado da ligação, e do pipeline do
+// ficheiro atual (NULL entre ficheiros)
+static void publishMetrics(Pipeline *pipe) {
+    if (metrics.segment == NULL) return;
+    LlCounters counters;
+    LlLinkHealth health;
+    LlTuning settings;
+    llCounters(&counters);
+    llLinkHealth(&health);
+    llGetTuning(&settings);
+    MetricsValues *values = &metricsValues;
+    const MetricsValues *base = &metricsBase;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    values->updated = now.tv_sec + now.tv_nsec / 1.0e9;
+    values->framesSent = base->framesSent + counters.framesSent;
+    values->framesAcked = base->framesAcked + counters.framesAcked;
+    values->framesReceived = base->framesReceived + counters.framesReceived;
+    values->framesRejected = base->framesRejected + counters.framesRejected;
+    values->retransmissions = base->retransmissions + counters.framesSent - counters.framesAcked -
+                              counters.framesOutstanding;
+    values->bytesAcked = base->bytesAcked + counters.ackedBytes;
+    values->bytesReceived = base->bytesReceived + counters.receivedBytes;
+    values->probesSent = base->probesSent + health.probesSent;
+    values->rttUs = health.rttUs;
+    values->window = settings.windowLimit;
+    values->outstanding = counters.framesOutstanding;
+    values->baudRate = health.baudRate;
+    values->linkState = health.state;
+    values->queueFirst = pipe != NULL ? spscSize(&pipe->first) : 0;
+    values->queueSecond = pipe != NULL ? spscSize(&pipe->second) : 0;
+    if (pipe != NULL) values->fileBytes = atomic_load_explicit(&pipe->progressEnd, memory_order_relaxed);
+    metricsPublish(&metrics, values);
+}
+
+// Passa os contadores da sessão que acabou para a base, antes de o llopen os pôr a zero
+static void addSessionMetrics() {
+    if (metrics.segment == NULL) return;
+    publishMetrics(NULL);
+    metricsBase = metricsValues;
+}
+
+static void closeMetrics() {
+    metricsClose(&metrics);
+}
+
+// Mostra a ocupação média das filas e o tempo que cada etapa passou bloqueada
+static void printPipelineStats(Pipeline *pipe, const char *stage1, const char *stage2, const char *stage3) {
+    SpscStats *first = &pipe->first.stats;
+    SpscStats *second = &pipe->second.stats;
+    printf("=== Pipeline ===\n");
+    printf("Fila %s -> %s: %ld pacotes, ocupação média %.2f/%d\n", stage1, stage2, first->pushes,
+           first->pushes ? (double)first->occupancySum / first->pushes : 0.0, PIPELINE_DEPTH);
+    printf("Fila %s -> %s: %ld pacotes, ocupação média %.2f/%d\n", stage2, stage3, second->pushes,
+           second->pushes ? (double)second->occupancySum / second->pushes : 0.0, PIPELINE_DEPTH);
+    printf("Etapa %s: bloqueada %.2f ms (fila cheia), %.2f ms (pool)\n", stage1,
+           first->producerStallMs, pipe->poolStallMs[0]);
+    printf("Etapa %s: bloqueada %.2f ms (fila vazia), %.2f ms (fila cheia), %.2f ms (pool)\n", stage2,
+           first->consumerStallMs, second->producerStallMs, pipe->poolStallMs[1]);
+    printf("Etapa %s: bloqueada %.2f ms (fila vazia)\n", stage3, second->consumerStallMs);
+    printf("================\n");
+}
+
+// Mostra o custo de montar os pacotes de dados: tempo por pacote, tramas do
+// pool por pacote (a leitura e a trama codificada) e mallocs durante o envio
+static void printPacketStats(Pipeline *pipe) {
+    FramePoolStats now;
+    framePoolGetStats(&now);
+    long packets = pipe->packetsBuilt;
+    printf("Pacotes de dados: %ld, %.0f ns por pacote (cabeçalho e stuffing), %.1f tramas do pool por pacote, "
+           "%ld alocações\n", packets, packets ? pipe->buildNs / packets : 0.0,
+           packets ? (double)(now.acquires - pipe->poolStart.acquires) / packets : 0.0,
+           now.allocations - pipe->poolStart.allocations);
+
+    FileSourceStats source;
+    fileSourceGetStats(&pipe->source, &source);
+    double megabytes = source.bytes / (1024.0 * 1024.0);
+    printf("Origem: %s, %lld bytes, %.2f ms de CPU por MB, faltas de página: %ld menores, %ld maiores\n",
+           source.mapped ? "mmap" : "fread", source.bytes, megabytes > 0 ? source.cpuMs / megabytes : 0.0,
+           source.minorFaults, source.majorFaults);
+}
+
+// Mostra as escritas do sink: o tempo no disco (na thread do sink) fica
+// separado da espera da etapa de escrita, que é o que pode atrasar a ligação
+static void printSinkStats(Pipeline *pipe) {
+    WriteSinkStats *stats = &pipe->sink.stats;
+    printf("Escrita: %ld pwrite de %.0f KiB em média, %.2f ms no disco, %.2f ms à espera de buffer, "
+           "fsync %.2f ms, %s\n", stats->writes, stats->writes ? stats->bytes / 1024.0 / stats->writes : 0.0,
+           stats->writeMs, stats->stallMs, stats->syncMs, stats->preallocated ? "pré-alocado" : "sem fallocate");
+    if (stats->holeBytes > 0) {
+        printf("Buracos: %lld bytes recriados %s\n", stats->holeBytes,
+               stats->holesPunched ? "com FALLOC_FL_PUNCH_HOLE" : "a escrever zeros");
+    }
 }
 
 // Abre um arquivo com o modo especificado
 static FILE* openFile(const char *filename, const char *mode) {
+    // "-" é o stdin do transmissor (enviado como stream)
+    if (strcmp(filename, "-") == 0 && mode[0] == 'r') return stdin;
     FILE *file = fopen(filename, mode);
     if (!file) {
         perror("Erro ao abrir o arquivo\n");
@@ -149,6 +2009,10 @@ static FILE* openFile(const char *filename, const char *mode) {
 
 // Calcula o tamanho do arquivo
 static long calculateFileSize(FILE *file) {
+    // Pipes, stdin e dispositivos não têm tamanho: são enviados como stream
+    struct stat info;
+    if (fstat(fileno(file), &info) < 0 || !S_ISREG(info.st_mode)) return STREAM_SIZE_UNKNOWN;
+
     // Move o ponteiro do arquivo para o final para obter o tamanho
     fseek(file, 0, SEEK_END);
     long size = ftell(file);
@@ -157,14 +2021,18 @@ static long calculateFileSize(FILE *file) {
     return size;
 }
 
-// Cria um pacote de controle para iniciar ou terminar a transmissão
-static unsigned char* createControlPacket(unsigned char type, const char *filename, long fileSize) {
+// Escreve em packet (capacity bytes) um pacote de controle para iniciar ou
+// terminar a transmissão. Com blockSize > 0 anuncia também o tamanho dos
+// blocos dos pacotes com offset.
+// Returns the packet size in bytes, or -1 if it does not fit.
+static int buildControlPacket(unsigned char *packet, int capacity, unsigned char type, const char *filename,
+                              long fileSize, int blockSize) {
     int filenameSize = strlen(filename);
-    unsigned char *packet = malloc(7 + filenameSize);
+    if (5 + sizeof(long) + filenameSize + (blockSize > 0 ? 6 : 0) > capacity || filenameSize > 255) return -1;
 
     // Define o tipo de controle e comprimento do tamanho do arquivo
     packet[0] = type;
-    packet[1] = 0;
+    packet[1] = CONTROL_FILE_SIZE;
     packet[2] = sizeof(long);
 
     // Insere o tamanho do arquivo no pacote
@@ -173,25 +2041,431 @@ static unsigned char* createControlPacket(unsigned char type, const char *filena
     }
 
     // Insere o nome do arquivo no pacote
-    packet[3 + sizeof(long)] = 1;
+    packet[3 + sizeof(long)] = CONTROL_FILE_NAME;
     packet[4 + sizeof(long)] = filenameSize;
     memcpy(packet + 5 + sizeof(long), filename, filenameSize);
+    int length = 5 + sizeof(long) + filenameSize;
+
+    if (blockSize > 0) {
+        packet[length++] = CONTROL_BLOCK_SIZE;
+        packet[length++] = 4;
+        for (int i = 3; i >= 0; i--) {
+            packet[length++] = (blockSize >> (8 * i)) & 0xFF;
+        }
+    }
+    return length;
+}
+
+// Cria um pacote de controle (buildControlPacket) numa trama do pool, que deve
+// ser devolvida com framePoolRelease. O tamanho fica em slot->length.
+static FrameSlot* createControlPacket(unsigned char type, const char *filename, long fileSize, int blockSize) {
+    FrameSlot *slot = framePoolAcquire();
+    int length = slot != NULL ? buildControlPacket(slot->data, slot->capacity, type, filename, fileSize, blockSize)
+                              : -1;
+    if (length < 0) {
+        fprintf(stderr, "Erro ao criar o pacote de controle\n");
+        framePoolRelease(slot);
+        return NULL;
+    }
+    slot->length = length;
+    return slot;
+}
+
+// Procura o campo type (TLV) de um pacote de controlo.
+// Returns a pointer to the value (length in *length), or NULL if it is missing.
+static const unsigned char *controlField(const unsigned char *packet, int size, unsigned char type, int *length) {
+    for (int i = 1; i + 2 <= size && i + 2 + packet[i + 1] <= size; i += 2 + packet[i + 1]) {
+        if (packet[i] == type) {
+            *length = packet[i + 1];
+            return &packet[i + 2];
+        }
+    }
+    return NULL;
+}
+
+// Tamanho do ficheiro num pacote de controlo (little-endian, como
+// buildControlPacket o escreve).
+// Returns the size, or STREAM_SIZE_UNKNOWN if it is unknown or missing.
+static long long controlFileSize(const unsigned char *packet, int size) {
+    int length;
+    const unsigned char *value = controlField(packet, size, CONTROL_FILE_SIZE, &length);
+    if (value == NULL || length == 0 || length > 8) return STREAM_SIZE_UNKNOWN;
+    // -1 (todos os bits a 1) num campo mais curto do que 8 bytes
+    if (length < 8 && (value[length - 1] & 0x80)) return STREAM_SIZE_UNKNOWN;
+    unsigned long long raw = 0;
+    for (int b = length - 1; b >= 0; b--) raw = (raw << 8) | value[b];
+    return (long long)raw < 0 ? STREAM_SIZE_UNKNOWN : (long long)raw;
+}
+
+// Acrescenta um campo (TLV) a um pacote de controlo.
+// Returns 0 on success, -1 if the packet does not fit in the slot.
+static int addControlField(FrameSlot *slot, unsigned char type, const unsigned char *value, int length) {
+    if (length > 255 || slot->length + 2 + length > slot->capacity) return -1;
+    slot->data[slot->length++] = type;
+    slot->data[slot->length++] = length;
+    if (length > 0) memcpy(&slot->data[slot->length], value, length);
+    slot->length += length;
+    return 0;
+}
 
-    return packet;
+// Acrescenta ao pacote de início a identidade do ficheiro (o hash; o nome e o
+// tamanho já lá estão) e o pedido de retoma.
+// Returns 0 on success, -1 if the packet does not fit in the slot.
+static int addResumeRequest(FrameSlot *slot, unsigned long long hash) {
+    unsigned char value[8];
+    for (int i = 0; i < 8; i++) {
+        value[i] = (hash >> (8 * (7 - i))) & 0xFF;
+    }
+    if (addControlField(slot, CONTROL_FILE_HASH, value, sizeof(value)) < 0) return -1;
+    return addControlField(slot, CONTROL_RESUME, NULL, 0);
+}
+
+// Acrescenta ao pacote de fim o primeiro byte enviado e o hash dos dados lidos
+static int addContentHash(FrameSlot *slot, Pipeline *pipe) {
+    unsigned long long digest = contentHashDigest(&pipe->hash);
+    unsigned char value[CONTENT_HASH_FIELD_SIZE];
+    for (int i = 0; i < 8; i++) {
+        value[i] = (pipe->hashStart >> (8 * (7 - i))) & 0xFF;
+        value[8 + i] = (digest >> (8 * (7 - i))) & 0xFF;
+    }
+    if (!batchMode) {
+        printf("Hash do conteúdo: %016llx (%llu bytes desde %lld, %.2f ms)\n", digest, pipe->hash.totalBytes,
+               pipe->hashStart, pipe->hashNs / 1.0e6);
+    }
+    return addControlField(slot, CONTROL_CONTENT_HASH, value, sizeof(value));
 }
 
-// Cria um pacote de dados com número de sequência
-static unsigned char* createDataPacket(unsigned char sequence, const unsigned char *data, int dataSize) {
-    unsigned char *packet = malloc(dataSize + 4);
+// Envia o pacote de início com o pedido de retoma e espera pelo offset do
+// receptor. Cada tentativa é um pacote novo (um reenvio da mesma trama seria
+// descartado como duplicado). Sem resposta começa do zero: os blocos que o
+// receptor já tem são descartados por ele.
+// Returns the offset to resume from, or -1 if the link failed.
+static long long requestResume(FrameSlot *controlPacket, long fileSize) {
+    unsigned char reply[LL_REPLY_MAX_SIZE];
+    for (int attempt = 0; attempt < RESUME_REQUEST_TRIES; attempt++) {
+        if (sendControlPacket(controlPacket->data, controlPacket->length) < 0) return -1;
+        int size = llReadReply(reply, RESUME_REPLY_MS);
+        if (size < 0) return -1;
+        if (size != 8) continue;
 
-    // Estrutura do pacote de dados: flag, sequência e tamanho
-    packet[0] = 0x01;
-    packet[1] = sequence;
-    packet[2] = (dataSize >> 8) & 0xFF;
-    packet[3] = dataSize & 0xFF;
-    memcpy(packet + 4, data, dataSize);  // Adiciona os dados
+        long long offset = 0;
+        for (int i = 0; i < 8; i++) offset = (offset << 8) | reply[i];
+        return offset >= 0 && offset <= fileSize ? offset : 0;
+    }
+    printf("Aviso: sem resposta ao pedido de retoma, a enviar desde o início\n");
+    return 0;
+}
+
+// Transmissor: envia o pacote de início com o pedido de delta e recebe o
+// tamanho da cópia do receptor e as assinaturas dos seus blocos, em pedidos de
+// DELTA_REQUEST_BLOCKS. As respostas perdidas voltam a ser pedidas; um bloco
+// sem assinatura só deixa de poder ser encontrado. pipe->delta fica a TRUE se
+// houver assinaturas.
+// Returns 0 on success, -1 if the link failed.
+static int requestSignatures(Pipeline *pipe, FrameSlot *controlPacket, int blockSize) {
+    unsigned char reply[LL_REPLY_MAX_SIZE];
+    long long basisSize = -1;
+    for (int attempt = 0; attempt < RESUME_REQUEST_TRIES && basisSize < 0; attempt++) {
+        if (sendControlPacket(controlPacket->data, controlPacket->length) < 0) return -1;
+        int size = llReadReply(reply, DELTA_REPLY_MS);
+        if (size < 0) return -1;
+        if (size != 8) continue;
+        basisSize = 0;
+        for (int i = 0; i < 8; i++) basisSize = (basisSize << 8) | reply[i];
+    }
+    if (basisSize < 0) {
+        printf("Aviso: sem resposta ao pedido de delta, a enviar o ficheiro todo\n");
+        return 0;
+    }
+    if (deltaIndexInit(&pipe->index, basisSize, blockSize) < 0) return -1;
+
+    int blocks = pipe->index.blocks;
+    for (int first = 0; first < blocks; first += DELTA_REQUEST_BLOCKS) {
+        int end = first + DELTA_REQUEST_BLOCKS < blocks ? first + DELTA_REQUEST_BLOCKS : blocks;
+        for (int attempt = 0; attempt < RESUME_REQUEST_TRIES; attempt++) {
+            int missing = first;
+            while (missing < end && deltaIndexHas(&pipe->index, missing)) missing++;
+            if (missing == end) break;
+            int count = end - missing;
+            unsigned char request[DELTA_REQUEST_SIZE] = {PACKET_DELTA_REQUEST, missing >> 24, missing >> 16,
+                                                         missing >> 8, missing, count >> 8, count};
+            if (sendControlPacket(request, sizeof(request)) < 0) return -1;
+
+            // Uma resposta por bloco, pela ordem: a última do pedido acaba a espera
+            int size;
+            while ((size = llReadReply(reply, DELTA_REPLY_MS)) > 0) {
+                if (size != DELTA_SIGNATURE_SIZE) continue;
+                int block = (reply[0] << 16) | (reply[1] << 8) | reply[2];
+                DeltaSignature signature = {0, 0};
+                for (int i = 3; i < 7; i++) signature.weak = (signature.weak << 8) | reply[i];
+                for (int i = 7; i < 15; i++) signature.strong = (signature.strong << 8) | reply[i];
+                deltaIndexSet(&pipe->index, block, &signature);
+                if (block == end - 1) break;
+            }
+            if (size < 0) return -1;
+        }
+    }
+    if (deltaIndexBuild(&pipe->index) < 0) return -1;
+    pipe->delta = blocks > 0;
+    printf("Delta: cópia do receptor com %lld bytes, %d/%d assinaturas de blocos de %d bytes\n", basisSize,
+           pipe->index.known, blocks, blockSize);
+    return 0;
+}
+
+// Receptor: responde a um pedido de assinaturas (C = 0x08) com uma resposta
+// por bloco da cópia anterior.
+// Returns 0 on success, -1 if the link failed.
+static int answerSignatures(Pipeline *pipe, const unsigned char *packet, int size) {
+    int blockSize = pipe->deltaBlockSize;
+    if (size != DELTA_REQUEST_SIZE || pipe->basis == NULL || blockSize <= 0) return 0;
+    long long first = ((long long)packet[1] << 24) | (packet[2] << 16) | (packet[3] << 8) | packet[4];
+    long long end = first + ((packet[5] << 8) | packet[6]);
+    long long blocks = pipe->basisSize / blockSize;
+    if (end > blocks) end = blocks;
+    if (end > DELTA_MAX_BLOCKS) end = DELTA_MAX_BLOCKS;
+
+    unsigned char *data = malloc(blockSize);
+    if (data == NULL) return 0;
+    int result = 0;
+    for (long long block = first; block < end && result == 0; block++) {
+        if (pread(fileno(pipe->basis), data, blockSize, block * blockSize) != blockSize) break;
+        DeltaSignature signature;
+        deltaSignature(data, blockSize, &signature);
+        unsigned char reply[DELTA_SIGNATURE_SIZE];
+        reply[0] = (block >> 16) & 0xFF;
+        reply[1] = (block >> 8) & 0xFF;
+        reply[2] = block & 0xFF;
+        for (int i = 0; i < 4; i++) reply[3 + i] = (signature.weak >> (8 * (3 - i))) & 0xFF;
+        for (int i = 0; i < 8; i++) reply[7 + i] = (signature.strong >> (8 * (7 - i))) & 0xFF;
+        result = llReply(reply, sizeof(reply));
+    }
+    free(data);
+    return result;
+}
+
+// Pedaços que cabem num pacote do dedup com header bytes de cabeçalho
+static int dedupEntriesPerPacket(int header) {
+    int entries = (llMaxPayload() - header) / DEDUP_ENTRY_SIZE;
+    return entries < DEDUP_BATCH ? entries : DEDUP_BATCH;
+}
+
+// Acrescenta um lugar à lista de pedaços
+static int growChunks(Pipeline *pipe) {
+    int capacity = pipe->chunkCapacity > 0 ? 2 * pipe->chunkCapacity : 1024;
+    DedupChunk *chunks = realloc(pipe->chunks, capacity * sizeof(DedupChunk));
+    if (chunks == NULL) return -1;
+    pipe->chunks = chunks;
+    pipe->chunkCapacity = capacity;
+    return 0;
+}
+
+// Corta o ficheiro em pedaços (chunkerCut) e calcula o hash de cada um. O
+// receptor está à espera da oferta: entre leituras a ligação continua a
+// responder às sondagens dele (llService).
+// Returns 0 on success, -1 on error.
+static int chunkFile(Pipeline *pipe, FILE *file) {
+    unsigned char *buffer = malloc(DEDUP_READ_BUFFER);
+    if (buffer == NULL) return -1;
+    long long offset = 0, readOffset = 0;
+    int start = 0, filled = 0, eof = FALSE, result = 0;
+    while (result == 0) {
+        // Sem um pedaço máximo à frente: o resto passa para o início e lê-se mais
+        if (!eof && filled - start < CHUNKER_MAX_SIZE) {
+            memmove(buffer, buffer + start, filled - start);
+            filled -= start;
+            start = 0;
+            ssize_t bytesRead = pread(fileno(file), buffer + filled, DEDUP_READ_BUFFER - filled, readOffset);
+            if (bytesRead < 0) result = -1;
+            else if (bytesRead == 0) eof = TRUE;
+            else {
+                filled += bytesRead;
+                readOffset += bytesRead;
+            }
+            if (llService() < 0) result = -1;
+            continue;
+        }
+        if (start == filled) break;
+        int length = chunkerCut(buffer + start, filled - start);
+        if (pipe->chunkCount == pipe->chunkCapacity && growChunks(pipe) < 0) {
+            result = -1;
+            break;
+        }
+        pipe->chunks[pipe->chunkCount++] = (DedupChunk){offset, chunkStoreHash(buffer + start, length), length, FALSE};
+        start += length;
+        offset += length;
+    }
+    free(buffer);
+    return result;
+}
+
+// Transmissor: envia o pacote de início com o pedido de dedup, corta o
+// ficheiro e oferece os pedaços em pacotes de até DEDUP_BATCH. Uma oferta sem
+// resposta é repetida; se nunca tiver resposta os seus pedaços vão em pacotes
+// de dados. pipe->dedup fica a TRUE se o receptor tiver armazém.
+// Returns 0 on success, -1 if the link failed.
+static int offerChunks(Pipeline *pipe, FrameSlot *controlPacket, FILE *file) {
+    unsigned char reply[LL_REPLY_MAX_SIZE];
+    int answered = FALSE;
+    long long stored = 0;
+    for (int attempt = 0; attempt < RESUME_REQUEST_TRIES && !answered; attempt++) {
+        if (sendControlPacket(controlPacket->data, controlPacket->length) < 0) return -1;
+        int size = llReadReply(reply, DEDUP_REPLY_MS);
+        if (size < 0) return -1;
+        if (size != 8) continue;
+        unsigned long long raw = 0;
+        for (int i = 0; i < 8; i++) raw = (raw << 8) | reply[i];
+        stored = (long long)raw;
+        answered = TRUE;
+    }
+    if (!answered || stored < 0) {
+        printf("Aviso: %s, a enviar o ficheiro todo\n",
+               answered ? "o receptor não tem armazém de pedaços" : "sem resposta ao pedido de dedup");
+        return 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (chunkFile(pipe, file) < 0) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double chunkMs = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1.0e6;
+
+    FrameSlot *offer = framePoolAcquire();
+    if (offer == NULL) return -1;
+    int perOffer = dedupEntriesPerPacket(DEDUP_OFFER_HEADER);
+    int known = 0;
+    long long knownBytes = 0;
+    for (int first = 0; first < pipe->chunkCount; first += perOffer) {
+        int count = pipe->chunkCount - first < perOffer ? pipe->chunkCount - first : perOffer;
+        unsigned char *packet = offer->data;
+        packet[0] = PACKET_DEDUP_OFFER;
+        for (int i = 0; i < 4; i++) packet[1 + i] = (first >> (8 * (3 - i))) & 0xFF;
+        for (int i = 0; i < 8; i++) packet[5 + i] = (pipe->chunks[first].offset >> (8 * (7 - i))) & 0xFF;
+        packet[13] = count;
+        for (int k = 0; k < count; k++) {
+            DedupChunk *chunk = &pipe->chunks[first + k];
+            unsigned char *entry = packet + DEDUP_OFFER_HEADER + k * DEDUP_ENTRY_SIZE;
+            for (int i = 0; i < 8; i++) entry[i] = (chunk->hash >> (8 * (7 - i))) & 0xFF;
+            for (int i = 0; i < 4; i++) entry[8 + i] = (chunk->length >> (8 * (3 - i))) & 0xFF;
+        }
+
+        // Só conta a resposta a esta oferta (uma atrasada de outra é ignorada)
+        answered = FALSE;
+        for (int attempt = 0; attempt < RESUME_REQUEST_TRIES && !answered; attempt++) {
+            if (sendControlPacket(packet, DEDUP_OFFER_HEADER + count * DEDUP_ENTRY_SIZE) < 0) {
+                framePoolRelease(offer);
+                return -1;
+            }
+            int size;
+            while (!answered && (size = llReadReply(reply, DEDUP_REPLY_MS)) > 0) {
+                int index = (reply[0] << 24) | (reply[1] << 16) | (reply[2] << 8) | reply[3];
+                if (size != DEDUP_REPLY_SIZE || index != first) continue;
+                unsigned long long bits = 0;
+                for (int i = 4; i < 12; i++) bits = (bits << 8) | reply[i];
+                for (int k = 0; k < count; k++) {
+                    DedupChunk *chunk = &pipe->chunks[first + k];
+                    chunk->stored = (bits >> k) & 1;
+                    known += chunk->stored;
+                    knownBytes += chunk->stored ? chunk->length : 0;
+                }
+                answered = TRUE;
+            }
+            if (size < 0) {
+                framePoolRelease(offer);
+                return -1;
+            }
+        }
+    }
+    framePoolRelease(offer);
+    pipe->dedup = TRUE;
+    printf("Dedup: %d pedaços (%lld bytes em média, cortados em %.2f ms), %d já no armazém do receptor (%lld "
+           "bytes, %lld pedaços no armazém)\n", pipe->chunkCount,
+           pipe->chunkCount ? (pipe->chunks[pipe->chunkCount - 1].offset + pipe->chunks[pipe->chunkCount - 1].length) /
+                              pipe->chunkCount : 0LL, chunkMs,
+           known, knownBytes, stored);
+    return 0;
+}
+
+// Receptor: responde a uma oferta de pedaços (C = 0x0A) com um bit por
+// pedaço que já está no armazém e guarda os que faltam para os acrescentar no fim.
+// Returns 0 on success, -1 if the link failed.
+static int answerOffer(Pipeline *pipe, const unsigned char *packet, int size) {
+    if (size < DEDUP_OFFER_HEADER || chunkStoreState <= 0 || !pipe->dedup) return 0;
+    int count = packet[13];
+    if (count > DEDUP_BATCH || size != DEDUP_OFFER_HEADER + count * DEDUP_ENTRY_SIZE) return 0;
+    long long offset = 0;
+    for (int b = 5; b < 13; b++) offset = (offset << 8) | packet[b];
+
+    unsigned long long bits = 0;
+    for (int k = 0; k < count; k++) {
+        const unsigned char *entry = packet + DEDUP_OFFER_HEADER + k * DEDUP_ENTRY_SIZE;
+        unsigned long long hash = 0;
+        int length = 0;
+        for (int b = 0; b < 8; b++) hash = (hash << 8) | entry[b];
+        for (int b = 8; b < 12; b++) length = (length << 8) | entry[b];
+        if (chunkStoreHas(&chunkStore, hash, length)) {
+            bits |= 1ULL << k;
+        } else if (offset >= pipe->offeredEnd && length > 0 && length <= CHUNKER_MAX_SIZE &&
+                   (pipe->chunkCount < pipe->chunkCapacity || growChunks(pipe) == 0)) {
+            pipe->chunks[pipe->chunkCount++] = (DedupChunk){offset, hash, length, FALSE};
+        }
+        offset += length;
+    }
+    if (offset > pipe->offeredEnd) pipe->offeredEnd = offset;
+
+    unsigned char reply[DEDUP_REPLY_SIZE];
+    memcpy(reply, packet + 1, 4);
+    for (int i = 0; i < 8; i++) reply[4 + i] = (bits >> (8 * (7 - i))) & 0xFF;
+    return llReply(reply, sizeof(reply));
+}
+
+// Escreve o cabeçalho de um pacote de dados nos bytes antes de data (há pelo
+// menos DATA_HEADROOM): com número de sequência, ou com o offset dos dados no
+// ficheiro se o receptor os aceitar. O pacote começa em data - header.
+// Returns the header size, or -1 if dataSize does not fit in the length field.
+static int writeDataHeader(unsigned char *data, unsigned char sequence, long long offset, int dataSize) {
+    if (dataSize > DATA_MAX_CHUNK) {
+        fprintf(stderr, "Erro ao criar o pacote de dados\n");
+        return -1;
+    }
+    int header = offsetPackets ? DATA_OFFSET_HEADER_SIZE : DATA_HEADER_SIZE;
+    unsigned char *packet = data - header;
+
+    // Estrutura do pacote de dados: flag, sequência (ou offset) e tamanho
+    if (offsetPackets) {
+        packet[0] = PACKET_DATA_OFFSET;
+        for (int i = 0; i < 8; i++) {
+            packet[1 + i] = (offset >> (8 * (7 - i))) & 0xFF;
+        }
+    } else {
+        packet[0] = 0x01;
+        packet[1] = sequence;
+    }
+    packet[header - 2] = (dataSize >> 8) & 0xFF;
+    packet[header - 1] = dataSize & 0xFF;
+    return header;
+}
+
+// Bytes do ficheiro em cada pacote de dados: todo o payload acordado no llopen
+// menos o cabeçalho, sem passar do campo de tamanho de 16 bits
+static int dataChunkSize() {
+    if (!negotiatedPeer) return LEGACY_CHUNK_SIZE;
+    int header = offsetPackets ? DATA_OFFSET_HEADER_SIZE : DATA_HEADER_SIZE;
+    return llMaxPayload() - header < DATA_MAX_CHUNK ? llMaxPayload() - header : DATA_MAX_CHUNK;
+}
+
+// Bytes de cada bloco do mapa do receptor. Com o auto-tuner e um receptor que
+// aceita vários blocos por pacote, o pacote máximo divide-se em
+// TUNER_MAX_BLOCKS blocos e cada pacote leva alguns deles; senão um pacote é um bloco.
+static int dataBlockSize() {
+    return tuning && multiBlockPeer ? dataChunkSize() / TUNER_MAX_BLOCKS : dataChunkSize();
+}
 
-    return packet;
+// Passa para a ligação e para a leitura os valores escolhidos pelo auto-tuner
+static void applyTuning(Pipeline *pipe) {
+    const TunerSettings *settings = autoTunerSettings(&tuner);
+    LlTuning link = {settings->windowLimit, settings->retransmitMs, settings->retries};
+    llSetTuning(&link);
+    atomic_store(&pipe->packetBlocks, settings->blocks);
 }
 
 // Envia um pacote de controle e verifica se foi bem-sucedido
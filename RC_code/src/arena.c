@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+struct ArenaBlock
+{
+    ArenaBlock *previous;
+    size_t size;            // Bytes de data
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+void arenaInit(Arena *arena, size_t blockSize) {
+    memset(arena, 0, sizeof(*arena));
+    arena->blockSize = blockSize > 0 ? blockSize : ARENA_BLOCK_SIZE;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+        block = malloc(sizeof(ArenaBlock) + blockSize);
+        if (block == NULL) return NULL;
+        block->previous = arena->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        arena->blocks = block;
+        arena->stats.mallocs++;
+    }
+    void *pointer = &block->data[block->used];
+    block->used += size;
+    arena->stats.allocations++;
+    arena->stats.bytes += size;
+    return pointer;
+}
+
+char *arenaStrdup(Arena *arena, const char *text) {
+    size_t size = strlen(text) + 1;
+    char *copy = arenaAlloc(arena, size);
+    if (copy != NULL) memcpy(copy, text, size);
+    return copy;
+}
+
+void arenaFree(Arena *arena) {
+    while (arena->blocks != NULL) {
+        ArenaBlock *previous = arena->blocks->previous;
+        free(arena->blocks);
+        arena->blocks = previous;
+    }
+}
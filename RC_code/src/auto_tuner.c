@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "auto_tuner.h"
+
+#define TUNER_EPOCH_MS 300          // Duração mínima de uma época...
+#define TUNER_EPOCH_FRAMES 8        // ...e tramas confirmadas nela
+#define TUNER_MIN_GAIN 0.03         // Melhoria mínima para aceitar uma mudança
+#define TUNER_MIN_RETRANSMIT_MS 50
+#define TUNER_LOSS_RETRIES 0.10     // Com mais perdas do que isto numa época, mais tentativas
+#define TUNER_MAX_RETRIES 16
+#define TUNER_EXPLORE_EVERY 8       // De quantas em quantas sessões experimenta o outro enquadramento
+#define TUNER_DIMENSIONS 3
+
+enum { DIM_BLOCKS, DIM_WINDOW, DIM_RETRANSMIT };
+
+static const char *dimensionNames[TUNER_DIMENSIONS] = {"blocos por pacote", "teto da janela", "timeout (ms)"};
+
+static int dimensionValue(const TunerSettings *settings, int dimension) {
+    return dimension == DIM_BLOCKS ? settings->blocks
+         : dimension == DIM_WINDOW ? settings->windowLimit : settings->retransmitMs;
+}
+
+static unsigned long long nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static int clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+int autoTunerEnabled() {
+    const char *option = getenv("RCOM_AUTOTUNE");
+    return option != NULL && atoi(option) != 0;
+}
+
+// Ficheiro do perfil de serialPort: o nome da porta sem as barras
+static void profilePath(const char *serialPort, char *path, size_t size) {
+    const char *dir = getenv("RCOM_PROFILE_DIR");
+    char home[TUNER_PATH_SIZE];
+    if (dir == NULL) {
+        const char *base = getenv("HOME");
+        snprintf(home, sizeof(home), "%s/.rcom", base != NULL ? base : "/tmp");
+        dir = home;
+    }
+    mkdir(dir, 0755);
+
+    char name[128];
+    int length = 0;
+    for (const char *c = serialPort; *c && length < (int)sizeof(name) - 1; c++) {
+        if (*c == '/' && length == 0) continue;
+        name[length++] = *c == '/' ? '_' : *c;
+    }
+    name[length] = '\0';
+    snprintf(path, size, "%.360s/%s.profile", dir, name);
+}
+
+static void loadProfile(AutoTuner *tuner) {
+    FILE *file = fopen(tuner->profilePath, "r");
+    if (file == NULL) return;
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char key[64];
+        double value;
+        if (sscanf(line, "%63[^=]=%lf", key, &value) != 2) continue;
+        if (strcmp(key, "blocks") == 0) tuner->current.blocks = (int)value;
+        else if (strcmp(key, "window") == 0) tuner->current.windowLimit = (int)value;
+        else if (strcmp(key, "retransmit_ms") == 0) tuner->current.retransmitMs = (int)value;
+        else if (strcmp(key, "retries") == 0) tuner->current.retries = (int)value;
+        else if (strcmp(key, "goodput_legacy") == 0) tuner->framingGoodput[0] = value;
+        else if (strcmp(key, "goodput_window") == 0) tuner->framingGoodput[1] = value;
+        else if (strcmp(key, "sessions") == 0) tuner->sessions = (int)value;
+    }
+    fclose(file);
+}
+
+static void saveProfile(const AutoTuner *tuner) {
+    char temp[TUNER_PATH_SIZE + 8];
+    snprintf(temp, sizeof(temp), "%s.tmp", tuner->profilePath);
+    FILE *file = fopen(temp, "w");
+    if (file == NULL) return;
+    fprintf(file, "blocks=%d\nwindow=%d\nretransmit_ms=%d\nretries=%d\n", tuner->current.blocks,
+            tuner->current.windowLimit, tuner->current.retransmitMs, tuner->current.retries);
+    fprintf(file, "goodput_legacy=%.0f\ngoodput_window=%.0f\nsessions=%d\n", tuner->framingGoodput[0],
+            tuner->framingGoodput[1], tuner->sessions);
+    if (fclose(file) == 0) rename(temp, tuner->profilePath);
+}
+
+void autoTunerPrepare(AutoTuner *tuner, const char *serialPort) {
+    memset(tuner, 0, sizeof(*tuner));
+    profilePath(serialPort, tuner->profilePath, sizeof(tuner->profilePath));
+    loadProfile(tuner);
+
+    // Enquadramento: o melhor conhecido; o que ainda não foi medido é
+    // experimentado de TUNER_EXPLORE_EVERY em TUNER_EXPLORE_EVERY sessões
+    if (getenv("RCOM_FRAMING") != NULL) return;
+    int window = tuner->framingGoodput[1] >= tuner->framingGoodput[0];
+    if (tuner->sessions % TUNER_EXPLORE_EVERY == TUNER_EXPLORE_EVERY - 1) window = !window;
+    setenv("RCOM_FRAMING", window ? "window" : "legacy", 0);
+}
+
+// Valores vizinhos de current no parâmetro dimension, na direção direction.
+// Returns 0 if they are out of range.
+static int neighbour(const AutoTuner *tuner, int dimension, int direction, TunerSettings *next) {
+    *next = tuner->current;
+    switch (dimension) {
+        case DIM_BLOCKS:
+            next->blocks = tuner->current.blocks + direction;
+            return next->blocks >= 1 && next->blocks <= tuner->maxBlocks;
+        case DIM_WINDOW:
+            next->windowLimit = direction > 0 ? tuner->current.windowLimit * 2 : tuner->current.windowLimit / 2;
+            next->windowLimit = clamp(next->windowLimit, 1, tuner->maxWindow);
+            return next->windowLimit != tuner->current.windowLimit;
+        default:
+            next->retransmitMs = direction > 0 ? tuner->current.retransmitMs * 2 : tuner->current.retransmitMs / 2;
+            next->retransmitMs = clamp(next->retransmitMs, tuner->minRetransmitMs, tuner->maxRetransmitMs);
+            return next->retransmitMs != tuner->current.retransmitMs;
+    }
+}
+
+// Passa ao parâmetro/direção seguinte (depois de uma tentativa rejeitada ou impossível)
+static void nextDirection(AutoTuner *tuner) {
+    if (tuner->direction > 0) {
+        tuner->direction = -1;
+    } else {
+        tuner->direction = 1;
+        tuner->dimension = (tuner->dimension + 1) % TUNER_DIMENSIONS;
+    }
+}
+
+// Escolhe a próxima tentativa. Returns 0 if no parameter can move.
+static int proposeTrial(AutoTuner *tuner) {
+    for (int i = 0; i < 2 * TUNER_DIMENSIONS; i++) {
+        if (neighbour(tuner, tuner->dimension, tuner->direction, &tuner->trial)) return 1;
+        nextDirection(tuner);
+    }
+    return 0;
+}
+
+void autoTunerStart(AutoTuner *tuner, int maxBlocks, int windowMode, int timeoutMs, int retries) {
+    tuner->maxBlocks = maxBlocks;
+    tuner->maxWindow = windowMode ? TUNER_MAX_WINDOW : 1;
+    tuner->minRetransmitMs = TUNER_MIN_RETRANSMIT_MS < timeoutMs ? TUNER_MIN_RETRANSMIT_MS : timeoutMs;
+    tuner->maxRetransmitMs = timeoutMs;
+    tuner->baseRetries = retries;
+    tuner->framingWindow = windowMode;
+
+    // Sem perfil: os valores do llopen (pacote máximo, janela sem teto)
+    TunerSettings *current = &tuner->current;
+    current->blocks = current->blocks > 0 ? clamp(current->blocks, 1, maxBlocks) : maxBlocks;
+    current->windowLimit = current->windowLimit > 0 ? clamp(current->windowLimit, 1, tuner->maxWindow)
+                                                    : tuner->maxWindow;
+    current->retransmitMs = current->retransmitMs > 0
+                          ? clamp(current->retransmitMs, tuner->minRetransmitMs, tuner->maxRetransmitMs)
+                          : timeoutMs;
+    current->retries = clamp(current->retries > retries ? current->retries : retries, retries, TUNER_MAX_RETRIES);
+    tuner->trial = *current;
+    tuner->phase = TUNER_BASELINE;
+    tuner->direction = -1;  // Primeiro experimenta pacotes mais pequenos (linhas com erros)
+    tuner->epochStartMs = nowMs();
+    llCounters(&tuner->epochStart);
+    printf("DEBUG (tuner): Início com %d/%d blocos por pacote, janela até %d, timeout %d ms, %d tentativas (%s)\n",
+           current->blocks, maxBlocks, current->windowLimit, current->retransmitMs, current->retries,
+           tuner->profilePath);
+}
+
+const TunerSettings *autoTunerSettings(const AutoTuner *tuner) {
+    return tuner->phase == TUNER_TRIAL ? &tuner->trial : &tuner->current;
+}
+
+int autoTunerStep(AutoTuner *tuner) {
+    LlCounters counters;
+    llCounters(&counters);
+    unsigned long long now = nowMs();
+    long framesAcked = counters.framesAcked - tuner->epochStart.framesAcked;
+    if (now - tuner->epochStartMs < TUNER_EPOCH_MS || framesAcked < TUNER_EPOCH_FRAMES) return 0;
+
+    double goodput = (counters.ackedBytes - tuner->epochStart.ackedBytes) * 1000.0 / (now - tuner->epochStartMs);
+    // Retransmissões: o que foi enviado e não ficou confirmado nem está na janela
+    long framesSent = counters.framesSent - tuner->epochStart.framesSent;
+    long framesLost = framesSent - framesAcked - (counters.framesOutstanding - tuner->epochStart.framesOutstanding);
+    double loss = framesSent > 0 ? (double)framesLost / framesSent : 0;
+    if (goodput > tuner->bestGoodput) tuner->bestGoodput = goodput;
+    tuner->epochStartMs = now;
+    tuner->epochStart = counters;
+
+    // Com muitas perdas uma trama pode esgotar as tentativas: sobe-as já
+    int changed = 0;
+    if (loss > TUNER_LOSS_RETRIES && tuner->current.retries < TUNER_MAX_RETRIES) {
+        tuner->current.retries = clamp(tuner->current.retries * 2, 1, TUNER_MAX_RETRIES);
+        tuner->trial.retries = tuner->current.retries;
+        printf("DEBUG (tuner): %.0f%% de tramas perdidas, %d tentativas por trama\n", 100 * loss,
+               tuner->current.retries);
+        changed = 1;
+    }
+
+    if (tuner->phase == TUNER_TRIAL) {
+        tuner->trials++;
+        if (goodput > tuner->referenceGoodput * (1 + TUNER_MIN_GAIN)) {
+            printf("DEBUG (tuner): %s %d -> %d: %.0f B/s (antes %.0f B/s)\n", dimensionNames[tuner->dimension],
+                   dimensionValue(&tuner->current, tuner->dimension), dimensionValue(&tuner->trial, tuner->dimension),
+                   goodput, tuner->referenceGoodput);
+            tuner->current = tuner->trial;
+            tuner->referenceGoodput = goodput;
+            tuner->changes++;
+            // Continua na mesma direção enquanto melhorar
+            if (neighbour(tuner, tuner->dimension, tuner->direction, &tuner->trial)) return 1;
+            nextDirection(tuner);
+        } else {
+            nextDirection(tuner);
+        }
+        // Volta aos valores aceites e mede de novo a referência
+        tuner->phase = TUNER_BASELINE;
+        return 1;
+    }
+
+    tuner->referenceGoodput = goodput;
+    if (!proposeTrial(tuner)) return changed;
+    tuner->phase = TUNER_TRIAL;
+    return 1;
+}
+
+void autoTunerFinish(AutoTuner *tuner, double sessionGoodput) {
+    double *framing = &tuner->framingGoodput[tuner->framingWindow ? 1 : 0];
+    *framing = *framing > 0 ? 0.5 * (*framing + sessionGoodput) : sessionGoodput;
+    tuner->sessions++;
+    printf("DEBUG (tuner): %ld de %ld mudanças aceites, melhor época %.0f B/s; perfil: %d blocos, janela até %d, "
+           "timeout %d ms, %d tentativas\n", tuner->changes, tuner->trials, tuner->bestGoodput,
+           tuner->current.blocks, tuner->current.windowLimit, tuner->current.retransmitMs, tuner->current.retries);
+    saveProfile(tuner);
+}
@@ -0,0 +1,159 @@
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checkpoint_journal.h"
+
+#define JOURNAL_MAGIC "RCJ1"
+#define JOURNAL_PATH_MAX 4096
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static unsigned long long fnv1a(unsigned long long hash, const unsigned char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+int fileIdentityCompute(FILE *file, const char *name, FileIdentity *identity, int (*step)(void)) {
+    memset(identity, 0, sizeof(*identity));
+    snprintf(identity->name, sizeof(identity->name), "%s", name);
+    identity->hash = FNV_OFFSET;
+
+    unsigned char buffer[65536];
+    size_t bytesRead;
+    rewind(file);
+    int failed = 0;
+    while (!failed && (bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        identity->hash = fnv1a(identity->hash, buffer, bytesRead);
+        identity->fileSize += bytesRead;
+        if (step != NULL && step() < 0) failed = 1;
+    }
+    failed = failed || ferror(file);
+    rewind(file);
+    return failed ? -1 : 0;
+}
+
+int fileIdentityEquals(const FileIdentity *a, const FileIdentity *b) {
+    return a->fileSize == b->fileSize && a->hash == b->hash && strcmp(a->name, b->name) == 0;
+}
+
+// Campos do diário em big-endian, seguidos de um FNV-1a de tudo o que vem antes
+static int putNumber(unsigned char *buf, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) buf[i] = (value >> (8 * (bytes - 1 - i))) & 0xFF;
+    return bytes;
+}
+
+static unsigned long long getNumber(const unsigned char *buf, int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; i++) value = (value << 8) | buf[i];
+    return value;
+}
+
+#define JOURNAL_MAX_SIZE (4 + 8 + 8 + 4 + 1 + JOURNAL_NAME_MAX + 4 + 16 * JOURNAL_MAX_RANGES + 8)
+
+static int journalEncode(const CheckpointJournal *journal, unsigned char *buf) {
+    int size = 0;
+    int nameSize = strlen(journal->identity.name);
+    memcpy(buf, JOURNAL_MAGIC, 4);
+    size += 4;
+    size += putNumber(&buf[size], journal->identity.fileSize, 8);
+    size += putNumber(&buf[size], journal->identity.hash, 8);
+    size += putNumber(&buf[size], journal->blockSize, 4);
+    buf[size++] = nameSize;
+    memcpy(&buf[size], journal->identity.name, nameSize);
+    size += nameSize;
+    size += putNumber(&buf[size], journal->rangeCount, 4);
+    for (int i = 0; i < journal->rangeCount; i++) {
+        size += putNumber(&buf[size], journal->ranges[i].start, 8);
+        size += putNumber(&buf[size], journal->ranges[i].end, 8);
+    }
+    size += putNumber(&buf[size], fnv1a(FNV_OFFSET, buf, size), 8);
+    return size;
+}
+
+int journalLoad(const char *path, CheckpointJournal *journal) {
+    unsigned char buf[JOURNAL_MAX_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    int size = fread(buf, 1, sizeof(buf), file);
+    fclose(file);
+
+    memset(journal, 0, sizeof(*journal));
+    if (size < 4 + 8 + 8 + 4 + 1 + 4 + 8 || memcmp(buf, JOURNAL_MAGIC, 4) != 0) return -1;
+    if (getNumber(&buf[size - 8], 8) != fnv1a(FNV_OFFSET, buf, size - 8)) return -1;
+
+    int pos = 4;
+    journal->identity.fileSize = getNumber(&buf[pos], 8);
+    journal->identity.hash = getNumber(&buf[pos + 8], 8);
+    journal->blockSize = getNumber(&buf[pos + 16], 4);
+    int nameSize = buf[pos + 20];
+    pos += 21;
+    if (pos + nameSize + 4 + 8 > size) return -1;
+    memcpy(journal->identity.name, &buf[pos], nameSize);
+    pos += nameSize;
+    journal->rangeCount = getNumber(&buf[pos], 4);
+    pos += 4;
+    if (journal->rangeCount < 0 || journal->rangeCount > JOURNAL_MAX_RANGES ||
+        pos + 16 * journal->rangeCount + 8 != size) return -1;
+    for (int i = 0; i < journal->rangeCount; i++, pos += 16) {
+        journal->ranges[i].start = getNumber(&buf[pos], 8);
+        journal->ranges[i].end = getNumber(&buf[pos + 8], 8);
+    }
+    return 0;
+}
+
+// Sincroniza a diretoria de path, para o rename sobreviver a uma falha de energia
+static void syncDirectory(const char *path) {
+    char copy[JOURNAL_PATH_MAX];
+    snprintf(copy, sizeof(copy), "%s", path);
+    int dir = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    if (dir < 0) return;
+    fsync(dir);
+    close(dir);
+}
+
+int journalSave(const char *path, const CheckpointJournal *journal) {
+    unsigned char buf[JOURNAL_MAX_SIZE];
+    int size = journalEncode(journal, buf);
+    char temp[JOURNAL_PATH_MAX];
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int)sizeof(temp)) return -1;
+
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (write(fd, buf, size) != size || fsync(fd) < 0) {
+        close(fd);
+        unlink(temp);
+        return -1;
+    }
+    close(fd);
+    if (rename(temp, path) < 0) {
+        unlink(temp);
+        return -1;
+    }
+    syncDirectory(path);
+    return 0;
+}
+
+void journalRemove(const char *path) {
+    if (unlink(path) == 0) syncDirectory(path);
+}
+
+void journalFromBitmap(CheckpointJournal *journal, const RangeBitmap *map) {
+    journal->blockSize = map->blockSize;
+    journal->rangeCount = 0;
+    long long start = rangeBitmapNextReceived(map, 0);
+    while (start < map->fileSize && journal->rangeCount < JOURNAL_MAX_RANGES) {
+        long long end = rangeBitmapNextMissing(map, start);
+        journal->ranges[journal->rangeCount++] = (JournalRange){start, end};
+        start = end < map->fileSize ? rangeBitmapNextReceived(map, end) : map->fileSize;
+    }
+}
+
+long long journalResumeOffset(const CheckpointJournal *journal) {
+    if (journal->rangeCount == 0 || journal->ranges[0].start != 0) return 0;
+    return journal->ranges[0].end;
+}
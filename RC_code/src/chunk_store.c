@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chunk_store.h"
+#include "content_hash.h"
+
+#define MAGIC_SIZE 8
+
+unsigned long long chunkStoreHash(const unsigned char *data, int length) {
+    ContentHash hash;
+    contentHashInit(&hash);
+    contentHashUpdate(&hash, data, length);
+    return contentHashDigest(&hash);
+}
+
+static unsigned int slotOf(const ChunkStore *store, unsigned long long hash) {
+    return (hash * 0x9E3779B97F4A7C15ULL) >> (64 - store->tableBits);
+}
+
+// Entrada do pedaço, ou a vazia onde ficaria
+static ChunkEntry *findEntry(const ChunkStore *store, unsigned long long hash, int length) {
+    unsigned int mask = (1u << store->tableBits) - 1;
+    for (unsigned int slot = slotOf(store, hash);; slot = (slot + 1) & mask) {
+        ChunkEntry *entry = &store->table[slot];
+        if (entry->length == 0 || (entry->hash == hash && entry->length == length)) return entry;
+    }
+}
+
+// Dobra a tabela quando passa de meio cheia
+static int insertEntry(ChunkStore *store, unsigned long long hash, int length, long long offset) {
+    if (2LL * (store->count + 1) > (1LL << store->tableBits)) {
+        ChunkEntry *old = store->table;
+        int oldSize = 1 << store->tableBits;
+        ChunkEntry *table = calloc(2 * oldSize, sizeof(ChunkEntry));
+        if (table == NULL) return -1;
+        store->table = table;
+        store->tableBits++;
+        for (int i = 0; i < oldSize; i++) {
+            if (old[i].length > 0) *findEntry(store, old[i].hash, old[i].length) = old[i];
+        }
+        free(old);
+    }
+    ChunkEntry *entry = findEntry(store, hash, length);
+    if (entry->length > 0) return 0;
+    *entry = (ChunkEntry){hash, length, offset};
+    store->count++;
+    store->bytes += length;
+    return 1;
+}
+
+static void putHeader(unsigned char *header, unsigned long long hash, int length) {
+    for (int i = 0; i < 8; i++) header[i] = (hash >> (8 * (7 - i))) & 0xFF;
+    for (int i = 0; i < 4; i++) header[8 + i] = (length >> (8 * (3 - i))) & 0xFF;
+}
+
+int chunkStoreOpen(ChunkStore *store, const char *path) {
+    memset(store, 0, sizeof(*store));
+    store->tableBits = 10;
+    store->table = calloc(1 << store->tableBits, sizeof(ChunkEntry));
+    store->fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (store->table == NULL || store->fd < 0 || fstat(store->fd, &info) < 0) {
+        chunkStoreClose(store);
+        return -1;
+    }
+
+    // Armazém novo: só o identificador
+    unsigned char magic[MAGIC_SIZE];
+    if (info.st_size == 0) {
+        if (pwrite(store->fd, CHUNK_STORE_MAGIC, MAGIC_SIZE, 0) != MAGIC_SIZE) {
+            chunkStoreClose(store);
+            return -1;
+        }
+        store->size = MAGIC_SIZE;
+        return 0;
+    }
+    if (pread(store->fd, magic, MAGIC_SIZE, 0) != MAGIC_SIZE || memcmp(magic, CHUNK_STORE_MAGIC, MAGIC_SIZE) != 0) {
+        chunkStoreClose(store);
+        return -1;
+    }
+
+    // O índice sai dos cabeçalhos; o que não chega a um registo inteiro é cortado
+    long long position = MAGIC_SIZE;
+    unsigned char header[CHUNK_STORE_HEADER];
+    while (position + CHUNK_STORE_HEADER <= info.st_size &&
+           pread(store->fd, header, CHUNK_STORE_HEADER, position) == CHUNK_STORE_HEADER) {
+        unsigned long long hash = 0;
+        int length = 0;
+        for (int i = 0; i < 8; i++) hash = (hash << 8) | header[i];
+        for (int i = 8; i < 12; i++) length = (length << 8) | header[i];
+        if (length <= 0 || length > CHUNK_STORE_MAX_LENGTH ||
+            position + CHUNK_STORE_HEADER + length > info.st_size) {
+            break;
+        }
+        if (insertEntry(store, hash, length, position + CHUNK_STORE_HEADER) < 0) {
+            chunkStoreClose(store);
+            return -1;
+        }
+        position += CHUNK_STORE_HEADER + length;
+    }
+    if (position < info.st_size && ftruncate(store->fd, position) < 0) {
+        chunkStoreClose(store);
+        return -1;
+    }
+    store->size = position;
+    return 0;
+}
+
+int chunkStoreHas(const ChunkStore *store, unsigned long long hash, int length) {
+    return store->table != NULL && length > 0 && findEntry(store, hash, length)->length > 0;
+}
+
+int chunkStoreRead(const ChunkStore *store, unsigned long long hash, int length, unsigned char *buf) {
+    if (!chunkStoreHas(store, hash, length)) return -1;
+    const ChunkEntry *entry = findEntry(store, hash, length);
+    if (pread(store->fd, buf, length, entry->offset) != length) return -1;
+    return chunkStoreHash(buf, length) == hash ? 0 : -1;
+}
+
+int chunkStoreAdd(ChunkStore *store, unsigned long long hash, const unsigned char *data, int length) {
+    if (length <= 0 || length > CHUNK_STORE_MAX_LENGTH) return -1;
+    if (chunkStoreHas(store, hash, length)) return 0;
+
+    // Os dados vão antes do índice: um registo só conta depois de estar no ficheiro
+    unsigned char header[CHUNK_STORE_HEADER];
+    putHeader(header, hash, length);
+    if (pwrite(store->fd, header, CHUNK_STORE_HEADER, store->size) != CHUNK_STORE_HEADER ||
+        pwrite(store->fd, data, length, store->size + CHUNK_STORE_HEADER) != length) {
+        return -1;
+    }
+    if (insertEntry(store, hash, length, store->size + CHUNK_STORE_HEADER) < 0) return -1;
+    store->size += CHUNK_STORE_HEADER + length;
+    store->added++;
+    store->addedBytes += length;
+    return 1;
+}
+
+int chunkStoreSync(ChunkStore *store) {
+    return store->fd >= 0 && fdatasync(store->fd) == 0 ? 0 : -1;
+}
+
+void chunkStoreClose(ChunkStore *store) {
+    if (store->fd >= 0) close(store->fd);
+    free(store->table);
+    store->fd = -1;
+    store->table = NULL;
+}
@@ -0,0 +1,42 @@
+#include <pthread.h>
+#include "chunker.h"
+
+// Máscaras do artigo do FastCDC para pedaços de 8 KiB: 15 e 11 bits espalhados
+// pela parte de cima do hash, que é a que depende de mais bytes
+#define MASK_STRICT 0x0003590703530000ULL
+#define MASK_LOOSE 0x0000d90003530000ULL
+
+static unsigned long long gear[256];
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+// Tabela fixa (splitmix64 com semente fixa): os cortes têm de ser os mesmos
+// em todas as sessões para os pedaços se repetirem
+static void gearInit() {
+    unsigned long long state = 0x52434F4D43444331ULL;
+    for (int i = 0; i < 256; i++) {
+        unsigned long long value = (state += 0x9E3779B97F4A7C15ULL);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = value ^ (value >> 31);
+    }
+}
+
+int chunkerCut(const unsigned char *data, int size) {
+    pthread_once(&gearOnce, gearInit);
+    if (size <= CHUNKER_MIN_SIZE) return size;
+    if (size > CHUNKER_MAX_SIZE) size = CHUNKER_MAX_SIZE;
+    int normal = size < CHUNKER_AVG_SIZE ? size : CHUNKER_AVG_SIZE;
+
+    // Os primeiros bytes não são vistos: o hash só depende dos últimos 64
+    unsigned long long hash = 0;
+    int i = CHUNKER_MIN_SIZE;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash & MASK_STRICT) == 0) return i + 1;
+    }
+    for (; i < size; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash & MASK_LOOSE) == 0) return i + 1;
+    }
+    return size;
+}
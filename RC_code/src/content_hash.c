@@ -0,0 +1,125 @@
+#include <string.h>
+#include "content_hash.h"
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static unsigned long long rotateLeft(unsigned long long value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Leituras little-endian sem alinhamento (o memcpy passa a um load)
+static unsigned long long read64(const unsigned char *p) {
+    unsigned long long value;
+    memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static unsigned long long read32(const unsigned char *p) {
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static unsigned long long round64(unsigned long long lane, unsigned long long input) {
+    lane += input * PRIME2;
+    lane = rotateLeft(lane, 31);
+    return lane * PRIME1;
+}
+
+static unsigned long long mergeRound(unsigned long long acc, unsigned long long lane) {
+    acc ^= round64(0, lane);
+    return acc * PRIME1 + PRIME4;
+}
+
+// Uma volta: cada acumulador consome 8 bytes, sem depender dos outros
+static void consumeStripe(unsigned long long lanes[4], const unsigned char *p) {
+    lanes[0] = round64(lanes[0], read64(p));
+    lanes[1] = round64(lanes[1], read64(p + 8));
+    lanes[2] = round64(lanes[2], read64(p + 16));
+    lanes[3] = round64(lanes[3], read64(p + 24));
+}
+
+void contentHashInit(ContentHash *hash) {
+    memset(hash, 0, sizeof(*hash));
+    hash->lanes[0] = PRIME1 + PRIME2;
+    hash->lanes[1] = PRIME2;
+    hash->lanes[2] = 0;
+    hash->lanes[3] = -PRIME1;
+}
+
+void contentHashUpdate(ContentHash *hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    hash->totalBytes += size;
+
+    // Completa a volta que ficou a meio na chamada anterior
+    if (hash->buffered > 0) {
+        size_t fill = CONTENT_HASH_STRIPE - hash->buffered;
+        if (size < fill) {
+            memcpy(hash->stripe + hash->buffered, p, size);
+            hash->buffered += size;
+            return;
+        }
+        memcpy(hash->stripe + hash->buffered, p, fill);
+        consumeStripe(hash->lanes, hash->stripe);
+        p += fill;
+        size -= fill;
+        hash->buffered = 0;
+    }
+
+    // Os acumuladores em variáveis locais ficam em registos durante o ciclo
+    unsigned long long lanes[4] = {hash->lanes[0], hash->lanes[1], hash->lanes[2], hash->lanes[3]};
+    for (; size >= CONTENT_HASH_STRIPE; p += CONTENT_HASH_STRIPE, size -= CONTENT_HASH_STRIPE) {
+        consumeStripe(lanes, p);
+    }
+    memcpy(hash->lanes, lanes, sizeof(lanes));
+
+    memcpy(hash->stripe, p, size);
+    hash->buffered = size;
+}
+
+unsigned long long contentHashDigest(const ContentHash *hash) {
+    unsigned long long acc;
+    if (hash->totalBytes >= CONTENT_HASH_STRIPE) {
+        const unsigned long long *lanes = hash->lanes;
+        acc = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (int i = 0; i < 4; i++) acc = mergeRound(acc, lanes[i]);
+    } else {
+        acc = hash->lanes[2] + PRIME5;  // lanes[2] é a semente (0)
+    }
+    acc += hash->totalBytes;
+
+    // O resto que não encheu uma volta: 8, 4 e 1 bytes de cada vez
+    const unsigned char *p = hash->stripe;
+    int left = hash->buffered;
+    for (; left >= 8; p += 8, left -= 8) {
+        acc ^= round64(0, read64(p));
+        acc = rotateLeft(acc, 27) * PRIME1 + PRIME4;
+    }
+    if (left >= 4) {
+        acc ^= read32(p) * PRIME1;
+        acc = rotateLeft(acc, 23) * PRIME2 + PRIME3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; p++, left--) {
+        acc ^= *p * PRIME5;
+        acc = rotateLeft(acc, 11) * PRIME1;
+    }
+
+    acc ^= acc >> 33;
+    acc *= PRIME2;
+    acc ^= acc >> 29;
+    acc *= PRIME3;
+    acc ^= acc >> 32;
+    return acc;
+}
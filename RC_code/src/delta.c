@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include "content_hash.h"
+#include "delta.h"
+
+#define WEAK_MASK 0xFFFF
+
+int deltaBlockSizeFor(long long fileSize) {
+    // Raiz quadrada inteira (o Makefile não liga a libm)
+    long long size = 0;
+    for (long long bit = 1LL << 30; bit > 0; bit >>= 1) {
+        if ((size + bit) * (size + bit) <= fileSize) size += bit;
+    }
+    size &= ~63LL;
+    if (size < DELTA_MIN_BLOCK) size = DELTA_MIN_BLOCK;
+    if (size > DELTA_MAX_BLOCK) size = DELTA_MAX_BLOCK;
+    return size;
+}
+
+unsigned int deltaWeak(const unsigned char *data, int size) {
+    unsigned int a = 0, b = 0;
+    for (int i = 0; i < size; i++) {
+        a += data[i];
+        b += (unsigned int)(size - i) * data[i];
+    }
+    return (a & WEAK_MASK) | ((b & WEAK_MASK) << 16);
+}
+
+unsigned int deltaRoll(unsigned int weak, unsigned char out, unsigned char in, int blockSize) {
+    unsigned int a = weak & WEAK_MASK;
+    unsigned int b = weak >> 16;
+    a = (a - out + in) & WEAK_MASK;
+    b = (b - (unsigned int)blockSize * out + a) & WEAK_MASK;
+    return a | (b << 16);
+}
+
+static unsigned long long strongHash(const unsigned char *data, int size) {
+    ContentHash hash;
+    contentHashInit(&hash);
+    contentHashUpdate(&hash, data, size);
+    return contentHashDigest(&hash);
+}
+
+void deltaSignature(const unsigned char *data, int size, DeltaSignature *signature) {
+    signature->weak = deltaWeak(data, size);
+    signature->strong = strongHash(data, size);
+}
+
+int deltaIndexInit(DeltaIndex *index, long long basisSize, int blockSize) {
+    memset(index, 0, sizeof(*index));
+    index->blockSize = blockSize;
+    long long blocks = blockSize > 0 ? basisSize / blockSize : 0;
+    index->blocks = blocks > DELTA_MAX_BLOCKS ? DELTA_MAX_BLOCKS : blocks;
+    if (index->blocks == 0) return 0;
+    index->signatures = malloc(index->blocks * sizeof(DeltaSignature));
+    index->present = calloc(index->blocks, 1);
+    if (index->signatures == NULL || index->present == NULL) {
+        deltaIndexFree(index);
+        return -1;
+    }
+    return 0;
+}
+
+void deltaIndexSet(DeltaIndex *index, int block, const DeltaSignature *signature) {
+    if (block < 0 || block >= index->blocks || index->present[block]) return;
+    index->signatures[block] = *signature;
+    index->present[block] = 1;
+    index->known++;
+}
+
+int deltaIndexHas(const DeltaIndex *index, int block) {
+    return block >= 0 && block < index->blocks && index->present[block];
+}
+
+static unsigned int bucketOf(const DeltaIndex *index, unsigned int weak) {
+    return (weak * 0x9E3779B1u) >> (32 - index->tableBits);
+}
+
+int deltaIndexBuild(DeltaIndex *index) {
+    if (index->blocks == 0) return 0;
+    // Pelo menos duas entradas por bloco, para as cadeias serem curtas
+    index->tableBits = 4;
+    while ((1LL << index->tableBits) < 2LL * index->blocks) index->tableBits++;
+    int entries = 1 << index->tableBits;
+    index->buckets = malloc(entries * sizeof(int));
+    index->next = malloc(index->blocks * sizeof(int));
+    if (index->buckets == NULL || index->next == NULL) return -1;
+    memset(index->buckets, 0xFF, entries * sizeof(int));
+
+    // Inseridos do fim para o início: numa cadeia os blocos ficam por ordem
+    for (int block = index->blocks - 1; block >= 0; block--) {
+        if (!index->present[block]) continue;
+        unsigned int bucket = bucketOf(index, index->signatures[block].weak);
+        index->next[block] = index->buckets[bucket];
+        index->buckets[bucket] = block;
+    }
+    return 0;
+}
+
+int deltaIndexFind(DeltaIndex *index, unsigned int weak, const unsigned char *data, int hint) {
+    if (index->buckets == NULL) return -1;
+    int hashed = 0;
+    unsigned long long strong = 0;
+
+    // O bloco seguinte ao da última referência é o mais provável
+    if (deltaIndexHas(index, hint) && index->signatures[hint].weak == weak) {
+        index->stats.weakHits++;
+        strong = strongHash(data, index->blockSize);
+        hashed = 1;
+        if (strong == index->signatures[hint].strong) {
+            index->stats.matches++;
+            return hint;
+        }
+        index->stats.falseMatches++;
+    }
+
+    for (int block = index->buckets[bucketOf(index, weak)]; block >= 0; block = index->next[block]) {
+        if (block == hint || index->signatures[block].weak != weak) continue;
+        if (!hashed) {
+            index->stats.weakHits++;
+            strong = strongHash(data, index->blockSize);
+            hashed = 1;
+        }
+        if (strong == index->signatures[block].strong) {
+            index->stats.matches++;
+            return block;
+        }
+        index->stats.falseMatches++;
+    }
+    return -1;
+}
+
+void deltaIndexFree(DeltaIndex *index) {
+    free(index->signatures);
+    free(index->present);
+    free(index->buckets);
+    free(index->next);
+    index->signatures = NULL;
+    index->present = NULL;
+    index->buckets = NULL;
+    index->next = NULL;
+    index->blocks = 0;
+}
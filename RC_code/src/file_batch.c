@@ -0,0 +1,103 @@
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "file_batch.h"
+
+#define BATCH_PATH_MAX 4096
+
+int fileBatchIsDirectory(const char *path) {
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static int addEntry(FileBatch *batch, const char *path, const char *name, long long size) {
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity > 0 ? 2 * batch->capacity : 64;
+        BatchEntry *entries = realloc(batch->entries, capacity * sizeof(BatchEntry));
+        if (entries == NULL) return -1;
+        batch->entries = entries;
+        batch->capacity = capacity;
+    }
+    BatchEntry *entry = &batch->entries[batch->count];
+    entry->path = arenaStrdup(&batch->names, path);
+    entry->name = arenaStrdup(&batch->names, name);
+    entry->size = size;
+    if (entry->path == NULL || entry->name == NULL) return -1;
+    batch->count++;
+    batch->totalBytes += size;
+    return 0;
+}
+
+// Percorre dir; prefix é o caminho relativo de dir ("" na raiz)
+static int scanDirectory(FileBatch *batch, const char *dir, const char *prefix) {
+    DIR *stream = opendir(dir);
+    if (stream == NULL) {
+        perror(dir);
+        return -1;
+    }
+    int result = 0;
+    struct dirent *item;
+    while (result == 0 && (item = readdir(stream)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) continue;
+        char path[BATCH_PATH_MAX], name[BATCH_PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, item->d_name);
+        snprintf(name, sizeof(name), "%s%s%s", prefix, *prefix ? "/" : "", item->d_name);
+
+        struct stat info;
+        if (lstat(path, &info) < 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            result = scanDirectory(batch, path, name);
+        } else if (S_ISREG(info.st_mode)) {
+            if (strlen(name) > BATCH_NAME_MAX) {
+                fprintf(stderr, "Caminho demasiado longo: %s\n", name);
+                result = -1;
+            } else {
+                result = addEntry(batch, path, name, info.st_size);
+            }
+        }
+    }
+    closedir(stream);
+    return result;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((const BatchEntry *)a)->name, ((const BatchEntry *)b)->name);
+}
+
+int fileBatchScan(const char *dir, FileBatch *batch) {
+    memset(batch, 0, sizeof(*batch));
+    arenaInit(&batch->names, 0);
+    if (scanDirectory(batch, dir, "") < 0) {
+        fileBatchFree(batch);
+        return -1;
+    }
+    if (batch->count > 1) qsort(batch->entries, batch->count, sizeof(BatchEntry), compareEntries);
+    return 0;
+}
+
+void fileBatchFree(FileBatch *batch) {
+    arenaFree(&batch->names);
+    free(batch->entries);
+    memset(batch, 0, sizeof(*batch));
+}
+
+int fileBatchOutputPath(const char *dir, const char *name, char *path, size_t size) {
+    if (name[0] == '\0' || name[0] == '/') return -1;
+    for (const char *part = name; part != NULL; part = strchr(part, '/') ? strchr(part, '/') + 1 : NULL) {
+        if (strncmp(part, "..", 2) == 0 && (part[2] == '/' || part[2] == '\0')) return -1;
+    }
+    if (snprintf(path, size, "%s/%s", dir, name) >= (int)size) return -1;
+
+    // Cria dir e as diretorias intermédias do caminho
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) return -1;
+    for (char *slash = path + strlen(dir) + 1; (slash = strchr(slash, '/')) != NULL; slash++) {
+        *slash = '\0';
+        int failed = mkdir(path, 0755) < 0 && errno != EEXIST;
+        *slash = '/';
+        if (failed) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file_source.h"
+
+static void readUsage(double *cpuMs, long *minor, long *major) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    *cpuMs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+             (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    *minor = usage.ru_minflt;
+    *major = usage.ru_majflt;
+}
+
+int fileSourceOpen(FileSource *source, FILE *file) {
+    memset(source, 0, sizeof(*source));
+    source->file = file;
+    readUsage(&source->startCpuMs, &source->startMinor, &source->startMajor);
+
+    const char *option = getenv("RCOM_MMAP");
+    struct stat info;
+    if (fstat(fileno(file), &info) < 0) return -1;
+    source->stream = !S_ISREG(info.st_mode);
+    source->fileSize = source->stream ? 0 : info.st_size;
+    if ((option != NULL && atoi(option) == 0) || source->stream || info.st_size == 0) return 0;
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (map == MAP_FAILED) return 0;     // Fica com fread
+    madvise(map, info.st_size, MADV_SEQUENTIAL);
+    source->map = map;
+    source->size = info.st_size;
+    source->position = ftello(file);
+    source->adviseEnd = source->position;
+    source->stats.mapped = 1;
+    return 0;
+}
+
+int fileSourceMapped(const FileSource *source) {
+    return source->map != NULL;
+}
+
+int fileSourceSlice(FileSource *source, int size, const unsigned char **slice) {
+    long long left = source->size - source->position;
+    if (left <= 0) return 0;
+    if (size > left) size = left;
+
+    // Pede a próxima janela de readahead quando a posição passa a metade da anterior
+    if (source->adviseEnd < source->size && source->position + FILE_SOURCE_READAHEAD / 2 >= source->adviseEnd) {
+        long page = sysconf(_SC_PAGESIZE);
+        long long start = source->adviseEnd & ~(long long)(page - 1);
+        long long end = source->position + FILE_SOURCE_READAHEAD;
+        if (end > source->size) end = source->size;
+        madvise((void *)(source->map + start), end - start, MADV_WILLNEED);
+        source->adviseEnd = end;
+    }
+
+    *slice = source->map + source->position;
+    source->position += size;
+    source->stats.bytes += size;
+    return size;
+}
+
+int fileSourceRead(FileSource *source, unsigned char *buf, int size) {
+    if (source->stream) {
+        ssize_t bytesRead;
+        while ((bytesRead = read(fileno(source->file), buf, size)) < 0 && errno == EINTR) {
+        }
+        if (bytesRead > 0) source->stats.bytes += bytesRead;
+        return bytesRead;
+    }
+    int bytesRead = fread(buf, 1, size, source->file);
+    if (bytesRead <= 0) return ferror(source->file) ? -1 : 0;
+    source->stats.bytes += bytesRead;
+    return bytesRead;
+}
+
+long long fileSourceHole(FileSource *source) {
+    if (source->stream) return 0;
+    long long position = source->map != NULL ? source->position : ftello(source->file);
+    if (position < source->dataEnd || position >= source->fileSize) return 0;
+
+    // O lseek muda o offset do descritor, que o fread usa: volta a pô-lo onde estava
+    int fd = fileno(source->file);
+    off_t saved = lseek(fd, 0, SEEK_CUR);
+    off_t data = lseek(fd, position, SEEK_DATA);
+    long long hole = 0;
+    if (data < 0) {
+        if (errno == ENXIO) hole = source->fileSize - position;    // Só buraco até ao fim
+        else source->dataEnd = source->fileSize;                    // Sem suporte: tudo dados
+    } else if (data > position) {
+        hole = data - position;
+    } else {
+        off_t end = lseek(fd, position, SEEK_HOLE);
+        source->dataEnd = end > position ? end : source->fileSize;
+    }
+    lseek(fd, saved, SEEK_SET);
+    return hole;
+}
+
+int fileSourceSkip(FileSource *source, long long size) {
+    if (source->map != NULL) {
+        source->position += size;
+    } else if (fseeko(source->file, size, SEEK_CUR) < 0) {
+        return -1;
+    }
+    source->stats.holeBytes += size;
+    return 0;
+}
+
+void fileSourceGetStats(FileSource *source, FileSourceStats *stats) {
+    double cpuMs;
+    long minor, major;
+    readUsage(&cpuMs, &minor, &major);
+    *stats = source->stats;
+    stats->cpuMs = cpuMs - source->startCpuMs;
+    stats->minorFaults = minor - source->startMinor;
+    stats->majorFaults = major - source->startMajor;
+}
+
+void fileSourceClose(FileSource *source) {
+    if (source->map != NULL) munmap((void *)source->map, source->size);
+    source->map = NULL;
+}
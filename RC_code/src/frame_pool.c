@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_pool.h"
+
+// Estado global do pool
+static FrameSlot *slots = NULL;         // Metadados das tramas
+static unsigned char *storage = NULL;   // Bloco único com os buffers de todas as tramas
+static int numSlots = 0;
+static int freeHead = -1;               // Topo da pilha de tramas livres
+static atomic_flag poolLock = ATOMIC_FLAG_INIT;
+static FramePoolStats poolStats;
+
+// A lista livre é partilhada entre threads, mas cada secção crítica é só
+// meia dúzia de instruções, por isso basta um spinlock
+static void lockPool() {
+    while (atomic_flag_test_and_set_explicit(&poolLock, memory_order_acquire)) {
+    }
+}
+
+static void unlockPool() {
+    atomic_flag_clear_explicit(&poolLock, memory_order_release);
+}
+
+// Arredonda n para o múltiplo seguinte de FRAME_POOL_ALIGN
+static int alignSize(int n) {
+    return (n + FRAME_POOL_ALIGN - 1) & ~(FRAME_POOL_ALIGN - 1);
+}
+
+int framePoolInit(int nSlots, int slotSize) {
+    if (slots != NULL) framePoolDestroy();
+    if (nSlots <= 0 || slotSize <= 0) return -1;
+
+    memset(&poolStats, 0, sizeof(poolStats));
+    int stride = alignSize(slotSize);
+
+    // Duas alocações, feitas uma única vez: metadados e buffers
+    slots = aligned_alloc(FRAME_POOL_ALIGN, alignSize(sizeof(FrameSlot) * nSlots));
+    poolStats.allocations++;
+    storage = aligned_alloc(FRAME_POOL_ALIGN, (size_t)stride * nSlots);
+    poolStats.allocations++;
+    if (slots == NULL || storage == NULL) {
+        fprintf(stderr, "Erro ao reservar memória para o pool de tramas\n");
+        framePoolDestroy();
+        return -1;
+    }
+
+    // Constrói a pilha de tramas livres
+    for (int i = 0; i < nSlots; i++) {
+        slots[i].data = storage + (size_t)stride * i;
+        slots[i].capacity = slotSize;
+        slots[i].length = 0;
+        atomic_init(&slots[i].refCount, 0);
+        slots[i].index = i;
+        slots[i].next = i + 1 < nSlots ? i + 1 : -1;
+    }
+    numSlots = nSlots;
+    freeHead = 0;
+    return 0;
+}
+
+void framePoolDestroy() {
+    free(slots);
+    free(storage);
+    slots = NULL;
+    storage = NULL;
+    numSlots = 0;
+    freeHead = -1;
+}
+
+FrameSlot *framePoolAcquire() {
+    lockPool();
+    if (freeHead < 0) {
+        poolStats.exhausted++;
+        unlockPool();
+        return NULL;
+    }
+    FrameSlot *slot = &slots[freeHead];
+    freeHead = slot->next;
+    slot->next = -1;
+    poolStats.acquires++;
+    if (++poolStats.inUse > poolStats.peakInUse) {
+        poolStats.peakInUse = poolStats.inUse;
+    }
+    unlockPool();
+
+    slot->length = 0;
+    atomic_store_explicit(&slot->refCount, 1, memory_order_relaxed);
+    return slot;
+}
+
+void framePoolRetain(FrameSlot *slot) {
+    atomic_fetch_add_explicit(&slot->refCount, 1, memory_order_relaxed);
+}
+
+void framePoolRelease(FrameSlot *slot) {
+    if (slot == NULL) return;
+    // Só quem retira a última referência devolve a trama ao pool
+    if (atomic_fetch_sub_explicit(&slot->refCount, 1, memory_order_acq_rel) != 1) return;
+
+    lockPool();
+    slot->next = freeHead;
+    freeHead = slot->index;
+    poolStats.releases++;
+    poolStats.inUse--;
+    unlockPool();
+}
+
+int framePoolAvailable() {
+    lockPool();
+    int available = numSlots - poolStats.inUse;
+    unlockPool();
+    return available;
+}
+
+void framePoolGetStats(FramePoolStats *stats) {
+    lockPool();
+    *stats = poolStats;
+    unlockPool();
+}
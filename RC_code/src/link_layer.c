@@ -1,16 +1,34 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
 #include "serial_port.h"
 #include "link_layer.h"
+#include "frame_pool.h"
+#include "link_layer_ext.h"
+#include "timer_wheel.h"
+#include "link_window.h"
+#include "link_negotiation.h"
+#include "serial_port_ext.h"
 
 #define C_RR0 0xAA   // RR0: el receptor está listo para recibir la trama de información número 0
 #define C_RR1 0xAB   // RR1: el receptor está listo para recibir la trama de información número 1
 #define C_REJ0 0x54  // REJ0: el receptor rechaza la trama de información número 0 (se detectó un error)
 #define C_REJ1 0x55  // REJ1: el receptor rechaza la trama de información número 1 (se detectó un error)
 int tramaRx = 0;
+
+// Mensagens de depuração por byte e por trama (stuffing, máquina de estados e
+// cada chamada do llread).
+// Desligadas por omissão porque dominam o tempo de CPU de cada trama.
+#ifndef DEBUG_BYTES
+#define DEBUG_BYTES 0
+#endif
+#define debugByte(...) do { if (DEBUG_BYTES) printf(__VA_ARGS__); } while (0)
+
 // Enums para caracteres de controle e comandos de comunicação
 typedef enum {
     FLAG = 0x7E,        //Usado para indicar o início e fim de uma trama
@@ -30,10 +48,82 @@ typedef enum {
     Command_DISC = 0x0B,    //Encerra a comunicação
     Command_DATA = 0x01,    //Indica envio de dados
     Command_RR = 0x05,      //Reconhece recebimento correto de uma trama
-    Command_REJ = 0x01      //Rejeita uma trama incorreta
+    Command_REJ = 0x01,     //Rejeita uma trama incorreta
+    Command_IW = 0x21,      //Trama de dados com janela: seguida do byte Ns
+    Command_IWP = 0x31,     //Trama de dados com janela e bit P: pede RR imediato
+    Command_RRW = 0x25,     //RR cumulativo com janela: seguido do byte Nr
+    Command_REJW = 0x29,    //REJ com janela (Go-Back-N): seguido do byte Nr
+    Command_KEEPALIVE = 0x13,       //Sondagem da ligação: o outro lado tem de responder
+    Command_KEEPALIVE_ACK = 0x17,   //Resposta a uma sondagem
+    Command_SETX = 0x43,    //SET estendido: seguido das capacidades do transmissor
+    Command_UAX = 0x47,     //UA estendido: seguido dos parâmetros acordados
+    Command_BAUD = 0x51,        //Pedido de mudança de taxa: seguido do índice da taxa
+    Command_BAUD_ACK = 0x53,    //Aceitação do pedido (ainda na taxa antiga)
+    Command_PROBE = 0x61,       //Sonda na nova taxa: índice, bloco de teste e FCS
+    Command_PROBE_ACK = 0x63,   //Resposta a uma sonda válida
+    Command_REPLY = 0x71        //Resposta da aplicação do receptor: seguida de um bloco curto
 } ControlCommands;
 
-unsigned char frame[MAX_FRAME_SIZE];    // Array para armazenar uma trama temporária
+// Janela deslizante (Go-Back-N). Os números de sequência vão de 0 a 63 para
+// nunca coincidirem com FLAG/ESCAPE, já que o cabeçalho não leva stuffing.
+#define SEQ_MODULUS 64
+#define MAX_WINDOW 32
+
+// Tamanho de uma trama de supervisão com número de sequência
+#define SUP_SEQ_FRAME_SIZE 6
+
+// Confirmações agregadas no receptor: um RR cumulativo por ACK_EVERY tramas
+// aceites ou quando o atraso expira, o que vier primeiro. Os valores podem ser
+// mudados com as variáveis de ambiente RCOM_ACK_EVERY e RCOM_ACK_DELAY_MS.
+#define ACK_EVERY 4
+#define ACK_DELAY_MIN_MS 2
+
+// Keepalive: sem bytes recebidos durante RCOM_KEEPALIVE_MS (por omissão o maior
+// entre KEEPALIVE_IDLE_MS e o tempo de uma trama máxima) envia uma sondagem e
+// repete-a até KEEPALIVE_PROBES vezes; se nada chegar em RCOM_DEAD_LINK_MS (por
+// omissão KEEPALIVE_PROBES x RCOM_KEEPALIVE_MS) mais o RTT, a ligação está morta.
+// RCOM_KEEPALIVE_MS=0 desliga o keepalive.
+#define KEEPALIVE_IDLE_MS 100
+#define KEEPALIVE_PROBES 3
+
+// Handshake SET/UA e DISC/UA: a primeira retransmissão é ao fim de poucos ms
+// (HANDSHAKE_RETRY_MIN_MS mais o RTT esperado) e o intervalo duplica até
+// HANDSHAKE_RETRY_MAX_MS; o total nunca passa de timeout x nRetransmissions.
+#define HANDSHAKE_RETRY_MIN_MS 5
+#define HANDSHAKE_RETRY_MAX_MS 250
+
+// Negociação no llopen: o transmissor envia um SETX com as suas capacidades
+// seguido de um SET normal. Um receptor que negoceia responde ao SETX com um UAX
+// com a interseção das capacidades; um receptor antigo ignora o SETX e responde
+// ao SET com UA, e a sessão usa as tramas de 5 bytes (stop-and-wait, BCC2 em XOR,
+// sem keepalive). As capacidades locais podem ser limitadas com RCOM_MAX_PAYLOAD,
+// RCOM_FCS (xor ou crc16) e RCOM_FRAMING (legacy ou window); RCOM_NEGOTIATE=0
+// desliga a negociação (comporta-se como um par antigo).
+#define HANDSHAKE_FRAME_MAX (5 + 2 * NEGOTIATION_MAX_SIZE)
+#define MIN_NEGOTIATED_PAYLOAD 64   // Menor RCOM_MAX_PAYLOAD aceite (cabe o pacote de controlo)
+
+// Pior caso das tramas de dados: cabeçalho com Ns, FCS de 2 bytes e todos os
+// bytes do pacote e do FCS escapados. As tramas do pool têm este tamanho para o
+// maior pacote local, calculado no llopen.
+#define FRAME_HEADER_MAX 5
+#define FCS_SIZE_MAX 2
+
+// Subida da taxa depois do llopen, até à menor RCOM_MAX_BAUD dos dois lados (por
+// omissão a taxa do llopen, ou seja, sem subida). O transmissor sobe um degrau da
+// tabela de cada vez: pede a taxa com BAUD, muda depois do BAUD_ACK e envia
+// BAUD_PROBES sondas com FCS; com menos de BAUD_PROBES_OK respostas volta à taxa
+// anterior, e o receptor volta sozinho se não receber uma sonda válida. Durante a
+// sessão, com mais de BAUD_ERROR_PERCENT% de REJ/timeouts o transmissor desce um
+// degrau; se nenhuma trama válida chegar durante baudFallbackMs (taxas diferentes
+// dos dois lados só produzem lixo) cada lado volta sozinho à taxa do llopen.
+#define BAUD_PROBES 3
+#define BAUD_PROBES_OK 2
+#define BAUD_PROBE_SIZE 64
+#define BAUD_VERIFY_MIN_MS 30
+#define BAUD_SWITCH_GUARD_US 3000   // O receptor só muda depois de o BAUD_ACK sair
+#define BAUD_ERROR_WINDOW 32
+#define BAUD_ERROR_PERCENT 25
+#define BAUD_FALLBACK_MS 2000       // Sem keepalive não há tramas periódicas: espera mais
 
 extern int fd;
 LinkLayerRole currentRole;  //Transmissor ou receptor
@@ -49,6 +139,8 @@ typedef struct {
     double tiempoRecepcion;   
     double tiempoDesconexion; 
     double tiempoTransferencia;
+    int tramasSupervisao;       // Tramas de supervisão enviadas (canal de retorno no receptor)
+    int bytesSupervisao;        // Bytes dessas tramas
 } EstatisticasConexao;
 
 // Instância global para as estatísticas
@@ -62,7 +154,8 @@ typedef enum {
     C_RCV,
     BCC1_OK,
     DATA,
-    STOP_R
+    STOP_R,
+    SEQ_RCV     // Número de sequência recebido, à espera do BCC1
 } LinkLayerState;
 
 int timeout = 3;                
@@ -73,12 +166,213 @@ clock_t desconexionStart;
 
 clock_t conexionStart;
 
-// Função de tratamento da interrupção de alarme
-void alarmHandler(int signal) {
+// Temporizadores da ligação (substituem o alarm(), que só permitia um)
+TimerWheel linkTimers;
+Timer handshakeTimer;   // SET/UA no llopen e DISC/UA no llclose
+Timer retransmitTimer;  // Trama de dados à espera de ACK
+Timer receiveTimer;     // Espera por uma trama no llread
+
+// Buffer de receção: cada read() traz todos os bytes disponíveis na porta
+#define RX_BUFFER_SIZE 512
+unsigned char rxBuffer[RX_BUFFER_SIZE];
+int rxStart = 0;
+int rxEnd = 0;
+
+// Uma trama de dados enviada e ainda não confirmada
+typedef struct {
+    FrameSlot *slot;            // Trama montada (com uma referência enquanto espera ACK)
+    int payloadSize;            // Tamanho do pacote (estatísticas)
+    int transmissions;          // Vezes que a trama foi enviada
+    int polled;                 // A última transmissão levava o bit P
+    unsigned long long startUs; // Início estimado da primeira transmissão na linha
+    Timer timer;                // Temporizador de retransmissão desta trama
+} WindowEntry;
+
+int windowMode = TRUE;              // Tramas com número de sequência e ACK cumulativo
+WindowEntry txWindow[SEQ_MODULUS];
+int sendBase = 0;                   // Ns da trama mais antiga por confirmar
+int nextSeq = 0;                    // Ns da próxima trama
+int outstanding = 0;                // Tramas por confirmar
+int windowSize = 1;                 // Janela atual, calculada pelo WindowSizer
+int windowTimeout = FALSE;          // Expirou o temporizador de uma trama da janela
+int pollNext = FALSE;               // A próxima trama pede RR imediato (bit P)
+int linkFailed = FALSE;             // Uma trama esgotou as retransmissões
+WindowSizer windowSizer;
+unsigned long long txBusyUntilUs = 0;   // Fim estimado da transmissão do que já foi escrito
+// Afinação durante a sessão (llSetTuning); 0 = valores do llopen
+int windowLimit = 0;                // Teto da janela calculada pelo WindowSizer
+int retransmitMs = 0;               // Timeout de retransmissão das tramas de dados
+long long bytesConfirmados = 0;     // Bytes de pacotes confirmados (llCounters)
+double ultimoRttUs = 0;             // Última amostra de RTT (llLinkHealth)
+int manterPorta = FALSE;            // O llclose não fecha a porta (llKeepPortOpen)
+int portaAberta = FALSE;            // A porta ficou aberta de uma sessão anterior
+// SET/SETX de um novo transmissor visto no llclose com a porta mantida aberta:
+// o llopen seguinte começa por ele em vez de esperar pela repetição
+unsigned char setPendente = 0;      // Controlo (0 = nenhum)
+unsigned char setPendenteBloco[NEGOTIATION_MAX_SIZE];
+int setPendenteTamanho = 0;
+int linkBaudRate = 9600;
+
+// Receptor com janela
+int expectedSeq = 0;                // Próximo Ns aceite
+int rejSent = FALSE;                // Já foi pedido um REJ para expectedSeq
+
+// RR adiado (confirmações agregadas)
+int ackEvery = ACK_EVERY;           // Tramas aceites por RR
+int ackDelayMs = 0;                 // Atraso máximo de um RR (0 = calculado pela taxa da linha)
+int ackPending = 0;                 // Tramas aceites ainda sem RR
+int ackDue = FALSE;                 // Expirou o atraso do RR pendente
+Timer ackTimer;
+int rrPorPoll = 0, rrPorContagem = 0, rrPorAtraso = 0;  // Motivo de cada RR agregado
+
+// Keepalive e deteção de ligação morta
+Timer keepaliveTimer;
+int keepaliveMs = 0;                // Silêncio antes de sondar (0 = desligado)
+int deadLinkMs = 0;                 // Silêncio depois da sondagem até declarar a ligação morta
+int keepaliveRunning = FALSE;
+int keepaliveDue = FALSE;           // Expirou o temporizador do keepalive
+int linkDead = FALSE;               // O outro lado não respondeu às sondagens
+unsigned long long lastRxMs = 0;    // Último read() com bytes
+unsigned long long probeLineMs = 0; // Instante estimado em que a primeira sondagem sem resposta entrou na linha
+int probesOutstanding = 0;          // Sondagens sem resposta
+double probeRttMs = 0;              // Tempo de resposta médio das sondagens
+long probesSent = 0;
+long probesAnswered = 0;
+LlError lastError = LL_ERROR_NONE;
+
+// Parâmetros da sessão acordados no llopen
+LinkCapabilities sessionCaps;
+int negotiated = FALSE;             // O outro lado respondeu ao SETX
+int fcsType = FCS_XOR;              // Verificação das tramas de dados
+int linkMaxPayload = MAX_PAYLOAD_SIZE;
+unsigned char handshakeReply[HANDSHAKE_FRAME_MAX];  // UA ou UAX enviado pelo receptor
+int handshakeReplySize = 0;
+
+// Mudança de baud rate durante a sessão
+Timer baudTimer;
+int baseBaudRate = 9600;            // Taxa do llopen: ponto de encontro quando uma taxa falha
+int previousBaudRate = 0;           // Taxa antes da última mudança pedida ao receptor
+int baudVerified = TRUE;            // O receptor já recebeu uma sonda válida na taxa atual
+unsigned long long baudVerifyDeadlineMs = 0;
+int baudDue = FALSE;                // Expirou o temporizador da taxa
+int baudFallbackMs = BAUD_FALLBACK_MS;
+int baudErrors = 0, baudFrames = 0; // REJ/timeouts e tramas confirmadas desde a última avaliação
+int baudDownshift = FALSE;          // Demasiados erros: descer um degrau antes do próximo reenvio
+int baudChanges = 0, baudFallbacks = 0;
+unsigned long long lastValidFrameMs = 0;    // Última trama com cabeçalho válido
+
+// Tempo (parede) da transferência, para a eficiência
+unsigned long long transferStartUs = 0;
+unsigned long long transferEndUs = 0;
+
+// Função chamada quando um temporizador da ligação expira
+void alarmHandler(Timer *timer, void *arg) {
     alarmEnabled = 1;
     alarmCount++;
 }
 
+// Temporizador de uma trama da janela
+void windowTimerHandler(Timer *timer, void *arg) {
+    windowTimeout = TRUE;
+    alarmHandler(timer, arg);
+}
+
+// Atraso do RR pendente
+void ackTimerHandler(Timer *timer, void *arg) {
+    ackDue = TRUE;
+}
+
+// Temporizador do keepalive; o trabalho é feito em servicoKeepalive, fora da roda
+void keepaliveTimerHandler(Timer *timer, void *arg) {
+    keepaliveDue = TRUE;
+}
+
+// Temporizador da taxa; o trabalho é feito em servicoBaud, fora da roda
+void baudTimerHandler(Timer *timer, void *arg) {
+    baudDue = TRUE;
+}
+
+void servicoKeepalive();
+void servicoBaud();
+static int aplicarTaxa(int baudRate);
+static void subirBaud();
+static void avaliarErrosBaud(int errors, int frames);
+int applyByteStuffing(const unsigned char *input, int length, unsigned char *output);
+int applyByteDestuffing(const unsigned char *input, int length, unsigned char *output);
+
+// Regista a chegada de bytes: a ligação está viva
+static void registarRecepcao() {
+    lastRxMs = timerNowMs();
+    if (probesOutstanding > 0) {
+        double rtt = lastRxMs > probeLineMs ? (double)(lastRxMs - probeLineMs) : 0;
+        probeRttMs = probesAnswered == 0 ? rtt : probeRttMs + 0.25 * (rtt - probeRttMs);
+        probesAnswered++;
+        probesOutstanding = 0;
+    }
+}
+
+// Regista uma trama com cabeçalho válido: a taxa atual funciona nos dois sentidos
+static void registarTramaValida() {
+    lastValidFrameMs = timerNowMs();
+}
+
+// Lê um byte da porta série. Sem bytes disponíveis e com block, dorme num único
+// poll() até chegar um byte ou até ao próximo prazo da roda de temporizadores.
+// Retorna 1 se leu um byte, 0 se expirou um temporizador (ou não havia bytes,
+// sem block), -1 em caso de erro.
+int receiveByte(unsigned char *byte, int block) {
+    if (rxStart < rxEnd) {
+        *byte = rxBuffer[rxStart++];
+        return 1;
+    }
+
+    for (;;) {
+        unsigned long long now = timerNowMs();
+        if (timerWheelAdvance(&linkTimers, now) > 0) {
+            if (keepaliveDue) servicoKeepalive();
+            if (baudDue) servicoBaud();
+            return 0;
+        }
+
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, block ? timerWheelNextTimeout(&linkTimers, now) : 0);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            lastError = LL_ERROR_IO;
+            return -1;
+        }
+        if (ready == 0) {
+            if (!block) return 0;
+            continue;   // Prazo atingido: a roda trata disso no início do ciclo
+        }
+
+        int bytes = read(fd, rxBuffer, RX_BUFFER_SIZE);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            lastError = LL_ERROR_IO;
+            return -1;
+        }
+        if (bytes == 0) {
+            // Porta fechada do outro lado
+            if (pfd.revents & (POLLHUP | POLLERR)) {
+                lastError = LL_ERROR_IO;
+                return -1;
+            }
+            continue;
+        }
+        registarRecepcao();
+        rxStart = 0;
+        rxEnd = bytes;
+        *byte = rxBuffer[rxStart++];
+        return 1;
+    }
+}
+
+// Lê um byte, bloqueando até haver um byte ou expirar um temporizador
+int readLinkByte(unsigned char *byte) {
+    return receiveByte(byte, TRUE);
+}
+
 // Função para enviar uma trama de supervisão (controlo)
 /*int enviarTramaSupervisao1(unsigned char address, unsigned char control) {
     unsigned char frame[5] = {0}; // Criação da trama de controlo
@@ -105,6 +399,567 @@ void enviarTramaSupervisao(int fd, unsigned char address, unsigned char control)
     writeBytesSerialPort(frame, 5);
     printf("DEBUG (enviarTramaSupervisao): A enviar frame de controlo: 0x%X\n", control);
     estatisticas.tramasEnviadas++;  // Atualiza a contagem de tramas enviadas na estatística
+    estatisticas.tramasSupervisao++;
+    estatisticas.bytesSupervisao += 5;
+}
+
+// Envia uma trama de supervisão com número de sequência (RR/REJ com janela)
+void enviarTramaSupervisaoSeq(int fd, unsigned char address, unsigned char control, unsigned char seq) {
+    unsigned char frame[SUP_SEQ_FRAME_SIZE] = {FLAG, address, control, seq, address ^ control ^ seq, FLAG};
+    writeBytesSerialPort(frame, SUP_SEQ_FRAME_SIZE);
+    estatisticas.tramasEnviadas++;
+    estatisticas.tramasSupervisao++;
+    estatisticas.bytesSupervisao += SUP_SEQ_FRAME_SIZE;
+}
+
+// Envia um RR/REJ com janela para expectedSeq. É cumulativo, por isso também
+// confirma as tramas aceites que esperavam por um RR agregado.
+void enviarConfirmacao(unsigned char control) {
+    enviarTramaSupervisaoSeq(fd, Address_Receiver, control, expectedSeq);
+    ackPending = 0;
+    ackDue = FALSE;
+    timerStop(&linkTimers, &ackTimer);
+}
+
+// Envia o RR agregado se houver tramas por confirmar
+void enviarConfirmacaoPendente() {
+    if (ackPending > 0) {
+        rrPorAtraso++;
+        enviarConfirmacao(Command_RRW);
+    }
+    ackDue = FALSE;
+}
+
+// Atraso máximo de um RR adiado depois de uma trama de frameBytes bytes: o tempo
+// de chegarem mais ackEvery tramas iguais, sem passar de um quarto do timeout do transmissor
+int atrasoConfirmacaoMs(int frameBytes) {
+    if (ackDelayMs > 0) return ackDelayMs;
+    int delay = ACK_DELAY_MIN_MS + (int)(ackEvery * windowSizerByteTimeUs(&windowSizer, frameBytes) / 1000.0);
+    int limit = timeout * 1000 / 4;
+    return delay < limit ? delay : (limit > 0 ? limit : 1);
+}
+
+// Envia uma sondagem de keepalive. No transmissor a sondagem fica atrás das
+// tramas que ainda estão na fila da porta, por isso o prazo da resposta conta a
+// partir do momento em que ela entra na linha.
+void enviarSondagem() {
+    unsigned long long now = timerNowMs();
+    unsigned long long busyUntil = (txBusyUntilUs + 999) / 1000;
+    if (probesOutstanding == 0) {
+        probeLineMs = (busyUntil > now ? busyUntil : now) +
+                      (unsigned long long)(windowSizerByteTimeUs(&windowSizer, 5) / 1000.0);
+    }
+    printf("DEBUG (keepalive): Sem bytes há %llu ms, a enviar sondagem %d\n",
+           now - lastRxMs, probesOutstanding + 1);
+    enviarTramaSupervisao(fd, currentRole == LlTx ? Address_Transmitter : Address_Receiver, Command_KEEPALIVE);
+    probesOutstanding++;
+    probesSent++;
+}
+
+// Responde a uma sondagem do outro lado. O receptor com janela responde com um
+// RR cumulativo, que também serve ao transmissor se um RR se tiver perdido.
+void responderSondagem() {
+    if (currentRole == LlRx && windowMode) {
+        enviarConfirmacao(Command_RRW);
+    } else {
+        enviarTramaSupervisao(fd, currentRole == LlTx ? Address_Transmitter : Address_Receiver, Command_KEEPALIVE_ACK);
+    }
+}
+
+// Transmissor: instante até ao qual o silêncio do receptor é normal. O RR da
+// trama mais antiga por confirmar pode vir agregado: chega até ao atraso do RR
+// (o mesmo cálculo do receptor) depois do fim dela na linha, mais o RTT.
+// Retorna 0 sem tramas na janela.
+static unsigned long long confirmacaoEsperadaMs() {
+    if (currentRole != LlTx || !windowMode || outstanding == 0) return 0;
+    WindowEntry *entry = &txWindow[sendBase];
+    if (entry->slot == NULL) return 0;
+    int length = entry->slot->length;
+    double dueUs = entry->startUs + windowSizerByteTimeUs(&windowSizer, length) + windowSizer.twoPropUs +
+                   1000.0 * atrasoConfirmacaoMs(length + SUP_SEQ_FRAME_SIZE);
+    return (unsigned long long)(dueUs / 1000.0);
+}
+
+// Decide o que fazer quando expira o temporizador do keepalive: esperar mais,
+// sondar outra vez ou declarar a ligação morta
+void servicoKeepalive() {
+    keepaliveDue = FALSE;
+    if (!keepaliveRunning || linkDead) return;
+
+    unsigned long long now = timerNowMs();
+    if (probesOutstanding == 0) {
+        // Com tramas à espera de um RR agregado o silêncio só conta depois de ele poder ter chegado
+        unsigned long long quietSince = lastRxMs;
+        unsigned long long ackDueMs = confirmacaoEsperadaMs();
+        if (ackDueMs > quietSince) quietSince = ackDueMs;
+        if (now < quietSince + keepaliveMs) {
+            timerStart(&linkTimers, &keepaliveTimer, quietSince + keepaliveMs - now);
+            return;
+        }
+        enviarSondagem();
+    } else {
+        // Prazo: RCOM_DEAD_LINK_MS depois de a sondagem estar na linha, mais o RTT
+        double rttMs = windowSizer.twoPropUs / 1000.0 > probeRttMs ? windowSizer.twoPropUs / 1000.0 : probeRttMs;
+        unsigned long long deadline = probeLineMs + deadLinkMs + (unsigned long long)rttMs;
+        if (now >= deadline && linkBaudRate != baseBaudRate) {
+            // Antes de dar a ligação como morta tenta a taxa do llopen, onde o
+            // outro lado também vai parar quando deixar de receber tramas válidas
+            printf("DEBUG (keepalive): Sem resposta às sondagens a %d baud, a voltar a %d\n",
+                   linkBaudRate, baseBaudRate);
+            baudFallbacks++;
+            baudVerified = TRUE;
+            aplicarTaxa(baseBaudRate);
+            probesOutstanding = 0;
+            lastRxMs = now;
+            timerStart(&linkTimers, &keepaliveTimer, keepaliveMs);
+            return;
+        }
+        if (now >= deadline) {
+            printf("DEBUG (keepalive): Ligação morta: sem resposta a %d sondagens em %llu ms\n",
+                   probesOutstanding, now - lastRxMs);
+            linkDead = TRUE;
+            lastError = LL_ERROR_LINK_DEAD;
+            alarmEnabled = 1;       // Acorda os ciclos que esperam por um temporizador
+            windowTimeout = TRUE;
+            return;
+        }
+        if (probesOutstanding < KEEPALIVE_PROBES) {
+            enviarSondagem();
+        } else {
+            timerStart(&linkTimers, &keepaliveTimer, deadline - now);
+            return;
+        }
+    }
+    int interval = deadLinkMs / KEEPALIVE_PROBES;
+    timerStart(&linkTimers, &keepaliveTimer, interval > 0 ? interval : 1);
+}
+
+// Arranca o keepalive depois do handshake
+void iniciarKeepalive() {
+    lastRxMs = timerNowMs();
+    probesOutstanding = 0;
+    keepaliveDue = linkDead = FALSE;
+    keepaliveRunning = keepaliveMs > 0;
+    if (keepaliveRunning) {
+        timerStart(&linkTimers, &keepaliveTimer, keepaliveMs);
+    }
+}
+
+// Primeiro intervalo de retransmissão do SET e do DISC: o RTT já medido (ou
+// pelo menos duas tramas de supervisão na linha) mais uma pequena margem
+int intervaloHandshakeInicialMs() {
+    double rttUs = windowSizer.twoPropUs + 2 * windowSizerByteTimeUs(&windowSizer, 5);
+    return HANDSHAKE_RETRY_MIN_MS + (int)(2 * rttUs / 1000.0);
+}
+
+// Milissegundos até deadlineMs (pelo menos 1, para não esperar sem limite)
+int msAte(unsigned long long deadlineMs) {
+    unsigned long long now = timerNowMs();
+    return deadlineMs > now ? (int)(deadlineMs - now) : 1;
+}
+
+// Janela em uso: a do WindowSizer, limitada pelo teto de llSetTuning
+static int janelaAtual() {
+    return windowLimit > 0 && windowLimit < windowSize ? windowLimit : windowSize;
+}
+
+// Timeout de retransmissão das tramas de dados (sem o tempo da trama na linha)
+static int tempoRetransmissaoMs() {
+    return retransmitMs > 0 ? retransmitMs : timeout * 1000;
+}
+
+// Maior trama com um pacote de payloadSize bytes, cabeçalho de headerSize bytes
+// e FCS de fcsSize bytes: tudo menos o cabeçalho pode ser escapado
+static int limiteTrama(int payloadSize, int headerSize, int fcsSize) {
+    return headerSize + 2 * (payloadSize + fcsSize) + 1;
+}
+
+int llFrameBound(int payloadSize) {
+    return limiteTrama(payloadSize, windowMode ? FRAME_HEADER_MAX : FRAME_HEADER_MAX - 1,
+                       fcsType == FCS_CRC16 ? 2 : 1);
+}
+
+// Tempo de bytes bytes na linha à taxa atual, em ms (arredondado para cima)
+static int tempoLinhaMs(int bytes) {
+    return (int)(windowSizerByteTimeUs(&windowSizer, bytes) / 1000.0) + 1;
+}
+
+// Tempo que o receptor espera por uma sonda válida depois de mudar para
+// baudRate: o BAUD_ACK e as sondas na linha mais dois RTT e uma margem
+static int tempoVerificacaoBaudMs(int baudRate) {
+    double probesUs = BAUD_PROBES * (2.0 * (BAUD_PROBE_SIZE + 2) + SUP_SEQ_FRAME_SIZE) * 10.0e6 / baudRate;
+    double ackUs = windowSizerByteTimeUs(&windowSizer, 2 * SUP_SEQ_FRAME_SIZE);
+    return BAUD_VERIFY_MIN_MS + (int)((2 * windowSizer.twoPropUs + ackUs + probesUs) / 1000.0);
+}
+
+// Prepara o temporizador da taxa: prazo da sonda no receptor, ou verificação
+// periódica das tramas válidas enquanto a taxa não é a do llopen
+static void armarTemporizadorBaud() {
+    if (!baudVerified) {
+        timerStart(&linkTimers, &baudTimer, msAte(baudVerifyDeadlineMs));
+    } else if (linkBaudRate != baseBaudRate) {
+        timerStart(&linkTimers, &baudTimer, baudFallbackMs / 4 > 0 ? baudFallbackMs / 4 : 1);
+    } else {
+        timerStop(&linkTimers, &baudTimer);
+    }
+}
+
+// Passa a porta e as estimativas de tempo da ligação para baudRate
+static int aplicarTaxa(int baudRate) {
+    if (serialPortSetBaudRate(baudRate) < 0) return -1;
+    linkBaudRate = baudRate;
+    windowSize = windowSizerSetBaudRate(&windowSizer, baudRate);
+    txBusyUntilUs = timerNowUs();
+    lastValidFrameMs = timerNowMs();
+    baudErrors = baudFrames = 0;
+    baudChanges++;
+    armarTemporizadorBaud();
+    return 0;
+}
+
+// Espera que uma trama de bytes bytes saia da porta antes de mudar de taxa. O
+// tcdrain não espera pela linha nos pseudo-terminais, daí o tempo da trama.
+static void esperarSaida(int bytes) {
+    tcdrain(fd);
+    usleep((useconds_t)windowSizerByteTimeUs(&windowSizer, bytes) + 1000);
+}
+
+// Decide o que fazer quando expira o temporizador da taxa: voltar à taxa
+// anterior se a sonda não chegou, ou à do llopen se deixaram de chegar tramas
+void servicoBaud() {
+    baudDue = FALSE;
+    unsigned long long now = timerNowMs();
+    if (!baudVerified && now >= baudVerifyDeadlineMs) {
+        printf("DEBUG (baud): Nenhuma sonda válida a %d baud, a voltar a %d\n", linkBaudRate, previousBaudRate);
+        baudVerified = TRUE;
+        baudFallbacks++;
+        aplicarTaxa(previousBaudRate);
+        return;
+    }
+    if (baudVerified && linkBaudRate != baseBaudRate && now - lastValidFrameMs >= (unsigned long long)baudFallbackMs) {
+        printf("DEBUG (baud): Sem tramas válidas há %llu ms a %d baud, a voltar a %d\n",
+               now - lastValidFrameMs, linkBaudRate, baseBaudRate);
+        baudFallbacks++;
+        aplicarTaxa(baseBaudRate);
+        return;
+    }
+    armarTemporizadorBaud();
+}
+
+// Receptor: aceita o pedido de mudança para a taxa na posição index da tabela.
+// Responde ainda na taxa antiga e muda logo a seguir; fica à espera de uma sonda
+// válida até tempoVerificacaoBaudMs.
+static void tratarPedidoBaud(int index) {
+    int baudRate = serialPortBaudAt(index);
+    if (baudRate == 0 || baudRate > sessionCaps.maxBaud || baudRate < baseBaudRate) return;
+    enviarTramaSupervisaoSeq(fd, Address_Receiver, Command_BAUD_ACK, index);
+    if (baudRate == linkBaudRate) return;
+
+    printf("DEBUG (baud): A mudar de %d para %d baud a pedido do transmissor\n", linkBaudRate, baudRate);
+    esperarSaida(SUP_SEQ_FRAME_SIZE);
+    previousBaudRate = linkBaudRate;
+    baudVerified = FALSE;
+    baudVerifyDeadlineMs = timerNowMs() + tempoVerificacaoBaudMs(baudRate);
+    if (aplicarTaxa(baudRate) < 0) {
+        baudVerified = TRUE;
+        armarTemporizadorBaud();
+    }
+}
+
+// Receptor: sonda recebida na taxa atual (bloco de teste já verificado)
+static void tratarSondaBaud(int index) {
+    if (serialPortBaudAt(index) != linkBaudRate) return;
+    enviarTramaSupervisaoSeq(fd, Address_Receiver, Command_PROBE_ACK, index);
+    if (!baudVerified) {
+        printf("DEBUG (baud): %d baud verificado pela sonda\n", linkBaudRate);
+        baudVerified = TRUE;
+        armarTemporizadorBaud();
+    }
+}
+
+// Espera até timeoutMs (sem limite se for 0) por uma trama de supervisão com o
+// endereço address e devolve o campo de controlo em control. As tramas do
+// handshake estendido (SETX/UAX) trazem um bloco com stuffing antes da FLAG
+// final: fica em body (NEGOTIATION_MAX_SIZE bytes, pode ser NULL) e o tamanho em
+// bodySize, 0 nas tramas de 5 bytes. Responde pelo caminho às sondagens do
+// keepalive. Retorna 1 se recebeu uma trama, 0 se o tempo acabou, -1 se a
+// ligação morreu (também antes da chamada) ou a porta falhou.
+int receberTramaSupervisao(unsigned char address, int timeoutMs, unsigned char *control,
+                           unsigned char *body, int *bodySize) {
+    LinkLayerState state = START;
+    unsigned char c = 0;
+    unsigned char stuffed[2 * NEGOTIATION_MAX_SIZE];
+    int stuffedSize = 0;
+    alarmEnabled = 0;
+    if (timeoutMs > 0) timerStart(&linkTimers, &handshakeTimer, timeoutMs);
+
+    // Com a ligação já morta o keepalive não volta a acordar o ciclo
+    while (!alarmEnabled && !linkDead) {
+        unsigned char byte;
+        int received = readLinkByte(&byte);
+        if (received < 0) break;
+        if (received == 0) continue;
+
+        switch (state) {
+            case START:
+                if (byte == FLAG) state = FLAG_RCV;
+                break;
+            case FLAG_RCV:
+                if (byte == address) state = A_RCV;
+                else if (byte != FLAG) state = START;
+                break;
+            case A_RCV:
+                if (byte == FLAG) state = FLAG_RCV;
+                else {
+                    c = byte;
+                    state = C_RCV;
+                }
+                break;
+            case C_RCV:
+                if (byte == (address ^ c)) state = BCC1_OK;
+                else state = byte == FLAG ? FLAG_RCV : START;
+                break;
+            case BCC1_OK:
+            case DATA:
+                if (byte != FLAG) {
+                    // Bloco de capacidades: descarta tramas maiores do que o previsto
+                    if (stuffedSize < (int)sizeof(stuffed)) {
+                        stuffed[stuffedSize++] = byte;
+                        state = DATA;
+                    } else {
+                        stuffedSize = 0;
+                        state = START;
+                    }
+                } else if (c == Command_KEEPALIVE) {
+                    responderSondagem();
+                    stuffedSize = 0;
+                    state = FLAG_RCV;
+                } else {
+                    unsigned char destuffed[2 * NEGOTIATION_MAX_SIZE];
+                    int size = applyByteDestuffing(stuffed, stuffedSize, destuffed);
+                    if (size > NEGOTIATION_MAX_SIZE) {
+                        stuffedSize = 0;
+                        state = FLAG_RCV;
+                        break;
+                    }
+                    if (body != NULL) memcpy(body, destuffed, size);
+                    if (bodySize != NULL) *bodySize = size;
+                    registarTramaValida();
+                    timerStop(&linkTimers, &handshakeTimer);
+                    *control = c;
+                    return 1;
+                }
+                break;
+            default:
+                state = START;
+                break;
+        }
+    }
+    timerStop(&linkTimers, &handshakeTimer);
+    return linkDead || lastError == LL_ERROR_IO ? -1 : 0;
+}
+
+// Capacidades deste lado, limitadas (ou, no pacote, alargadas) pelas variáveis
+// de ambiente RCOM_MAX_PAYLOAD, RCOM_FCS e RCOM_FRAMING
+static void capacidadesLocais(LinkCapabilities *caps) {
+    caps->version = NEGOTIATION_VERSION;
+    caps->maxPayload = MAX_PAYLOAD_SIZE;
+    caps->maxWindow = MAX_WINDOW;
+    caps->fcsMask = FCS_XOR | FCS_CRC16;
+    caps->framingMask = FRAMING_LEGACY | FRAMING_WINDOW;
+    caps->compressionMask = COMPRESSION_NONE;
+    caps->timeout = timeout < 255 ? timeout : 255;
+    caps->retries = retransmissions < 255 ? retransmissions : 255;
+    caps->maxBaud = baseBaudRate;
+
+    // Acima de MAX_PAYLOAD_SIZE (jumbo) os dois lados têm de o pedir
+    const char *option = getenv("RCOM_MAX_PAYLOAD");
+    if (option != NULL && atoi(option) >= MIN_NEGOTIATED_PAYLOAD && atoi(option) <= LL_MAX_JUMBO_PAYLOAD) {
+        caps->maxPayload = atoi(option);
+    }
+    option = getenv("RCOM_FCS");
+    if (option != NULL && strcmp(option, "xor") == 0) caps->fcsMask = FCS_XOR;
+    if (option != NULL && strcmp(option, "crc16") == 0) caps->fcsMask = FCS_CRC16;
+    option = getenv("RCOM_FRAMING");
+    if (option != NULL && strcmp(option, "legacy") == 0) caps->framingMask = FRAMING_LEGACY;
+    if (option != NULL && strcmp(option, "window") == 0) caps->framingMask = FRAMING_WINDOW;
+    option = getenv("RCOM_MAX_BAUD");
+    if (option != NULL && serialPortBaudIndex(atoi(option)) >= 0 && atoi(option) > baseBaudRate) {
+        caps->maxBaud = atoi(option);
+    }
+}
+
+// Parâmetros com um par que não negoceia: tramas de 5 bytes, stop-and-wait e BCC2 em XOR
+static void capacidadesLegadas(const LinkCapabilities *local, LinkCapabilities *caps) {
+    *caps = *local;
+    caps->version = 0;
+    caps->maxWindow = 1;
+    caps->fcsMask = FCS_XOR;
+    caps->framingMask = FRAMING_LEGACY;
+    caps->compressionMask = COMPRESSION_NONE;
+    caps->maxBaud = caps->maxBaud < baseBaudRate ? caps->maxBaud : baseBaudRate;
+}
+
+static int negociacaoAtiva() {
+    const char *option = getenv("RCOM_NEGOTIATE");
+    return option == NULL || atoi(option) != 0;
+}
+
+// Monta uma trama de supervisão com um bloco (até NEGOTIATION_MAX_SIZE bytes)
+// com stuffing antes da FLAG final. frame tem de ter HANDSHAKE_FRAME_MAX bytes.
+// Retorna o tamanho da trama.
+static int montarTramaComBloco(unsigned char address, unsigned char control,
+                               const unsigned char *body, int bodySize, unsigned char *frame) {
+    int size = 0;
+    frame[size++] = FLAG;
+    frame[size++] = address;
+    frame[size++] = control;
+    frame[size++] = address ^ control;
+    size += applyByteStuffing(body, bodySize, &frame[size]);
+    frame[size++] = FLAG;
+    return size;
+}
+
+// Monta um SETX/UAX: cabeçalho de supervisão, capacidades com stuffing e FLAG.
+// frame tem de ter HANDSHAKE_FRAME_MAX bytes. Retorna o tamanho da trama.
+static int montarTramaEstendida(unsigned char address, unsigned char control,
+                                const LinkCapabilities *caps, unsigned char *frame) {
+    unsigned char body[NEGOTIATION_MAX_SIZE];
+    return montarTramaComBloco(address, control, body, capabilitiesEncode(caps, body), frame);
+}
+
+// Passa a usar os parâmetros acordados (extended) ou os de um par antigo
+static void aplicarParametros(const LinkCapabilities *caps, int extended) {
+    sessionCaps = *caps;
+    negotiated = extended;
+    windowMode = caps->framingMask == FRAMING_WINDOW;
+    fcsType = caps->fcsMask;
+    linkMaxPayload = caps->maxPayload;
+    windowSizer.maxWindow = caps->maxWindow < MAX_WINDOW ? caps->maxWindow : MAX_WINDOW;
+    timeout = caps->timeout;
+    retransmissions = caps->retries;
+    if (!extended) keepaliveMs = 0;     // Um par antigo não responde às sondagens
+    baudFallbackMs = keepaliveMs > 0 ? keepaliveMs + deadLinkMs / 2 : BAUD_FALLBACK_MS;
+    printf("DEBUG (llopen): Parâmetros %s: pacote até %d bytes, janela até %d, FCS %s, tramas %s, "
+           "timeout %d s, %d tentativas, até %d baud\n", extended ? "negociados" : "de um par sem negociação",
+           linkMaxPayload, windowSizer.maxWindow, fcsType == FCS_CRC16 ? "CRC-16" : "XOR",
+           windowMode ? "com janela" : "stop-and-wait", timeout, retransmissions, caps->maxBaud);
+}
+
+// Reenvia a resposta do llopen (UA ou UAX) a um SET repetido: o transmissor
+// ainda não a recebeu. Depois de negociar só responde ao SETX, que vem sempre
+// antes do SET normal, para não enviar duas respostas a cada tentativa.
+static void responderHandshake(unsigned char control) {
+    if (handshakeReplySize == 0 || (control == Command_SET && negotiated)) return;
+    writeBytesSerialPort(handshakeReply, handshakeReplySize);
+    estatisticas.tramasEnviadas++;
+    estatisticas.tramasSupervisao++;
+    estatisticas.bytesSupervisao += handshakeReplySize;
+}
+
+LlError llLastError() {
+    return lastError;
+}
+
+const char *llErrorString(LlError error) {
+    switch (error) {
+        case LL_ERROR_NONE: return "sem erro";
+        case LL_ERROR_TIMEOUT: return "retransmissões esgotadas";
+        case LL_ERROR_LINK_DEAD: return "ligação morta (sem resposta ao keepalive)";
+        case LL_ERROR_IO: return "erro na porta série";
+    }
+    return "erro desconhecido";
+}
+
+void llLinkHealth(LlLinkHealth *health) {
+    memset(health, 0, sizeof(*health));
+    health->state = !keepaliveRunning ? (linkDead ? LL_LINK_DEAD : LL_LINK_DOWN)
+                  : linkDead ? LL_LINK_DEAD
+                  : probesOutstanding > 0 ? LL_LINK_PROBING : LL_LINK_UP;
+    health->msSinceRx = lastRxMs > 0 ? (long)(timerNowMs() - lastRxMs) : -1;
+    health->keepaliveMs = keepaliveMs;
+    health->deadLinkMs = deadLinkMs;
+    health->probesSent = probesSent;
+    health->probesAnswered = probesAnswered;
+    health->baudRate = linkBaudRate;
+    health->rttUs = ultimoRttUs;
+}
+
+int llSessionParameters(LinkCapabilities *caps) {
+    *caps = sessionCaps;
+    return negotiated;
+}
+
+int llMaxPayload() {
+    return linkMaxPayload;
+}
+
+void llSetTuning(const LlTuning *tuning) {
+    windowLimit = tuning->windowLimit > 0 ? tuning->windowLimit : 0;
+    retransmitMs = tuning->retransmitMs > 0 ? tuning->retransmitMs : 0;
+    if (tuning->retries > 0) retransmissions = tuning->retries;
+}
+
+void llGetTuning(LlTuning *tuning) {
+    tuning->windowLimit = janelaAtual();
+    tuning->retransmitMs = tempoRetransmissaoMs();
+    tuning->retries = retransmissions;
+}
+
+void llCounters(LlCounters *counters) {
+    counters->ackedBytes = bytesConfirmados;
+    counters->framesSent = estatisticas.tramasEnviadas - estatisticas.tramasSupervisao;
+    counters->framesAcked = estatisticas.tramasAceitas;
+    counters->framesOutstanding = outstanding;
+    counters->framesReceived = estatisticas.tramasRecebidas;
+    counters->framesRejected = estatisticas.tramasRejeitadas;
+    counters->receivedBytes = currentRole == LlRx ? estatisticas.totalBytesTransmitidos : 0;
+}
+
+void llKeepPortOpen(int keep) {
+    manterPorta = keep;
+    if (!keep) setPendente = 0;
+    if (!keep && portaAberta) {
+        closeSerialPort();
+        portaAberta = FALSE;
+    }
+}
+
+int llReply(const unsigned char *buf, int size) {
+    if (currentRole != LlRx || size < 0 || size > LL_REPLY_MAX_SIZE) return -1;
+    unsigned char body[NEGOTIATION_MAX_SIZE];
+    unsigned char check = 0;
+    for (int i = 0; i < size; i++) {
+        body[i] = buf[i];
+        check ^= buf[i];
+    }
+    body[size] = check;
+    unsigned char frame[HANDSHAKE_FRAME_MAX];
+    int frameSize = montarTramaComBloco(Address_Receiver, Command_REPLY, body, size + 1, frame);
+    if (writeBytesSerialPort(frame, frameSize) != frameSize) {
+        lastError = LL_ERROR_IO;
+        return -1;
+    }
+    return 0;
+}
+
+int llReadReply(unsigned char *buf, int timeoutMs) {
+    if (currentRole != LlTx || timeoutMs <= 0) return -1;
+    unsigned long long deadline = timerNowMs() + timeoutMs;
+    unsigned char control;
+    unsigned char body[NEGOTIATION_MAX_SIZE];
+    int bodySize = 0;
+    int result;
+    // Ignora as outras tramas do receptor (RR repetidos, sondagens já respondidas)
+    while ((result = receberTramaSupervisao(Address_Receiver, msAte(deadline), &control, body, &bodySize)) > 0) {
+        if (control != Command_REPLY || bodySize < 1) continue;
+        unsigned char check = 0;
+        for (int i = 0; i < bodySize - 1; i++) check ^= body[i];
+        if (check != body[bodySize - 1]) continue;
+        memcpy(buf, body, bodySize - 1);
+        return bodySize - 1;
+    }
+    return result;
 }
 
 // Atualiza as estatísticas com base no resultado de uma trama enviada
@@ -132,6 +987,32 @@ void mostrarEstatisticas() {
     printf("Tempo total de transmissão: %.2f ms\n", estatisticas.tiempoTransmision);
     printf("Tempo total de receção: %.2f ms\n", estatisticas.tiempoRecepcion);
     printf("Tempo total de desconexão: %.2f ms\n", estatisticas.tiempoDesconexion);
+    printf("Tramas de supervisão enviadas: %d (%d bytes)\n", estatisticas.tramasSupervisao, estatisticas.bytesSupervisao);
+    if (currentRole == LlRx && estatisticas.tramasRecebidas > 0) {
+        // Canal de retorno e CPU por trama aceite (com ACKs agregados, RCOM_ACK_EVERY)
+        printf("Canal de retorno: %.2f bytes por trama aceite (um RR por até %d tramas)\n",
+               (double)estatisticas.bytesSupervisao / estatisticas.tramasRecebidas, ackEvery);
+        printf("RR agregados: %d por contagem, %d pedidos pelo bit P, %d por atraso\n",
+               rrPorContagem, rrPorPoll, rrPorAtraso);
+        printf("Tempo de CPU: %.3f ms por trama aceite\n",
+               (double)clock() * 1000.0 / CLOCKS_PER_SEC / estatisticas.tramasRecebidas);
+    }
+
+    printf("Sessão: %s, pacote até %d bytes, FCS %s, tramas %s\n",
+           negotiated ? "parâmetros negociados (SETX/UAX)" : "par sem negociação (SET/UA)",
+           linkMaxPayload, fcsType == FCS_CRC16 ? "CRC-16" : "XOR", windowMode ? "com janela" : "stop-and-wait");
+    printf("Taxa: %d baud (llopen a %d, máxima acordada %d), %d mudanças, %d recuos\n",
+           linkBaudRate, baseBaudRate, sessionCaps.maxBaud, baudChanges, baudFallbacks);
+    printf("Keepalive: %ld sondagens enviadas, %ld respondidas (sondagem após %d ms, ligação morta após mais %d ms)\n",
+           probesSent, probesAnswered, keepaliveMs, deadLinkMs);
+
+    // Contadores do pool de tramas: depois do llopen não deve haver alocações
+    FramePoolStats poolStats;
+    framePoolGetStats(&poolStats);
+    printf("Pool de tramas: %ld alocações (todas no llopen), %ld aquisições, %ld libertações, "
+           "%ld esgotamentos, pico de %d tramas em uso\n",
+           poolStats.allocations, poolStats.acquires, poolStats.releases,
+           poolStats.exhausted, poolStats.peakInUse);
     printf("===============================\n");
 }
 
@@ -160,6 +1041,60 @@ unsigned char calculateBCC2(const unsigned char *buf, int bufSize) {
     return bcc2;
 }
 
+// CRC-16/CCITT (polinómio 0x1021, valor inicial 0xFFFF), calculado byte a byte com uma tabela
+unsigned short crc16Table[256];
+
+void crc16Init() {
+    for (int i = 0; i < 256; i++) {
+        unsigned short crc = i << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        crc16Table[i] = crc;
+    }
+}
+
+// Continua o CRC crc com mais bufSize bytes (pacotes em várias partes)
+static unsigned short updateCRC16(unsigned short crc, const unsigned char *buf, int bufSize) {
+    for (int i = 0; i < bufSize; i++) {
+        crc = (crc << 8) ^ crc16Table[((crc >> 8) ^ buf[i]) & 0xFF];
+    }
+    return crc;
+}
+
+unsigned short calculateCRC16(const unsigned char *buf, int bufSize) {
+    return updateCRC16(0xFFFF, buf, bufSize);
+}
+
+// Calcula o FCS acordado para o pacote formado por head e buf (head pode ser
+// NULL) e escreve-o em fcs. Retorna o seu tamanho.
+static int calcularFCSPartes(const unsigned char *head, int headSize, const unsigned char *buf, int bufSize,
+                             unsigned char *fcs) {
+    if (fcsType == FCS_CRC16) {
+        unsigned short crc = updateCRC16(updateCRC16(0xFFFF, head, headSize), buf, bufSize);
+        fcs[0] = crc >> 8;
+        fcs[1] = crc & 0xFF;
+        return 2;
+    }
+    fcs[0] = calculateBCC2(head, headSize) ^ calculateBCC2(buf, bufSize);
+    return 1;
+}
+
+// Calcula o FCS acordado para o pacote e escreve-o em fcs. Retorna o seu tamanho.
+static int calcularFCS(const unsigned char *buf, int bufSize, unsigned char *fcs) {
+    return calcularFCSPartes(NULL, 0, buf, bufSize, fcs);
+}
+
+// Verifica o FCS no fim de um pacote já sem stuffing (size bytes).
+// Retorna o tamanho do pacote sem o FCS, ou -1 se estiver errado.
+static int verificarFCS(const unsigned char *packet, int size) {
+    unsigned char fcs[2];
+    int fcsSize = fcsType == FCS_CRC16 ? 2 : 1;
+    if (size < fcsSize) return -1;
+    calcularFCS(packet, size - fcsSize, fcs);
+    return memcmp(fcs, &packet[size - fcsSize], fcsSize) == 0 ? size - fcsSize : -1;
+}
+
 // Simula un error en los datos con una probabilidad dada
 /*int introduceError(float probability) {
     return ((float)rand() / RAND_MAX) < probability;
@@ -172,8 +1107,10 @@ unsigned char calculateBCC2(const unsigned char *buf, int bufSize) {
 // Retorna: o descritor da porta serial se bem-sucedido, -1 caso contrário
 int llopen(LinkLayer connectionParameters) {
     conexionStart = clock();            // Inicia o temporizador global da conexão
-    fd = openSerialPort(connectionParameters.serialPort, connectionParameters.baudRate);
+    if (!portaAberta) fd = openSerialPort(connectionParameters.serialPort, connectionParameters.baudRate);
+    portaAberta = FALSE;
     currentRole = connectionParameters.role;
+    memset(&estatisticas, 0, sizeof(estatisticas));
 
     // Verifica se a porta serial foi aberta corretamente
     if (fd < 0) {
@@ -183,131 +1120,196 @@ int llopen(LinkLayer connectionParameters) {
 
     timeout = connectionParameters.timeout;     // Define o tempo limite para retransmissão
     retransmissions = connectionParameters.nRetransmissions;    // Define o número de retransmissões permitidas
-    int attempt_count = 0;
     clock_t start = clock();    // Inicia o temporizador para monitorar o tempo de conexão
     printf("DEBUG (llopen): Iniciando conexión en modo %s\n", connectionParameters.role == LlTx ? "Transmisor" : "Receptor");
-    LinkLayerState state = START;
-    (void)signal(SIGALRM, alarmHandler);
+    timerWheelInit(&linkTimers, timerNowMs());
+    timerInit(&handshakeTimer, TIMER_HANDSHAKE, 0, alarmHandler, NULL);
+    timerInit(&retransmitTimer, TIMER_RETRANSMIT, 0, alarmHandler, NULL);
+    timerInit(&receiveTimer, TIMER_RECEIVE, 0, alarmHandler, NULL);
+    timerInit(&ackTimer, TIMER_ACK, 0, ackTimerHandler, NULL);
+    timerInit(&keepaliveTimer, TIMER_KEEPALIVE, 0, keepaliveTimerHandler, NULL);
+    timerInit(&baudTimer, TIMER_BAUD, 0, baudTimerHandler, NULL);
+    if (setPendente == 0) rxStart = rxEnd = 0;     // O que veio depois do SET pendente é desta sessão
+    lastError = LL_ERROR_NONE;
+    keepaliveRunning = linkDead = FALSE;
+    probesSent = probesAnswered = 0;
+    probeRttMs = 0;
+
+    // Estado da janela deslizante
+    for (int seq = 0; seq < SEQ_MODULUS; seq++) {
+        txWindow[seq].slot = NULL;
+        timerInit(&txWindow[seq].timer, TIMER_RETRANSMIT, seq, windowTimerHandler, NULL);
+    }
+    sendBase = nextSeq = outstanding = 0;
+    expectedSeq = 0;
+    rejSent = windowTimeout = linkFailed = FALSE;
+    linkBaudRate = baseBaudRate = connectionParameters.baudRate;
+    baudVerified = TRUE;
+    baudDue = baudDownshift = FALSE;
+    baudErrors = baudFrames = baudChanges = baudFallbacks = 0;
+    lastValidFrameMs = timerNowMs();
+    txBusyUntilUs = transferStartUs = transferEndUs = 0;
+    // Capacidades para o SET/UA estendido; até à resposta valem as de um par antigo.
+    // O pacote acordado nunca passa do local: as tramas do pool ficam com o pior
+    // caso dele.
+    LinkCapabilities localCaps, peerCaps, agreedCaps, legacyCaps;
+    capacidadesLocais(&localCaps);
+    capacidadesLegadas(&localCaps, &legacyCaps);
+    if (framePoolInit(FRAME_POOL_SLOTS, limiteTrama(localCaps.maxPayload, FRAME_HEADER_MAX, FCS_SIZE_MAX)) < 0) {
+        closeSerialPort();
+        return -1;
+    }
+
+    // Até haver tramas reais, assume tramas de tamanho máximo (janela mais pequena)
+    windowSizerInit(&windowSizer, linkBaudRate, MAX_WINDOW, localCaps.maxPayload + 8);
+    windowSize = 1;
+    windowLimit = retransmitMs = 0;
+    bytesConfirmados = 0;
+    ultimoRttUs = 0;
+    ackPending = rrPorPoll = rrPorContagem = rrPorAtraso = 0;
+    ackDue = pollNext = FALSE;
+    const char *option = getenv("RCOM_ACK_EVERY");
+    ackEvery = option != NULL && atoi(option) > 0 ? atoi(option) : ACK_EVERY;
+    option = getenv("RCOM_ACK_DELAY_MS");
+    ackDelayMs = option != NULL && atoi(option) > 0 ? atoi(option) : 0;
+    option = getenv("RCOM_KEEPALIVE_MS");
+    int maxFrameMs = tempoLinhaMs(localCaps.maxPayload + 8);
+    keepaliveMs = option != NULL ? atoi(option) : (maxFrameMs > KEEPALIVE_IDLE_MS ? maxFrameMs : KEEPALIVE_IDLE_MS);
+    if (keepaliveMs < 0) keepaliveMs = 0;
+    option = getenv("RCOM_DEAD_LINK_MS");
+    deadLinkMs = option != NULL && atoi(option) > 0 ? atoi(option) : KEEPALIVE_PROBES * keepaliveMs;
+
+    int negotiate = negociacaoAtiva();
+    unsigned char body[NEGOTIATION_MAX_SIZE];
+    int bodySize = 0;
+    negotiated = FALSE;
+    handshakeReplySize = 0;
+    fcsType = FCS_XOR;
+    linkMaxPayload = localCaps.maxPayload;
+    crc16Init();
 
     switch (connectionParameters.role) {
         
         // Caso o rol seja de Transmissor
         case LlTx:{
-            while (retransmissions > 0) {
-                unsigned char supFrame[5] = {FLAG, Address_Transmitter, Command_SET, Address_Transmitter ^ Command_SET, FLAG};
-                write(fd, supFrame, 5);
-                alarm(timeout);
-                alarmEnabled = 0;
-                while (state != STOP_R  && !alarmEnabled) {
-                
-                    unsigned char byte = 0;
-                    int bytes;
-
-                    if((bytes = readByteSerialPort(&byte)) < 0){
-                        printf("DEBUG (llopen Tx): Error receiving UA\n");
-                        return -1;
+            // Reenvia o SET com intervalos crescentes: o receptor pode ainda não
+            // ter aberto a porta, ou o SET/UA pode ter-se perdido
+            unsigned long long connectStartUs = timerNowUs();
+            unsigned long long deadline = timerNowMs() + (unsigned long long)timeout * retransmissions * 1000;
+            int retryMs = intervaloHandshakeInicialMs();
+            int attempts = 0;
+
+            // SETX seguido do SET normal, escritos de uma vez: um receptor antigo
+            // descarta o SETX (controlo desconhecido) e responde só ao SET
+            unsigned char setFrames[HANDSHAKE_FRAME_MAX + 5];
+            int setSize = negotiate ? montarTramaEstendida(Address_Transmitter, Command_SETX, &localCaps, setFrames) : 0;
+            unsigned char supFrame[5] = {FLAG, Address_Transmitter, Command_SET, Address_Transmitter ^ Command_SET, FLAG};
+            memcpy(&setFrames[setSize], supFrame, 5);
+            setSize += 5;
+
+            while (timerNowMs() < deadline) {
+                write(fd, setFrames, setSize);
+                attempts++;
+                unsigned long long setSentUs = timerNowUs();     // Para medir o RTT do SET/UA
+
+                // Espera pelo UA até à próxima retransmissão; outras tramas (p.ex. um
+                // DISC atrasado de uma sessão anterior) são ignoradas
+                unsigned long long retryAt = timerNowMs() + retryMs;
+                if (retryAt > deadline) retryAt = deadline;
+                unsigned char control = 0;
+                int result;
+                while ((result = receberTramaSupervisao(Address_Receiver, msAte(retryAt), &control, body, &bodySize)) > 0) {
+                    if (control == Command_UA) {
+                        aplicarParametros(&legacyCaps, FALSE);
+                        break;
                     }
-                    
-                    if(bytes){
-            
-                        switch (state) {
-                            case START: 
-                                if (byte == FLAG) state = FLAG_RCV; 
-                                break;
-                            case FLAG_RCV:  
-                                if (byte == Address_Receiver) state = A_RCV;
-                                else if (byte == FLAG) state = FLAG_RCV;  
-                                else state = START;  // Reseta caso o byte não seja esperado
-                                break;
-                            case A_RCV:
-                                if (byte == Command_UA) state = C_RCV;
-                                else if (byte == FLAG) state = FLAG_RCV;  
-                                else state = START;  // Reseta caso o byte não seja esperado
-                                break;
-                            case C_RCV:
-                                if (byte == (Address_Receiver ^ Command_UA)) state = BCC1_OK;
-                                else if (byte == FLAG) state = FLAG_RCV;  
-                                else state = START;  
-                                break;
-                            case BCC1_OK:
-                                if (byte == FLAG) state = STOP_R;
-                                else state = START;  
-                                break;
-                            default:
-                                state = START;
-                                break;
-                            
-                        }
+                    // O UAX traz os parâmetros escolhidos pelo receptor: só servem se
+                    // forem um subconjunto das capacidades deste lado
+                    if (control == Command_UAX && negotiate && capabilitiesDecode(body, bodySize, &peerCaps) == 0 &&
+                        capabilitiesIntersect(&localCaps, &peerCaps, &agreedCaps) == 0) {
+                        aplicarParametros(&agreedCaps, TRUE);
+                        break;
                     }
                 }
-                // Se a conexão foi estabelecida (estado STOP_R alcançado)
-                if (state == STOP_R) {
+                if (result < 0) {
+                    printf("DEBUG (llopen Tx): Error receiving UA\n");
+                    return -1;
+                }
+
+                // Se a conexão foi estabelecida (UA recebido)
+                if (result > 0) {
                     estatisticas.tiempoTransmision += (double)(clock() - start) / CLOCKS_PER_SEC;
-                    printf("DEBUG (llopen Tx): Conexión establecida correctamente.\n");
+                    printf("DEBUG (llopen Tx): Conexión establecida correctamente en %.2f ms (%d SET).\n",
+                           (timerNowUs() - connectStartUs) / 1000.0, attempts);
+
+                    // Primeira janela a partir do RTT do handshake e da taxa da linha. Com
+                    // vários SET o UA pode responder a um anterior: o RTT medido a partir
+                    // do último é por defeito, e as tramas de dados corrigem-no depois.
+                    double rttUs = (double)(timerNowUs() - setSentUs);
+                    windowSize = windowSizerHandshake(&windowSizer, rttUs, 5);
+                    printf("DEBUG (llopen Tx): RTT SET/UA = %.2f ms, a = %.3f, janela = %d "
+                           "(eficiência máxima %.1f%%, stop-and-wait %.1f%%)\n",
+                           rttUs / 1000.0, windowSizerA(&windowSizer), windowSize,
+                           100.0 * windowSizerEfficiencyBound(&windowSizer, windowSize),
+                           100.0 * windowSizerEfficiencyBound(&windowSizer, 1));
+                    if (negotiated && windowMode && sessionCaps.maxBaud > linkBaudRate) {
+                        subirBaud();
+                    }
+                    iniciarKeepalive();
                     return fd;
                 }
 
-                // Se o alarme foi acionado (timeout)
-                if (alarmEnabled) {
-                    desconexionStart = clock();
-                    estatisticas.tiempoDesconexion += (double)(clock() - desconexionStart) * 1000.0 / CLOCKS_PER_SEC;
-                }
-                retransmissions--;
-                printf("DEBUG (llopen Tx): Reintento restante = %d\n", retransmissions);
+                retryMs = retryMs * 2 < HANDSHAKE_RETRY_MAX_MS ? retryMs * 2 : HANDSHAKE_RETRY_MAX_MS;
+                debugByte("DEBUG (llopen Tx): UA não recebido, próximo SET dentro de %d ms\n", retryMs);
             }
             // Caso não seja possível estabelecer a conexão após todas as tentativas
-            printf("DEBUG (llopen Tx): Error, no se pudo establecer la conexión.\n");
+            printf("DEBUG (llopen Tx): Error, no se pudo establecer la conexión (%d SET).\n", attempts);
+            lastError = LL_ERROR_TIMEOUT;
             return -1;
         }
 
         // Caso o rol seja de Receptor
         case LlRx:{
             
-            while(state != STOP_R) {
-                unsigned char byte;
-                int bytes;
-                if((bytes = readByteSerialPort(&byte)) < 0){
-                    attempt_count++;
-                    printf("DEBUG (llopen Rx): Error receiving UA\n");
+            // Espera por um SET. Com a negociação ligada responde ao SETX com o
+            // UAX; se o SETX se perdeu (ou não há capacidades em comum) responde ao
+            // SET que vem a seguir com o UA e a sessão usa as tramas de 5 bytes.
+            for (;;) {
+                unsigned char control = setPendente;
+                int result = 1;
+                if (setPendente != 0) {
+                    printf("DEBUG (llopen Rx): A usar o SET recebido no fecho da sessão anterior\n");
+                    memcpy(body, setPendenteBloco, setPendenteTamanho);
+                    bodySize = setPendenteTamanho;
+                    setPendente = 0;
+                } else {
+                    result = receberTramaSupervisao(Address_Transmitter, 0, &control, body, &bodySize);
+                }
+                if (result < 0) {
+                    printf("DEBUG (llopen Rx): Error receiving SET\n");
                     return -1;
                 }
-                if(bytes > 0) {
-                     // Lê bytes da porta serial e processa-os de acordo com o estado atual
-                    switch (state) {
-                        case START:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else state = START;
-                            break;
-                        case FLAG_RCV:
-                            if (byte == Address_Transmitter) state = A_RCV;
-                            else if (byte == FLAG) state = FLAG_RCV;  
-                            else state = START;  
-                            break;
-                        case A_RCV:
-                            if (byte == Command_SET) state = C_RCV;
-                            else if (byte == FLAG) state = FLAG_RCV;  
-                            else state = START;  
-                            break;
-                        case C_RCV:
-                            if (byte == (Address_Transmitter ^ Command_SET)) state = BCC1_OK; 
-                            else state = START;  
-                            break;
-                        case BCC1_OK:
-                            if (byte == FLAG) state = STOP_R;
-                            else state = START;  
-                            break;
-                        default:
-                            state = START;
-                            break;
-                    }
+                if (result == 0) continue;
+                if (control == Command_SETX && negotiate && capabilitiesDecode(body, bodySize, &peerCaps) == 0 &&
+                    capabilitiesIntersect(&localCaps, &peerCaps, &agreedCaps) == 0) {
+                    handshakeReplySize = montarTramaEstendida(Address_Receiver, Command_UAX, &agreedCaps, handshakeReply);
+                    aplicarParametros(&agreedCaps, TRUE);
+                    break;
+                }
+                if (control == Command_SET) {
+                    unsigned char uaFrame[5] = {FLAG, Address_Receiver, Command_UA, Address_Receiver ^ Command_UA, FLAG};
+                    memcpy(handshakeReply, uaFrame, 5);
+                    handshakeReplySize = 5;
+                    aplicarParametros(&legacyCaps, FALSE);
+                    break;
                 }
             }
-            unsigned char uaFrame[5] = {FLAG, Address_Receiver, Command_UA, Address_Receiver ^ Command_UA, FLAG};
-            write(fd, uaFrame, 5);
+            writeBytesSerialPort(handshakeReply, handshakeReplySize);
 
             // Registra o tempo de recepção
             estatisticas.tiempoRecepcion += (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
             printf("DEBUG (llopen Rx): Conexión establecida y UA enviado.\n");
+            iniciarKeepalive();
             return fd;
         }
         // Retorna erro se o rol não for válido
@@ -323,70 +1325,483 @@ int applyByteStuffing(const unsigned char *input, int length, unsigned char *out
     
     // Percorre cada byte do array de entrada
     for (int i = 0; i < length; i++) {
-        printf("DEBUG (applyByteStuffing): Byte original = 0x%X\n", input[i]);
+        debugByte("DEBUG (applyByteStuffing): Byte original = 0x%X\n", input[i]);
         
         // Verifica se o byte atual é um FLAG
         if (input[i] == FLAG) {
             output[stuffedIndex++] = ESCAPE;
             output[stuffedIndex++] = 0x5E;
-            printf("DEBUG (applyByteStuffing): FLAG detectado, aplicando stuffing -> ESCAPE + 0x5E\n");
+            debugByte("DEBUG (applyByteStuffing): FLAG detectado, aplicando stuffing -> ESCAPE + 0x5E\n");
         } 
         // Verifica se o byte atual é um ESCAPE
         else if (input[i] == ESCAPE) {
             output[stuffedIndex++] = ESCAPE;
             output[stuffedIndex++] = 0x5D;
-            printf("DEBUG (applyByteStuffing): ESCAPE detectado, aplicando stuffing -> ESCAPE + 0x5D\n");
+            debugByte("DEBUG (applyByteStuffing): ESCAPE detectado, aplicando stuffing -> ESCAPE + 0x5D\n");
         } 
         // Caso não seja FLAG nem ESCAPE, copia o byte para o array de saída sem alteração
         else {
             output[stuffedIndex++] = input[i];
-            printf("DEBUG (applyByteStuffing): Byte sem alteração = 0x%X\n", input[i]);
+            debugByte("DEBUG (applyByteStuffing): Byte sem alteração = 0x%X\n", input[i]);
         }
     }
-    printf("DEBUG (applyByteStuffing): Tamanho final após stuffing = %d\n", stuffedIndex);
+    debugByte("DEBUG (applyByteStuffing): Tamanho final após stuffing = %d\n", stuffedIndex);
     // Retorna o tamanho do array de saída após stuffing
     return stuffedIndex;
 }
 
-////////////////////////////////////////////////
-// LLWRITE - Envia uma trama de dados
-////////////////////////////////////////////////
-// Parâmetros:
-//   buf: ponteiro para o buffer que contém os dados a serem enviados
-//   bufSize: tamanho do buffer de dados
-// Retorna:
-//   0 se a trama for enviada com sucesso e confirmada, -1 em caso de erro
+// Monta uma trama de dados completa no buffer da trama recebida
+int llEncodeFrame(const unsigned char *buf, int bufSize, FrameSlot *slot) {
+    return llEncodeFrameParts(NULL, 0, buf, bufSize, slot);
+}
 
-int llwrite(const unsigned char *buf, int bufSize) {
-    if (estatisticas.tiempoTransferencia == 0) {
-        estatisticas.tiempoTransferencia = (double)clock();
+int llEncodeFrameParts(const unsigned char *head, int headSize, const unsigned char *buf, int bufSize,
+                       FrameSlot *slot) {
+    // Pior caso: todos os bytes do pacote e do FCS precisam de stuffing
+    int packetSize = headSize + bufSize;
+    if (headSize < 0 || bufSize < 0 || packetSize > linkMaxPayload || llFrameBound(packetSize) > slot->capacity) {
+        printf("DEBUG (llEncodeFrame): Erro, tamanho de pacote inválido (%d)\n", packetSize);
+        return -1;
     }
 
-    unsigned char frame[MAX_FRAME_SIZE];
+    unsigned char *frame = slot->data;
     int frameIndex = 0;
     
     frame[frameIndex++] = FLAG;
     frame[frameIndex++] = Address_Transmitter;
-    frame[frameIndex++] = Command_DATA;
-    frame[frameIndex++] = Address_Transmitter ^ Command_DATA;
+    if (windowMode) {
+        // Ns e BCC1 só são conhecidos quando a trama entra na janela (llwriteFrame)
+        frame[frameIndex++] = Command_IW;
+        frame[frameIndex++] = 0;
+        frame[frameIndex++] = Address_Transmitter ^ Command_IW;
+    } else {
+        frame[frameIndex++] = Command_DATA;
+        frame[frameIndex++] = Address_Transmitter ^ Command_DATA;
+    }
 
-    unsigned char BCC2 = calculateBCC2(buf, bufSize);
+    unsigned char fcs[2];
+    int fcsSize = calcularFCSPartes(head, headSize, buf, bufSize, fcs);
+    frameIndex += applyByteStuffing(head, headSize, &frame[frameIndex]);
     frameIndex += applyByteStuffing(buf, bufSize, &frame[frameIndex]);
-    frameIndex += applyByteStuffing(&BCC2, 1, &frame[frameIndex]);
+    frameIndex += applyByteStuffing(fcs, fcsSize, &frame[frameIndex]);
     frame[frameIndex++] = FLAG;
+    slot->length = frameIndex;
+    return frameIndex;
+}
+
+// Distância de from até to no espaço de números de sequência
+static int seqDistance(int from, int to) {
+    return (to - from + SEQ_MODULUS) % SEQ_MODULUS;
+}
+
+// (Re)envia a trama da janela com número de sequência seq. Com poll a trama
+// leva o bit P e o receptor confirma-a logo em vez de agregar o RR.
+static void sendWindowEntry(int seq, int poll) {
+    WindowEntry *entry = &txWindow[seq];
+    unsigned char *frame = entry->slot->data;
+    unsigned char control = poll ? Command_IWP : Command_IW;
+    frame[2] = control;
+    frame[3] = seq;
+    frame[4] = Address_Transmitter ^ control ^ seq;
+    entry->polled = poll;
+    writeBytesSerialPort(frame, entry->slot->length);
+
+    // A linha só começa a transmitir esta trama depois das anteriores: o RTT
+    // conta a partir daí, senão incluiria a fila de saída da porta
+    unsigned long long now = timerNowUs();
+    unsigned long long startUs = txBusyUntilUs > now ? txBusyUntilUs : now;
+    txBusyUntilUs = startUs + (unsigned long long)windowSizerByteTimeUs(&windowSizer, entry->slot->length);
+    if (entry->transmissions++ == 0) entry->startUs = startUs;
+
+    // O timeout conta a partir do fim da trama na linha (uma trama jumbo a
+    // pouca velocidade pode demorar mais do que o próprio timeout)
+    timerStart(&linkTimers, &entry->timer, tempoRetransmissaoMs() + (int)((txBusyUntilUs - now) / 1000));
+    estatisticas.tramasEnviadas++;
+}
+
+// Confirma todas as tramas anteriores a nr (RR/REJ cumulativo)
+static void acknowledgeUpTo(int nr) {
+    int acked = seqDistance(sendBase, nr);
+    if (acked == 0 || acked > outstanding) return;  // Confirmação repetida ou inválida
+
+    unsigned long long now = timerNowUs();
+    int previous = windowSize;
+    double rttUs = 0;
+
+    // Um RR pedido pelo bit P pode chegar antes de o receptor juntar as tramas
+    // que costuma agregar: só serve para aumentar a estimativa
+    WindowEntry *last = &txWindow[(sendBase + acked - 1) % SEQ_MODULUS];
+    if (!last->polled || acked > windowSizer.ackStride) {
+        windowSize = windowSizerAckStride(&windowSizer, acked);
+    }
+    for (int i = 0; i < acked; i++) {
+        WindowEntry *entry = &txWindow[sendBase];
+        timerStop(&linkTimers, &entry->timer);
+
+        // Só tramas enviadas uma vez dão amostras de RTT sem ambiguidade (Karn).
+        // A amostra é a da trama que provocou o RR, a última que ele confirma.
+        if (i == acked - 1 && entry->transmissions == 1 && now > entry->startUs) {
+            rttUs = (double)(now - entry->startUs);
+            ultimoRttUs = rttUs;
+            windowSize = windowSizerSample(&windowSizer, rttUs, entry->slot->length, SUP_SEQ_FRAME_SIZE);
+        }
+
+        actualizarEstadisticasEnvio(1);
+        estatisticas.totalBytesTransmitidos += entry->payloadSize;
+        bytesConfirmados += entry->payloadSize;
+        framePoolRelease(entry->slot);     // Liberta a referência de "à espera de ACK"
+        entry->slot = NULL;
+        sendBase = (sendBase + 1) % SEQ_MODULUS;
+        outstanding--;
+    }
+    transferEndUs = now;
+    avaliarErrosBaud(0, acked);
+    if (windowSize != previous) {
+        printf("DEBUG (janela): RTT = %.2f ms, a = %.3f, %.1f tramas por RR, janela %d -> %d (eficiência máxima %.1f%%)\n",
+               rttUs / 1000.0, windowSizerA(&windowSizer), windowSizer.ackStride, previous, windowSize,
+               100.0 * windowSizerEfficiencyBound(&windowSizer, windowSize));
+    }
+
+    // Se o temporizador da nova base já expirou (enquanto não era a base), trata-o agora
+    if (outstanding > 0 && !timerActive(&txWindow[sendBase].timer)) {
+        windowTimeout = TRUE;
+    }
+}
+
+// Go-Back-N: reenvia todas as tramas por confirmar a partir de fromSeq; a última
+// pede RR imediato para a janela não ficar à espera de um RR agregado
+static void goBackN(int fromSeq) {
+    for (int seq = fromSeq; seq != nextSeq; seq = (seq + 1) % SEQ_MODULUS) {
+        sendWindowEntry(seq, (seq + 1) % SEQ_MODULUS == nextSeq);
+    }
+}
+
+// Estado do analisador de tramas de supervisão do transmissor; persiste entre
+// chamadas porque uma trama pode chegar aos bocados
+typedef struct {
+    LinkLayerState state;
+    unsigned char control;
+    unsigned char seq;
+} SupervisionParser;
+
+SupervisionParser ackParser = {START, 0, 0};
+
+// Trata um byte vindo do receptor. Retorna 1 quando completa uma trama de
+// supervisão válida (control e seq ficam no analisador).
+static int parseSupervisionByte(SupervisionParser *parser, unsigned char byte) {
+    switch (parser->state) {
+        case START:
+            if (byte == FLAG) parser->state = FLAG_RCV;
+            break;
+        case FLAG_RCV:
+            if (byte == Address_Receiver) parser->state = A_RCV;
+            else if (byte != FLAG) parser->state = START;
+            break;
+        case A_RCV:
+            parser->control = byte;
+            if (byte == FLAG) parser->state = FLAG_RCV;
+            else if (byte == Command_RRW || byte == Command_REJW || byte == Command_BAUD_ACK ||
+                     byte == Command_PROBE_ACK) parser->state = C_RCV;
+            else parser->state = SEQ_RCV;     // Trama sem número de sequência: segue-se o BCC1
+            parser->seq = 0;
+            break;
+        case C_RCV:
+            parser->seq = byte;
+            parser->state = SEQ_RCV;
+            break;
+        case SEQ_RCV:
+            if (byte == (Address_Receiver ^ parser->control ^ parser->seq)) parser->state = BCC1_OK;
+            else parser->state = byte == FLAG ? FLAG_RCV : START;
+            break;
+        case BCC1_OK:
+            parser->state = START;
+            if (byte == FLAG) {
+                parser->state = FLAG_RCV;   // A FLAG final pode ser a inicial da próxima
+                registarTramaValida();
+                return 1;
+            }
+            break;
+        default:
+            parser->state = START;
+            break;
+    }
+    return 0;
+}
+
+// Transmissor: espera até deadlineMs por wanted tramas control com o índice
+// index (BAUD_ACK ou PROBE_ACK). Retorna quantas chegaram, ou -1 se a ligação morreu.
+static int esperarRespostaBaud(unsigned char control, int index, unsigned long long deadlineMs, int wanted) {
+    int received = 0;
+    alarmEnabled = 0;
+    timerStart(&linkTimers, &handshakeTimer, msAte(deadlineMs));
+    while (!alarmEnabled && !linkDead && received < wanted) {
+        unsigned char byte;
+        int result = readLinkByte(&byte);
+        if (result < 0) break;
+        if (result == 0 || !parseSupervisionByte(&ackParser, byte)) continue;
+        if (ackParser.control == control && ackParser.seq == index) received++;
+        else if (ackParser.control == Command_KEEPALIVE) responderSondagem();
+    }
+    timerStop(&linkTimers, &handshakeTimer);
+    return linkDead || lastError == LL_ERROR_IO ? -1 : received;
+}
+
+// Envia as sondas da taxa na posição index: cabeçalho com o índice, um bloco de
+// teste com FLAG e ESCAPE (passa pelo stuffing) e o FCS da sessão
+static void enviarSondasBaud(int index) {
+    unsigned char block[BAUD_PROBE_SIZE + 2];
+    unsigned char frame[SUP_SEQ_FRAME_SIZE + 2 * (BAUD_PROBE_SIZE + 2)];
+    for (int i = 0; i < BAUD_PROBE_SIZE; i++) block[i] = i ^ FLAG;
+    int blockSize = BAUD_PROBE_SIZE + calcularFCS(block, BAUD_PROBE_SIZE, &block[BAUD_PROBE_SIZE]);
+
+    int size = 0;
+    frame[size++] = FLAG;
+    frame[size++] = Address_Transmitter;
+    frame[size++] = Command_PROBE;
+    frame[size++] = index;
+    frame[size++] = Address_Transmitter ^ Command_PROBE ^ index;
+    size += applyByteStuffing(block, blockSize, &frame[size]);
+    frame[size++] = FLAG;
+    for (int i = 0; i < BAUD_PROBES; i++) {
+        writeBytesSerialPort(frame, size);
+    }
+}
+
+// Transmissor: pede ao receptor a taxa baudRate, muda a sua e envia as sondas.
+// Retorna o número de sondas confirmadas, ou -1 se o pedido não teve resposta
+// (e a taxa não mudou).
+static int trocarTaxa(int baudRate) {
+    int index = serialPortBaudIndex(baudRate);
+    int verifyMs = tempoVerificacaoBaudMs(baudRate);
+
+    // Se o BAUD_ACK se perder o receptor muda sozinho e volta ao fim de
+    // verifyMs: os pedidos continuam para lá disso
+    unsigned long long deadline = timerNowMs() + 2 * verifyMs + HANDSHAKE_RETRY_MAX_MS;
+    int retryMs = intervaloHandshakeInicialMs();
+    int acked = 0;
+    while (acked == 0 && timerNowMs() < deadline) {
+        enviarTramaSupervisaoSeq(fd, Address_Transmitter, Command_BAUD, index);
+        unsigned long long retryAt = timerNowMs() + retryMs;
+        acked = esperarRespostaBaud(Command_BAUD_ACK, index, retryAt < deadline ? retryAt : deadline, 1);
+        retryMs = retryMs * 2 < HANDSHAKE_RETRY_MAX_MS ? retryMs * 2 : HANDSHAKE_RETRY_MAX_MS;
+    }
+    if (acked <= 0) {
+        printf("DEBUG (baud): Sem resposta ao pedido de %d baud\n", baudRate);
+        return -1;
+    }
+    if (aplicarTaxa(baudRate) < 0) return -1;
+
+    // O BAUD_ACK chega quando o receptor ainda o está a acabar de enviar
+    usleep(BAUD_SWITCH_GUARD_US);
+    enviarSondasBaud(index);
+    int answered = esperarRespostaBaud(Command_PROBE_ACK, index, timerNowMs() + verifyMs, BAUD_PROBES);
+    return answered < 0 ? 0 : answered;
+}
+
+// Transmissor: muda a taxa dos dois lados para baudRate. Retorna 0 se a nova
+// taxa passou nas sondas, -1 se ficou na anterior.
+static int mudarBaud(int baudRate) {
+    int previous = linkBaudRate;
+    int answered = trocarTaxa(baudRate);
+    if (answered < 0) return -1;
+    if (answered >= BAUD_PROBES_OK) {
+        printf("DEBUG (baud): %d baud verificado (%d/%d sondas)\n", baudRate, answered, BAUD_PROBES);
+        return 0;
+    }
+    printf("DEBUG (baud): Só %d/%d sondas respondidas a %d baud, a voltar a %d\n",
+           answered, BAUD_PROBES, baudRate, previous);
+    baudFallbacks++;
+    // Com alguma sonda confirmada o receptor deu a taxa por boa: tem de ser
+    // pedida de volta nesta. Sem nenhuma volta sozinho no fim da verificação.
+    if (answered == 0 || trocarTaxa(previous) < 0) aplicarTaxa(previous);
+    return -1;
+}
+
+// Transmissor: sobe a taxa um degrau de cada vez até à máxima acordada ou até um falhar
+static void subirBaud() {
+    unsigned long long startUs = timerNowUs();
+    int initial = linkBaudRate;
+    int index = serialPortBaudIndex(linkBaudRate);
+    while (index >= 0 && serialPortBaudAt(index + 1) != 0 && serialPortBaudAt(index + 1) <= sessionCaps.maxBaud) {
+        if (mudarBaud(serialPortBaudAt(index + 1)) < 0) break;
+        index++;
+    }
+    printf("DEBUG (baud): Taxa %d -> %d baud em %.2f ms (máxima acordada %d)\n",
+           initial, linkBaudRate, (timerNowUs() - startUs) / 1000.0, sessionCaps.maxBaud);
+}
+
+// Transmissor: conta erros (REJ e timeouts) e tramas confirmadas; acima de
+// BAUD_ERROR_PERCENT% a taxa desce um degrau antes da próxima trama
+static void avaliarErrosBaud(int errors, int frames) {
+    baudErrors += errors;
+    baudFrames += frames;
+    int total = baudErrors + baudFrames;
+    if (total < BAUD_ERROR_WINDOW) return;
+    if (linkBaudRate > baseBaudRate && baudErrors * 100 > BAUD_ERROR_PERCENT * total) {
+        baudDownshift = TRUE;
+    }
+    baudErrors = baudFrames = 0;
+}
+
+// Transmissor, antes de reenviar a janela: com a taxa acima da do llopen e os
+// erros a subir (ou a trama mais antiga já reenviada uma vez) desce um degrau.
+// A janela volta a ter todas as tentativas na nova taxa.
+static void descerTaxaSeErros() {
+    WindowEntry *base = &txWindow[sendBase];
+    if (linkBaudRate <= baseBaudRate || (!baudDownshift && base->transmissions < 2)) return;
+    baudDownshift = FALSE;
+    int lower = serialPortBaudAt(serialPortBaudIndex(linkBaudRate) - 1);
+    if (lower < baseBaudRate) return;
+    printf("DEBUG (baud): Demasiados erros a %d baud, a descer para %d\n", linkBaudRate, lower);
+    if (mudarBaud(lower) < 0) return;
+    for (int seq = sendBase; seq != nextSeq; seq = (seq + 1) % SEQ_MODULUS) {
+        txWindow[seq].transmissions = 0;
+    }
+}
+
+// Processa as confirmações recebidas. Bloqueia enquanto a janela estiver cheia
+// (ou, com drain, até estar vazia); sem isso só trata o que já chegou.
+// Retorna 0, ou -1 se a ligação falhou.
+static int serviceWindow(int drain) {
+    for (;;) {
+        if (windowTimeout) {
+            windowTimeout = FALSE;
+            WindowEntry *base = &txWindow[sendBase];
+            if (outstanding > 0 && !timerActive(&base->timer)) {
+                if (base->transmissions >= retransmissions) {
+                    printf("DEBUG (llwrite): Trama %d sem confirmação após %d envios\n", sendBase, base->transmissions);
+                    lastError = LL_ERROR_TIMEOUT;
+                    linkFailed = TRUE;
+                } else {
+                    printf("DEBUG (llwrite): Tempo esgotado na trama %d, a reenviar %d tramas\n", sendBase, outstanding);
+                    avaliarErrosBaud(1, 0);
+                    descerTaxaSeErros();
+                    goBackN(sendBase);
+                }
+            }
+        }
+        if (linkDead) linkFailed = TRUE;
+        if (linkFailed) return -1;
+        // Tudo confirmado: o que vier a seguir (p.ex. um llReply) fica por ler
+        if (drain && outstanding == 0) return 0;
+
+        int mustWait = outstanding >= janelaAtual() || (drain && outstanding > 0);
+        unsigned char byte;
+        int result = receiveByte(&byte, mustWait);
+        if (result < 0) {
+            linkFailed = TRUE;
+            return -1;
+        }
+        if (result == 0) {
+            if (!mustWait && !windowTimeout) return 0;
+            continue;
+        }
+
+        if (!parseSupervisionByte(&ackParser, byte)) continue;
+        int nr = ackParser.seq % SEQ_MODULUS;
+        if (ackParser.control == Command_RRW) {
+            acknowledgeUpTo(nr);
+        } else if (ackParser.control == Command_REJW) {
+            printf("DEBUG (llwrite): REJ %d recebido, a reenviar a partir dessa trama\n", nr);
+            acknowledgeUpTo(nr);
+            actualizarEstadisticasEnvio(0);
+            avaliarErrosBaud(1, 0);
+            if (outstanding > 0 && nr == sendBase) {
+                descerTaxaSeErros();
+                goBackN(sendBase);
+            }
+        } else if (ackParser.control == Command_KEEPALIVE) {
+            responderSondagem();
+        }
+    }
+}
+
+// Com a janela cheia depois de enviar slot, diz se a linha esvazia antes de o
+// RR da trama mais antiga poder chegar (o write() só põe os bytes na fila da
+// porta, por isso a janela enche muito antes de a linha parar)
+static int windowWillStall(FrameSlot *slot) {
+    unsigned long long now = timerNowUs();
+    unsigned long long busyUntil = txBusyUntilUs > now ? txBusyUntilUs : now;
+    double idleInUs = (busyUntil - now) + windowSizerByteTimeUs(&windowSizer, slot->length);
+    double ackInUs = windowSizer.twoPropUs + windowSizerByteTimeUs(&windowSizer, SUP_SEQ_FRAME_SIZE);
+    return idleInUs < ackInUs;
+}
+
+// Põe uma trama montada na janela e envia-a; só bloqueia se a janela estiver cheia
+static int writeFrameWindowed(FrameSlot *slot, int payloadSize) {
+    // Espera até haver espaço (a janela pode ter encolhido abaixo das tramas pendentes)
+    while (outstanding >= janelaAtual() || outstanding >= SEQ_MODULUS - 1) {
+        if (serviceWindow(FALSE) < 0) return -1;
+    }
+    if (serviceWindow(FALSE) < 0) return -1;
+
+    framePoolRetain(slot);
+    int seq = nextSeq;
+    WindowEntry *entry = &txWindow[seq];
+    entry->slot = slot;
+    entry->payloadSize = payloadSize;
+    entry->transmissions = 0;
+    nextSeq = (nextSeq + 1) % SEQ_MODULUS;
+    outstanding++;
+
+    // Pede RR imediato quando quem chamou vai esperar pela confirmação (llwrite)
+    // ou quando esta trama enche a janela e a linha ficaria parada antes de chegar
+    // um RR agregado; nos outros casos o receptor agrega as confirmações
+    int poll = pollNext || (outstanding >= janelaAtual() && windowWillStall(slot));
+    pollNext = FALSE;
+    sendWindowEntry(seq, poll);
+    return slot->length;
+}
+
+int llFlush() {
+    if (!windowMode) return 0;
+    return serviceWindow(TRUE);
+}
+
+int llService() {
+    if (windowMode) return serviceWindow(FALSE);
+
+    // Stop-and-wait: não há tramas por confirmar, só sondagens para responder
+    unsigned char byte;
+    int result;
+    while ((result = receiveByte(&byte, FALSE)) > 0) {
+        if (parseSupervisionByte(&ackParser, byte) && ackParser.control == Command_KEEPALIVE) responderSondagem();
+    }
+    if (result < 0 || linkDead) {
+        if (linkDead) lastError = LL_ERROR_LINK_DEAD;
+        return -1;
+    }
+    return 0;
+}
+
+// Envia uma trama já montada. Com janela, volta logo que a trama é enviada e
+// as confirmações são tratadas nas chamadas seguintes (ou em llFlush); sem
+// janela, espera pela confirmação do receptor.
+int llwriteFrame(FrameSlot *slot, int payloadSize) {
+    if (transferStartUs == 0) {
+        transferStartUs = timerNowUs();
+    }
+    if (windowMode) {
+        return writeFrameWindowed(slot, payloadSize);
+    }
+
+    // A trama fica com uma referência extra enquanto espera pelo ACK
+    framePoolRetain(slot);
+    unsigned char *frame = slot->data;
+    int frameIndex = slot->length;
 
     int tentativas = retransmissions;
-    while (tentativas > 0) {
+    while (tentativas > 0 && !linkDead) {
         // Enviar la trama completa
         writeBytesSerialPort(frame, frameIndex);
         alarmEnabled = 0;
-        alarm(timeout);
+        timerStart(&linkTimers, &retransmitTimer, tempoRetransmissaoMs() + tempoLinhaMs(frameIndex));
         estatisticas.tramasEnviadas++;
 
         unsigned char byte;
         LinkLayerState state = START;
         while (!alarmEnabled && state != STOP_R) {
-            if (readByteSerialPort(&byte) > 0) {
+            if (readLinkByte(&byte) > 0) {
                 switch (state) {
                     case START:
                         if (byte == FLAG) state = FLAG_RCV;
@@ -396,12 +1811,20 @@ int llwrite(const unsigned char *buf, int bufSize) {
                         break;
                     case A_RCV:
                         if (byte == C_RR0 || byte == C_RR1) {
+                            registarTramaValida();
                             state = STOP_R;  // Confirmación de recepción correcta
                         } else if (byte == C_REJ0 || byte == C_REJ1) {
                             // Reiniciar la transmisión al recibir REJ
                             state = START;
                             printf("DEBUG (llwrite): REJ received, resending frame...\n");
                             break; // Salir del bucle interno para reenviar la trama completa
+                        } else if (byte == Command_KEEPALIVE) {
+                            responderSondagem();
+                            state = START;
+                        } else {
+                            // Outra trama (p.ex. um UAX repetido): o bloco que traz
+                            // não pode ser confundido com um RR
+                            state = byte == FLAG ? FLAG_RCV : START;
                         }
                         break;
                     default:
@@ -413,10 +1836,13 @@ int llwrite(const unsigned char *buf, int bufSize) {
 
         // Si se recibió RR, confirmar y avanzar
         if (state == STOP_R && (byte == C_RR0 || byte == C_RR1)) {
-            alarm(0);
+            timerStop(&linkTimers, &retransmitTimer);
             actualizarEstadisticasEnvio(1);
-            estatisticas.totalBytesTransmitidos += bufSize;
+            estatisticas.totalBytesTransmitidos += payloadSize;
+            bytesConfirmados += payloadSize;
 
+            framePoolRelease(slot);     // Liberta a referência de "à espera de ACK"
+            transferEndUs = timerNowUs();
             return frameIndex;  // Confirmación exitosa, avanza al siguiente paquete
         }
 
@@ -427,11 +1853,41 @@ int llwrite(const unsigned char *buf, int bufSize) {
     }
 
     // Si todos los intentos fallan, retorno con error
+    lastError = linkDead ? LL_ERROR_LINK_DEAD : LL_ERROR_TIMEOUT;
     actualizarEstadisticasEnvio(0);
+    framePoolRelease(slot);
     printf("DEBUG (llwrite): Error, no se pudo enviar la trama correctamente.\n");
     return -1;
 }
 
+////////////////////////////////////////////////
+// LLWRITE - Envia uma trama de dados
+////////////////////////////////////////////////
+// Parâmetros:
+//   buf: ponteiro para o buffer que contém os dados a serem enviados
+//   bufSize: tamanho do buffer de dados
+// Retorna:
+//   0 se a trama for enviada com sucesso e confirmada, -1 em caso de erro
+
+int llwrite(const unsigned char *buf, int bufSize) {
+    // A trama vem do pool e volta para lá depois de confirmada
+    FrameSlot *slot = framePoolAcquire();
+    if (slot == NULL) {
+        printf("DEBUG (llwrite): Erro, pool de tramas esgotado\n");
+        return -1;
+    }
+
+    // Com janela, só retorna depois de esta trama (e as anteriores) serem confirmadas
+    int result = -1;
+    if (llEncodeFrame(buf, bufSize, slot) > 0) {
+        pollNext = TRUE;
+        result = llwriteFrame(slot, bufSize);
+        if (result >= 0 && llFlush() < 0) result = -1;
+    }
+    framePoolRelease(slot);
+    return result;
+}
+
 //Esta função remove bytes de escape de uma trama recebida, restaurando os bytes originais
 int applyByteDestuffing(const unsigned char *input, int length, unsigned char *output) {
 
@@ -444,120 +1900,257 @@ int applyByteDestuffing(const unsigned char *input, int length, unsigned char *o
         if (escape) {
             if (input[i] == 0x5E) {
                 output[destuffedIndex++] = FLAG;
-                printf("DEBUG (applyByteDestuffing): ESCAPE seguido de 0x5E, convertendo para FLAG\n");
+                debugByte("DEBUG (applyByteDestuffing): ESCAPE seguido de 0x5E, convertendo para FLAG\n");
             } 
             else if (input[i] == 0x5D) {
                 output[destuffedIndex++] = ESCAPE;
-                printf("DEBUG (applyByteDestuffing): ESCAPE seguido de 0x5D, convertendo para ESCAPE\n");
+                debugByte("DEBUG (applyByteDestuffing): ESCAPE seguido de 0x5D, convertendo para ESCAPE\n");
             }
             escape = 0;     // Reinicia o indicador de ESCAPE
         } 
         else if (input[i] == ESCAPE) {
             escape = 1;     // Marca que o byte ESCAPE foi encontrado e aguarda o próximo byte
-            printf("DEBUG (applyByteDestuffing): Byte ESCAPE detectado, aguardando próximo byte\n");
+            debugByte("DEBUG (applyByteDestuffing): Byte ESCAPE detectado, aguardando próximo byte\n");
         } 
          // Deteta o FLAG final e para o processamento
         else if (input[i] == FLAG && i == length - 1) { 
-            printf("DEBUG (applyByteDestuffing): FLAG final detectado, parando processamento\n");
+            debugByte("DEBUG (applyByteDestuffing): FLAG final detectado, parando processamento\n");
             break;
         } 
         // Copia o byte sem alteração se não houver destuffing
         else {
             output[destuffedIndex++] = input[i];
-            printf("DEBUG (applyByteDestuffing): Byte sem alteração = 0x%X\n", input[i]);
+            debugByte("DEBUG (applyByteDestuffing): Byte sem alteração = 0x%X\n", input[i]);
         }
     }
-    printf("DEBUG (applyByteDestuffing): Tamanho final após destuffing = %d\n", destuffedIndex);
+    debugByte("DEBUG (applyByteDestuffing): Tamanho final após destuffing = %d\n", destuffedIndex);
     // Retorna o tamanho final do array de saída após o destuffing
     return destuffedIndex;
 }
 
+// Tira o stuffing da trama no próprio buffer e verifica o FCS; só o pacote
+// (no máximo linkMaxPayload bytes) é copiado para packet. Retorna o tamanho do
+// pacote, ou -1 se o FCS estiver errado.
+static int extrairPacote(unsigned char *frame, int length, unsigned char *packet) {
+    int payloadSize = verificarFCS(frame, applyByteDestuffing(frame, length, frame));
+    if (payloadSize < 0 || payloadSize > linkMaxPayload) return -1;
+    memcpy(packet, frame, payloadSize);
+    return payloadSize;
+}
+
 ////////////////////////////////////////////////
 // LLREAD - Lê uma trama de dados 
 ////////////////////////////////////////////////
 // Parâmetros:
 //   packet: ponteiro para o buffer onde os dados recebidos serão armazenados
+//           (com pelo menos llMaxPayload() bytes)
 // Retorna:
 //   O tamanho do pacote de dados (sem FLAG, A, C, e BCC1) se for recebido corretamente,
 //   -1 em caso de erro.
 int llread(unsigned char *packet) {
     LinkLayerState state = START;
-    unsigned char frame[MAX_FRAME_SIZE];
+    FrameSlot *slot = framePoolAcquire();
+    if (slot == NULL) {
+        printf("DEBUG (llread): Erro, pool de tramas esgotado\n");
+        return -1;
+    }
+    unsigned char *frame = slot->data;
     int frameIndex = 0;
     unsigned char byte;
     int tentativas = retransmissions;
+    int windowed = FALSE;       // Trama com número de sequência (Command_IW/IWP)
+    unsigned char control = 0;
+    unsigned char seq = 0;
+    int ioError = FALSE;
+    // Limites do pacote acordado: tramas maiores são lixo, e uma trama inteira
+    // tem de caber no timeout mesmo a pouca velocidade
+    int frameLimit = llFrameBound(linkMaxPayload);
+    int waitMs = timeout * 1000 + tempoLinhaMs(frameLimit);
     
     // Loop principal de tentativas de leitura
     while (tentativas > 0) {
         alarmEnabled = 0;
-        alarm(timeout);
-        printf("DEBUG (llread): Inicio do loop de leitura, tentativas restantes = %d\n", tentativas);
+        timerStart(&linkTimers, &receiveTimer, waitMs);
+        debugByte("DEBUG (llread): Inicio do loop de leitura, tentativas restantes = %d\n", tentativas);
         
         // Loop para ler bytes enquanto o alarme não dispara e o estado final não é alcançado
         while (!alarmEnabled && state != STOP_R) {
-            if (readByteSerialPort(&byte) > 0) {
-                printf("DEBUG (llread): Estado = %d, Byte recebido = 0x%X\n", state, byte);
+            int received = readLinkByte(&byte);
+            if (received < 0) {
+                ioError = TRUE;
+                break;
+            }
+            if (ackDue) {
+                enviarConfirmacaoPendente();    // Expirou o atraso do RR agregado
+            }
+            if (received > 0) {
+                debugByte("DEBUG (llread): Estado = %d, Byte recebido = 0x%X\n", state, byte);
                 switch (state) {
                     case START:
                         if (byte == FLAG) {
                             state = FLAG_RCV;
-                            printf("DEBUG (llread): Transição para FLAG_RCV\n");
+                            debugByte("DEBUG (llread): Transição para FLAG_RCV\n");
                         }
                         break;
                     case FLAG_RCV:
                         if (byte == Address_Transmitter) {
                             state = A_RCV;
-                            printf("DEBUG (llread): Transição para A_RCV\n");
+                            debugByte("DEBUG (llread): Transição para A_RCV\n");
                         }
                         break;
                     case A_RCV:
-                        if (byte == Command_DATA) {
+                        if (byte == Command_DATA || byte == Command_IW || byte == Command_IWP ||
+                            byte == Command_BAUD || byte == Command_PROBE) {
+                            // BAUD e PROBE levam o índice da taxa no lugar do Ns
+                            windowed = byte != Command_DATA;
+                            control = byte;
                             state = C_RCV;
-                            printf("DEBUG (llread): Transição para C_RCV (Command_DATA)\n");
+                            debugByte("DEBUG (llread): Transição para C_RCV (Command_DATA)\n");
                         } else if (byte == Command_DISC) {
                             printf("DEBUG (llread): Command_DISC recebido, desconectando...\n");
+                            enviarConfirmacaoPendente();
+                            timerStop(&linkTimers, &receiveTimer);
+                            framePoolRelease(slot);
                             return -2;
+                        } else if (byte == Command_KEEPALIVE) {
+                            responderSondagem();
+                            state = START;
+                        } else if (byte == Command_KEEPALIVE_ACK) {
+                            registarTramaValida();
+                            state = START;
+                        } else if (byte == Command_SET || byte == Command_SETX) {
+                            // SET repetido: o UA do llopen perdeu-se ou chegou depois de
+                            // o transmissor reenviar o SET. Volta a responder.
+                            responderHandshake(byte);
+                            state = START;
                         }
                         break;
                     case C_RCV:
-                        if (byte == (Address_Transmitter ^ Command_DATA)) {
+                        if (windowed) {
+                            seq = byte;
+                            state = byte == FLAG ? FLAG_RCV : SEQ_RCV;
+                        } else if (byte == (Address_Transmitter ^ Command_DATA)) {
+                            registarTramaValida();
                             state = BCC1_OK;
-                            printf("DEBUG (llread): BCC1 OK, transição para DATA\n");
+                            debugByte("DEBUG (llread): BCC1 OK, transição para DATA\n");
+                        }
+                        break;
+                    case SEQ_RCV:
+                        if (byte == (Address_Transmitter ^ control ^ seq) && seq < SEQ_MODULUS) {
+                            registarTramaValida();
+                            state = BCC1_OK;
+                            debugByte("DEBUG (llread): Ns = %d, BCC1 OK, transição para DATA\n", seq);
+                        } else {
+                            state = byte == FLAG ? FLAG_RCV : START;
                         }
                         break;
                     case BCC1_OK:
-                        if (byte != FLAG) {
+                        if (byte == FLAG && control == Command_BAUD) {
+                            tratarPedidoBaud(seq);
+                            state = FLAG_RCV;
+                        } else if (byte != FLAG) {
                             frame[frameIndex++] = byte;
                             state = DATA;
-                            printf("DEBUG (llread): Transição para DATA, dado recebido = 0x%X\n", byte);
+                            debugByte("DEBUG (llread): Transição para DATA, dado recebido = 0x%X\n", byte);
                         }
                         break;
                     case DATA:
                         if (byte == FLAG) {
                             state = STOP_R;
-                            printf("DEBUG (llread): FLAG de fim recebido, transição para STOP_R\n");
+                            debugByte("DEBUG (llread): FLAG de fim recebido, transição para STOP_R\n");
+                        } else if (frameIndex >= frameLimit) {
+                            // Trama maior que o pior caso do pacote acordado: descarta e procura a próxima FLAG
+                            state = START;
+                            frameIndex = 0;
+                            printf("DEBUG (llread): Trama demasiado grande, descartada\n");
                         } else {
                             frame[frameIndex++] = byte;
-                            printf("DEBUG (llread): Dado adicionado ao frame = 0x%X\n", byte);
+                            debugByte("DEBUG (llread): Dado adicionado ao frame = 0x%X\n", byte);
                         }
                         break;
                     default:
                         state = START;
-                        printf("DEBUG (llread): Estado desconhecido, reiniciando para START\n");
+                        debugByte("DEBUG (llread): Estado desconhecido, reiniciando para START\n");
                         break;
                 }
             }
         }
 
+        // O keepalive declarou a ligação morta (ou a porta falhou): não vale a pena esperar mais tentativas
+        if (linkDead || ioError) break;
+
+        // Trama com janela: só a trama esperada é aceite (Go-Back-N)
+        if (state == STOP_R && windowed) {
+            state = START;
+            int length = frameIndex;
+            frameIndex = 0;
+
+            // Sonda de uma nova taxa: o índice não é um Ns
+            if (control == Command_PROBE) {
+                if (extrairPacote(frame, length, packet) >= 0) {
+                    tratarSondaBaud(seq);
+                }
+                continue;
+            }
+
+            int distance = seqDistance(expectedSeq, seq);
+            if (distance != 0) {
+                if (distance < SEQ_MODULUS / 2) {
+                    // Falta uma trama: pede o reenvio a partir dela, uma só vez
+                    if (!rejSent) {
+                        printf("DEBUG (llread): Trama %d fora de ordem, a enviar REJ %d\n", seq, expectedSeq);
+                        enviarConfirmacao(Command_REJW);
+                        rejSent = TRUE;
+                    }
+                } else {
+                    // Duplicado (o RR perdeu-se): volta a confirmar
+                    enviarConfirmacao(Command_RRW);
+                }
+                continue;
+            }
+
+            int payloadSize = extrairPacote(frame, length, packet);
+            if (payloadSize >= 0) {
+                expectedSeq = (expectedSeq + 1) % SEQ_MODULUS;
+                rejSent = FALSE;
+
+                // RR agregado: só confirma já com o bit P (janela do transmissor
+                // cheia ou llwrite à espera) ou ao fim de ackEvery tramas
+                if (++ackPending >= ackEvery || control == Command_IWP) {
+                    if (control == Command_IWP) rrPorPoll++;
+                    else rrPorContagem++;
+                    enviarConfirmacao(Command_RRW);
+                } else if (!timerActive(&ackTimer)) {
+                    timerStart(&linkTimers, &ackTimer, atrasoConfirmacaoMs(length + SUP_SEQ_FRAME_SIZE));
+                }
+                actualizarEstadisticasRecepcao();
+                estatisticas.totalBytesTransmitidos += payloadSize;
+                if (transferStartUs == 0) transferStartUs = timerNowUs();
+                transferEndUs = timerNowUs();
+                timerStop(&linkTimers, &receiveTimer);
+                framePoolRelease(slot);
+                return payloadSize;
+            }
+
+            // FCS errado: o transmissor reenvia a partir desta trama. Não conta como
+            // tentativa: com a janela, quem limita as retransmissões é o transmissor
+            printf("DEBUG (llread): Erro: FCS incorreto na trama %d. A enviar REJ...\n", seq);
+            if (!rejSent) {
+                enviarConfirmacao(Command_REJW);
+                rejSent = TRUE;
+            }
+            estatisticas.tramasRejeitadas++;
+            continue;
+        }
+
         // Processa a trama recebida se o estado final for alcançado
         if (state == STOP_R) {
-            int destuffedSize = applyByteDestuffing(frame, frameIndex, packet);
-            unsigned char BCC2 = calculateBCC2(packet, destuffedSize - 1);
-            printf("DEBUG (llread): Tamanho após destuffing = %d, BCC2 calculado = 0x%X\n", destuffedSize, BCC2);
+            int payloadSize = extrairPacote(frame, frameIndex, packet);
+            debugByte("DEBUG (llread): Trama de %d bytes, FCS %s\n", frameIndex, payloadSize >= 0 ? "correto" : "errado");
             
-            // Verifica o BCC2 para garantir a integridade dos dados
-            if (BCC2 == packet[destuffedSize - 1]) {
-                printf("DEBUG (llread): Trama recebida corretamente. A enviar RR...\n");
+            // Verifica o FCS para garantir a integridade dos dados
+            if (payloadSize >= 0) {
+                debugByte("DEBUG (llread): Trama recebida corretamente. A enviar RR...\n");
                 if (tramaRx == 0) {
                     enviarTramaSupervisao(fd, Address_Receiver, C_RR0);
                 } else {
@@ -566,10 +2159,12 @@ int llread(unsigned char *packet) {
                 tramaRx = (tramaRx + 1) % 2;
                 actualizarEstadisticasRecepcao();
                 estatisticas.tramasRecebidas++;
-                return destuffedSize - 1;
+                timerStop(&linkTimers, &receiveTimer);
+                framePoolRelease(slot);
+                return payloadSize;
             } else {
                 // Envia REJ se o BCC2 for incorreto
-                printf("DEBUG (llread): Erro: BCC2 incorreto. A enviar REJ...\n");
+                printf("DEBUG (llread): Erro: FCS incorreto. A enviar REJ...\n");
                 if (tramaRx == 0) {
                     enviarTramaSupervisao(fd, Address_Receiver, C_REJ0);
                 } else {
@@ -593,10 +2188,24 @@ int llread(unsigned char *packet) {
     }
 
     printf("DEBUG (llread): Error, no se pudo recibir la trama correctamente.\n");
+    timerStop(&linkTimers, &receiveTimer);
+    if (lastError != LL_ERROR_IO) {
+        lastError = linkDead ? LL_ERROR_LINK_DEAD : LL_ERROR_TIMEOUT;
+    }
+    framePoolRelease(slot);
     return -1;
 
 }
 
+// Receptor: guarda o SET/SETX de uma nova sessão recebido no llclose para o
+// próximo llopen, se a porta ficar aberta (sem isso o transmissor repete-o)
+static void guardarSetPendente(unsigned char control, const unsigned char *body, int bodySize) {
+    if (!manterPorta) return;
+    setPendente = control;
+    setPendenteTamanho = control == Command_SETX ? bodySize : 0;
+    memcpy(setPendenteBloco, body, setPendenteTamanho);
+}
+
 ////////////////////////////////////////////////
 // LLCLOSE - Fecha a conexão
 ////////////////////////////////////////////////
@@ -606,89 +2215,110 @@ int llread(unsigned char *packet) {
 //   0 se a conexão for fechada corretamente, -1 em caso de erro.
 int llclose(int showStatistics) {
     printf("DEBUG: Iniciando función llclose.\n");
-    LinkLayerState state = START;
     clock_t start = clock();
+    unsigned long long closeStartUs = timerNowUs();
+    int result = 0;
+    unsigned char control = 0;
+    int received;
     // Se o rol atual é de Transmissor (LlTx)
     if (currentRole == LlTx) {
-         // Envia a trama DISC para iniciar a desconexão
-        enviarTramaSupervisao(fd, Address_Transmitter, Command_DISC);
-         // Loop para tentar receber o DISC do receptor e confirmar o encerramento
-        while (state != STOP_R && retransmissions > 0) {
-            alarmEnabled = 0;
-            alarm(timeout);
-
-            unsigned char byte;
-            while (!alarmEnabled && state != STOP_R) {
-                if (readByteSerialPort(&byte) > 0) {
-                    // Máquina de estados para verificar e processar o DISC do receptor
-                    switch (state) {
-                        case START:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            break;
-                        case FLAG_RCV:
-                            if (byte == Address_Receiver) state = A_RCV;
-                            break;
-                        case A_RCV:
-                            if (byte == Command_DISC) state = C_RCV;
-                            break;
-                        case C_RCV:
-                            if (byte == (Address_Receiver ^ Command_DISC)) state = BCC1_OK;
-                            break;
-                        case BCC1_OK:
-                            if (byte == FLAG) state = STOP_R;
-                            break;
-                        default:
-                            break;
-                    }
-                }
+        // Garante que todas as tramas da janela foram confirmadas antes do DISC
+        if (llFlush() < 0) {
+            printf("DEBUG (llclose): Há tramas por confirmar\n");
+        }
+
+        // Envia o DISC e reenvia-o com intervalos crescentes até receber o DISC do
+        // receptor, no máximo durante timeout x nRetransmissions (ou até o keepalive
+        // dar a ligação como morta)
+        unsigned long long deadline = timerNowMs() + (unsigned long long)timeout * retransmissions * 1000;
+        int retryMs = intervaloHandshakeInicialMs();
+        int discReceived = FALSE;
+        while (!discReceived && !linkDead && timerNowMs() < deadline) {
+            enviarTramaSupervisao(fd, Address_Transmitter, Command_DISC);
+            unsigned long long retryAt = timerNowMs() + retryMs;
+            if (retryAt > deadline) retryAt = deadline;
+            while ((received = receberTramaSupervisao(Address_Receiver, msAte(retryAt), &control, NULL, NULL)) > 0 &&
+                   control != Command_DISC) {
             }
-            
+            if (received < 0) break;
+            discReceived = received > 0;
+            retryMs = retryMs * 2 < HANDSHAKE_RETRY_MAX_MS ? retryMs * 2 : HANDSHAKE_RETRY_MAX_MS;
+        }
+
+        if (discReceived) {
+            // Envia a trama de confirmação UA após receber DISC do receptor
+            enviarTramaSupervisao(fd, Address_Transmitter, Command_UA);
+        } else {
+            if (lastError != LL_ERROR_IO) lastError = linkDead ? LL_ERROR_LINK_DEAD : LL_ERROR_TIMEOUT;
+            printf("DEBUG (llclose): DISC do receptor não recebido (%s)\n", llErrorString(lastError));
+            result = -1;
         }
-        // Envia a trama de confirmação UA após receber DISC do receptor
-        enviarTramaSupervisao(fd, Address_Transmitter, Command_UA);
         estatisticas.tiempoTransmision += (double)(clock() - start) / CLOCKS_PER_SEC;
     } 
     // Caso o rol seja Receptor (LlRx)
     else if (currentRole == LlRx) {
-        while (state != STOP_R) {
-            // Loop para tentar receber o DISC do transmissor
-            unsigned char byte;
-            if (readByteSerialPort(&byte) > 0) {
-                // Máquina de estados para processar o DISC do transmissor
-                switch (state) {
-                    case START:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        break;
-                    case FLAG_RCV:
-                        if (byte == Address_Transmitter) state = A_RCV;
-                        break;
-                    case A_RCV:
-                        if (byte == Command_DISC) state = C_RCV;
-                        break;
-                    case C_RCV:
-                        if (byte == (Address_Transmitter ^ Command_DISC)) state = BCC1_OK;
-                        break;
-                    case BCC1_OK:
-                        if (byte == FLAG) state = STOP_R;
-                        break;
-                    default:
-                        break;
+        enviarConfirmacaoPendente();    // Não deixa tramas aceites à espera de um RR agregado
+
+        // A espera pelo DISC acaba se o keepalive der a ligação como morta ou,
+        // com o keepalive desligado, ao fim de todas as retransmissões do
+        // transmissor. Se a sessão já falhou assim (ou a porta deu erro) não há
+        // DISC a esperar.
+        unsigned long long deadline = timerNowMs() + (unsigned long long)timeout * retransmissions * 1000;
+        unsigned char body[NEGOTIATION_MAX_SIZE];
+        int bodySize = 0;
+        received = -1;
+        setPendente = 0;
+        if (!linkDead && lastError != LL_ERROR_TIMEOUT && lastError != LL_ERROR_IO) {
+            while ((received = receberTramaSupervisao(Address_Transmitter, msAte(deadline), &control, body, &bodySize)) > 0 &&
+                   control != Command_DISC) {
+                if (control != Command_SET && control != Command_SETX) continue;
+                // SET repetido numa sessão sem dados: o UA do llopen perdeu-se.
+                // Depois de tramas aceites é de um novo transmissor: o anterior
+                // desapareceu sem DISC e o UA desta sessão não lhe serve.
+                if (estatisticas.tramasRecebidas > 0) {
+                    printf("DEBUG (llclose): SET de uma nova sessão, a fechar sem DISC\n");
+                    guardarSetPendente(control, body, bodySize);
+                    received = -1;
+                    break;
                 }
+                responderHandshake(control);
             }
         }
-        // Envia o DISC ao transmissor para confirmar a desconexão
-        enviarTramaSupervisao(fd, Address_Receiver, Command_DISC);
+
+        if (received > 0) {
+            // Envia o DISC ao transmissor e espera pelo UA. Um DISC repetido quer dizer
+            // que o nosso se perdeu; sem UA, desiste ao fim de um timeout (o
+            // transmissor pode já ter fechado a porta depois de enviar o UA)
+            enviarTramaSupervisao(fd, Address_Receiver, Command_DISC);
+            deadline = timerNowMs() + (unsigned long long)timeout * 1000;
+            while ((received = receberTramaSupervisao(Address_Transmitter, msAte(deadline), &control, body, &bodySize)) > 0 &&
+                   control != Command_UA) {
+                if (control == Command_DISC) enviarTramaSupervisao(fd, Address_Receiver, Command_DISC);
+                // O transmissor já abriu outra sessão: o UA perdeu-se
+                if (control == Command_SET || control == Command_SETX) {
+                    guardarSetPendente(control, body, bodySize);
+                    break;
+                }
+            }
+            if (received <= 0) {
+                printf("DEBUG (llclose): UA do transmissor não recebido, a fechar na mesma\n");
+            }
+        } else {
+            if (lastError != LL_ERROR_IO) lastError = linkDead ? LL_ERROR_LINK_DEAD : LL_ERROR_TIMEOUT;
+            printf("DEBUG (llclose): DISC do transmissor não recebido (%s)\n", llErrorString(lastError));
+            result = -1;
+        }
         estatisticas.tiempoRecepcion += (double)(clock() - start) / CLOCKS_PER_SEC;
     }
-    estatisticas.tiempoTransferencia = ((double)clock() - estatisticas.tiempoTransferencia) / CLOCKS_PER_SEC;
+    printf("DEBUG (llclose): Desconexão em %.2f ms\n", (timerNowUs() - closeStartUs) / 1000.0);
+    // Tempo real (não de CPU) entre a primeira trama de dados e a última confirmação
+    estatisticas.tiempoTransferencia = transferEndUs > transferStartUs ? (transferEndUs - transferStartUs) / 1.0e6 : 0.0;
 
-    
-    
     // Calcula a eficiência e exibe estatísticas, se solicitado
     
-    int C = 9600; // Capacidade do enlace em bits por segundo
+    int C = linkBaudRate; // Capacidade do enlace em bits por segundo
     int R = estatisticas.totalBytesTransmitidos * 8; // Total de bits transmitidos
-    double eficiencia = ((double)R / (estatisticas.tiempoTransferencia * C)) * 100;
+    double eficiencia = estatisticas.tiempoTransferencia > 0 ? ((double)R / (estatisticas.tiempoTransferencia * C)) * 100 : 0.0;
 
     // Exibe as estatísticas se showStatistics estiver ativo
     if (showStatistics) {
@@ -699,9 +2329,33 @@ int llclose(int showStatistics) {
         printf("Tempo total de transferência: %.2f segundos\n", estatisticas.tiempoTransferencia);
         printf("Total de bits transmitidos (R): %d bits\n", R);
         printf("Eficiência do protocolo (S): %.2f%%\n", eficiencia);
+        if (currentRole == LlTx && windowMode) {
+            // Limites teóricos: stop-and-wait 1/(1+2a), janela W min(1, W/(1+2a))
+            printf("Janela final: %d tramas (a = %.3f, %ld amostras de RTT)\n",
+                   windowSize, windowSizerA(&windowSizer), windowSizer.samples);
+            printf("Eficiência máxima teórica: %.2f%% com a janela, %.2f%% em stop-and-wait (1/(1+2a))\n",
+                   100.0 * windowSizerEfficiencyBound(&windowSizer, windowSize),
+                   100.0 * windowSizerEfficiencyBound(&windowSizer, 1));
+        }
     }
      // Fecha a porta serial e retorna sucesso
+    keepaliveRunning = FALSE;
+    timerStop(&linkTimers, &keepaliveTimer);
+    timerStop(&linkTimers, &baudTimer);
+    framePoolDestroy();
+    tcdrain(fd);    // O UA/DISC final não pode ficar na fila: o próximo llopen limpa-a
+    // O closeSerialPort repõe a taxa original: o último byte tem de sair antes
+    if (linkBaudRate != baseBaudRate) esperarSaida(SUP_SEQ_FRAME_SIZE);
+    if (manterPorta) {
+        // A próxima sessão começa à taxa do llopen, como numa porta acabada de abrir
+        if (linkBaudRate != baseBaudRate && serialPortSetBaudRate(baseBaudRate) < 0) {
+            closeSerialPort();
+            return -1;
+        }
+        portaAberta = TRUE;
+        return result;
+    }
     closeSerialPort();
-    return 0;
+    return result;
 
 }
\ No newline at end of file
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "link_metrics.h"
+
+static unsigned long long coarseMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+// Returns 1 if the segment name was left behind by a process that no longer
+// exists (morreu sem metricsClose).
+static int segmentoAbandonado(const char *name) {
+    Metrics existing;
+    if (metricsAttach(&existing, name + 1) < 0) return 0;
+    int pid = existing.segment->values.pid;
+    metricsClose(&existing);
+    return pid > 0 && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+int metricsCreate(Metrics *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    const char *option = getenv("RCOM_METRICS");
+    if (option == NULL || option[0] == '\0' || strcmp(option, "0") == 0) return 0;
+    if (strcmp(option, "1") == 0) {
+        snprintf(metrics->name, sizeof(metrics->name), "/%s%d", METRICS_PREFIX, (int)getpid());
+    } else {
+        snprintf(metrics->name, sizeof(metrics->name), "/%s%.*s", METRICS_PREFIX, METRICS_NAME_SIZE, option);
+    }
+    if (strchr(metrics->name + 1, '/') != NULL) return -1;
+    option = getenv("RCOM_METRICS_MS");
+    metrics->intervalMs = option != NULL && atol(option) > 0 ? atol(option) : METRICS_DEFAULT_MS;
+
+    // O nome pode vir de RCOM_METRICS e ser o de outro processo vivo (p.ex. tx e
+    // rx na mesma máquina): o segmento dele não é tomado, senão o primeiro a
+    // acabar removia o do outro. Só se reaproveita o de um processo que morreu.
+    int fd = shm_open(metrics->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        if (!segmentoAbandonado(metrics->name)) {
+            errno = EEXIST;
+            return -1;
+        }
+        shm_unlink(metrics->name);
+        fd = shm_open(metrics->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) return -1;
+    if (ftruncate(fd, sizeof(MetricsSegment)) < 0) {
+        close(fd);
+        shm_unlink(metrics->name);
+        return -1;
+    }
+    MetricsSegment *segment = mmap(NULL, sizeof(MetricsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        shm_unlink(metrics->name);
+        return -1;
+    }
+    // Quem lê só aceita o segmento depois do identificador
+    segment->size = sizeof(MetricsSegment);
+    atomic_init(&segment->sequence, 0);
+    segment->values.pid = getpid();
+    atomic_thread_fence(memory_order_release);
+    segment->magic = METRICS_MAGIC;
+    metrics->segment = segment;
+    metrics->owner = 1;
+    return 0;
+}
+
+int metricsDue(Metrics *metrics) {
+    if (metrics->segment == NULL) return 0;
+    unsigned long long now = coarseMs();
+    if (now - metrics->lastMs < (unsigned long long)metrics->intervalMs) return 0;
+    metrics->lastMs = now;
+    return 1;
+}
+
+void metricsPublish(Metrics *metrics, const MetricsValues *values) {
+    MetricsSegment *segment = metrics->segment;
+    if (segment == NULL) return;
+    unsigned int sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&segment->values, values, sizeof(*values));
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+}
+
+int metricsAttach(Metrics *metrics, const char *name) {
+    memset(metrics, 0, sizeof(*metrics));
+    snprintf(metrics->name, sizeof(metrics->name), "/%s", name);
+    int fd = shm_open(metrics->name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(MetricsSegment)) {
+        close(fd);
+        return -1;
+    }
+    MetricsSegment *segment = mmap(NULL, sizeof(MetricsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) return -1;
+    if (segment->magic != METRICS_MAGIC || segment->size != sizeof(MetricsSegment)) {
+        munmap(segment, sizeof(MetricsSegment));
+        return -1;
+    }
+    metrics->segment = segment;
+    return 0;
+}
+
+int metricsRead(const Metrics *metrics, MetricsValues *values) {
+    const MetricsSegment *segment = metrics->segment;
+    for (int i = 0; i < METRICS_READ_TRIES; i++) {
+        unsigned int before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(values, &segment->values, sizeof(*values));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) == before) return 0;
+    }
+    return -1;
+}
+
+void metricsClose(Metrics *metrics) {
+    if (metrics->segment == NULL) return;
+    munmap(metrics->segment, sizeof(MetricsSegment));
+    if (metrics->owner) shm_unlink(metrics->name);
+    metrics->segment = NULL;
+}
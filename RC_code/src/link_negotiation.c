@@ -0,0 +1,75 @@
+#include "link_negotiation.h"
+
+// Bit mais alto presente em mask (o modo preferido), ou 0
+static int highestBit(int mask) {
+    int bit = 0;
+    for (int i = 0; i < 8; i++) {
+        if (mask & (1 << i)) bit = 1 << i;
+    }
+    return bit;
+}
+
+static int minimum(int a, int b) {
+    return a < b ? a : b;
+}
+
+static int maximum(int a, int b) {
+    return a > b ? a : b;
+}
+
+int capabilitiesEncode(const LinkCapabilities *caps, unsigned char *buf) {
+    int size = 0;
+    buf[size++] = caps->version;
+    buf[size++] = (caps->maxPayload >> 24) & 0xFF;
+    buf[size++] = (caps->maxPayload >> 16) & 0xFF;
+    buf[size++] = (caps->maxPayload >> 8) & 0xFF;
+    buf[size++] = caps->maxPayload & 0xFF;
+    buf[size++] = caps->maxWindow;
+    buf[size++] = caps->fcsMask;
+    buf[size++] = caps->framingMask;
+    buf[size++] = caps->compressionMask;
+    buf[size++] = caps->timeout;
+    buf[size++] = caps->retries;
+    buf[size++] = (caps->maxBaud >> 24) & 0xFF;
+    buf[size++] = (caps->maxBaud >> 16) & 0xFF;
+    buf[size++] = (caps->maxBaud >> 8) & 0xFF;
+    buf[size++] = caps->maxBaud & 0xFF;
+
+    unsigned char check = 0;
+    for (int i = 0; i < size; i++) check ^= buf[i];
+    buf[size++] = check;
+    return size;
+}
+
+int capabilitiesDecode(const unsigned char *buf, int size, LinkCapabilities *caps) {
+    // Versões futuras podem acrescentar campos no fim: lê só os conhecidos
+    if (size < 12) return -1;
+    unsigned char check = 0;
+    for (int i = 0; i < size - 1; i++) check ^= buf[i];
+    if (check != buf[size - 1]) return -1;
+
+    caps->version = buf[0];
+    caps->maxPayload = (buf[1] << 24) | (buf[2] << 16) | (buf[3] << 8) | buf[4];
+    caps->maxWindow = buf[5];
+    caps->fcsMask = buf[6];
+    caps->framingMask = buf[7];
+    caps->compressionMask = buf[8];
+    caps->timeout = buf[9];
+    caps->retries = buf[10];
+    caps->maxBaud = size >= 16 ? (buf[11] << 24) | (buf[12] << 16) | (buf[13] << 8) | buf[14] : 0;
+    return caps->maxPayload > 0 && caps->maxWindow > 0 ? 0 : -1;
+}
+
+int capabilitiesIntersect(const LinkCapabilities *local, const LinkCapabilities *peer, LinkCapabilities *result) {
+    result->version = minimum(local->version, peer->version);
+    result->maxPayload = minimum(local->maxPayload, peer->maxPayload);
+    result->maxWindow = minimum(local->maxWindow, peer->maxWindow);
+    result->fcsMask = highestBit(local->fcsMask & peer->fcsMask);
+    result->framingMask = highestBit(local->framingMask & peer->framingMask);
+    result->compressionMask = highestBit(local->compressionMask & peer->compressionMask);
+    if (result->compressionMask == 0) result->compressionMask = COMPRESSION_NONE;
+    result->timeout = maximum(local->timeout, peer->timeout);
+    result->retries = maximum(local->retries, peer->retries);
+    result->maxBaud = minimum(local->maxBaud, peer->maxBaud);
+    return result->fcsMask != 0 && result->framingMask != 0 ? 0 : -1;
+}
@@ -0,0 +1,92 @@
+#include "link_window.h"
+
+// Peso das novas amostras na média do tamanho das tramas
+#define FRAME_BYTES_GAIN 0.125
+// Peso de cada RR na média de tramas confirmadas por RR
+#define ACK_STRIDE_GAIN 0.25
+
+// Arredonda para cima sem depender da libm
+static int roundUp(double value) {
+    int rounded = (int)value;
+    return rounded < value ? rounded + 1 : rounded;
+}
+
+// Recalcula a janela: W >= 1 + 2a tramas enchem a linha enquanto se espera pelo
+// primeiro ACK; soma-se a margem das tramas que cada RR agregado deixa por
+// confirmar (pelo menos uma, para o processamento do receptor)
+static int recomputeWindow(WindowSizer *sizer) {
+    int window = roundUp(1.0 + 2.0 * windowSizerA(sizer));
+    int stride = roundUp(sizer->ackStride);
+    window += stride > 1 ? stride : 1;
+    if (window < 1) window = 1;
+    if (window > sizer->maxWindow) window = sizer->maxWindow;
+    sizer->window = window;
+    return window;
+}
+
+void windowSizerInit(WindowSizer *sizer, int baudRate, int maxWindow, double frameBytesGuess) {
+    sizer->baudRate = baudRate > 0 ? baudRate : 9600;
+    sizer->maxWindow = maxWindow > 0 ? maxWindow : 1;
+    sizer->frameBytes = frameBytesGuess > 0 ? frameBytesGuess : 1;
+    sizer->twoPropUs = 0;
+    sizer->epochMinUs = -1;
+    sizer->epochSamples = 0;
+    sizer->samples = 0;
+    sizer->ackStride = 1;
+    sizer->window = 1;
+}
+
+double windowSizerByteTimeUs(const WindowSizer *sizer, double bytes) {
+    return bytes * 10.0 * 1.0e6 / sizer->baudRate;
+}
+
+double windowSizerA(const WindowSizer *sizer) {
+    return (sizer->twoPropUs / 2.0) / windowSizerByteTimeUs(sizer, sizer->frameBytes);
+}
+
+double windowSizerEfficiencyBound(const WindowSizer *sizer, int window) {
+    double bound = window / (1.0 + 2.0 * windowSizerA(sizer));
+    return bound < 1.0 ? bound : 1.0;
+}
+
+int windowSizerHandshake(WindowSizer *sizer, double rttUs, int supBytes) {
+    double twoProp = rttUs - 2.0 * windowSizerByteTimeUs(sizer, supBytes);
+    sizer->twoPropUs = twoProp > 0 ? twoProp : 0;
+    return recomputeWindow(sizer);
+}
+
+int windowSizerSample(WindowSizer *sizer, double rttUs, int frameBytes, int ackBytes) {
+    sizer->frameBytes += FRAME_BYTES_GAIN * (frameBytes - sizer->frameBytes);
+
+    // O RTT de uma trama inclui o seu próprio tempo de transmissão e o do ACK
+    double twoProp = rttUs - windowSizerByteTimeUs(sizer, frameBytes + ackBytes);
+    if (twoProp < 0) twoProp = 0;
+    sizer->samples++;
+
+    // Filtro de mínimo por épocas: ignora o atraso de filas e processamento, mas
+    // acompanha aumentos reais do atraso (p.ex. "prop" mudado no cabo) na época seguinte
+    if (sizer->epochMinUs < 0 || twoProp < sizer->epochMinUs) {
+        sizer->epochMinUs = twoProp;
+    }
+    if (sizer->samples == 1 || twoProp < sizer->twoPropUs) {
+        sizer->twoPropUs = twoProp;
+    }
+    if (++sizer->epochSamples >= WINDOW_RTT_EPOCH) {
+        sizer->twoPropUs = sizer->epochMinUs;
+        sizer->epochMinUs = -1;
+        sizer->epochSamples = 0;
+    }
+    return recomputeWindow(sizer);
+}
+
+int windowSizerAckStride(WindowSizer *sizer, int framesAcked) {
+    if (framesAcked > 0) {
+        sizer->ackStride += ACK_STRIDE_GAIN * (framesAcked - sizer->ackStride);
+    }
+    return recomputeWindow(sizer);
+}
+
+int windowSizerSetBaudRate(WindowSizer *sizer, int baudRate) {
+    if (baudRate > 0) sizer->baudRate = baudRate;
+    return recomputeWindow(sizer);
+}
@@ -0,0 +1,127 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "progress.h"
+
+// Relógio de baixa resolução (alguns ms): lido no vDSO, sem entrar no kernel
+static unsigned long long coarseMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+void progressInit(Progress *progress, int transmitter, const char *name, long long total, long long startDone) {
+    memset(progress, 0, sizeof(*progress));
+    const char *option = getenv("RCOM_PROGRESS");
+    if (option == NULL) {
+        progress->format = PROGRESS_TEXT;
+    } else if (strcmp(option, "json") == 0) {
+        progress->format = PROGRESS_JSON;
+    } else {
+        progress->format = atoi(option) != 0 ? PROGRESS_TEXT : PROGRESS_OFF;
+    }
+    option = getenv("RCOM_PROGRESS_MS");
+    progress->intervalMs = option != NULL && atol(option) > 0 ? atol(option) : PROGRESS_DEFAULT_MS;
+    progress->transmitter = transmitter;
+    snprintf(progress->name, sizeof(progress->name), "%s", name != NULL ? name : "");
+    progress->total = total;
+    progress->startDone = progress->lastDone = startDone;
+    progress->startMs = progress->lastMs = coarseMs();
+    llCounters(&progress->lastCounters);
+}
+
+// Retransmissões desde o último intervalo, em fração das tramas de dados
+static double retransmissionRate(Progress *progress) {
+    LlCounters counters;
+    llCounters(&counters);
+    LlCounters *last = &progress->lastCounters;
+    double rate = 0;
+    if (progress->transmitter) {
+        // O que foi enviado e não ficou confirmado nem está na janela
+        long sent = counters.framesSent - last->framesSent;
+        long lost = sent - (counters.framesAcked - last->framesAcked) -
+                    (counters.framesOutstanding - last->framesOutstanding);
+        if (sent > 0 && lost > 0) rate = (double)lost / sent;
+    } else {
+        long rejected = counters.framesRejected - last->framesRejected;
+        long frames = counters.framesReceived - last->framesReceived + rejected;
+        if (frames > 0) rate = (double)rejected / frames;
+    }
+    *last = counters;
+    return rate;
+}
+
+static void printJsonString(const char *value) {
+    fputc('"', stderr);
+    for (const unsigned char *c = (const unsigned char *)value; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(stderr, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(stderr, "\\u%04x", *c);
+        } else {
+            fputc(*c, stderr);
+        }
+    }
+    fputc('"', stderr);
+}
+
+static void printLine(Progress *progress, long long done, unsigned long long now, int final) {
+    double elapsed = (now - progress->startMs) / 1000.0;
+    double interval = (now - progress->lastMs) / 1000.0;
+    double rate = interval > 0 ? (done - progress->lastDone) / interval : 0;
+    double average = elapsed > 0 ? (done - progress->startDone) / elapsed : 0;
+    double retransmissions = retransmissionRate(progress);
+    int known = progress->total >= 0;
+    double percent = known ? (progress->total > 0 ? 100.0 * done / progress->total : 100.0) : 0;
+    long long eta = known && average > 0 ? (long long)((progress->total - done) / average + 0.5) : -1;
+    if (final) eta = known && done >= progress->total ? 0 : -1;   // Sem dados a caminho: acabou ou falhou
+    const char *role = progress->transmitter ? "tx" : "rx";
+
+    if (progress->format == PROGRESS_JSON) {
+        fprintf(stderr, "{\"role\":\"%s\",\"file\":", role);
+        printJsonString(progress->name);
+        fprintf(stderr, ",\"elapsed\":%.3f,\"bytes\":%lld,", elapsed, done);
+        if (known) {
+            fprintf(stderr, "\"total\":%lld,\"percent\":%.2f,", progress->total, percent);
+        } else {
+            fprintf(stderr, "\"total\":null,\"percent\":null,");
+        }
+        fprintf(stderr, "\"rate\":%.0f,\"average\":%.0f,\"retransmissions\":%.4f,", rate, average, retransmissions);
+        if (eta >= 0) {
+            fprintf(stderr, "\"eta\":%lld,", eta);
+        } else {
+            fprintf(stderr, "\"eta\":null,");
+        }
+        fprintf(stderr, "\"final\":%s}\n", final ? "true" : "false");
+    } else {
+        fprintf(stderr, "Progresso (%s) %s: %.2f", role, progress->name, done / (1024.0 * 1024.0));
+        if (known) {
+            fprintf(stderr, "/%.2f MiB (%.1f%%)", progress->total / (1024.0 * 1024.0), percent);
+        } else {
+            fprintf(stderr, " MiB");
+        }
+        fprintf(stderr, ", %.1f KiB/s agora, %.1f KiB/s média, %.1f%% retransmissões", rate / 1024, average / 1024,
+                100 * retransmissions);
+        if (eta >= 0) {
+            fprintf(stderr, ", faltam %02lld:%02lld:%02lld", eta / 3600, eta / 60 % 60, eta % 60);
+        }
+        fprintf(stderr, final ? " (fim)\n" : "\n");
+    }
+    progress->lines++;
+    progress->lastMs = now;
+    progress->lastDone = done;
+}
+
+void progressStep(Progress *progress, long long done) {
+    if (progress->format == PROGRESS_OFF) return;
+    unsigned long long now = coarseMs();
+    if (now - progress->lastMs < (unsigned long long)progress->intervalMs) return;
+    printLine(progress, done, now, 0);
+}
+
+void progressFinish(Progress *progress, long long done) {
+    if (progress->format == PROGRESS_OFF || (progress->format == PROGRESS_TEXT && progress->lines == 0)) return;
+    printLine(progress, done, coarseMs(), 1);
+}
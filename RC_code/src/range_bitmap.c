@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include "range_bitmap.h"
+
+#define WORD_BITS 64
+
+int rangeBitmapInit(RangeBitmap *map, long long fileSize, int blockSize) {
+    map->words = NULL;
+    map->fileSize = fileSize;
+    map->blockSize = blockSize;
+    map->blocks = 0;
+    map->receivedBlocks = map->receivedBytes = 0;
+    if (fileSize < 0 || blockSize <= 0) return -1;
+
+    map->blocks = (fileSize + blockSize - 1) / blockSize;
+    long long words = (map->blocks + WORD_BITS - 1) / WORD_BITS;
+    map->words = calloc(words > 0 ? words : 1, sizeof(unsigned long long));
+    return map->words != NULL ? 0 : -1;
+}
+
+void rangeBitmapFree(RangeBitmap *map) {
+    free(map->words);
+    map->words = NULL;
+}
+
+// Tamanho do bloco index (o último acaba no fim do ficheiro)
+static long long blockLength(const RangeBitmap *map, long long index) {
+    long long start = index * map->blockSize;
+    return map->fileSize - start < map->blockSize ? map->fileSize - start : map->blockSize;
+}
+
+int rangeBitmapMark(RangeBitmap *map, long long offset, int length) {
+    if (offset < 0 || offset % map->blockSize != 0 || length <= 0) return -1;
+    long long index = offset / map->blockSize;
+    long long end = offset + length;
+    if (index >= map->blocks || end > map->fileSize) return -1;
+    if (end != map->fileSize && length % map->blockSize != 0) return -1;
+
+    int marked = 0;
+    for (; index * map->blockSize < end; index++) {
+        unsigned long long bit = 1ULL << (index % WORD_BITS);
+        unsigned long long *word = &map->words[index / WORD_BITS];
+        if (*word & bit) continue;
+        *word |= bit;
+        map->receivedBlocks++;
+        map->receivedBytes += blockLength(map, index);
+        marked = 1;
+    }
+    return marked;
+}
+
+int rangeBitmapHas(const RangeBitmap *map, long long offset) {
+    if (offset < 0 || offset >= map->fileSize) return 0;
+    long long index = offset / map->blockSize;
+    return (map->words[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+int rangeBitmapComplete(const RangeBitmap *map) {
+    return map->receivedBlocks == map->blocks;
+}
+
+long long rangeBitmapNextMissing(const RangeBitmap *map, long long offset) {
+    long long index = offset > 0 ? offset / map->blockSize : 0;
+    while (index < map->blocks) {
+        // Salta palavras inteiras já completas
+        unsigned long long word = map->words[index / WORD_BITS] >> (index % WORD_BITS);
+        if (word == ~0ULL >> (index % WORD_BITS)) {
+            index = (index / WORD_BITS + 1) * WORD_BITS;
+            continue;
+        }
+        if (!(word & 1)) return index * map->blockSize;
+        index++;
+    }
+    return map->fileSize;
+}
+
+long long rangeBitmapNextReceived(const RangeBitmap *map, long long offset) {
+    long long index = offset > 0 ? offset / map->blockSize : 0;
+    while (index < map->blocks) {
+        // Salta palavras inteiras ainda vazias
+        unsigned long long word = map->words[index / WORD_BITS] >> (index % WORD_BITS);
+        if (word == 0) {
+            index = (index / WORD_BITS + 1) * WORD_BITS;
+            continue;
+        }
+        if (word & 1) return index * map->blockSize;
+        index++;
+    }
+    return map->fileSize;
+}
+
+long long rangeBitmapMarkPrefix(RangeBitmap *map, long long end) {
+    long long blocks = end >= map->fileSize ? map->blocks : (end > 0 ? end / map->blockSize : 0);
+    for (long long index = 0; index < blocks; index++) {
+        rangeBitmapMark(map, index * map->blockSize, blockLength(map, index));
+    }
+    return blocks == map->blocks ? map->fileSize : blocks * map->blockSize;
+}
@@ -0,0 +1,41 @@
+#define _DEFAULT_SOURCE
+#include "serial_port_ext.h"
+
+#include <stdio.h>
+#include <termios.h>
+
+extern int fd;
+
+// Taxas suportadas; acima de 115200 dependem do hardware (e do cabo)
+static const int baudRates[] = {1200, 1800, 2400, 4800, 9600, 19200, 38400, 57600, 115200,
+                                230400, 460800, 921600, 1000000, 1500000, 2000000, 3000000, 4000000};
+static const speed_t baudFlags[] = {B1200, B1800, B2400, B4800, B9600, B19200, B38400, B57600, B115200,
+                                    B230400, B460800, B921600, B1000000, B1500000, B2000000, B3000000, B4000000};
+
+#define BAUD_RATE_COUNT ((int)(sizeof(baudRates) / sizeof(baudRates[0])))
+
+int serialPortBaudIndex(int baudRate) {
+    for (int i = 0; i < BAUD_RATE_COUNT; i++) {
+        if (baudRates[i] == baudRate) return i;
+    }
+    return -1;
+}
+
+int serialPortBaudAt(int index) {
+    return index >= 0 && index < BAUD_RATE_COUNT ? baudRates[index] : 0;
+}
+
+int serialPortSetBaudRate(int baudRate) {
+    int index = serialPortBaudIndex(baudRate);
+    struct termios tio;
+    if (index < 0 || tcgetattr(fd, &tio) == -1) return -1;
+
+    tcdrain(fd);
+    cfsetispeed(&tio, baudFlags[index]);
+    cfsetospeed(&tio, baudFlags[index]);
+    if (tcsetattr(fd, TCSANOW, &tio) == -1) {
+        perror("tcsetattr");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "spsc_queue.h"
+
+// Número de tentativas com sched_yield antes de começar a dormir
+#define SPSC_SPIN_YIELDS 64
+#define SPSC_SLEEP_MIN_NS 50000
+#define SPSC_SLEEP_MAX_NS 2000000
+
+static double elapsedMs(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1.0e6;
+}
+
+// Espera progressiva: primeiro cede o CPU, depois dorme períodos crescentes
+// (uma etapa pode ficar parada segundos à espera de um ACK retransmitido)
+static void backoff(int *spins) {
+    int n = (*spins)++;
+    if (n < SPSC_SPIN_YIELDS) {
+        sched_yield();
+        return;
+    }
+    long sleepNs = SPSC_SLEEP_MIN_NS;
+    for (int i = SPSC_SPIN_YIELDS; i < n && sleepNs < SPSC_SLEEP_MAX_NS; i += 8) {
+        sleepNs *= 2;
+    }
+    struct timespec pause = {0, sleepNs < SPSC_SLEEP_MAX_NS ? sleepNs : SPSC_SLEEP_MAX_NS};
+    nanosleep(&pause, NULL);
+}
+
+int spscInit(SpscQueue *queue, unsigned int capacity) {
+    if (capacity == 0 || capacity > SPSC_MAX_CAPACITY || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    memset(&queue->stats, 0, sizeof(queue->stats));
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 0;
+}
+
+int spscTryPush(SpscQueue *queue, SpscItem item) {
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head > queue->mask) return 0;   // Cheia
+
+    queue->items[tail & queue->mask] = item;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    queue->stats.pushes++;
+    queue->stats.occupancySum += tail + 1 - head;
+    return 1;
+}
+
+int spscTryPop(SpscQueue *queue, SpscItem *item) {
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) return 0;   // Vazia
+
+    *item = queue->items[head & queue->mask];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    queue->stats.pops++;
+    return 1;
+}
+
+void spscPush(SpscQueue *queue, SpscItem item) {
+    if (spscTryPush(queue, item)) return;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int spins = 0;
+    while (!spscTryPush(queue, item)) {
+        backoff(&spins);
+    }
+    queue->stats.producerStallMs += elapsedMs(&start);
+}
+
+void spscPop(SpscQueue *queue, SpscItem *item) {
+    if (spscTryPop(queue, item)) return;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int spins = 0;
+    while (!spscTryPop(queue, item)) {
+        backoff(&spins);
+    }
+    queue->stats.consumerStallMs += elapsedMs(&start);
+}
+
+int spscPopTimed(SpscQueue *queue, SpscItem *item, int timeoutMs) {
+    if (spscTryPop(queue, item)) return 1;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int spins = 0;
+    int popped;
+    while (!(popped = spscTryPop(queue, item)) && elapsedMs(&start) < timeoutMs) {
+        backoff(&spins);
+    }
+    queue->stats.consumerStallMs += elapsedMs(&start);
+    return popped;
+}
+
+unsigned int spscSize(SpscQueue *queue) {
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return tail - head;
+}
@@ -0,0 +1,174 @@
+#include <string.h>
+#include <time.h>
+#include "timer_wheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+
+// Maior atraso representável diretamente na roda
+#define TW_MAX_DELAY ((1ULL << (TW_SLOT_BITS * TW_LEVELS)) - 1)
+
+unsigned long long timerNowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+unsigned long long timerNowUs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+void timerWheelInit(TimerWheel *wheel, unsigned long long nowMs) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = nowMs;
+}
+
+void timerInit(Timer *timer, TimerKind kind, int id, TimerCallback callback, void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->kind = kind;
+    timer->id = id;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->level = -1;
+}
+
+int timerActive(const Timer *timer) {
+    return timer->level >= 0;
+}
+
+// Coloca o temporizador na posição correspondente ao seu instante de expiração
+static void placeTimer(TimerWheel *wheel, Timer *timer) {
+    unsigned long long expires = timer->expires;
+    if (expires < wheel->now) {
+        expires = wheel->now;   // Só acontece ao descer de nível: dispara neste tick
+    }
+    unsigned long long delta = expires - wheel->now;
+    if (delta > TW_MAX_DELAY) {
+        // Demasiado longe: fica no último nível e é recolocado mais tarde
+        expires = wheel->now + TW_MAX_DELAY;
+        delta = TW_MAX_DELAY;
+    }
+
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ULL << (TW_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (expires >> (TW_SLOT_BITS * level)) & TW_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = wheel->slots[level][slot];
+    if (timer->next != NULL) timer->next->prev = timer;
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void unlinkTimer(TimerWheel *wheel, Timer *timer) {
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next != NULL) timer->next->prev = timer->prev;
+    if (wheel->slots[timer->level][timer->slot] == NULL) {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+    timer->level = -1;
+    timer->prev = timer->next = NULL;
+}
+
+void timerStart(TimerWheel *wheel, Timer *timer, unsigned long long delayMs) {
+    if (timerActive(timer)) {
+        unlinkTimer(wheel, timer);
+        wheel->active--;
+    }
+    timer->expires = wheel->now + (delayMs > 0 ? delayMs : 1);
+    placeTimer(wheel, timer);
+    wheel->active++;
+}
+
+void timerStop(TimerWheel *wheel, Timer *timer) {
+    if (!timerActive(timer)) return;
+    unlinkTimer(wheel, timer);
+    wheel->active--;
+}
+
+// Retira a lista de uma posição da roda
+static Timer *takeSlot(TimerWheel *wheel, int level, int slot) {
+    Timer *list = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    return list;
+}
+
+// Redistribui uma posição de um nível superior pelos níveis inferiores
+static void cascade(TimerWheel *wheel, int level, int slot) {
+    Timer *timer = takeSlot(wheel, level, slot);
+    while (timer != NULL) {
+        Timer *next = timer->next;
+        placeTimer(wheel, timer);
+        timer = next;
+    }
+}
+
+int timerWheelAdvance(TimerWheel *wheel, unsigned long long nowMs) {
+    int fired = 0;
+    while (wheel->now < nowMs) {
+        // Sem temporizadores ativos não há nada a processar em cada tick
+        if (wheel->active == 0) {
+            wheel->now = nowMs;
+            break;
+        }
+        wheel->now++;
+
+        // Ao completar uma volta de um nível, desce a posição seguinte do nível acima
+        for (int level = 1; level < TW_LEVELS; level++) {
+            if ((wheel->now & ((1ULL << (TW_SLOT_BITS * level)) - 1)) != 0) break;
+            cascade(wheel, level, (wheel->now >> (TW_SLOT_BITS * level)) & TW_MASK);
+        }
+
+        Timer *timer = takeSlot(wheel, 0, wheel->now & TW_MASK);
+        while (timer != NULL) {
+            Timer *next = timer->next;
+            timer->level = -1;
+            timer->prev = timer->next = NULL;
+            if (timer->expires > wheel->now) {
+                // Estava para lá do alcance da roda quando foi colocado
+                placeTimer(wheel, timer);
+            } else {
+                wheel->active--;
+                fired++;
+                if (timer->callback != NULL) timer->callback(timer, timer->arg);
+            }
+            timer = next;
+        }
+    }
+    return fired;
+}
+
+// Distância (em posições, 1..64) da posição atual até à próxima posição ocupada
+static int nextOccupied(unsigned long long mask, int current) {
+    int shift = (current + 1) & TW_MASK;
+    unsigned long long rotated = shift ? (mask >> shift) | (mask << (TW_SLOTS - shift)) : mask;
+    return __builtin_ctzll(rotated) + 1;
+}
+
+int timerWheelNextTimeout(TimerWheel *wheel, unsigned long long nowMs) {
+    if (wheel->active == 0) return -1;
+
+    unsigned long long best = ~0ULL;
+    for (int level = 0; level < TW_LEVELS; level++) {
+        if (wheel->occupied[level] == 0) continue;
+        int bits = TW_SLOT_BITS * level;
+        int current = (wheel->now >> bits) & TW_MASK;
+        // Instante em que a posição ocupada é processada (nível 0) ou descida (restantes)
+        unsigned long long when = ((wheel->now >> bits) + nextOccupied(wheel->occupied[level], current)) << bits;
+        if (when < best) best = when;
+    }
+
+    if (best <= nowMs) return 0;
+    unsigned long long wait = best - nowMs;
+    return wait > 0x7FFFFFFF ? 0x7FFFFFFF : (int)wait;
+}
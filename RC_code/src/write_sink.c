@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "write_sink.h"
+
+static double elapsedMs(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1.0e6;
+}
+
+// Thread do sink: escreve os buffers cheios pela ordem em que foram entregues
+static void *flushThread(void *arg) {
+    WriteSink *sink = arg;
+    pthread_mutex_lock(&sink->lock);
+    for (;;) {
+        while (sink->pending == 0 && !sink->stop) pthread_cond_wait(&sink->changed, &sink->lock);
+        if (sink->pending == 0) break;
+        WriteSinkBuffer *buffer = &sink->buffers[sink->flushIndex];
+        pthread_mutex_unlock(&sink->lock);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int written = 0;
+        while (written < buffer->length) {
+            ssize_t result = pwrite(sink->fd, buffer->data + written, buffer->length - written,
+                                    buffer->offset + written);
+            if (result <= 0) break;
+            written += result;
+        }
+        double writeMs = elapsedMs(&start);
+
+        pthread_mutex_lock(&sink->lock);
+        if (written < buffer->length) sink->failed = 1;
+        sink->stats.writes++;
+        sink->stats.bytes += written;
+        sink->stats.writeMs += writeMs;
+        buffer->length = 0;
+        sink->flushIndex = (sink->flushIndex + 1) % WRITE_SINK_BUFFERS;
+        sink->pending--;
+        pthread_cond_broadcast(&sink->changed);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return NULL;
+}
+
+int writeSinkOpen(WriteSink *sink, int fd) {
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = fd;
+    for (int i = 0; i < WRITE_SINK_BUFFERS; i++) {
+        sink->buffers[i].data = aligned_alloc(WRITE_SINK_ALIGN, WRITE_SINK_BUFFER_SIZE);
+        if (sink->buffers[i].data == NULL) {
+            for (int j = 0; j < i; j++) free(sink->buffers[j].data);
+            return -1;
+        }
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->changed, NULL);
+    if (pthread_create(&sink->thread, NULL, flushThread, sink) != 0) {
+        for (int i = 0; i < WRITE_SINK_BUFFERS; i++) free(sink->buffers[i].data);
+        return -1;
+    }
+    return 0;
+}
+
+int writeSinkPreallocate(WriteSink *sink, long long size) {
+    if (size <= 0 || fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, 0, size) < 0) return -1;
+    sink->stats.preallocated = 1;
+    return 0;
+}
+
+static WriteSinkBuffer *currentBuffer(WriteSink *sink) {
+    return &sink->buffers[sink->fillIndex];
+}
+
+// Entrega o buffer atual à thread e espera que haja outro livre
+static void queueBuffer(WriteSink *sink) {
+    sink->fillIndex = (sink->fillIndex + 1) % WRITE_SINK_BUFFERS;
+    pthread_mutex_lock(&sink->lock);
+    sink->pending++;
+    pthread_cond_broadcast(&sink->changed);
+    if (sink->pending == WRITE_SINK_BUFFERS) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (sink->pending == WRITE_SINK_BUFFERS) pthread_cond_wait(&sink->changed, &sink->lock);
+        sink->stats.stallMs += elapsedMs(&start);
+    }
+    pthread_mutex_unlock(&sink->lock);
+}
+
+int writeSinkWrite(WriteSink *sink, const unsigned char *data, int size, long long offset) {
+    if (sink->failed) return -1;
+    while (size > 0) {
+        WriteSinkBuffer *buffer = currentBuffer(sink);
+        if (buffer->length > 0 && offset != buffer->offset + buffer->length) {
+            queueBuffer(sink);
+            continue;
+        }
+        if (buffer->length == 0) {
+            // O fim do buffer fica alinhado, e com ele o início do seguinte
+            buffer->offset = offset;
+            buffer->limit = WRITE_SINK_BUFFER_SIZE - (int)(offset % WRITE_SINK_ALIGN);
+        }
+        int chunk = buffer->limit - buffer->length < size ? buffer->limit - buffer->length : size;
+        memcpy(buffer->data + buffer->length, data, chunk);
+        buffer->length += chunk;
+        data += chunk;
+        offset += chunk;
+        size -= chunk;
+        if (buffer->length == buffer->limit) queueBuffer(sink);
+    }
+    return 0;
+}
+
+int writeSinkHole(WriteSink *sink, long long offset, long long size) {
+    if (sink->failed) return -1;
+    sink->stats.holeBytes += size;
+    // O ficheiro cresce primeiro: o ext4 ignora buracos depois do fim, mesmo
+    // nos blocos pré-alocados
+    struct stat info;
+    if (fstat(sink->fd, &info) < 0) return -1;
+    if (info.st_size < offset + size && ftruncate(sink->fd, offset + size) < 0) return -1;
+    if (fallocate(sink->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size) == 0) {
+        sink->stats.holesPunched = 1;
+        return 0;
+    }
+
+    static const unsigned char zeros[WRITE_SINK_ALIGN];
+    while (size > 0) {
+        int chunk = size < WRITE_SINK_ALIGN ? size : WRITE_SINK_ALIGN;
+        if (writeSinkWrite(sink, zeros, chunk, offset) < 0) return -1;
+        offset += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+int writeSinkFlush(WriteSink *sink) {
+    if (currentBuffer(sink)->length > 0) queueBuffer(sink);
+    pthread_mutex_lock(&sink->lock);
+    while (sink->pending > 0) pthread_cond_wait(&sink->changed, &sink->lock);
+    int failed = sink->failed;
+    pthread_mutex_unlock(&sink->lock);
+    return failed ? -1 : 0;
+}
+
+int writeSinkSync(WriteSink *sink) {
+    if (writeSinkFlush(sink) < 0) return -1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = fsync(sink->fd);
+    sink->stats.syncMs += elapsedMs(&start);
+    return result;
+}
+
+void writeSinkClose(WriteSink *sink) {
+    writeSinkFlush(sink);
+    pthread_mutex_lock(&sink->lock);
+    sink->stop = 1;
+    pthread_cond_broadcast(&sink->changed);
+    pthread_mutex_unlock(&sink->lock);
+    pthread_join(sink->thread, NULL);
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->changed);
+    for (int i = 0; i < WRITE_SINK_BUFFERS; i++) free(sink->buffers[i].data);
+}
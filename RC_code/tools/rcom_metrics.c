@@ -0,0 +1,194 @@
+// Métricas dos processos da ligação no formato de texto do Prometheus.
+// Lê os segmentos de memória partilhada criados com RCOM_METRICS (link_metrics.h)
+// sem parar quem os escreve: cada leitura é repetida até ser consistente
+// (seqlock). Sem nomes lê todos os de /dev/shm; os de processos que já
+// acabaram são ignorados. Com -o escreve num ficheiro (trocado de uma vez,
+// para o textfile collector do node_exporter) em vez do stdout; com -w repete
+// a cada intervalo.
+//
+// Compilar (a partir de RC_code/):
+//   gcc -Wall -O2 -Iinclude -o bin/rcom_metrics tools/rcom_metrics.c src/link_metrics.c
+// Usar:
+//   ./bin/rcom_metrics [-w segundos] [-o ficheiro] [rcom.<pid> ...]
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "link_metrics.h"
+
+#define MAX_SEGMENTS 256
+#define SHM_DIR "/dev/shm"
+
+typedef enum { FIELD_LONG, FIELD_INT, FIELD_DOUBLE } FieldType;
+
+typedef struct
+{
+    const char *name;
+    const char *type;           // counter ou gauge
+    const char *help;
+    FieldType field;
+    size_t offset;
+    double scale;               // Unidades do Prometheus (segundos)
+} Metric;
+
+static const Metric metricTable[] = {
+    {"rcom_frames_sent_total", "counter", "Data frames sent, including retransmissions.", FIELD_LONG,
+     offsetof(MetricsValues, framesSent), 1},
+    {"rcom_frames_acked_total", "counter", "Data frames acknowledged by the receiver.", FIELD_LONG,
+     offsetof(MetricsValues, framesAcked), 1},
+    {"rcom_frames_received_total", "counter", "Data frames accepted by the receiver.", FIELD_LONG,
+     offsetof(MetricsValues, framesReceived), 1},
+    {"rcom_frames_rejected_total", "counter", "Data frames rejected by the receiver.", FIELD_LONG,
+     offsetof(MetricsValues, framesRejected), 1},
+    {"rcom_retransmissions_total", "counter", "Data frames sent again.", FIELD_LONG,
+     offsetof(MetricsValues, retransmissions), 1},
+    {"rcom_acked_bytes_total", "counter", "Packet bytes acknowledged by the receiver.", FIELD_LONG,
+     offsetof(MetricsValues, bytesAcked), 1},
+    {"rcom_received_bytes_total", "counter", "Packet bytes accepted by the receiver.", FIELD_LONG,
+     offsetof(MetricsValues, bytesReceived), 1},
+    {"rcom_files_total", "counter", "Files completed.", FIELD_LONG, offsetof(MetricsValues, files), 1},
+    {"rcom_keepalive_probes_total", "counter", "Keepalive probes sent.", FIELD_LONG,
+     offsetof(MetricsValues, probesSent), 1},
+    {"rcom_file_bytes", "gauge", "Bytes of the current file already sent or written.", FIELD_LONG,
+     offsetof(MetricsValues, fileBytes), 1},
+    {"rcom_file_size_bytes", "gauge", "Size of the current file (-1 if unknown).", FIELD_LONG,
+     offsetof(MetricsValues, fileTotal), 1},
+    {"rcom_rtt_seconds", "gauge", "Last round-trip time sample of a data frame.", FIELD_DOUBLE,
+     offsetof(MetricsValues, rttUs), 1.0e-6},
+    {"rcom_window_frames", "gauge", "Send window in use.", FIELD_INT, offsetof(MetricsValues, window), 1},
+    {"rcom_outstanding_frames", "gauge", "Frames waiting for acknowledgement.", FIELD_INT,
+     offsetof(MetricsValues, outstanding), 1},
+    {"rcom_queue_first_items", "gauge", "Items in the first pipeline queue.", FIELD_INT,
+     offsetof(MetricsValues, queueFirst), 1},
+    {"rcom_queue_second_items", "gauge", "Items in the second pipeline queue.", FIELD_INT,
+     offsetof(MetricsValues, queueSecond), 1},
+    {"rcom_baud_rate", "gauge", "Current line rate.", FIELD_INT, offsetof(MetricsValues, baudRate), 1},
+    {"rcom_link_state", "gauge", "Link state (0 down, 1 up, 2 probing, 3 dead).", FIELD_INT,
+     offsetof(MetricsValues, linkState), 1},
+    {"rcom_last_update_seconds", "gauge", "Time of the last update since the epoch.", FIELD_DOUBLE,
+     offsetof(MetricsValues, updated), 1},
+};
+
+static double fieldValue(const MetricsValues *values, const Metric *metric) {
+    const char *base = (const char *)values + metric->offset;
+    double value = metric->field == FIELD_LONG ? *(const long long *)base
+                 : metric->field == FIELD_INT ? *(const int *)base
+                 : *(const double *)base;
+    return value * metric->scale;
+}
+
+// Valor de uma etiqueta com \, " e mudanças de linha escapados
+static void printLabel(FILE *out, const char *value) {
+    for (; *value != '\0'; value++) {
+        if (*value == '\\' || *value == '"') fprintf(out, "\\%c", *value);
+        else if (*value == '\n') fprintf(out, "\\n");
+        else fputc(*value, out);
+    }
+}
+
+// Nomes dos segmentos em /dev/shm.
+// Returns the number of names.
+static int listSegments(char names[][NAME_MAX + 1], int capacity) {
+    DIR *dir = opendir(SHM_DIR);
+    if (dir == NULL) return 0;
+    int count = 0;
+    struct dirent *entry;
+    while (count < capacity && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, METRICS_PREFIX, strlen(METRICS_PREFIX)) != 0) continue;
+        snprintf(names[count++], NAME_MAX + 1, "%s", entry->d_name);
+    }
+    closedir(dir);
+    return count;
+}
+
+// Escreve as métricas de todos os segmentos vivos.
+// Returns the number of processes.
+static int writeMetrics(FILE *out, char names[][NAME_MAX + 1], int count) {
+    static MetricsValues values[MAX_SEGMENTS];
+    int live = 0;
+    for (int i = 0; i < count; i++) {
+        Metrics metrics;
+        if (metricsAttach(&metrics, names[i]) < 0) continue;
+        int result = metricsRead(&metrics, &values[live]);
+        metricsClose(&metrics);
+        if (result < 0) {
+            fprintf(stderr, "%s: leitura inconsistente, ignorado\n", names[i]);
+            continue;
+        }
+        // Segmento deixado por um processo que foi morto
+        if (kill(values[live].pid, 0) < 0 && errno == ESRCH) continue;
+        live++;
+    }
+
+    for (size_t m = 0; m < sizeof(metricTable) / sizeof(metricTable[0]); m++) {
+        const Metric *metric = &metricTable[m];
+        fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help, metric->name, metric->type);
+        for (int i = 0; i < live; i++) {
+            fprintf(out, "%s{pid=\"%d\",role=\"%s\",port=\"", metric->name, values[i].pid,
+                    values[i].transmitter ? "tx" : "rx");
+            printLabel(out, values[i].port);
+            fprintf(out, "\"} %.15g\n", fieldValue(&values[i], metric));
+        }
+    }
+    return live;
+}
+
+// Escreve num temporário ao lado e troca-o com o ficheiro: quem lê nunca vê meio ficheiro
+static int writeFile(const char *path, char names[][NAME_MAX + 1], int count) {
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+    FILE *out = fopen(temporary, "w");
+    if (out == NULL) return -1;
+    writeMetrics(out, names, count);
+    if (fclose(out) != 0 || rename(temporary, path) < 0) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double interval = 0;
+    const char *path = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "w:o:")) != -1) {
+        switch (option) {
+            case 'w': interval = atof(optarg); break;
+            case 'o': path = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-w seconds] [-o file] [segment ...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    static char names[MAX_SEGMENTS][NAME_MAX + 1];
+    for (;;) {
+        int count = 0;
+        if (optind < argc) {
+            for (int i = optind; i < argc && count < MAX_SEGMENTS; i++) {
+                snprintf(names[count++], NAME_MAX + 1, "%s", argv[i]);
+            }
+        } else {
+            count = listSegments(names, MAX_SEGMENTS);
+        }
+        if (path != NULL) {
+            if (writeFile(path, names, count) < 0) {
+                perror(path);
+                return 1;
+            }
+        } else {
+            writeMetrics(stdout, names, count);
+            fflush(stdout);
+        }
+        if (interval <= 0) break;
+        usleep((useconds_t)(interval * 1.0e6));
+    }
+    return 0;
+}